@@ -3,6 +3,14 @@ import sys
 import random
 from .utils import log_info, log_success, log_error
 
+def entity_dictionary(config, ip, port):
+    """Protocol tokens declared on the entity at ip:port (empty if none)."""
+    for entity in config["entities"].values():
+        if entity.get("ip") == ip and entity.get("port") == port:
+            return list(entity.get("dictionary") or [])
+    return []
+
+
 def inject_fuzzer_redirections(config_path):
     with open(config_path, "r") as f:
         config = yaml.safe_load(f)
@@ -56,6 +64,11 @@ def inject_fuzzer_redirections(config_path):
                 "entityB_proxy_port_send": random_port()
             }
 
+            dictionary = list(entity.get("dictionary") or [])
+            dictionary += [t for t in entity_dictionary(config, dst_ip, dst_port) if t not in dictionary]
+            if dictionary:
+                connection["dictionary"] = dictionary
+
             connections.append(connection)
 
             log_info(
@@ -125,11 +138,14 @@ def inject_tcp_redirections(config_path):
 
         proxy_port = random_port()
 
-        tcp_redirections.append({
+        redirection = {
             "server_ip": server_ip,
             "server_port": server_port,
             "proxy_port": proxy_port
-        })
+        }
+        if entity.get("dictionary"):
+            redirection["dictionary"] = list(entity["dictionary"])
+        tcp_redirections.append(redirection)
 
         log_info(f"TCP redirect: {server_ip}:{server_port} → proxy_port {proxy_port}")
 
@@ -16,11 +16,15 @@
 #include <vector>
 #include "ConfigurationManager.hpp"
 #include "ExecutionManager.hpp"
+#include "ProcessSupervisor.hpp"
 #include "Messages.h"
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
 #include <optional>
+#include <atomic>
+#include <time.h>
+#include <sys/time.h>
 
 #define MAX_MSG_SIZE 4096
 
@@ -30,12 +34,23 @@ int start_client();
 
 ssize_t send_message(int sockfd, const void* buffer, size_t len);
 ssize_t recv_message(int sockfd, void* buffer);
+void*   stats_thread_func(void* arg);
 
 /* Variables */
 char                             IP[64];
 utils::ConfigurationManager      cm;
 utils::ExecutionManager          em;
+utils::ProcessSupervisor         supervisor;
+int                              server_sockfd = -1;
 std::vector<utils::EntityConfig> entities;
 std::vector<pid_t>               processList;
+pthread_mutex_t                  send_mutex = PTHREAD_MUTEX_INITIALIZER; // the supervisor and stats threads both send
+
+/* Pushed to the server in STATS messages */
+long                  started_at; // ms since the epoch
+std::atomic<uint64_t> launches{0};
+std::atomic<uint64_t> restarts{0};
+std::atomic<uint64_t> restart_ms{0};
+std::atomic<uint64_t> crashes{0};
 
 #endif
\ No newline at end of file
@@ -39,102 +39,91 @@ void set_entities_list(int sockfd)
     }
 }
 
-void analyze_child_exit_status(int status)
+/*
+ * Crash report sent to the launcher server: "CRASH <entity> <class> <details>", e.g.
+ *   CRASH udp_server SIGNAL 11 (Segmentation fault)
+ *   CRASH udp_server SANITIZER AddressSanitizer:stack-buffer-overflow server.c:42 in main
+ *   CRASH udp_server HANG cpu-bound for 5000 ms
+ */
+void on_child_exit(pid_t pid, const std::string& name, const utils::CrashReport& report)
 {
-    if (WIFEXITED(status)) {
-        printf("Child exited with status %d\n", WEXITSTATUS(status));
-    } else if (WIFSIGNALED(status)) {
-        int sig = WTERMSIG(status);
-        printf("Child terminated by signal: %s (signal %d)\n", strsignal(sig), sig);
-
-        switch (sig) {
-            case SIGSEGV:
-                printf("Segmentation fault (possible stack overflow or invalid memory access).\n");
-                break;
-            case SIGFPE:
-                printf("Floating point exception (e.g., divide by zero).\n");
-                break;
-            case SIGABRT:
-                printf("Abort signal (e.g., assert failure).\n");
-                break;
-            default:
-                printf("Other signal.\n");
-        }
-    } else {
-        printf("Child terminated in an unknown way.\n");
+    std::string message = std::string(CRASH) + " " + name + " " + report.format();
+    if (message.size() >= MAX_MSG_SIZE) {
+        message.resize(MAX_MSG_SIZE - 1);
     }
-}
-
-void* monitor_child(void* args)
-{
-    struct _monitor_child_struct {
-        pid_t pid;
-        int   sockfd;
-    }*    _threadArg = (struct _monitor_child_struct*) args;
-    pid_t _pid       = _threadArg->pid;
-    int   _sockfd    = _threadArg->sockfd;
-    int   status     = 0;
-    char  buffer[16] = CRASH;
-
-    free(_threadArg);
-
-    waitpid(_pid, &status, 0);
-
-    analyze_child_exit_status(status);
-    send_message(_sockfd, buffer, strlen(buffer));
 
-    return NULL;
+    printf("[INFO] Application %s (PID %d) exited: %s\n", name.c_str(), pid, report.format().c_str());
+    if (report.crash_class != utils::CRASH_CLASS_EXIT) {
+        crashes++;
+    }
+    send_message(server_sockfd, message.c_str(), message.size());
 }
 
-void start_entities(int sockfd)
+void start_entities()
 {
-    struct _monitor_child_struct {
-        pid_t pid;
-        int   sockfd;
-    }*         _threadArg = NULL;
-    static int index      = 0;
+    static int index = 0;
     index++;
     for (auto& entity : entities) {
-        std::optional<pid_t> pid = em.launchEntity(entity, index);
-        if (pid.has_value()) {
+        utils::ChildOutput   output;
+        std::optional<pid_t> pid = em.launchEntity(entity, index, &output);
+        if (pid.has_value() && supervisor.watch(pid.value(), entity.name, &output, entity.hang_timeout_ms)) {
+            launches++;
             processList.push_back(pid.value());
-            _threadArg         = (struct _monitor_child_struct*) malloc(1 * sizeof(struct _monitor_child_struct));
-            _threadArg->pid    = pid.value();
-            _threadArg->sockfd = sockfd;
-            pthread_t thread;
-            pthread_create(&thread, NULL, monitor_child, (void*) _threadArg);
-            pthread_detach(thread);
-            printf("[DEBUG] Created waiting thread for application %d\n", pid.value());
         }
     }
 }
 
-void stop_process(pid_t pid)
-{
-    if (kill(pid, SIGKILL) == 0) {
-        printf("Process %d was terminated.\n", pid);
-    } else {
-        printf("Failed to terminate process %d.\n", pid);
-    }
-}
-
 void stop_processes()
 {
     for (pid_t pid : processList) {
-        stop_process(pid);
+        supervisor.stop(pid);
     }
     processList.clear();
 }
 
-void multiplex_message(char* buffer, int sockfd)
+void multiplex_message(char* buffer)
 {
     if (strncmp(buffer, START, sizeof(START)) == 0) {
         printf("[INFO] Starting Entities...\n");
-        start_entities(sockfd);
+        start_entities();
     } else if (strncmp(buffer, RESTART, sizeof(RESTART)) == 0) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
         stop_processes();
         printf("[INFO] Restarting Entities...\n");
-        start_entities(sockfd);
+        start_entities();
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        restart_ms += (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+        restarts++;
+    }
+}
+
+/*
+ * Pushes this launcher's counters to the server every STATS_INTERVAL_S:
+ *   STATS client <IP> started=<ms> launches=<n> restarts=<n> restart_ms=<n> crashes=<n>
+ */
+void* stats_thread_func(void*)
+{
+    char message[256];
+    while (1) {
+        sleep(STATS_INTERVAL_S);
+        int len = snprintf(message, sizeof(message),
+                           "%s client %s started=%ld launches=%llu restarts=%llu restart_ms=%llu crashes=%llu", STATS,
+                           IP, started_at, (unsigned long long) launches.load(), (unsigned long long) restarts.load(),
+                           (unsigned long long) restart_ms.load(), (unsigned long long) crashes.load());
+        send_message(server_sockfd, message, len);
+    }
+    return NULL;
+}
+
+void start_stats_thread()
+{
+    pthread_t stats_thread;
+    int       ret = pthread_create(&stats_thread, NULL, stats_thread_func, NULL);
+    if (ret != 0) {
+        perror("[ERROR] pthread_create (stats thread)");
+    } else {
+        pthread_detach(stats_thread);
     }
 }
 
@@ -143,11 +132,12 @@ void client_loop(int sockfd)
     int  ret;
     char buffer[MAX_MSG_SIZE];
     set_entities_list(sockfd);
+    start_stats_thread();
 
     while (1) {
         memset(buffer, 0, sizeof(buffer));
         ret = recv_message(sockfd, buffer);
-        multiplex_message(buffer, sockfd);
+        multiplex_message(buffer);
     }
 }
 
@@ -157,6 +147,7 @@ ssize_t send_message(int sockfd, const void* buffer, size_t len)
     int   bytes_sent, total_bytes;
     char* buff = (char*) &len;
 
+    pthread_mutex_lock(&send_mutex);
     bytes_sent  = 0;
     total_bytes = sizeof(len);
 
@@ -182,6 +173,7 @@ ssize_t send_message(int sockfd, const void* buffer, size_t len)
         bytes_sent += ret;
     }
 
+    pthread_mutex_unlock(&send_mutex);
     return len;
 }
 
@@ -259,6 +251,10 @@ int main(int argc, char* argv[])
 
     start_flusher_thread();
 
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    started_at = (long) now.tv_sec * 1000 + now.tv_usec / 1000;
+
     cm = utils::ConfigurationManager(argv[2]);
     if (cm.parse() != true) {
         printf("[ERROR] utils::ConfigurationManager::parse()\n");
@@ -269,7 +265,15 @@ int main(int argc, char* argv[])
     em = utils::ExecutionManager(cm);
     printf("[INFO] Execution Manager loaded!\n");
 
-    int sockfd = init_client(server_addr);
+    int sockfd    = init_client(server_addr);
+    server_sockfd = sockfd;
+
+    if (!supervisor.start(on_child_exit)) {
+        printf("[ERROR] utils::ProcessSupervisor::start()\n");
+        exit(-1);
+    }
+    printf("[INFO] Process supervisor started!\n");
+
     client_loop(sockfd);
 
     printf("[INFO] Client launcher started...");
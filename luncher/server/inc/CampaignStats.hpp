@@ -0,0 +1,87 @@
+#ifndef __CAMPAIGN_STATS_HPP__
+#define __CAMPAIGN_STATS_HPP__
+
+#include <map>
+#include <set>
+#include <string>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "Messages.h"
+
+#define STATS_RING_SIZE 720 // one hour of samples at STATS_INTERVAL_S
+#define STATS_STALE_S   (3 * STATS_INTERVAL_S)
+#define STATS_TEXT_DUMP "/tmp/logs/stats.txt"
+#define STATS_JSON_DUMP "/tmp/logs/stats.json"
+
+/* One point of the campaign time series, over all hosts. */
+struct StatsSample {
+    time_t   time;
+    double   execs_per_sec;   // messages mutated by the proxies
+    double   packets_per_sec; // messages received by the proxies
+    uint64_t execs;
+    uint64_t crashes;
+    uint64_t unique_crashes;
+    uint64_t hangs;
+    uint64_t restarts;
+    double   restart_ms; // average proxy restart in this interval (0 = none)
+    int      hosts;      // heard from within STATS_STALE_S
+};
+
+/*
+ * Campaign-wide statistics: the counters pushed by every proxy and launcher
+ * client in STATS messages, the crashes and restarts seen by the server, and
+ * a fixed-size ring of samples taken every STATS_INTERVAL_S.
+ */
+class CampaignStats {
+  public:
+    CampaignStats();
+
+    bool update(const char* message);     // STATS <role> <host> <key>=<value> ...
+    void recordCrash(const char* report); // CRASH <entity> <class> <details>
+    void recordRestart(double ms);        // the server restarted the proxy
+
+    void        sample();
+    std::string text();
+    std::string json();
+    void        dump(); // STATS_TEXT_DUMP and STATS_JSON_DUMP
+
+  private:
+    struct Host {
+        std::string                     role;
+        std::string                     name;
+        time_t                          last_seen = 0;
+        uint64_t                        started   = 0; // pushed by the sender, changes when it restarts
+        std::map<std::string, uint64_t> base;    // totals from before the sender restarted
+        std::map<std::string, uint64_t> current; // as last pushed
+        std::map<std::string, uint64_t> sampled; // totals at the previous sample
+        std::map<std::string, double>   rates;   // per second, between the last two samples
+    };
+
+    struct Medians {
+        double execs_per_sec = 0; // of the live proxies
+        double restart_ms    = 0; // of the live clients
+    };
+
+    static uint64_t    total(const Host& host, const std::string& key);
+    static double      rate(const Host& host, const std::string& key);
+    static double      restartMs(const Host& host);
+    Medians            medians(time_t now) const;
+    static const char* status(const Host& host, const Medians& medians, time_t now);
+
+    pthread_mutex_t             mutex_;
+    std::map<std::string, Host> hosts_; // by "<role> <host>"
+    std::set<std::string>       crash_signatures_;
+    uint64_t                    crashes_            = 0;
+    uint64_t                    hangs_              = 0;
+    uint64_t                    restarts_           = 0;
+    double                      restart_ms_         = 0;
+    uint64_t                    sampled_restarts_   = 0;
+    double                      sampled_restart_ms_ = 0;
+    struct timespec             sampled_at_;
+    StatsSample                 ring_[STATS_RING_SIZE];
+    size_t                      ring_next_  = 0;
+    size_t                      ring_count_ = 0;
+};
+
+#endif
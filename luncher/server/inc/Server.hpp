@@ -16,15 +16,18 @@
 #include "ConfigurationManager.hpp"
 #include "ExecutionManager.hpp"
 #include "ServerUtils.hpp"
+#include "CampaignStats.hpp"
 #include "Messages.h"
 #include <vector>
 #include <optional>
 #include <signal.h>
 #include <sys/wait.h>
+#include <time.h>
 
 #define MAX_MSG_SIZE 4096
 #define CONFIG_FILE  "/root/git-clones/cezfuzzer/config.yaml"
 #define LISTEN_PORT  23927
+#define CRASH_LOG    "/tmp/logs/crashes.log"
 
 /* Functions */
 int init_server();
@@ -35,6 +38,9 @@ ssize_t recv_message(int sockfd, void* buffer);
 
 void* listen_thread_func(void* arg);
 void* handle_client_connection(void* arg);
+void* notify_thread_func(void* arg);
+void* stats_thread_func(void* arg);
+void  request_restart();
 
 /* Variables */
 YAML::Node                  config;
@@ -42,6 +48,8 @@ pthread_t                   listen_thread;
 utils::ConfigurationManager cm;
 utils::ExecutionManager     em;
 struct client_list          client_list;
+CampaignStats               stats;
+volatile sig_atomic_t       _statsRequested      = 0; // SIGUSR1: print the campaign statistics
 std::vector<int>            client_fd_list;
 bool                        _notification        = false;
 std::string                 _notificationMessage = "";
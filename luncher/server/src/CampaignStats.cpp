@@ -0,0 +1,356 @@
+#include "CampaignStats.hpp"
+#include <algorithm>
+#include <vector>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static double elapsed_s(const struct timespec& since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - since.tv_sec) + (double) (now.tv_nsec - since.tv_nsec) / 1e9;
+}
+
+static std::string json_string(const std::string& value)
+{
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += ((unsigned char) c < 0x20) ? ' ' : c;
+    }
+    return out + "\"";
+}
+
+static std::string format(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char* fmt, ...)
+{
+    char    line[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    return line;
+}
+
+CampaignStats::CampaignStats()
+{
+    pthread_mutex_init(&mutex_, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &sampled_at_);
+    memset(ring_, 0, sizeof(ring_));
+}
+
+bool CampaignStats::update(const char* message)
+{
+    char  copy[4096];
+    char* save = NULL;
+    strncpy(copy, message, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    char* tag  = strtok_r(copy, " \n", &save);
+    char* role = strtok_r(NULL, " \n", &save);
+    char* name = strtok_r(NULL, " \n", &save);
+    if (tag == NULL || strcmp(tag, STATS) != 0 || role == NULL || name == NULL) {
+        return false;
+    }
+
+    std::map<std::string, uint64_t> values;
+    uint64_t                        started = 0;
+    for (char* field = strtok_r(NULL, " \n", &save); field != NULL; field = strtok_r(NULL, " \n", &save)) {
+        char* eq = strchr(field, '=');
+        if (eq == NULL) {
+            return false;
+        }
+        *eq = '\0';
+        if (strcmp(field, "started") == 0) {
+            started = strtoull(eq + 1, NULL, 10);
+        } else {
+            values[field] = strtoull(eq + 1, NULL, 10);
+        }
+    }
+
+    pthread_mutex_lock(&mutex_);
+    Host& host = hosts_[std::string(role) + " " + name];
+    host.role  = role;
+    host.name  = name;
+    // Counters start over with the sender: keep what it had counted so the totals do not go back
+    if (host.started != started) {
+        for (const auto& [key, value] : host.current) {
+            host.base[key] += value;
+        }
+        host.current.clear();
+        host.started = started;
+    }
+    for (const auto& [key, value] : values) {
+        uint64_t& current = host.current[key];
+        if (value < current) {
+            host.base[key] += current;
+        }
+        current = value;
+    }
+    host.last_seen = time(NULL);
+    pthread_mutex_unlock(&mutex_);
+    return true;
+}
+
+/*
+ * A hang is one bug per entity whatever it waited for; any other report is
+ * its own crash signature (class, signal or sanitizer bug and location). A
+ * clean exit (class EXIT) only asks for a restart and is not a crash.
+ */
+void CampaignStats::recordCrash(const char* report)
+{
+    char entity[128] = {0};
+    char klass[32]   = {0};
+    int  consumed    = 0;
+    if (sscanf(report, CRASH " %127s %31s %n", entity, klass, &consumed) < 2 || strcmp(klass, "EXIT") == 0) {
+        return;
+    }
+
+    std::string signature = std::string(entity) + " " + klass;
+    bool        hang      = strcmp(klass, "HANG") == 0;
+    if (!hang) {
+        signature += std::string(" ") + (report + consumed);
+    }
+
+    pthread_mutex_lock(&mutex_);
+    crashes_++;
+    if (hang) {
+        hangs_++;
+    }
+    crash_signatures_.insert(signature);
+    pthread_mutex_unlock(&mutex_);
+}
+
+void CampaignStats::recordRestart(double ms)
+{
+    pthread_mutex_lock(&mutex_);
+    restarts_++;
+    restart_ms_ += ms;
+    pthread_mutex_unlock(&mutex_);
+}
+
+uint64_t CampaignStats::total(const Host& host, const std::string& key)
+{
+    auto base    = host.base.find(key);
+    auto current = host.current.find(key);
+    return (base != host.base.end() ? base->second : 0) + (current != host.current.end() ? current->second : 0);
+}
+
+double CampaignStats::rate(const Host& host, const std::string& key)
+{
+    auto it = host.rates.find(key);
+    return it != host.rates.end() ? it->second : 0;
+}
+
+double CampaignStats::restartMs(const Host& host)
+{
+    uint64_t restarts = total(host, "restarts");
+    return restarts ? (double) total(host, "restart_ms") / restarts : 0;
+}
+
+/*
+ * Appends one point to the ring. Called every STATS_INTERVAL_S; the rates are
+ * over the time since the previous call.
+ */
+void CampaignStats::sample()
+{
+    pthread_mutex_lock(&mutex_);
+    double seconds = elapsed_s(sampled_at_);
+    clock_gettime(CLOCK_MONOTONIC, &sampled_at_);
+
+    StatsSample point = {};
+    point.time        = time(NULL);
+    for (auto& [id, host] : hosts_) {
+        std::set<std::string> keys;
+        for (const auto& [key, value] : host.base) {
+            keys.insert(key);
+        }
+        for (const auto& [key, value] : host.current) {
+            keys.insert(key);
+        }
+        for (const std::string& key : keys) {
+            uint64_t now      = total(host, key);
+            host.rates[key]   = seconds > 0 ? (double) (now - host.sampled[key]) / seconds : 0;
+            host.sampled[key] = now;
+        }
+        point.execs_per_sec += rate(host, "mutations");
+        point.packets_per_sec += rate(host, "packets_in");
+        point.execs += total(host, "mutations");
+        if (point.time - host.last_seen <= STATS_STALE_S) {
+            point.hosts++;
+        }
+    }
+    point.crashes        = crashes_;
+    point.unique_crashes = crash_signatures_.size();
+    point.hangs          = hangs_;
+    point.restarts       = restarts_;
+    if (restarts_ > sampled_restarts_) {
+        point.restart_ms = (restart_ms_ - sampled_restart_ms_) / (double) (restarts_ - sampled_restarts_);
+    }
+    sampled_restarts_   = restarts_;
+    sampled_restart_ms_ = restart_ms_;
+
+    ring_[ring_next_] = point;
+    ring_next_        = (ring_next_ + 1) % STATS_RING_SIZE;
+    ring_count_       = std::min<size_t>(ring_count_ + 1, STATS_RING_SIZE);
+    pthread_mutex_unlock(&mutex_);
+}
+
+CampaignStats::Medians CampaignStats::medians(time_t now) const
+{
+    std::vector<double> execs, restarts;
+    for (const auto& [id, host] : hosts_) {
+        if (now - host.last_seen > STATS_STALE_S) {
+            continue;
+        }
+        if (host.current.count("mutations")) {
+            execs.push_back(rate(host, "mutations"));
+        }
+        if (total(host, "restarts") > 0) {
+            restarts.push_back(restartMs(host));
+        }
+    }
+
+    Medians result;
+    if (!execs.empty()) {
+        std::nth_element(execs.begin(), execs.begin() + execs.size() / 2, execs.end());
+        result.execs_per_sec = execs[execs.size() / 2];
+    }
+    if (!restarts.empty()) {
+        std::nth_element(restarts.begin(), restarts.begin() + restarts.size() / 2, restarts.end());
+        result.restart_ms = restarts[restarts.size() / 2];
+    }
+    return result;
+}
+
+/*
+ * "stale" when the host stopped pushing, "slow" when it mutates at less than
+ * half the median rate or restarts its entities twice as slowly as the median.
+ */
+const char* CampaignStats::status(const Host& host, const Medians& medians, time_t now)
+{
+    if (now - host.last_seen > STATS_STALE_S) {
+        return "stale";
+    }
+    if (host.current.count("mutations") && rate(host, "mutations") < medians.execs_per_sec / 2) {
+        return "slow";
+    }
+    if (total(host, "restarts") > 0 && restartMs(host) > medians.restart_ms * 2) {
+        return "slow";
+    }
+    return "ok";
+}
+
+std::string CampaignStats::text()
+{
+    pthread_mutex_lock(&mutex_);
+    time_t      now    = time(NULL);
+    Medians     middle = medians(now);
+    std::string out;
+
+    const StatsSample* last = ring_count_ ? &ring_[(ring_next_ + STATS_RING_SIZE - 1) % STATS_RING_SIZE] : NULL;
+    out += "=== Campaign ===\n";
+    out += format("execs/s %.1f  packets/s %.1f  execs %llu\n", last ? last->execs_per_sec : 0.0,
+                  last ? last->packets_per_sec : 0.0, (unsigned long long) (last ? last->execs : 0));
+    out += format("crashes %llu (unique %zu)  hangs %llu  restarts %llu (avg %.1f ms)\n", (unsigned long long) crashes_,
+                  crash_signatures_.size(), (unsigned long long) hangs_, (unsigned long long) restarts_,
+                  restarts_ ? restart_ms_ / (double) restarts_ : 0.0);
+
+    out += "\n=== Hosts ===\n";
+    out += format("%-8s %-24s %6s %12s %12s %9s %11s %s\n", "role", "host", "seen", "execs/s", "packets/s", "restarts",
+                  "restart ms", "status");
+    for (const auto& [id, host] : hosts_) {
+        out += format("%-8s %-24s %5lds %12.1f %12.1f %9llu %11.1f %s\n", host.role.c_str(), host.name.c_str(),
+                      (long) (now - host.last_seen), rate(host, "mutations"), rate(host, "packets_in"),
+                      (unsigned long long) total(host, "restarts"), restartMs(host), status(host, middle, now));
+    }
+
+    out += "\n=== Last minute ===\n";
+    out += format("%-10s %12s %12s %9s %7s %6s %9s %6s\n", "time", "execs/s", "packets/s", "crashes", "unique",
+                  "hangs", "restarts", "hosts");
+    size_t shown = std::min<size_t>(ring_count_, 60 / STATS_INTERVAL_S);
+    for (size_t i = ring_count_ - shown; i < ring_count_; ++i) {
+        const StatsSample& point = ring_[(ring_next_ + STATS_RING_SIZE - ring_count_ + i) % STATS_RING_SIZE];
+        out += format("%-10ld %12.1f %12.1f %9llu %7llu %6llu %9llu %6d\n", (long) point.time, point.execs_per_sec,
+                      point.packets_per_sec, (unsigned long long) point.crashes,
+                      (unsigned long long) point.unique_crashes, (unsigned long long) point.hangs,
+                      (unsigned long long) point.restarts, point.hosts);
+    }
+    pthread_mutex_unlock(&mutex_);
+    return out;
+}
+
+std::string CampaignStats::json()
+{
+    pthread_mutex_lock(&mutex_);
+    time_t      now    = time(NULL);
+    Medians     middle = medians(now);
+    std::string out;
+
+    out += format("{\"time\": %ld, \"interval_s\": %d,\n", (long) now, STATS_INTERVAL_S);
+    out += format(" \"crashes\": %llu, \"unique_crashes\": %zu, \"hangs\": %llu, \"restarts\": %llu, "
+                  "\"restart_ms_avg\": %.1f,\n",
+                  (unsigned long long) crashes_, crash_signatures_.size(), (unsigned long long) hangs_,
+                  (unsigned long long) restarts_, restarts_ ? restart_ms_ / (double) restarts_ : 0.0);
+
+    out += " \"hosts\": [";
+    const char* separator = "\n";
+    for (const auto& [id, host] : hosts_) {
+        out += separator + std::string("  {\"role\": ") + json_string(host.role) +
+               ", \"host\": " + json_string(host.name) + format(", \"seen_s_ago\": %ld", (long) (now - host.last_seen));
+        out += format(", \"status\": \"%s\", \"restart_ms_avg\": %.1f", status(host, middle, now), restartMs(host));
+        for (const auto& [key, value] : host.rates) {
+            out += format(", \"%s_total\": %llu, \"%s_per_sec\": %.2f", key.c_str(),
+                          (unsigned long long) total(host, key), key.c_str(), value);
+        }
+        out += "}";
+        separator = ",\n";
+    }
+
+    out += "],\n \"series\": [";
+    separator = "\n";
+    for (size_t i = 0; i < ring_count_; ++i) {
+        const StatsSample& point = ring_[(ring_next_ + STATS_RING_SIZE - ring_count_ + i) % STATS_RING_SIZE];
+        out += separator;
+        out += format("  {\"time\": %ld, \"execs_per_sec\": %.2f, \"packets_per_sec\": %.2f, \"execs\": %llu, "
+                      "\"crashes\": %llu, \"unique_crashes\": %llu, \"hangs\": %llu, \"restarts\": %llu, "
+                      "\"restart_ms\": %.1f, \"hosts\": %d}",
+                      (long) point.time, point.execs_per_sec, point.packets_per_sec, (unsigned long long) point.execs,
+                      (unsigned long long) point.crashes, (unsigned long long) point.unique_crashes,
+                      (unsigned long long) point.hangs, (unsigned long long) point.restarts, point.restart_ms,
+                      point.hosts);
+        separator = ",\n";
+    }
+    out += "]}\n";
+    pthread_mutex_unlock(&mutex_);
+    return out;
+}
+
+static void write_file(const char* path, const std::string& content)
+{
+    std::string tmp  = std::string(path) + ".tmp";
+    FILE*       file = fopen(tmp.c_str(), "w");
+    if (file == NULL) {
+        perror("[ERROR] fopen(stats dump)");
+        return;
+    }
+    fputs(content.c_str(), file);
+    fclose(file);
+    // Readers never see a half-written dump
+    if (rename(tmp.c_str(), path) < 0) {
+        perror("[ERROR] rename(stats dump)");
+    }
+}
+
+void CampaignStats::dump()
+{
+    mkdir("/tmp/logs", 0755);
+    write_file(STATS_TEXT_DUMP, text());
+    write_file(STATS_JSON_DUMP, json());
+}
@@ -41,6 +41,139 @@ void send_start_signal(int sockfd)
     ret = send_message(sockfd, START, strlen(START));
 }
 
+void record_crash(const char* report)
+{
+    stats.recordCrash(report);
+
+    FILE* crash_log = fopen(CRASH_LOG, "a");
+    if (crash_log == NULL) {
+        perror("[ERROR] fopen(crash log)");
+        return;
+    }
+    fprintf(crash_log, "%ld %s\n", (long) time(NULL), report);
+    fclose(crash_log);
+}
+
+void on_stats_signal(int)
+{
+    _statsRequested = 1;
+}
+
+/*
+ * Samples the campaign statistics every STATS_INTERVAL_S and rewrites
+ * STATS_TEXT_DUMP / STATS_JSON_DUMP; SIGUSR1 also prints them.
+ */
+void* stats_thread_func(void*)
+{
+    int ticks = 0;
+    while (1) {
+        sleep(1);
+        if (++ticks >= STATS_INTERVAL_S) {
+            ticks = 0;
+            stats.sample();
+            stats.dump();
+        }
+        if (_statsRequested) {
+            _statsRequested = 0;
+            printf("%s", stats.text().c_str());
+        }
+    }
+    return NULL;
+}
+
+void init_stats()
+{
+    struct sigaction action;
+    pthread_t        stats_thread;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stats_signal;
+    action.sa_flags   = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    if (pthread_create(&stats_thread, NULL, stats_thread_func, NULL) != 0) {
+        perror("[ERROR] pthread_create() stats");
+        return;
+    }
+    pthread_detach(stats_thread);
+}
+
+void request_restart()
+{
+    pthread_mutex_lock(&_notificatioMutex);
+    _notificationMessage = RESTART;
+    _notification        = true;
+    pthread_cond_signal(&_notificationCond);
+    pthread_mutex_unlock(&_notificatioMutex);
+}
+
+/*
+ * Receives crash reports sent as plain UDP datagrams, e.g. the proxy's
+ * "CRASH <entity> HANG ..." when a target stops answering, and the proxy's
+ * periodic STATS.
+ */
+void* notify_thread_func(void* arg)
+{
+    int  notify_fd            = *(int*) arg;
+    char buffer[MAX_MSG_SIZE] = {0};
+
+    printf("[INFO] Notify thread started on UDP port %d...\n", NOTIFY_PORT);
+
+    while (1) {
+        ssize_t len = recv(notify_fd, buffer, sizeof(buffer) - 1, 0);
+        if (len < 0) {
+            perror("[ERROR] recv() notify");
+            continue;
+        }
+        buffer[len] = '\0';
+
+        if (strncmp(buffer, STATS, strlen(STATS)) == 0) {
+            if (!stats.update(buffer)) {
+                printf("[WARN] Malformed statistics: %s\n", buffer);
+            }
+            continue;
+        }
+        printf("[INFO] Notification: %s\n", buffer);
+
+        if (strncmp(buffer, CRASH, strlen(CRASH)) == 0) {
+            record_crash(buffer);
+            request_restart();
+        }
+    }
+    return NULL;
+}
+
+void init_notify_listener()
+{
+    static int         notify_fd;
+    struct sockaddr_in addr;
+    pthread_t          notify_thread;
+
+    notify_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (notify_fd < 0) {
+        perror("[ERROR] socket() notify");
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port        = htons(NOTIFY_PORT);
+
+    if (bind(notify_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("[ERROR] bind() notify");
+        close(notify_fd);
+        return;
+    }
+
+    if (pthread_create(&notify_thread, NULL, notify_thread_func, (int*) &notify_fd) != 0) {
+        perror("[ERROR] pthread_create() notify");
+        close(notify_fd);
+        return;
+    }
+    pthread_detach(notify_thread);
+}
+
 void* handle_client_connection(void* arg)
 {
     int  client_fd            = *(int*) arg;
@@ -53,14 +186,22 @@ void* handle_client_connection(void* arg)
     while (1) {
         memset(buffer, 0, MAX_MSG_SIZE);
         ret = recv_message(client_fd, buffer);
+        if (ret < 0) {
+            printf("[INFO] Client on socket %d disconnected\n", client_fd);
+            break;
+        }
+
+        if (strncmp(buffer, STATS, strlen(STATS)) == 0) {
+            if (!stats.update(buffer)) {
+                printf("[WARN] Malformed statistics: %s\n", buffer);
+            }
+            continue;
+        }
         printf("[INFO] Message: %s\n", buffer);
 
         if (strncmp(buffer, CRASH, strlen(CRASH)) == 0) {
-            pthread_mutex_lock(&_notificatioMutex);
-            _notificationMessage = RESTART;
-            _notification        = true;
-            pthread_cond_signal(&_notificationCond);
-            pthread_mutex_unlock(&_notificatioMutex);
+            record_crash(buffer);
+            request_restart();
         }
 
         sleep(1);
@@ -261,6 +402,8 @@ int main(int argc, char* argv[])
     printf("[INFO] Configuration loaded!\n");
 
     init_server();
+    init_notify_listener();
+    init_stats();
     printf("[INFO] Server launcher started...\n");
 
     em = utils::ExecutionManager(cm);
@@ -277,8 +420,13 @@ int main(int argc, char* argv[])
 
         printf("[INFO] Notification received...\n");
         if (_notificationMessage == RESTART) {
+            struct timespec restart_start, restart_end;
+            clock_gettime(CLOCK_MONOTONIC, &restart_start);
             stop_process(proxyPid.value());
             proxyPid = em.launchEntity(proxyConfig, -1);
+            clock_gettime(CLOCK_MONOTONIC, &restart_end);
+            stats.recordRestart((restart_end.tv_sec - restart_start.tv_sec) * 1e3 +
+                                (restart_end.tv_nsec - restart_start.tv_nsec) / 1e6);
             printf("[INFO] Proxy restarted...\n");
             for (auto& clientfd : client_fd_list) {
                 send_message(clientfd, RESTART, sizeof(RESTART));
@@ -49,6 +49,14 @@ bool ConfigurationManager::parse() {
                     }
                 }
 
+                if (data["hang_timeout_ms"]) {
+                    entity.hang_timeout_ms = data["hang_timeout_ms"].as<int>();
+                }
+
+                if (data["coverage_map"]) {
+                    entity.coverage_map = data["coverage_map"].as<std::string>();
+                }
+
                 if (data["destinations"]) {
                     for (const auto& dst : data["destinations"]) {
                         Destination d;
@@ -30,6 +30,8 @@ struct EntityConfig {
     std::vector<std::string> args;
 
     // Optional
+    int hang_timeout_ms = 0; // kill and report as HANG after this long spinning on the CPU (0 = off)
+    std::string coverage_map; // exported as CEZ_COVERAGE_MAP to coverage-instrumented targets
     std::vector<Destination> destinations;
     std::optional<ConnectTo> connect_to;
 };
@@ -0,0 +1,229 @@
+#include "CrashAnalyzer.hpp"
+#include <cctype>
+#include <cstring>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define MAX_LINE_LENGTH 4096
+
+namespace utils {
+
+/*
+ * "signed integer overflow" -> "signed-integer-overflow"
+ */
+static std::string slugify(const std::string& text)
+{
+    std::string slug;
+    for (char c : text) {
+        if (isalnum((unsigned char) c)) {
+            slug += (char) tolower((unsigned char) c);
+        } else if ((c == ' ' || c == '-' || c == '_') && !slug.empty() && slug.back() != '-') {
+            slug += '-';
+        }
+    }
+    while (!slug.empty() && slug.back() == '-') {
+        slug.pop_back();
+    }
+    return slug;
+}
+
+static std::string trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r");
+    size_t end   = text.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+}
+
+static std::string basename(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/*
+ * Frames belonging to the sanitizer runtime itself (interceptors, report helpers).
+ */
+static bool isRuntimeFrame(const std::string& function, const std::string& frame)
+{
+    return function.rfind("__interceptor_", 0) == 0 || function.rfind("__asan", 0) == 0 ||
+           function.rfind("__ubsan", 0) == 0 || function.rfind("__sanitizer", 0) == 0 ||
+           frame.find("sanitizer_common") != std::string::npos || frame.find("/libasan") != std::string::npos ||
+           frame.find("/libubsan") != std::string::npos;
+}
+
+const char* crashClassName(CrashClass crash_class)
+{
+    switch (crash_class) {
+        case CRASH_CLASS_EXIT:
+            return "EXIT";
+        case CRASH_CLASS_EXIT_CODE:
+            return "EXIT_CODE";
+        case CRASH_CLASS_SIGNAL:
+            return "SIGNAL";
+        case CRASH_CLASS_SANITIZER:
+            return "SANITIZER";
+        case CRASH_CLASS_HANG:
+            return "HANG";
+    }
+    return "UNKNOWN";
+}
+
+std::string CrashReport::format() const
+{
+    std::string text = crashClassName(crash_class);
+
+    switch (crash_class) {
+        case CRASH_CLASS_EXIT:
+        case CRASH_CLASS_EXIT_CODE:
+            text += " " + std::to_string(exit_code);
+            break;
+        case CRASH_CLASS_SIGNAL:
+            text += " " + std::to_string(signal) + " (" + strsignal(signal) + ")";
+            break;
+        case CRASH_CLASS_SANITIZER:
+            text += " " + sanitizer + ":" + (bug_type.empty() ? "unknown" : bug_type);
+            if (!location.empty()) {
+                text += " " + location;
+            }
+            break;
+        case CRASH_CLASS_HANG:
+            text += " cpu-bound for " + std::to_string(hang_ms) + " ms";
+            break;
+    }
+
+    return text;
+}
+
+void SanitizerStreamParser::feed(const char* data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == '\n' || line_.size() >= MAX_LINE_LENGTH) {
+            parseLine(line_);
+            line_.clear();
+            if (data[i] == '\n') {
+                continue;
+            }
+        }
+        line_ += data[i];
+    }
+}
+
+void SanitizerStreamParser::finish()
+{
+    if (!line_.empty()) {
+        parseLine(line_);
+        line_.clear();
+    }
+}
+
+/*
+ * Recognised lines (only the first report of a run is kept):
+ *   ==42==ERROR: AddressSanitizer: heap-buffer-overflow on address ...
+ *   ==42==ERROR: LeakSanitizer: detected memory leaks
+ *   WARNING: ThreadSanitizer: data race (pid=42)
+ *   server.c:17:9: runtime error: signed integer overflow: ...
+ *       #1 0x4f5a1b in parse_msg /app/tests/server.c:42:5
+ *   SUMMARY: AddressSanitizer: stack-buffer-overflow /app/tests/server.c:42:5 in parse_msg
+ */
+void SanitizerStreamParser::parseLine(const std::string& line)
+{
+    if (summary_seen_) {
+        return;
+    }
+
+    size_t pos;
+
+    if ((pos = line.find("SUMMARY: ")) != std::string::npos) {
+        std::string rest  = line.substr(pos + strlen("SUMMARY: "));
+        size_t      colon = rest.find(": ");
+        if (colon == std::string::npos || colon == 0) {
+            return;
+        }
+        if (sanitizer_.empty()) {
+            sanitizer_ = rest.substr(0, colon);
+        }
+        rest         = rest.substr(colon + 2);
+        size_t space = rest.find(' ');
+        if (bug_type_.empty()) {
+            bug_type_ = rest.substr(0, space);
+        }
+        if (location_.empty() && space != std::string::npos) {
+            std::string where = trim(rest.substr(space + 1));
+            size_t      in    = where.find(" in ");
+            location_         = in == std::string::npos ? basename(where)
+                                                        : basename(where.substr(0, in)) + where.substr(in);
+        }
+        summary_seen_ = true;
+        return;
+    }
+
+    if ((pos = line.find("ERROR: ")) != std::string::npos || (pos = line.find("WARNING: ")) != std::string::npos) {
+        std::string rest  = line.substr(line.find(": ", pos) + 2);
+        size_t      colon = rest.find("Sanitizer: ");
+        if (colon == std::string::npos || !sanitizer_.empty()) {
+            return;
+        }
+        sanitizer_       = rest.substr(0, colon + strlen("Sanitizer"));
+        std::string what = rest.substr(colon + strlen("Sanitizer: "));
+        if (sanitizer_ == "LeakSanitizer") {
+            bug_type_ = "memory-leak";
+        } else if (sanitizer_ == "ThreadSanitizer") {
+            bug_type_ = slugify(what.substr(0, what.find(" (")));
+        } else {
+            bug_type_ = what.substr(0, what.find(' '));
+        }
+        return;
+    }
+
+    if ((pos = line.find(": runtime error: ")) != std::string::npos) {
+        if (!sanitizer_.empty()) {
+            return;
+        }
+        std::string what = line.substr(pos + strlen(": runtime error: "));
+        sanitizer_       = "UndefinedBehaviorSanitizer";
+        bug_type_        = slugify(what.substr(0, what.find(':')));
+        location_        = basename(trim(line.substr(0, pos)));
+        return;
+    }
+
+    // First stack frame outside the sanitizer runtime: "#1 0x... in function /path/file.c:42:5"
+    if (detected() && location_.empty() && (pos = line.find('#')) != std::string::npos &&
+        line.find(" 0x", pos) != std::string::npos) {
+        size_t in = line.find(" in ", pos);
+        if (in == std::string::npos) {
+            return;
+        }
+        std::string frame    = trim(line.substr(in + strlen(" in ")));
+        size_t      space    = frame.find(' ');
+        std::string function = frame.substr(0, space);
+        if (isRuntimeFrame(function, frame)) {
+            return;
+        }
+        location_ = space == std::string::npos ? function : basename(frame.substr(space + 1)) + " in " + function;
+    }
+}
+
+CrashReport analyzeExitStatus(int status, const SanitizerStreamParser* parser)
+{
+    CrashReport report;
+
+    if (WIFEXITED(status)) {
+        report.exit_code   = WEXITSTATUS(status);
+        report.crash_class = report.exit_code == 0 ? CRASH_CLASS_EXIT : CRASH_CLASS_EXIT_CODE;
+    } else if (WIFSIGNALED(status)) {
+        report.signal      = WTERMSIG(status);
+        report.crash_class = CRASH_CLASS_SIGNAL;
+    }
+
+    // A sanitizer report explains the exit better than the exit code or the SIGABRT it raises.
+    if (parser && parser->detected()) {
+        report.crash_class = CRASH_CLASS_SANITIZER;
+        report.sanitizer   = parser->sanitizer();
+        report.bug_type    = parser->bugType();
+        report.location    = parser->location();
+    }
+
+    return report;
+}
+
+} // namespace utils
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace utils {
+
+enum CrashClass {
+    CRASH_CLASS_EXIT,      // exited with status 0
+    CRASH_CLASS_EXIT_CODE, // exited with a non-zero status and no sanitizer report
+    CRASH_CLASS_SIGNAL,    // killed by a signal
+    CRASH_CLASS_SANITIZER, // ASan/UBSan/LSan/TSan report seen on stderr
+    CRASH_CLASS_HANG,      // killed by the watchdog after spinning without progress
+};
+
+/**
+ * Result of analysing a terminated entity; format() is what gets sent to the
+ * launcher server after the CRASH keyword.
+ */
+struct CrashReport {
+    CrashClass  crash_class = CRASH_CLASS_EXIT;
+    int         exit_code   = 0;
+    int         signal      = 0;
+    std::string sanitizer; // e.g. AddressSanitizer
+    std::string bug_type;  // e.g. stack-buffer-overflow, signed-integer-overflow
+    std::string location;  // "file.c:42 in main" from the SUMMARY line or first frame
+    int         hang_ms = 0;
+
+    std::string format() const;
+};
+
+const char* crashClassName(CrashClass crash_class);
+
+/**
+ * Incremental parser for sanitizer reports. Bytes are fed as they come out of
+ * the target's stderr pipe; only the current partial line is buffered.
+ */
+class SanitizerStreamParser {
+  public:
+    void feed(const char* data, size_t len);
+    void finish();
+
+    bool               detected() const { return !sanitizer_.empty(); }
+    const std::string& sanitizer() const { return sanitizer_; }
+    const std::string& bugType() const { return bug_type_; }
+    const std::string& location() const { return location_; }
+
+  private:
+    std::string line_;
+    std::string sanitizer_;
+    std::string bug_type_;
+    std::string location_;
+    bool        summary_seen_ = false;
+
+    void parseLine(const std::string& line);
+};
+
+CrashReport analyzeExitStatus(int status, const SanitizerStreamParser* parser);
+
+} // namespace utils
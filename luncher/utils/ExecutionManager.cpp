@@ -3,94 +3,270 @@
 #include <fstream>
 #include <fcntl.h>
 #include <unistd.h>
+#include <spawn.h>
+#include <signal.h>
 #include <sys/wait.h>
 #include <cstring>
+#include <cstdlib>
+#include <climits>
 #include <sys/stat.h>
 
+extern char** environ;
+
+#define LOG_DIR "/tmp/logs"
+
 namespace utils {
 
-ExecutionManager::ExecutionManager() = default;
+/*
+ * Locations where coreutils ships the preload library used by `stdbuf`. Setting
+ * the same environment variables `stdbuf -o0 -e0` would set gives us unbuffered
+ * output without exec'ing an extra process for every launch.
+ */
+static const char* STDBUF_LIBS[] = {
+    "/usr/libexec/coreutils/libstdbuf.so",
+    "/usr/lib/coreutils/libstdbuf.so",
+    "/usr/lib/x86_64-linux-gnu/coreutils/libstdbuf.so",
+    nullptr,
+};
 
-ExecutionManager::ExecutionManager(const ConfigurationManager& config) : config_(config) {}
+static bool isExecutable(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(path.c_str(), X_OK) == 0;
+}
 
-std::optional<pid_t> ExecutionManager::launchEntity(const EntityConfig& entity, int index)
+/*
+ * Resolves `program` the way execvp() would, but only once per entity.
+ */
+static std::string resolveExecutable(const std::string& program)
 {
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("[ERROR] fork()");
-        return std::nullopt;
+    if (program.find('/') != std::string::npos) {
+        char resolved[PATH_MAX];
+        if (realpath(program.c_str(), resolved) != nullptr) {
+            return resolved;
+        }
+        return program;
     }
 
-    if (pid == 0) {
-        // Child process
-        std::string log_path = "/tmp/logs/" + entity.name + "_" + std::to_string(index) + ".log";
-        mkdir("/tmp/logs", 0755);
+    const char* path_env = getenv("PATH");
+    std::string search   = path_env ? path_env : "/usr/local/bin:/usr/bin:/bin";
+    size_t      start    = 0;
 
-        int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) {
-            perror("[ERROR] open(log file)");
-            exit(EXIT_FAILURE);
+    while (start <= search.size()) {
+        size_t      end = search.find(':', start);
+        std::string dir = search.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (dir.empty()) {
+            dir = ".";
+        }
+        std::string candidate = dir + "/" + program;
+        if (isExecutable(candidate)) {
+            return candidate;
+        }
+        if (end == std::string::npos) {
+            break;
         }
+        start = end + 1;
+    }
 
-        dup2(fd, STDOUT_FILENO);
-        dup2(fd, STDERR_FILENO);
-        close(fd);
+    return program;
+}
 
-        std::vector<char*> argv = buildArgv(entity);
+ExecutionManager::ExecutionManager() = default;
 
-        printf("[DEBUG] Launching entity \"%s\" with arguments:\n", entity.name.c_str());
-        for (size_t i = 0; i < argv.size() - 1; ++i) { // exclude nullptr
-            printf("  argv[%zu]: %s\n", i, argv[i]);
-        }
+ExecutionManager::ExecutionManager(const ConfigurationManager& config) : config_(config)
+{
+    mkdir(LOG_DIR, 0755);
+}
+
+std::optional<pid_t> ExecutionManager::launchEntity(const EntityConfig& entity, int index, ChildOutput* output)
+{
+    std::shared_ptr<const LaunchPlan> plan = getPlan(entity);
 
-        std::vector<char*> new_argv;
-        new_argv.push_back(strdup("stdbuf"));
-        new_argv.push_back(strdup("-o0")); // stdout non-buffered
-        new_argv.push_back(strdup("-e0")); // stderr non-buffered
-        for (auto ptr : argv) {
-            new_argv.push_back(ptr);
+    int log_fd = openLogFile(entity, index);
+    if (log_fd < 0) {
+        return std::nullopt;
+    }
+
+    // When the caller captures stderr, the child writes it into a pipe and the caller copies it to the log.
+    int err_pipe[2] = {-1, -1};
+    if (output != nullptr) {
+        if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+            perror("[ERROR] pipe2(stderr)");
+            close(log_fd);
+            return std::nullopt;
         }
-        new_argv.push_back(nullptr);
-        execvp(new_argv[0], new_argv.data());
+        fcntl(err_pipe[0], F_SETFL, fcntl(err_pipe[0], F_GETFL) | O_NONBLOCK);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    posix_spawn_file_actions_adddup2(&actions, log_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, output ? err_pipe[1] : log_fd, STDERR_FILENO);
+
+    // The launcher may have signals blocked or ignored in some threads; the target must start clean.
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    pid_t pid = -1;
+    int   ret = posix_spawn(&pid, plan->path.c_str(), &actions, &attr, plan->argv.data(), plan->envp.data());
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
 
-        perror("[ERROR] execvp()");
-        exit(EXIT_FAILURE);
+    if (output != nullptr) {
+        close(err_pipe[1]);
     }
 
-    std::vector<char*> argv = buildArgv(entity);
+    if (ret != 0) {
+        fprintf(stderr, "[ERROR] posix_spawn(%s): %s\n", plan->path.c_str(), strerror(ret));
+        close(log_fd);
+        if (output != nullptr) {
+            close(err_pipe[0]);
+        }
+        return std::nullopt;
+    }
 
-    printf("[DEBUG] Launching entity \"%s\" with arguments:\n", entity.name.c_str());
-    for (size_t i = 0; i < argv.size() - 1; ++i) { // exclude nullptr
-        printf("  argv[%zu]: %s\n", i, argv[i]);
+    if (output != nullptr) {
+        output->stderr_fd = err_pipe[0];
+        output->log_fd    = log_fd;
+    } else {
+        close(log_fd);
     }
 
     std::cout << "[INFO] Launched " << entity.name << " (PID " << pid << ")\n";
     return pid;
 }
 
-std::vector<char*> ExecutionManager::buildArgv(const EntityConfig& entity)
+std::shared_ptr<const LaunchPlan> ExecutionManager::getPlan(const EntityConfig& entity)
+{
+    auto it = plans_.find(entity.name);
+    if (it != plans_.end()) {
+        return it->second;
+    }
+
+    std::shared_ptr<const LaunchPlan> plan = buildPlan(entity);
+    plans_[entity.name]                    = plan;
+    return plan;
+}
+
+std::shared_ptr<const LaunchPlan> ExecutionManager::buildPlan(const EntityConfig& entity)
 {
-    std::vector<char*> argv;
+    auto plan  = std::make_shared<LaunchPlan>();
+    plan->args = buildArgv(entity);
+    plan->env  = buildEnv(entity);
+    plan->path = resolveExecutable(plan->args[0]);
+
+    // Pointers are taken only after both string vectors are final.
+    for (auto& arg : plan->args) {
+        plan->argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    plan->argv.push_back(nullptr);
+
+    for (auto& var : plan->env) {
+        plan->envp.push_back(const_cast<char*>(var.c_str()));
+    }
+    plan->envp.push_back(nullptr);
+
+    printf("[DEBUG] Launch plan for entity \"%s\" (%s):\n", entity.name.c_str(), plan->path.c_str());
+    for (size_t i = 0; i < plan->args.size(); ++i) {
+        printf("  argv[%zu]: %s\n", i, plan->args[i].c_str());
+    }
+
+    return plan;
+}
+
+std::vector<std::string> ExecutionManager::buildArgv(const EntityConfig& entity)
+{
+    std::vector<std::string> argv;
 
     if (!entity.exec_with.empty()) {
-        argv.push_back(strdup(entity.exec_with.c_str()));
+        argv.push_back(entity.exec_with);
     }
 
-    std::string full_path = "/app/" + entity.binary_path;
-    argv.push_back(strdup(full_path.c_str()));
+    argv.push_back("/app/" + entity.binary_path);
 
     for (const auto& arg : entity.args) {
-        argv.push_back(strdup(arg.c_str()));
+        argv.push_back(arg);
     }
 
     if (entity.role == "client" && entity.connect_to.has_value()) {
-        argv.push_back(strdup(entity.connect_to->ip.c_str()));
-        argv.push_back(strdup(std::to_string(entity.connect_to->port).c_str()));
+        argv.push_back(entity.connect_to->ip);
+        argv.push_back(std::to_string(entity.connect_to->port));
     }
 
-    argv.push_back(nullptr); // terminator
-
     return argv;
 }
 
+std::vector<std::string> ExecutionManager::buildEnv(const EntityConfig& entity)
+{
+    std::vector<std::string> env;
+    std::string              preload;
+    std::string              asan_options;
+
+    for (char** var = environ; var && *var; ++var) {
+        if (strncmp(*var, "LD_PRELOAD=", strlen("LD_PRELOAD=")) == 0) {
+            preload = *var + strlen("LD_PRELOAD=");
+            continue;
+        }
+        if (strncmp(*var, "ASAN_OPTIONS=", strlen("ASAN_OPTIONS=")) == 0) {
+            asan_options = *var + strlen("ASAN_OPTIONS=");
+            continue;
+        }
+        if (strncmp(*var, "CEZ_COVERAGE_MAP=", strlen("CEZ_COVERAGE_MAP=")) == 0) {
+            continue;
+        }
+        env.push_back(*var);
+    }
+
+    for (const char** lib = STDBUF_LIBS; *lib; ++lib) {
+        if (access(*lib, R_OK) == 0) {
+            preload = preload.empty() ? *lib : preload + ":" + *lib;
+            env.push_back("_STDBUF_O=0"); // stdout non-buffered
+            env.push_back("_STDBUF_E=0"); // stderr non-buffered
+            break;
+        }
+    }
+
+    if (!preload.empty()) {
+        env.push_back("LD_PRELOAD=" + preload);
+        // ASan-instrumented targets refuse to start when another library is preloaded before the runtime.
+        asan_options = asan_options.empty() ? "verify_asan_link_order=0" : asan_options + ":verify_asan_link_order=0";
+    }
+
+    if (!asan_options.empty()) {
+        env.push_back("ASAN_OPTIONS=" + asan_options);
+    }
+
+    // Read by the coverage runtime of targets built with CEZ_COVERAGE (tests/coverage).
+    if (!entity.coverage_map.empty()) {
+        env.push_back("CEZ_COVERAGE_MAP=" + entity.coverage_map);
+    }
+
+    return env;
+}
+
+int ExecutionManager::openLogFile(const EntityConfig& entity, int index)
+{
+    std::string log_path = LOG_DIR "/" + entity.name + "_" + std::to_string(index) + ".log";
+
+    int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("[ERROR] open(log file)");
+    }
+    return fd;
+}
+
 } // namespace utils
@@ -3,20 +3,49 @@
 #include "ConfigurationManager.hpp"
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 #include <optional>
 #include <sys/types.h>
 
 namespace utils {
 
+/**
+ * Everything needed to spawn an entity, computed once per entity so that a
+ * (re)launch only has to open the log file and call posix_spawn().
+ */
+struct LaunchPlan {
+    std::string              path; // absolute path of the executable (no PATH lookup at spawn time)
+    std::vector<std::string> args;
+    std::vector<std::string> env;
+    std::vector<char*>       argv; // points into args, nullptr terminated
+    std::vector<char*>       envp; // points into env, nullptr terminated
+};
+
+/**
+ * Launcher-side ends of a child's output when stderr is captured: the read end
+ * of the stderr pipe (non-blocking) and the log file the output is copied to.
+ */
+struct ChildOutput {
+    int stderr_fd = -1;
+    int log_fd    = -1;
+};
+
 class ExecutionManager {
   public:
     ExecutionManager();
     explicit ExecutionManager(const ConfigurationManager& config);
-    std::optional<pid_t> launchEntity(const EntityConfig& entity, int index);
+    std::optional<pid_t> launchEntity(const EntityConfig& entity, int index, ChildOutput* output = nullptr);
 
   private:
-    ConfigurationManager config_;
-    std::vector<char*>   buildArgv(const EntityConfig& entity);
+    ConfigurationManager                                     config_;
+    std::map<std::string, std::shared_ptr<const LaunchPlan>> plans_;
+
+    std::shared_ptr<const LaunchPlan> getPlan(const EntityConfig& entity);
+    std::shared_ptr<const LaunchPlan> buildPlan(const EntityConfig& entity);
+    std::vector<std::string>          buildArgv(const EntityConfig& entity);
+    std::vector<std::string>          buildEnv(const EntityConfig& entity);
+    int                               openLogFile(const EntityConfig& entity, int index);
 };
 
 } // namespace utils
@@ -6,4 +6,16 @@
 
 #define CRASH "CRASH"
 
+/* Crash reports can also be sent as a single UDP datagram to this port on the
+ * launcher server (used by the proxy, which has no launcher connection). */
+#define NOTIFY_PORT 23928
+
+/* Periodic campaign statistics, pushed to the launcher server by the proxy (UDP,
+ * NOTIFY_PORT) and by launcher clients (their server connection):
+ *   STATS <role> <host> <key>=<value> ...
+ * Values are counters since the sender started, at started=<ms since the epoch>;
+ * the server turns them into rates. */
+#define STATS            "STATS"
+#define STATS_INTERVAL_S 5
+
 #endif
\ No newline at end of file
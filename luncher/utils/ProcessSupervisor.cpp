@@ -0,0 +1,430 @@
+#include "ProcessSupervisor.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+#define MAX_EVENTS   32
+#define PIPE_BUFFER  4096
+
+/*
+ * Watchdog sampling period, and the fraction of wall time a child must spend
+ * on the CPU during a period to count as busy.
+ */
+#define WATCHDOG_TICK_MS  100
+#define WATCHDOG_BUSY_PCT 75
+
+namespace utils {
+
+static int pidfd_open(pid_t pid)
+{
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int pidfd_send_signal(int pidfd, int sig)
+{
+    return (int) syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+static int64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * utime + stime of a process in milliseconds, from /proc/<pid>/stat.
+ */
+static int64_t cpu_time_ms(pid_t pid)
+{
+    char path[64];
+    char buffer[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    FILE* stat_file = fopen(path, "r");
+    if (stat_file == NULL) {
+        return -1;
+    }
+    size_t len = fread(buffer, 1, sizeof(buffer) - 1, stat_file);
+    fclose(stat_file);
+    buffer[len] = '\0';
+
+    // The command name may contain spaces; fields are counted from the closing parenthesis (field 2).
+    char* fields = strrchr(buffer, ')');
+    if (fields == NULL) {
+        return -1;
+    }
+
+    unsigned long utime = 0, stime = 0;
+    if (sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+
+    static long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    return (int64_t) (utime + stime) * 1000 / ticks_per_sec;
+}
+
+ProcessSupervisor::ProcessSupervisor()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+ProcessSupervisor::~ProcessSupervisor()
+{
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool ProcessSupervisor::start(ExitCallback on_exit)
+{
+    on_exit_  = std::move(on_exit);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        perror("[ERROR] epoll_create1 (supervisor)");
+        return false;
+    }
+
+    // Lets watch() interrupt an untimed epoll_wait once a child needs the watchdog tick.
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        perror("[ERROR] eventfd (supervisor)");
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+        return false;
+    }
+    struct epoll_event wev{};
+    wev.events  = EPOLLIN;
+    wev.data.fd = wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &wev);
+
+    if (pthread_create(&thread_, nullptr, loopEntry, this) != 0) {
+        perror("[ERROR] pthread_create (supervisor)");
+        close(wake_fd_);
+        close(epoll_fd_);
+        wake_fd_  = -1;
+        epoll_fd_ = -1;
+        return false;
+    }
+    pthread_detach(thread_);
+    return true;
+}
+
+/*
+ * A child that cannot be supervised would never be drained, stopped or reaped:
+ * its output is closed and it is killed and reaped right away.
+ */
+static void discard_child(pid_t pid, const std::string& name, int pidfd, const ChildOutput* output)
+{
+    if (output != nullptr) {
+        if (output->stderr_fd >= 0) {
+            close(output->stderr_fd);
+        }
+        if (output->log_fd >= 0) {
+            close(output->log_fd);
+        }
+    }
+    if (pidfd >= 0) {
+        pidfd_send_signal(pidfd, SIGKILL);
+        close(pidfd);
+    } else {
+        kill(pid, SIGKILL);
+    }
+    if (waitpid(pid, nullptr, 0) < 0) {
+        perror("[ERROR] waitpid (discarded child)");
+    }
+    printf("[WARN] Application %s (PID %d) could not be supervised and was killed\n", name.c_str(), pid);
+}
+
+bool ProcessSupervisor::watch(pid_t pid, const std::string& name, const ChildOutput* output, int hang_timeout_ms)
+{
+    int pidfd = pidfd_open(pid);
+    if (pidfd < 0) {
+        perror("[ERROR] pidfd_open");
+        discard_child(pid, name, -1, output);
+        return false;
+    }
+
+    Child child{};
+    child.pid    = pid;
+    child.name   = name;
+    child.parser = nullptr;
+    if (output != nullptr && output->stderr_fd >= 0) {
+        child.stderr_fd = output->stderr_fd;
+        child.log_fd    = output->log_fd;
+        child.parser    = std::make_shared<SanitizerStreamParser>();
+    }
+    child.hang_timeout_ms = hang_timeout_ms;
+    child.last_check_ms   = monotonic_ms();
+
+    pthread_mutex_lock(&mutex_);
+    children_[pidfd] = child;
+    if (child.stderr_fd >= 0) {
+        pipes_[child.stderr_fd] = pidfd;
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    // An unread pipe would stall the child once full, so failing to poll it fails the whole watch
+    bool registered = true;
+    if (child.stderr_fd >= 0) {
+        struct epoll_event pev{};
+        pev.events  = EPOLLIN;
+        pev.data.fd = child.stderr_fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, child.stderr_fd, &pev) < 0) {
+            perror("[ERROR] epoll_ctl (stderr pipe)");
+            registered = false;
+        }
+    }
+
+    struct epoll_event ev{};
+    ev.events  = EPOLLIN;
+    ev.data.fd = pidfd;
+    if (registered && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd, &ev) < 0) {
+        perror("[ERROR] epoll_ctl (pidfd)");
+        if (child.stderr_fd >= 0) {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, child.stderr_fd, nullptr);
+        }
+        registered = false;
+    }
+
+    if (!registered) {
+        pthread_mutex_lock(&mutex_);
+        children_.erase(pidfd);
+        if (child.stderr_fd >= 0) {
+            pipes_.erase(child.stderr_fd);
+        }
+        pthread_mutex_unlock(&mutex_);
+        discard_child(pid, name, pidfd, output);
+        return false;
+    }
+
+    if (hang_timeout_ms > 0) {
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            perror("[ERROR] write (supervisor wakeup)");
+        }
+    }
+
+    printf("[DEBUG] Supervising application %s (PID %d)\n", name.c_str(), pid);
+    return true;
+}
+
+/*
+ * Kills a child on purpose. The supervisor loop still reaps it, but its exit
+ * is not reported, so a RESTART never turns into a spurious CRASH.
+ */
+void ProcessSupervisor::stop(pid_t pid)
+{
+    pthread_mutex_lock(&mutex_);
+    for (auto& [pidfd, child] : children_) {
+        if (child.pid != pid) {
+            continue;
+        }
+        child.stopping = true;
+        // Signalling through the pidfd cannot hit a recycled PID.
+        if (pidfd_send_signal(pidfd, SIGKILL) == 0) {
+            printf("Process %d was terminated.\n", pid);
+        } else {
+            printf("Failed to terminate process %d.\n", pid);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void* ProcessSupervisor::loopEntry(void* arg)
+{
+    static_cast<ProcessSupervisor*>(arg)->loop();
+    return nullptr;
+}
+
+void ProcessSupervisor::loop()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, hasWatchdogs() ? WATCHDOG_TICK_MS : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] epoll_wait (supervisor)");
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                uint64_t count;
+                if (read(wake_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("[ERROR] read (supervisor wakeup)");
+                }
+                continue;
+            }
+
+            pthread_mutex_lock(&mutex_);
+            bool is_pipe = pipes_.count(fd) != 0;
+            pthread_mutex_unlock(&mutex_);
+
+            if (is_pipe) {
+                onPipeReadable(fd);
+            } else {
+                reap(fd);
+            }
+        }
+
+        checkWatchdogs();
+    }
+}
+
+bool ProcessSupervisor::hasWatchdogs()
+{
+    bool any = false;
+    pthread_mutex_lock(&mutex_);
+    for (auto& [pidfd, child] : children_) {
+        any = any || child.hang_timeout_ms > 0;
+    }
+    pthread_mutex_unlock(&mutex_);
+    return any;
+}
+
+/*
+ * A child that used at least WATCHDOG_BUSY_PCT of every sampling period for
+ * hang_timeout_ms is spinning (e.g. stuck in an endless parse loop). It is
+ * killed here and reported as a HANG once the pidfd fires.
+ */
+void ProcessSupervisor::checkWatchdogs()
+{
+    int64_t now = monotonic_ms();
+
+    pthread_mutex_lock(&mutex_);
+    for (auto& [pidfd, child] : children_) {
+        if (child.hang_timeout_ms <= 0 || child.hung || child.stopping ||
+            now - child.last_check_ms < WATCHDOG_TICK_MS) {
+            continue;
+        }
+
+        int64_t cpu = cpu_time_ms(child.pid);
+        if (cpu < 0) {
+            continue;
+        }
+
+        if (child.last_cpu_ms >= 0) {
+            bool busy = (cpu - child.last_cpu_ms) * 100 >= (now - child.last_check_ms) * WATCHDOG_BUSY_PCT;
+            if (!busy) {
+                child.busy_since_ms = -1;
+            } else if (child.busy_since_ms < 0) {
+                child.busy_since_ms = child.last_check_ms;
+            } else if (now - child.busy_since_ms >= child.hang_timeout_ms) {
+                printf("[WARN] Application %s (PID %d) spinning for %lld ms, killing it\n", child.name.c_str(),
+                       child.pid, (long long) (now - child.busy_since_ms));
+                child.hung = true;
+                pidfd_send_signal(pidfd, SIGKILL);
+            }
+        }
+
+        child.last_cpu_ms   = cpu;
+        child.last_check_ms = now;
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void ProcessSupervisor::reap(int pidfd)
+{
+    pthread_mutex_lock(&mutex_);
+    auto it = children_.find(pidfd);
+    if (it == children_.end()) {
+        pthread_mutex_unlock(&mutex_);
+        return;
+    }
+    Child child = it->second;
+    children_.erase(it);
+    if (child.stderr_fd >= 0) {
+        pipes_.erase(child.stderr_fd);
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pidfd, nullptr);
+
+    int status = 0;
+    if (waitpid(child.pid, &status, 0) < 0) {
+        perror("[ERROR] waitpid (supervisor)");
+    }
+    close(pidfd);
+
+    // Whatever the child wrote right before dying is still sitting in the pipe.
+    if (child.stderr_fd >= 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, child.stderr_fd, nullptr);
+        drain(child.stderr_fd, child.log_fd, child.parser.get());
+        child.parser->finish();
+        close(child.stderr_fd);
+        close(child.log_fd);
+    }
+
+    if (!child.stopping && on_exit_) {
+        CrashReport report = analyzeExitStatus(status, child.parser.get());
+        if (child.hung) {
+            report.crash_class = CRASH_CLASS_HANG;
+            report.hang_ms     = child.hang_timeout_ms;
+        }
+        on_exit_(child.pid, child.name, report);
+    }
+}
+
+void ProcessSupervisor::onPipeReadable(int stderr_fd)
+{
+    pthread_mutex_lock(&mutex_);
+    auto pit = pipes_.find(stderr_fd);
+    if (pit == pipes_.end()) {
+        pthread_mutex_unlock(&mutex_);
+        return;
+    }
+    Child& child = children_[pit->second];
+    int    log_fd = child.log_fd;
+    auto   parser = child.parser;
+    pthread_mutex_unlock(&mutex_);
+
+    drain(stderr_fd, log_fd, parser.get());
+}
+
+/*
+ * Reads everything currently available on a (non-blocking) stderr pipe,
+ * appends it to the log and feeds it to the sanitizer parser.
+ */
+void ProcessSupervisor::drain(int stderr_fd, int log_fd, SanitizerStreamParser* parser)
+{
+    char buffer[PIPE_BUFFER];
+
+    while (true) {
+        ssize_t len = read(stderr_fd, buffer, sizeof(buffer));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            // EOF keeps the pipe readable; stop polling it until the pidfd fires.
+            if (len == 0) {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, stderr_fd, nullptr);
+            }
+            return;
+        }
+
+        if (log_fd >= 0 && write(log_fd, buffer, len) < 0) {
+            perror("[ERROR] write (child log)");
+        }
+        parser->feed(buffer, len);
+    }
+}
+
+} // namespace utils
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "CrashAnalyzer.hpp"
+#include "ExecutionManager.hpp"
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+#include <pthread.h>
+#include <sys/types.h>
+
+namespace utils {
+
+/**
+ * Reaps every launched entity from a single epoll loop. Each child is tracked
+ * through a pidfd, which becomes readable the moment the process exits, so no
+ * thread has to block in waitpid() per child. Captured stderr pipes are
+ * drained by the same loop, copied to the child's log and scanned for
+ * sanitizer reports while the target is still running.
+ *
+ * Children watched with a hang timeout are also sampled every tick: one that
+ * keeps the CPU busy for the whole timeout is killed and reported as a HANG.
+ *
+ * watch() takes over the child and its output fds; if it fails, the child
+ * has already been killed and reaped and the fds closed.
+ */
+class ProcessSupervisor {
+  public:
+    using ExitCallback = std::function<void(pid_t pid, const std::string& name, const CrashReport& report)>;
+
+    ProcessSupervisor();
+    ~ProcessSupervisor();
+
+    bool start(ExitCallback on_exit);
+    bool watch(pid_t pid, const std::string& name, const ChildOutput* output = nullptr, int hang_timeout_ms = 0);
+    void stop(pid_t pid);
+
+  private:
+    struct Child {
+        pid_t       pid;
+        std::string name;
+        bool        stopping  = false; // killed on purpose, exit is not reported
+        int         stderr_fd = -1;
+        int         log_fd    = -1;
+
+        std::shared_ptr<SanitizerStreamParser> parser;
+
+        // CPU-time watchdog
+        int     hang_timeout_ms = 0;
+        bool    hung            = false;
+        int64_t last_cpu_ms     = -1;
+        int64_t last_check_ms   = 0;
+        int64_t busy_since_ms   = -1;
+    };
+
+    int                            epoll_fd_ = -1;
+    int                            wake_fd_  = -1;
+    pthread_t                      thread_;
+    pthread_mutex_t                mutex_;
+    ExitCallback                   on_exit_;
+    std::unordered_map<int, Child> children_; // pidfd -> child
+    std::unordered_map<int, int>   pipes_;    // stderr pipe -> pidfd
+
+    static void* loopEntry(void* arg);
+    void         loop();
+    void         reap(int pidfd);
+    void         drain(int stderr_fd, int log_fd, SanitizerStreamParser* parser);
+    void         onPipeReadable(int stderr_fd);
+    bool         hasWatchdogs();
+    void         checkWatchdogs();
+};
+
+} // namespace utils
@@ -0,0 +1,144 @@
+// corpus_bench: CorpusStore add, random view and reopen rates, and the anonymous memory (heap) it takes, for N inputs;
+// then the cost of a SeedScheduler pick per power schedule, as the corpus grows to N.
+// Usage: corpus_bench [inputs, default 1000000] [dir, default /tmp/corpus_bench]
+#include "CorpusStore.hpp"
+#include "SeedScheduler.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static volatile size_t sink; // keeps the picks from being optimized out
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long heap_kb()
+{
+    FILE* status = fopen("/proc/self/status", "r");
+    char  line[256];
+    long  kb = -1;
+    while (status && fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "RssAnon:", 8) == 0) {
+            kb = atol(line + 8);
+        }
+    }
+    if (status) {
+        fclose(status);
+    }
+    return kb;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t      inputs = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    std::string dir    = argc > 2 ? argv[2] : "/tmp/corpus_bench";
+    if (system(("rm -rf '" + dir + "'").c_str()) != 0) {
+        return 1;
+    }
+
+    std::vector<uint8_t> input(1024);
+    uint64_t             rng   = 0x9E3779B97F4A7C15ull;
+    size_t               bytes = 0;
+    {
+        CorpusStore store(dir);
+        if (!store.open()) {
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < inputs; ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            size_t size = 16 + rng % 1009;
+            memcpy(input.data(), &i, sizeof(i)); // unique
+            memcpy(input.data() + sizeof(i), &rng, sizeof(rng));
+            store.add(input.data(), size);
+            bytes += size;
+        }
+        double add_s = seconds_since(start);
+
+        // Adding them again only hashes and looks up
+        rng   = 0x9E3779B97F4A7C15ull;
+        start = std::chrono::steady_clock::now();
+        size_t again = 0;
+        for (size_t i = 0; i < inputs; ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            memcpy(input.data(), &i, sizeof(i));
+            memcpy(input.data() + sizeof(i), &rng, sizeof(rng));
+            again += store.add(input.data(), 16 + rng % 1009);
+        }
+        double dup_s = seconds_since(start);
+
+        start             = std::chrono::steady_clock::now();
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < inputs; ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            const uint8_t* data;
+            size_t         size;
+            if (store.view(rng % store.size(), data, size)) {
+                checksum += data[size - 1];
+            }
+        }
+        double view_s = seconds_since(start);
+
+        printf("inputs %zu (%.1f MB), stored %zu, duplicates re-added %zu\n", inputs, bytes / 1048576.0, store.size(),
+               again);
+        printf("add        %10.0f /s\n", inputs / add_s);
+        printf("add (dup)  %10.0f /s\n", inputs / dup_s);
+        printf("view       %10.0f /s (checksum %llu)\n", inputs / view_s, (unsigned long long) checksum);
+        printf("heap       %10ld kB\n", heap_kb());
+    }
+
+    auto        start = std::chrono::steady_clock::now();
+    CorpusStore store(dir);
+    if (!store.open()) {
+        return 1;
+    }
+    printf("reopen     %10.3f s, heap %ld kB\n", seconds_since(start), heap_kb());
+
+    const char* names[] = {"uniform", "explore", "fast", "coe"};
+    printf("\n%10s %10s %10s %10s %10s\n", "seeds", names[0], names[1], names[2], names[3]);
+    for (size_t seeds = 1000; seeds <= inputs; seeds *= 10) {
+        printf("%10zu", seeds);
+        for (PowerSchedule schedule : {SCHEDULE_UNIFORM, SCHEDULE_EXPLORE, SCHEDULE_FAST, SCHEDULE_COE}) {
+            SeedScheduler scheduler;
+            scheduler.setSchedule(schedule);
+            for (size_t i = 0; i < seeds; ++i) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                SeedInfo info;
+                info.path      = rng;
+                info.exec_us   = 50 + rng % 1000;
+                info.edges     = 10 + rng % 500;
+                info.new_edges = rng % 3 == 0;
+                scheduler.add(info, 16 + rng % 1009);
+                scheduler.hitPath(rng >> 20);
+            }
+            // Every pick is followed by the traffic of one message, as in guided mode
+            const size_t picks = 1000000;
+            size_t       sum   = 0;
+            start              = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < picks; ++i) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                sum += scheduler.pick(rng);
+                scheduler.hitPath(rng % (seeds * 4));
+            }
+            printf(" %7.0f ns", seconds_since(start) * 1e9 / picks);
+            sink += sum;
+        }
+        printf("  per pick\n");
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+// fill_bench: patternFill against the chunked memcpy loop Fuzzer.cpp used for repeat-padding.
+// Usage: fill_bench [iterations per case, default 20]
+#include "Fuzzer.hpp"
+#include "PatternFill.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static void naiveFill(uint8_t* dst, size_t target, const uint8_t* pattern, size_t pattern_len)
+{
+    size_t copied = 0;
+    while (copied < target) {
+        size_t toCopy = std::min(pattern_len, target - copied);
+        memcpy(dst + copied, pattern, toCopy);
+        copied += toCopy;
+    }
+}
+
+template <typename Fill>
+static double measure(Fill fill, uint8_t* dst, size_t target, const uint8_t* pattern, size_t pattern_len,
+                      int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fill(dst, target, pattern, pattern_len);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double) target * iterations / (1024.0 * 1024.0) / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+
+    const size_t patterns[] = {1, 5, 64, 1500};
+    const size_t targets[]  = {MIN_OUTPUT_SIZE, 4 * 1024 * 1024, 32 * 1024 * 1024};
+
+    std::vector<uint8_t> pattern(1500);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = (uint8_t) (i * 7 + 3);
+    }
+    std::vector<uint8_t> naive(targets[2]), fast(targets[2]);
+
+    printf("%10s %8s %14s %14s %8s\n", "target", "pattern", "naive MB/s", "fill MB/s", "same");
+    for (size_t target : targets) {
+        for (size_t pattern_len : patterns) {
+            double naive_mbs = measure(naiveFill, naive.data(), target, pattern.data(), pattern_len, iterations);
+            double fill_mbs  = measure(patternFill, fast.data(), target, pattern.data(), pattern_len, iterations);
+            bool   same      = memcmp(naive.data(), fast.data(), target) == 0;
+            printf("%10zu %8zu %14.1f %14.1f %8s\n", target, pattern_len, naive_mbs, fill_mbs, same ? "yes" : "NO");
+        }
+    }
+    return 0;
+}
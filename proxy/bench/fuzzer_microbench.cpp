@@ -0,0 +1,354 @@
+// fuzzer_microbench: FuzzerCore's fuzzing functions and mutation backends, input sizes 1 B - 64 KB.
+// Besides ns/op every case reports allocs/op, alloc_bytes/op and out_bytes/op: the radamsa modes and
+// normalizeOutputSize size their buffers by MIN_OUTPUT_SIZE/MAX_BUFFER_SIZE, not by the input.
+// post, pre, full and guided exec ./radamsa, so they need it in the working directory and are skipped otherwise.
+// Usage: fuzzer_microbench [Google Benchmark flags, e.g. --benchmark_filter=pass --benchmark_format=json]
+#include "Coverage.hpp"
+#include "Dictionary.hpp"
+#include "Fuzzer.hpp"
+#include "MutationKernels.hpp"
+#include "Schema.hpp"
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Every allocation of the process goes through these (operator new calls malloc too)
+static std::atomic<uint64_t> alloc_count{0};
+static std::atomic<uint64_t> alloc_bytes{0};
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(count * size, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+}
+
+#define MIN_INPUT_SIZE 1
+#define MAX_INPUT_SIZE (64 * 1024)
+
+// A textual request, so the dictionary finds its tokens in it
+static std::vector<uint8_t> makeInput(size_t size)
+{
+    static const char    text[] = "GET /index.html HTTP/1.1\r\nHost: bench\r\nUser-Agent: cez\r\n\r\n";
+    std::vector<uint8_t> input(size);
+    for (size_t i = 0; i < size; ++i) {
+        input[i] = (uint8_t) text[i % (sizeof(text) - 1)];
+    }
+    return input;
+}
+
+// type (uint8), length of payload (uint32), payload, crc32 of type..payload
+static std::vector<uint8_t> makeFramedInput(size_t size)
+{
+    std::vector<uint8_t> message = makeInput(size);
+    if (size >= 9) {
+        uint32_t payload = (uint32_t) (size - 9);
+        message[0]       = 1;
+        message[1]       = (uint8_t) (payload >> 24);
+        message[2]       = (uint8_t) (payload >> 16);
+        message[3]       = (uint8_t) (payload >> 8);
+        message[4]       = (uint8_t) payload;
+    }
+    return message;
+}
+
+static Schema* benchSchema()
+{
+    static Schema* schema = [] {
+        std::vector<utils::FieldConfig> fields(4);
+        fields[0].name        = "type";
+        fields[0].type        = "uint8";
+        fields[0].values      = {1, 2, 3};
+        fields[1].name        = "length";
+        fields[1].type        = "uint32";
+        fields[1].length_of   = {"payload"};
+        fields[2].name        = "payload";
+        fields[2].type        = "bytes";
+        fields[3].name        = "crc";
+        fields[3].type        = "uint32";
+        fields[3].checksum    = "crc32";
+        fields[3].checksum_of = {"type", "payload"};
+        for (auto& field : fields) {
+            field.endian = "big";
+        }
+        return Schema::compile("bench", fields);
+    }();
+    return schema;
+}
+
+static Dictionary* benchDictionary()
+{
+    static Dictionary* dictionary = new Dictionary({"GET", "POST", "HTTP/1.0", "Host:", "\\r\\n", "\\x00\\xff"});
+    return dictionary;
+}
+
+static Corpus* benchCorpus()
+{
+    static Corpus* corpus = [] {
+        Corpus* corpus = new Corpus();
+        for (size_t size : {16, 256, 4096}) {
+            std::vector<uint8_t> entry = makeInput(size);
+            corpus->add(entry.data(), entry.size());
+        }
+        return corpus;
+    }();
+    return corpus;
+}
+
+struct AllocSnapshot {
+    uint64_t count = alloc_count.load(std::memory_order_relaxed);
+    uint64_t bytes = alloc_bytes.load(std::memory_order_relaxed);
+};
+
+static void reportCounters(benchmark::State& state, const AllocSnapshot& before, uint64_t output, size_t input_size)
+{
+    AllocSnapshot after;
+    state.counters["allocs/op"] = benchmark::Counter((double) (after.count - before.count),
+                                                     benchmark::Counter::kAvgIterations);
+    state.counters["alloc_bytes/op"] = benchmark::Counter((double) (after.bytes - before.bytes),
+                                                          benchmark::Counter::kAvgIterations);
+    state.counters["out_bytes/op"]   = benchmark::Counter((double) output, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed((int64_t) (state.iterations() * input_size));
+}
+
+static bool haveRadamsa(benchmark::State& state)
+{
+    if (access("./radamsa", X_OK) == 0) {
+        return true;
+    }
+    state.SkipWithError("no ./radamsa in the working directory");
+    return false;
+}
+
+// Runs one fuzzing function that returns a malloc()ed buffer, as the forwarding threads do
+template <typename Fuzz>
+static void runFuzz(benchmark::State& state, const std::vector<uint8_t>& input, Fuzz fuzz)
+{
+    uint64_t      output = 0;
+    AllocSnapshot before;
+    for (auto _ : state) {
+        size_t   newSize = 0;
+        uint8_t* out     = fuzz(input.data(), input.size(), newSize);
+        benchmark::DoNotOptimize(out);
+        output += newSize;
+        free(out);
+    }
+    reportCounters(state, before, output, input.size());
+}
+
+static void BM_pass(benchmark::State& state)
+{
+    FuzzerCore fuzzer(FUZZSTYLE_RANDOMIZATION, FUZZMODE_PASS);
+    runFuzz(state, makeInput(state.range(0)),
+            [&](const uint8_t* in, size_t size, size_t& newSize) { return fuzzer.pass(in, size, newSize); });
+}
+
+static void BM_normalizeOutputSize(benchmark::State& state)
+{
+    FuzzerCore fuzzer;
+    runFuzz(state, makeInput(state.range(0)), [&](const uint8_t* in, size_t size, size_t& newSize) {
+        return fuzzer.normalizeOutputSize((uint8_t*) in, size, newSize);
+    });
+}
+
+static void BM_postFuzzing(benchmark::State& state)
+{
+    FuzzerCore fuzzer;
+    if (haveRadamsa(state)) {
+        runFuzz(state, makeInput(state.range(0)),
+                [&](const uint8_t* in, size_t size, size_t& newSize) { return fuzzer.postFuzzing(in, size, newSize); });
+    }
+}
+
+static void BM_preFuzzing(benchmark::State& state)
+{
+    FuzzerCore fuzzer;
+    if (haveRadamsa(state)) {
+        runFuzz(state, makeInput(state.range(0)),
+                [&](const uint8_t* in, size_t size, size_t& newSize) { return fuzzer.preFuzzing(in, size, newSize); });
+    }
+}
+
+static void BM_fullFuzzing(benchmark::State& state)
+{
+    FuzzerCore fuzzer;
+    if (haveRadamsa(state)) {
+        runFuzz(state, makeInput(state.range(0)),
+                [&](const uint8_t* in, size_t size, size_t& newSize) { return fuzzer.fullFuzzing(in, size, newSize); });
+    }
+}
+
+// Seeds from the corpus and mutators picked at random: schema, tokens or radamsa
+static void BM_guidedFuzzing(benchmark::State& state)
+{
+    FuzzerCore  fuzzer(FUZZSTYLE_RANDOMIZATION, FUZZMODE_GUIDED);
+    FuzzContext context;
+    context.corpus     = benchCorpus();
+    context.dictionary = benchDictionary();
+    context.schema     = benchSchema();
+    if (haveRadamsa(state)) {
+        runFuzz(state, makeFramedInput(state.range(0)), [&](const uint8_t* in, size_t size, size_t& newSize) {
+            return fuzzer.guidedFuzzing(in, size, newSize, context);
+        });
+    }
+}
+
+static void BM_deterministicFuzzing(benchmark::State& state)
+{
+    FuzzerCore fuzzer(FUZZSTYLE_RANDOMIZATION, FUZZMODE_DETERMINISTIC);
+    runFuzz(state, makeInput(state.range(0)), [&](const uint8_t* in, size_t size, size_t& newSize) {
+        return fuzzer.deterministicFuzzing(in, size, newSize);
+    });
+}
+
+static void BM_dictionaryFuzzing(benchmark::State& state)
+{
+    FuzzerCore fuzzer(FUZZSTYLE_RANDOMIZATION, FUZZMODE_DICTIONARY);
+    runFuzz(state, makeInput(state.range(0)), [&](const uint8_t* in, size_t size, size_t& newSize) {
+        return fuzzer.dictionaryFuzzing(in, size, newSize, benchDictionary());
+    });
+}
+
+// Messages shorter than the schema's fixed fields fall back to token mutations
+static void BM_schemaFuzzing(benchmark::State& state)
+{
+    FuzzerCore  fuzzer(FUZZSTYLE_RANDOMIZATION, FUZZMODE_SCHEMA);
+    FuzzContext context;
+    context.dictionary = benchDictionary();
+    context.schema     = benchSchema();
+    runFuzz(state, makeFramedInput(state.range(0)), [&](const uint8_t* in, size_t size, size_t& newSize) {
+        return fuzzer.schemaFuzzing(in, size, newSize, context);
+    });
+}
+
+// Backends on their own, mutating in place: no output buffer
+static void BM_deterministicStage(benchmark::State& state)
+{
+    std::vector<uint8_t> buffer = makeInput(state.range(0));
+    uint32_t             stage  = 0;
+    AllocSnapshot        before;
+    for (auto _ : state) {
+        FuzzerCore::applyDeterministicStage(buffer.data(), buffer.size(), stage++);
+        benchmark::ClobberMemory();
+    }
+    reportCounters(state, before, 0, buffer.size());
+}
+
+static void BM_tokenMutations(benchmark::State& state)
+{
+    std::vector<uint8_t> input = makeInput(state.range(0));
+    std::vector<uint8_t> buffer;
+    uint32_t             random = 0x9E3779B9;
+    uint64_t             output = 0;
+    AllocSnapshot        before;
+    for (auto _ : state) {
+        buffer = input;
+        FuzzerCore::applyTokenMutations(buffer, *benchDictionary(), random++);
+        output += buffer.size();
+    }
+    reportCounters(state, before, output, input.size());
+}
+
+static void BM_schemaMutate(benchmark::State& state)
+{
+    std::vector<uint8_t> input = makeFramedInput(state.range(0));
+    std::vector<uint8_t> out;
+    uint32_t             random = 0x6C8E9CF5;
+    uint64_t             output = 0;
+    AllocSnapshot        before;
+    for (auto _ : state) {
+        out.clear();
+        benchSchema()->mutate(input.data(), input.size(), out, random++, benchDictionary());
+        output += out.size();
+    }
+    reportCounters(state, before, output, input.size());
+}
+
+#define SIZE_SWEEP RangeMultiplier(4)->Range(MIN_INPUT_SIZE, MAX_INPUT_SIZE)
+
+BENCHMARK(BM_pass)->SIZE_SWEEP;
+BENCHMARK(BM_normalizeOutputSize)->SIZE_SWEEP;
+BENCHMARK(BM_postFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_preFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_fullFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_guidedFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_deterministicFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_dictionaryFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_schemaFuzzing)->SIZE_SWEEP;
+BENCHMARK(BM_deterministicStage)->SIZE_SWEEP;
+BENCHMARK(BM_tokenMutations)->SIZE_SWEEP;
+BENCHMARK(BM_schemaMutate)->SIZE_SWEEP;
+
+// The SIMD kernels, once per ISA this CPU supports (BM_kernel/<kernel>/<isa>/<size>)
+static void registerKernels()
+{
+    struct KernelRun {
+        const char* name;
+        void (*run)(const MutationKernels& kernels, uint8_t* buf, size_t len, uint32_t i);
+    };
+    static const KernelRun runs[] = {
+        {"flip", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.flip(b, n, 1u << (i & 31)); }},
+        {"add8", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add8(b, n, (int8_t) (i | 1)); }},
+        {"add16",
+         [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add16(b, n, (int16_t) (i | 1)); }},
+        {"add32",
+         [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add32(b, n, (int32_t) (i | 1)); }},
+        {"substitute",
+         [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.substitute(b, n, (uint8_t) i, 0x7f); }},
+    };
+
+    const MutationKernels* variants[3];
+    int                    count = MutationKernels::available(variants, 3);
+    for (const KernelRun& run : runs) {
+        for (int v = 0; v < count; ++v) {
+            const MutationKernels* kernels = variants[v];
+            std::string            name    = std::string("BM_kernel/") + run.name + "/" + kernels->isa;
+            benchmark::RegisterBenchmark(name.c_str(), [kernels, &run](benchmark::State& state) {
+                std::vector<uint8_t> buffer = makeInput(state.range(0));
+                uint32_t             i      = 0;
+                AllocSnapshot        before;
+                for (auto _ : state) {
+                    run.run(*kernels, buffer.data(), buffer.size(), i++);
+                    benchmark::ClobberMemory();
+                }
+                reportCounters(state, before, 0, buffer.size());
+            })->SIZE_SWEEP;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    registerKernels();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
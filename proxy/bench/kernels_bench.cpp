@@ -0,0 +1,63 @@
+// kernels_bench: throughput of every mutation kernel for every ISA the CPU supports.
+// Usage: kernels_bench [total MB per kernel, default 256]
+#include "Fuzzer.hpp"
+#include "MutationKernels.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_BUFFER_SIZE (64 * BATCH) // 256 KB, stays in L2
+
+struct KernelRun {
+    const char* name;
+    void (*run)(const MutationKernels& kernels, uint8_t* block, size_t len, uint32_t i);
+};
+
+static const KernelRun RUNS[] = {
+    {"flip", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.flip(b, n, 1u << (i & 31)); }},
+    {"add8", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add8(b, n, (int8_t) (i | 1)); }},
+    {"add16", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add16(b, n, (int16_t) (i | 1)); }},
+    {"add32", [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.add32(b, n, (int32_t) (i | 1)); }},
+    {"substitute",
+     [](const MutationKernels& k, uint8_t* b, size_t n, uint32_t i) { k.substitute(b, n, (uint8_t) i, 0x7f); }},
+};
+
+int main(int argc, char* argv[])
+{
+    size_t total_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+    size_t rounds   = total_mb * 1024 * 1024 / BENCH_BUFFER_SIZE;
+
+    std::vector<uint8_t> buffer(BENCH_BUFFER_SIZE);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = (uint8_t) (i * 131 + 7);
+    }
+
+    const MutationKernels* variants[3];
+    int                    count = MutationKernels::available(variants, 3);
+
+    printf("%-12s %-8s %12s\n", "kernel", "isa", "MB/s");
+    for (const KernelRun& run : RUNS) {
+        for (int v = 0; v < count; ++v) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < rounds; ++r) {
+                // Same BATCH-sized blocks FuzzerCore's substitution stages work on
+                for (size_t offset = 0; offset < buffer.size(); offset += BATCH) {
+                    run.run(*variants[v], buffer.data() + offset, BATCH, (uint32_t) r);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double mb      = (double) rounds * BENCH_BUFFER_SIZE / (1024.0 * 1024.0);
+            printf("%-12s %-8s %12.1f\n", run.name, variants[v]->isa, mb / seconds);
+        }
+    }
+
+    // Keeps the compiler from discarding the work
+    uint32_t checksum = 0;
+    for (uint8_t byte : buffer) {
+        checksum = checksum * 31 + byte;
+    }
+    printf("checksum %08x\n", checksum);
+    return 0;
+}
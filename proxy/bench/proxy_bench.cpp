@@ -0,0 +1,571 @@
+// proxy_bench: end-to-end throughput and latency of proxy_fuzzer on loopback, per fuzz mode.
+// UDP and TCP echo servers run in this process; proxy_fuzzer is started once per mode with a generated config
+// in plain forwarding mode (`udp_transparent: false`), so neither Docker nor iptables nor root is needed.
+// Each client keeps one message in flight: client -> proxy -> echo -> proxy -> client. The latency is that round
+// trip (two proxy hops); a TCP reply is timed to its first byte, since fuzzing changes the sizes.
+// Modes that run radamsa (post, pre, full) are skipped unless --radamsa names its binary.
+// Usage: proxy_bench [--proxy PATH] [--modes pass,deterministic,...] [--sizes 64,1400] [--rate MSGS_PER_SEC]
+//                    [--udp-clients N] [--tcp-connections N] [--seconds S] [--port BASE] [--udp-workers N]
+//                    [--radamsa PATH] [--out FILE]
+// Prints one JSON document (to FILE with --out).
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PROXY_FUZZER_PATH
+#define PROXY_FUZZER_PATH "./proxy_fuzzer"
+#endif
+
+#define REPLY_TIMEOUT_MS 200  // a reply later than this counts as lost
+#define READY_TIMEOUT_MS 5000 // how long the proxy gets to open its ports
+
+struct Options {
+    std::string              proxy = PROXY_FUZZER_PATH;
+    std::vector<std::string> modes = {"pass", "deterministic", "dictionary", "guided", "schema", "post", "pre", "full"};
+    std::vector<size_t>      sizes = {64, 512, 1400, 8192};
+    double                   rate  = 0; // messages per second per transport, 0 = as fast as replies come
+    int                      udp_clients     = 4;
+    int                      tcp_connections = 2;
+    double                   seconds         = 2;
+    int                      port            = 47000; // base of the 7 ports used
+    int                      udp_workers     = 1;
+    std::string              radamsa;
+    std::string              out;
+};
+
+struct Result {
+    uint64_t             sent    = 0;
+    uint64_t             replies = 0;
+    uint64_t             bytes   = 0; // reply bytes
+    std::vector<int64_t> latencies_ns;
+};
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static sockaddr_in loopback(int port)
+{
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+static std::vector<std::string> splitList(const char* list)
+{
+    std::vector<std::string> items;
+    std::string              item;
+    for (const char* c = list;; ++c) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+            item.clear();
+            if (*c == '\0') {
+                break;
+            }
+        } else {
+            item += *c;
+        }
+    }
+    return items;
+}
+
+static bool usesRadamsa(const std::string& mode)
+{
+    return mode == "post" || mode == "pre" || mode == "full";
+}
+
+// ---------------------------------------------------------------- echo servers
+
+static void udpEcho(int sock)
+{
+    std::vector<uint8_t> buffer(65536);
+    while (true) {
+        sockaddr_in src{};
+        socklen_t   len = sizeof(src);
+        ssize_t     n   = recvfrom(sock, buffer.data(), buffer.size(), 0, (sockaddr*) &src, &len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] [udp echo] recvfrom");
+            return;
+        }
+        sendto(sock, buffer.data(), (size_t) n, 0, (sockaddr*) &src, len);
+    }
+}
+
+static void tcpEchoConnection(int fd)
+{
+    std::vector<uint8_t> buffer(65536);
+    while (true) {
+        ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t sent = 0; sent < n;) {
+            ssize_t w = send(fd, buffer.data() + sent, (size_t) (n - sent), MSG_NOSIGNAL);
+            if (w <= 0) {
+                close(fd);
+                return;
+            }
+            sent += w;
+        }
+    }
+    close(fd);
+}
+
+static void tcpEcho(int listen_fd)
+{
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[ERROR] [tcp echo] accept");
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(tcpEchoConnection, fd).detach();
+    }
+}
+
+static bool startEchoServers(int udp_port, int tcp_port)
+{
+    int         one  = 1;
+    sockaddr_in addr = loopback(udp_port);
+    int         udp  = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp < 0 || bind(udp, (sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("[ERROR] UDP echo bind");
+        return false;
+    }
+    addr    = loopback(tcp_port);
+    int tcp = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(tcp, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (tcp < 0 || bind(tcp, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(tcp, 64) < 0) {
+        perror("[ERROR] TCP echo bind");
+        return false;
+    }
+    std::thread(udpEcho, udp).detach();
+    std::thread(tcpEcho, tcp).detach();
+    return true;
+}
+
+// ---------------------------------------------------------------- proxy
+
+static std::string writeConfig(const Options& options, const std::string& dir, const std::string& mode)
+{
+    int  p = options.port;
+    char yaml[4096];
+    snprintf(yaml, sizeof(yaml),
+             "entities:\n"
+             "  bench_udp_client:\n"
+             "    {role: client, protocol: udp, ip: 127.0.0.1, port: -1, fuzzed: false, binary_path: '',\n"
+             "     exec_with: ''}\n"
+             "  bench_udp_echo:\n"
+             "    {role: server, protocol: udp, ip: 127.0.0.1, port: %d, fuzzed: true, binary_path: '',\n"
+             "     exec_with: ''}\n"
+             "  bench_tcp_echo:\n"
+             "    {role: server, protocol: tcp, ip: 127.0.0.1, port: %d, fuzzed: true, binary_path: '',\n"
+             "     exec_with: ''}\n"
+             "  bench_proxy:\n"
+             "    role: fuzzer\n"
+             "    ip: 127.0.0.1\n"
+             "    port: 0\n"
+             "    fuzzed: true\n"
+             "    binary_path: ''\n"
+             "    exec_with: ''\n"
+             "    fuzz_mode: %s\n"
+             "    udp_transparent: false\n"
+             "    udp_workers: %d\n"
+             "    connections:\n"
+             "      - {entityA_ip: 127.0.0.1, entityA_port: -1, entityA_proxy_port_recv: %d, "
+             "entityA_proxy_port_send: %d,\n"
+             "         entityB_ip: 127.0.0.1, entityB_port: %d, entityB_proxy_port_recv: %d, "
+             "entityB_proxy_port_send: %d}\n"
+             "    tcp_redirections:\n"
+             "      - {server_ip: 127.0.0.1, server_port: %d, proxy_port: %d}\n",
+             p, p + 1, mode.c_str(), options.udp_workers, p + 2, p + 4, p, p + 3, p + 5, p + 1, p + 6);
+
+    std::string path = dir + "/" + mode + ".yaml";
+    FILE*       file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        perror("[ERROR] fopen config");
+        return "";
+    }
+    fputs(yaml, file);
+    fclose(file);
+    return path;
+}
+
+// Runs the proxy in `dir` (where radamsa is linked as ./radamsa), its output in <dir>/<mode>.log
+static pid_t startProxy(const Options& options, const std::string& dir, const std::string& mode,
+                        const std::string& config)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[ERROR] fork");
+        return -1;
+    }
+    if (pid == 0) {
+        std::string log = dir + "/" + mode + ".log";
+        int         fd  = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (chdir(dir.c_str()) < 0) {
+            perror("[ERROR] chdir");
+        }
+        execl(options.proxy.c_str(), options.proxy.c_str(), config.c_str(), (char*) nullptr);
+        perror("[ERROR] execl proxy_fuzzer");
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stopProxy(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// Until a probe datagram comes back through the proxy's UDP side
+static bool waitReady(pid_t pid, int udp_port)
+{
+    int         sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in dst  = loopback(udp_port);
+    connect(sock, (sockaddr*) &dst, sizeof(dst));
+
+    bool    ready    = false;
+    int64_t deadline = nowNs() + (int64_t) READY_TIMEOUT_MS * 1000000;
+    while (!ready && nowNs() < deadline && waitpid(pid, nullptr, WNOHANG) == 0) {
+        send(sock, "ready?", 6, 0);
+        struct pollfd pfd = {sock, POLLIN, 0};
+        if (poll(&pfd, 1, 100) == 1) {
+            char reply[65536];
+            ready = recv(sock, reply, sizeof(reply), 0) >= 0;
+        }
+    }
+    close(sock);
+    return ready;
+}
+
+// ---------------------------------------------------------------- clients
+
+static int connectClient(bool tcp, int port)
+{
+    sockaddr_in dst  = loopback(port);
+    int64_t     till = nowNs() + (int64_t) READY_TIMEOUT_MS * 1000000;
+    while (nowNs() < till) {
+        int sock = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+        if (sock < 0) {
+            perror("[ERROR] socket");
+            return -1;
+        }
+        if (connect(sock, (sockaddr*) &dst, sizeof(dst)) == 0) {
+            int one = 1;
+            if (tcp) {
+                setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            return sock;
+        }
+        close(sock);
+        usleep(50000);
+    }
+    fprintf(stderr, "[ERROR] Cannot connect to the proxy on port %d\n", port);
+    return -1;
+}
+
+// One message in flight on `sock` until `end_ns`; `interval_ns` paces the sends (0 = back to back)
+static void runClient(int sock, bool tcp, bool exact, size_t size, int64_t end_ns, int64_t interval_ns,
+                      Result& result)
+{
+    std::vector<uint8_t> message(size, 'A');
+    std::vector<uint8_t> reply(65536);
+    int64_t              next_ns = nowNs();
+
+    while (nowNs() < end_ns) {
+        if (interval_ns > 0) {
+            int64_t wait_ns = next_ns - nowNs();
+            if (wait_ns > 0) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait_ns));
+            }
+            next_ns += interval_ns;
+        }
+        // Whatever is left of earlier replies does not belong to this message
+        while (recv(sock, reply.data(), reply.size(), MSG_DONTWAIT) > 0) {
+        }
+
+        int64_t start_ns = nowNs();
+        if (send(sock, message.data(), size, MSG_NOSIGNAL) < 0) {
+            perror("[ERROR] send");
+            return;
+        }
+        ++result.sent;
+
+        // `exact`: the reply is as long as the message (pass mode), so a TCP reply is read to its end
+        size_t  got     = 0;
+        int64_t first   = 0;
+        do {
+            struct pollfd pfd = {sock, POLLIN, 0};
+            if (poll(&pfd, 1, REPLY_TIMEOUT_MS) != 1) {
+                break;
+            }
+            ssize_t n = recv(sock, reply.data(), reply.size(), 0);
+            if (n < 0) {
+                break;
+            }
+            if (first == 0) {
+                first = nowNs();
+            }
+            got += (size_t) n;
+        } while (tcp && exact && got < size);
+
+        if (first != 0) {
+            ++result.replies;
+            result.bytes += got;
+            result.latencies_ns.push_back(first - start_ns);
+        }
+    }
+}
+
+/*
+ * Connects `clients` sockets through the proxy and waits for one round trip on
+ * each: the proxy sets up TCP connections one after the other, taking a while
+ * for each, and that should not count against the first measurement.
+ */
+static std::vector<int> openClients(bool tcp, int port, int clients)
+{
+    std::vector<int> socks;
+    for (int i = 0; i < clients; ++i) {
+        int sock = connectClient(tcp, port);
+        if (sock >= 0) {
+            socks.push_back(sock);
+        }
+    }
+    for (int sock : socks) {
+        char          reply[65536];
+        struct pollfd pfd = {sock, POLLIN, 0};
+        if (send(sock, "warmup", 6, MSG_NOSIGNAL) < 0 || poll(&pfd, 1, READY_TIMEOUT_MS) != 1 ||
+            recv(sock, reply, sizeof(reply), 0) <= 0) {
+            fprintf(stderr, "[WARN] No warm-up reply through the proxy on port %d\n", port);
+        }
+    }
+    return socks;
+}
+
+static Result runTraffic(const std::vector<int>& socks, bool tcp, bool exact, size_t size, const Options& options)
+{
+    std::vector<Result>      results(socks.size());
+    std::vector<std::thread> threads;
+    int64_t interval_ns = options.rate > 0 ? (int64_t) (1e9 * (double) socks.size() / options.rate) : 0;
+    int64_t end_ns      = nowNs() + (int64_t) (options.seconds * 1e9);
+    for (size_t i = 0; i < socks.size(); ++i) {
+        threads.emplace_back(runClient, socks[i], tcp, exact, size, end_ns, interval_ns, std::ref(results[i]));
+    }
+
+    Result total;
+    for (size_t i = 0; i < socks.size(); ++i) {
+        threads[i].join();
+        total.sent += results[i].sent;
+        total.replies += results[i].replies;
+        total.bytes += results[i].bytes;
+        total.latencies_ns.insert(total.latencies_ns.end(), results[i].latencies_ns.begin(),
+                                  results[i].latencies_ns.end());
+    }
+    return total;
+}
+
+// ---------------------------------------------------------------- report
+
+static double percentileUs(std::vector<int64_t>& sorted, double q)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, (size_t) (q * (double) sorted.size()));
+    return (double) sorted[index] / 1000.0;
+}
+
+static std::string jsonResult(const std::string& mode, const char* transport, size_t size, int clients,
+                              const Options& options, Result& result)
+{
+    std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+    char line[512];
+    snprintf(line, sizeof(line),
+             "    {\"mode\": \"%s\", \"transport\": \"%s\", \"size\": %zu, \"clients\": %d, \"sent\": %llu, "
+             "\"replies\": %llu, \"lost\": %llu, \"pps\": %.1f, \"bytes_per_sec\": %.1f, "
+             "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f}",
+             mode.c_str(), transport, size, clients, (unsigned long long) result.sent,
+             (unsigned long long) result.replies, (unsigned long long) (result.sent - result.replies),
+             (double) result.replies / options.seconds, (double) result.bytes / options.seconds,
+             percentileUs(result.latencies_ns, 0.50), percentileUs(result.latencies_ns, 0.99),
+             percentileUs(result.latencies_ns, 0.999));
+    return line;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "[ERROR] %s needs a value\n", arg.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--proxy") {
+            options.proxy = value;
+        } else if (arg == "--modes") {
+            options.modes = splitList(value);
+        } else if (arg == "--sizes") {
+            options.sizes.clear();
+            for (const auto& size : splitList(value)) {
+                options.sizes.push_back(std::min<size_t>(std::max(atoi(size.c_str()), 1), 65507));
+            }
+        } else if (arg == "--rate") {
+            options.rate = atof(value);
+        } else if (arg == "--udp-clients") {
+            options.udp_clients = atoi(value);
+        } else if (arg == "--tcp-connections") {
+            options.tcp_connections = atoi(value);
+        } else if (arg == "--seconds") {
+            options.seconds = atof(value);
+        } else if (arg == "--port") {
+            options.port = atoi(value);
+        } else if (arg == "--udp-workers") {
+            options.udp_workers = atoi(value);
+        } else if (arg == "--radamsa") {
+            options.radamsa = value;
+        } else if (arg == "--out") {
+            options.out = value;
+        } else {
+            fprintf(stderr, "[ERROR] Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return options.seconds > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s [--proxy PATH] [--modes a,b] [--sizes 64,1400] [--rate N] [--udp-clients N] "
+                        "[--tcp-connections N] [--seconds S] [--port BASE] [--udp-workers N] [--radamsa PATH] "
+                        "[--out FILE]\n",
+                argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    char dir_template[] = "/tmp/proxy_bench.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        perror("[ERROR] mkdtemp");
+        return 1;
+    }
+    std::string dir = dir_template;
+    if (!options.radamsa.empty()) {
+        char* radamsa = realpath(options.radamsa.c_str(), nullptr);
+        if (radamsa == nullptr || symlink(radamsa, (dir + "/radamsa").c_str()) < 0) {
+            perror("[WARN] radamsa");
+            options.radamsa.clear();
+        }
+        free(radamsa);
+    }
+    if (!startEchoServers(options.port, options.port + 1)) {
+        return 1;
+    }
+    fprintf(stderr, "[INFO] proxy_bench: %s, logs and configs in %s\n", options.proxy.c_str(), dir.c_str());
+
+    std::vector<std::string> results;
+    std::vector<std::string> skipped;
+    for (const auto& mode : options.modes) {
+        if (usesRadamsa(mode) && options.radamsa.empty()) {
+            skipped.push_back("\"" + mode + "\"");
+            continue;
+        }
+        std::string config = writeConfig(options, dir, mode);
+        pid_t       pid    = config.empty() ? -1 : startProxy(options, dir, mode, config);
+        if (pid < 0) {
+            return 1;
+        }
+        if (!waitReady(pid, options.port + 2)) {
+            fprintf(stderr, "[ERROR] proxy_fuzzer (%s) did not come up, see %s/%s.log\n", mode.c_str(), dir.c_str(),
+                    mode.c_str());
+            stopProxy(pid);
+            return 1;
+        }
+
+        bool             exact   = mode == "pass";
+        std::vector<int> udp_fds = openClients(false, options.port + 2, options.udp_clients);
+        std::vector<int> tcp_fds = openClients(true, options.port + 6, options.tcp_connections);
+        for (size_t size : options.sizes) {
+            if (!udp_fds.empty()) {
+                fprintf(stderr, "[INFO] %s udp %zu bytes\n", mode.c_str(), size);
+                Result udp = runTraffic(udp_fds, false, exact, size, options);
+                results.push_back(jsonResult(mode, "udp", size, (int) udp_fds.size(), options, udp));
+            }
+            if (!tcp_fds.empty()) {
+                fprintf(stderr, "[INFO] %s tcp %zu bytes\n", mode.c_str(), size);
+                Result tcp = runTraffic(tcp_fds, true, exact, size, options);
+                results.push_back(jsonResult(mode, "tcp", size, (int) tcp_fds.size(), options, tcp));
+            }
+        }
+        for (int fd : udp_fds) {
+            close(fd);
+        }
+        for (int fd : tcp_fds) {
+            close(fd);
+        }
+        stopProxy(pid);
+    }
+
+    std::string json = "{\n  \"seconds\": " + std::to_string(options.seconds) +
+                       ",\n  \"rate\": " + std::to_string(options.rate) +
+                       ",\n  \"udp_workers\": " + std::to_string(options.udp_workers) + ",\n  \"skipped\": [";
+    for (size_t i = 0; i < skipped.size(); ++i) {
+        json += (i ? ", " : "") + skipped[i];
+    }
+    json += "],\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        json += results[i] + (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json += "  ]\n}\n";
+
+    FILE* out = options.out.empty() ? stdout : fopen(options.out.c_str(), "w");
+    if (out == nullptr) {
+        perror("[ERROR] fopen --out");
+        return 1;
+    }
+    fputs(json.c_str(), out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
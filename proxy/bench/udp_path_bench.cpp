@@ -0,0 +1,84 @@
+// udp_path_bench: cost per datagram of the UDP forwarding send path over loopback.
+//   copy   - the old path: zeroed 65,500-byte stack payload, memcpy of the fuzzer output, sendto
+//   direct - UDPTrain without GSO: sendto straight from the fuzzer output
+//   gso    - UDPTrain with UDP_SEGMENT trains (when the kernel supports it)
+// Every case starts from a malloc()ed copy of the message, standing in for the fuzzer output.
+// Usage: udp_path_bench [datagrams per case, default 200000]
+#include "UDPHandler.hpp"
+#include "UDPOffload.hpp"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+__attribute__((noinline)) static void copyPath(int sock, const sockaddr_in& dst, uint8_t* fuzzedBuf, size_t fuzzedSize)
+{
+    uint8_t _UDPPayload[MAX_UDP_PAYLOAD_SIZE] = {0};
+    size_t  _UDPPayloadSize = fuzzedSize > (MAX_UDP_PAYLOAD_SIZE - 1) ? (MAX_UDP_PAYLOAD_SIZE - 1) : fuzzedSize;
+    memcpy(_UDPPayload, fuzzedBuf, _UDPPayloadSize);
+    sendto(sock, _UDPPayload, _UDPPayloadSize, 0, (const sockaddr*) &dst, sizeof(dst));
+    free(fuzzedBuf);
+}
+
+static uint8_t* fuzzerOutput(const std::vector<uint8_t>& message)
+{
+    uint8_t* out = (uint8_t*) malloc(message.size());
+    memcpy(out, message.data(), message.size());
+    return out;
+}
+
+template <typename Send> static double nsPerDatagram(Send send, int count)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        send();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * 1e9 / count;
+}
+
+int main(int argc, char* argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+
+    // Nobody reads the sink: the datagrams go through the whole send path and are dropped once its queue is full
+    int         sink = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in dst{};
+    dst.sin_family      = AF_INET;
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len       = sizeof(dst);
+    if (sink < 0 || bind(sink, (sockaddr*) &dst, sizeof(dst)) < 0 || getsockname(sink, (sockaddr*) &dst, &len) < 0) {
+        perror("[ERROR] sink socket");
+        return 1;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+    bool gso = udpGsoSupported();
+    printf("%8s %12s %12s %12s\n", "bytes", "copy ns", "direct ns", gso ? "gso ns" : "gso n/a");
+
+    const size_t sizes[] = {64, 512, 1400, 8192, 65000};
+    for (size_t size : sizes) {
+        std::vector<uint8_t> message(size, 0x41);
+
+        double copy_ns = nsPerDatagram([&] { copyPath(sock, dst, fuzzerOutput(message), size); }, count);
+
+        UDPTrain direct(sock, dst, false);
+        double   direct_ns = nsPerDatagram([&] { direct.add(fuzzerOutput(message), size); }, count);
+
+        double gso_ns = 0;
+        if (gso) {
+            UDPTrain train(sock, dst, true);
+            gso_ns = nsPerDatagram([&] { train.add(fuzzerOutput(message), size); }, count);
+            train.flush();
+        }
+        printf("%8zu %12.1f %12.1f %12.1f\n", size, copy_ns, direct_ns, gso_ns);
+    }
+
+    close(sock);
+    close(sink);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CAPTURE_ORIGINAL    0          // pcapng interface of the messages as received
+#define CAPTURE_MUTATED     1          // and as sent on, after fuzzing and fix-ups
+#define CAPTURE_BATCH_MS    100        // the writer wakes up at least this often
+#define CAPTURE_BATCH_BYTES (1 << 20)  // or as soon as this much is waiting
+#define CAPTURE_MAX_PENDING (64 << 20) // packets beyond this much waiting are dropped
+#define CAPTURE_RETRY_S     5          // after a file could not be created, packets are dropped this long
+
+/*
+ * The wire endpoints of one direction of a connection. UDP links are built
+ * per message; a TCP link lives as long as its forwarding thread and carries
+ * the next sequence number of each interface (the mutated stream is usually
+ * longer or shorter than the original one).
+ */
+struct CaptureLink {
+    uint8_t  proto;    // IPPROTO_UDP or IPPROTO_TCP
+    uint32_t src_ip;   // network order
+    uint32_t dst_ip;   // network order
+    uint16_t src_port; // host order
+    uint16_t dst_port; // host order
+    uint32_t seq[2];   // TCP only, per interface
+};
+
+/**
+ * pcapng capture of the fuzzer's traffic, on for a non-empty `pcap_dir`. Every
+ * message is written twice, as received on interface "original" and as sent on
+ * "mutated", with IPv4 and UDP/TCP headers synthesized from the connection's
+ * endpoints (raw IP link type, so no Ethernet header).
+ *
+ * Forwarding threads only encode the packet into a pending buffer; a writer
+ * thread copies the buffer in batches into a memory-mapped file, which is
+ * kept exactly as long as what has been copied so a killed proxy leaves a
+ * readable file. Files rotate after `pcap_rotate_mb` MB or `pcap_rotate_s`
+ * seconds, named <pcap_dir>/proxy_<pid>_<n>.pcapng. A file that cannot be
+ * created (disk full, mmap failing) is removed again and the next one is only
+ * tried CAPTURE_RETRY_S seconds later; the packets in between are dropped.
+ */
+class PacketCapture {
+  public:
+    static PacketCapture* getInstance();
+    static PacketCapture* active() { return active_.load(std::memory_order_acquire); } // nullptr when off
+
+    static CaptureLink link(uint8_t proto, const sockaddr_in& src, const sockaddr_in& dst);
+    static CaptureLink link(uint8_t proto, const std::string& src_ip, uint16_t src_port, const std::string& dst_ip,
+                            uint16_t dst_port);
+
+    bool start(const std::string& dir, int rotate_mb, int rotate_s);
+    void record(int interface, CaptureLink& link, const uint8_t* payload, size_t len);
+
+  private:
+    PacketCapture();
+
+    static PacketCapture*              instance_;
+    static std::atomic<PacketCapture*> active_;
+
+    pthread_mutex_t       mutex_;
+    pthread_cond_t        wake_;
+    std::vector<uint8_t>  pending_; // pcapng blocks waiting for the writer
+    std::atomic<uint64_t> dropped_{0};
+
+    // Writer thread only
+    std::string dir_;
+    size_t      rotate_bytes_ = 0;
+    int         rotate_s_     = 0;
+    int         file_seq_     = 0;
+    int         fd_           = -1;
+    uint8_t*    map_          = nullptr;
+    size_t      map_size_     = 0;
+    size_t      used_         = 0; // bytes in the current file
+    size_t      header_size_  = 0; // its section and interface blocks
+    time_t      opened_at_    = 0;
+    time_t      retry_at_     = 0; // no new file before this after one failed
+
+    bool         openFile(size_t min_size);
+    void         closeFile();
+    bool         append(const uint8_t* blocks, size_t len);
+    void         writeBatch(const std::vector<uint8_t>& batch);
+    static void* writerEntry(void* arg);
+};
+
+#endif // CAPTURE_HPP
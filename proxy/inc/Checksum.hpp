@@ -0,0 +1,36 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Checksums found in message headers, used to fix up a message after mutation
+ * so the target does not drop it before parsing the mutated fields.
+ *
+ *  - crc32:  IEEE 802.3 (zlib, PNG, Ethernet)
+ *  - crc32c: Castagnoli (SCTP, iSCSI, ext4)
+ *  - inet:   RFC 1071 ones' complement sum of 16-bit big-endian words (IP, UDP, TCP, ICMP)
+ *  - sum8:   byte sum modulo 256
+ *  - xor8:   XOR of all bytes
+ */
+enum ChecksumType { CHECKSUM_NONE, CHECKSUM_CRC32, CHECKSUM_CRC32C, CHECKSUM_INET, CHECKSUM_SUM8, CHECKSUM_XOR8 };
+
+ChecksumType parseChecksumType(const std::string& name); // CHECKSUM_NONE if unknown
+
+// crc32 uses slicing-by-8 tables; crc32c and inetChecksum use SSE4.2/AVX2 when the CPU has them
+uint32_t crc32(const uint8_t* data, size_t len);
+uint32_t crc32c(const uint8_t* data, size_t len);
+uint16_t inetChecksum(const uint8_t* data, size_t len);
+uint32_t computeChecksum(ChecksumType type, const uint8_t* data, size_t len);
+
+// Table-driven / scalar versions of the above, for comparison in benchmarks
+uint32_t crc32cScalar(const uint8_t* data, size_t len);
+uint16_t inetChecksumScalar(const uint8_t* data, size_t len);
+
+// Integer fields of 1-8 bytes, as they sit in a message
+uint64_t loadUint(const uint8_t* data, uint32_t width, bool big_endian);
+void     storeUint(uint8_t* data, uint32_t width, bool big_endian, uint64_t value);
+
+#endif // CHECKSUM_HPP
@@ -0,0 +1,94 @@
+#ifndef CORPUS_MINIMIZER_HPP
+#define CORPUS_MINIMIZER_HPP
+
+#include "Coverage.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#define CMIN_WORDS (COVERAGE_MAP_SIZE / 64) // 64-bit words of an edge bitset
+
+struct CminOptions {
+    std::string              config;
+    std::string              entity;                    // default: the only entity with a `coverage_map`
+    std::string              out;                       // default: <corpus_dir>/<entity>.cmin
+    std::vector<std::string> target;                    // default: the entity's exec_with, binary_path and args
+    int                      jobs               = 0;    // 0 = one per CPU
+    int                      timeout_ms         = 1000; // longest a single input may take
+    int                      settle_ms          = 5;    // no reply: done once the map stops changing this long
+    int                      startup_timeout_ms = 5000;
+    bool                     replace            = false; // move the result over the input corpus
+};
+
+/**
+ * proxy_fuzzer --cmin: replays every input of an entity's corpus (the store
+ * under the fuzzer's `corpus_dir`) against its coverage-instrumented target
+ * and keeps a small subset that still reaches every edge the whole corpus
+ * reached.
+ *
+ * Replays run on `jobs` threads. Each launches its own instance of the target
+ * in a network namespace of its own, so the instances can listen on the same
+ * port, with a coverage map of its own. Every input is sent once, on a fresh
+ * socket; it is done at the target's first reply, or once the map has not
+ * changed for `settle_ms`. An input that crashes or hangs the target keeps
+ * the coverage it reached and the instance is restarted.
+ *
+ * The edges of an input are a bitset (hit counts are ignored) kept sparse:
+ * only its non-zero words. The subset is a greedy set cover: the input
+ * reaching the most edges not covered yet is taken next, the smaller one on
+ * a tie. Gains only shrink, so a stale gain is an upper bound and only the
+ * top of the heap is ever recomputed (lazy greedy); each recomputation is a
+ * popcount over the input's words.
+ */
+class CorpusMinimizer {
+  public:
+    explicit CorpusMinimizer(const CminOptions& options);
+
+    bool run();
+
+    static bool parseOptions(int argc, char* argv[], CminOptions& options); // argv[0] is "--cmin"
+    static void usage(const char* argv0);
+
+  private:
+    struct Cover {
+        std::vector<uint16_t> index; // of the non-zero words
+        std::vector<uint64_t> bits;
+        SeedInfo              info; // from the replay
+        uint32_t              size = 0;
+        bool                  done = false;
+    };
+
+    struct Instance {
+        int         id;
+        pid_t       pid     = -1;
+        uint8_t*    map     = nullptr;
+        std::string map_path;
+    };
+
+    CminOptions                  options_;
+    utils::EntityConfig          entity_;
+    std::string                  in_dir_;
+    std::unique_ptr<CorpusStore> in_;
+    std::vector<Cover>           covers_;
+    std::atomic<size_t>          next_{0};
+    std::atomic<size_t>          replayed_{0};
+    std::atomic<size_t>          crashes_{0};
+    std::atomic<size_t>          hangs_{0};
+    std::atomic<bool>            failed_{false};
+    bool                         isolated_ = true; // instances in network namespaces of their own
+
+    bool                loadConfig();
+    bool                replayAll();
+    void                work(int id);
+    bool                launch(Instance& instance);
+    void                stop(Instance& instance);
+    bool                replay(Instance& instance, const uint8_t* data, size_t size, Cover& cover);
+    std::vector<size_t> select();
+    bool                write(const std::vector<size_t>& kept);
+};
+
+#endif // CORPUS_MINIMIZER_HPP
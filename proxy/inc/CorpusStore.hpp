@@ -0,0 +1,97 @@
+#ifndef CORPUS_STORE_HPP
+#define CORPUS_STORE_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+
+#define CORPUS_SEGMENT_SIZE (64u << 20) // bytes per segment file
+#define CORPUS_MAX_SEGMENTS 4096
+#define CORPUS_MAX_ENTRIES  (1u << 26) // index capacity reserved in the address space (3 GB)
+#define CORPUS_INDEX_GROW   65536      // index entries the file grows by at a time
+#define CORPUS_INDEX_HEADER 4096       // the header has a page of its own
+
+/* What the coverage feedback knew about an input when it was added; the power schedules use it. */
+struct SeedInfo {
+    uint64_t path      = 0; // hash of the hit-count buckets it reached, 0 if unknown
+    uint32_t exec_us   = 0; // until the target's first reply, 0 if unknown
+    uint16_t edges     = 0; // it reached (at most 65535)
+    uint16_t new_edges = 0; // it was the first to reach
+};
+
+/* One input in the index file: where its bytes are in the segments. */
+struct CorpusEntry {
+    uint64_t hash;     // of the bytes, never 0
+    uint64_t offset;   // in the segment
+    uint32_t segment;  // segment_<n>.dat
+    uint32_t size;     // bytes
+    uint64_t found_ns; // wall clock when it was added
+    SeedInfo info;
+};
+
+/* Start of the index file; `count` is what readers may use. */
+struct CorpusIndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t count;    // entries written; published last, with release order
+    uint64_t capacity; // entries the file has room for
+    uint32_t segment;  // being appended to
+    uint32_t reserved; // 0
+    uint64_t tail;     // end of the data in that segment
+};
+
+/**
+ * Inputs kept on disk under one directory, deduplicated by content hash and
+ * only ever appended. The bytes go into segment files of up to 64 MB; the
+ * index is an array of fixed-size entries after a header. Both are mapped, so
+ * reading an input is a pointer into the page cache and picking a random one
+ * is an index into the array: nothing but the hashes of the entries (for
+ * deduplication) is kept on the heap.
+ *
+ * Several proxies may share a directory. Adding takes flock() on the index
+ * file and first hashes what the others added since; readers take no lock,
+ * they only see entries once `count` covers them.
+ */
+class CorpusStore {
+  public:
+    explicit CorpusStore(const std::string& dir);
+    ~CorpusStore();
+
+    bool open();
+    bool add(const uint8_t* data, size_t size, const SeedInfo& info = SeedInfo()); // false if already there, or error
+    bool view(size_t index, const uint8_t*& data, size_t& size);
+    bool entry(size_t index, CorpusEntry& entry);
+
+    size_t             size() const { return __atomic_load_n(&header_->count, __ATOMIC_ACQUIRE); }
+    const std::string& dir() const { return dir_; }
+
+  private:
+    std::string        dir_;
+    int                index_fd_ = -1;
+    CorpusIndexHeader* header_   = nullptr;
+    CorpusEntry*       entries_  = nullptr;
+
+    // Read-only segment mappings, made on first use
+    std::atomic<const uint8_t*> segments_[CORPUS_MAX_SEGMENTS] = {};
+    pthread_mutex_t             map_mutex_;
+
+    // Writers in this process; flock() keeps the other processes out
+    pthread_mutex_t       mutex_;
+    int                   segment_fd_ = -1;
+    uint32_t              segment_id_ = 0; // of segment_fd_
+    std::vector<uint64_t> hashes_;         // open addressing, 0 = free slot
+    size_t                hashed_ = 0;     // index entries already in hashes_
+
+    bool           growIndex();
+    bool           openSegment(uint32_t segment);
+    const uint8_t* segment(uint32_t segment);
+    void           catchUp();
+    bool           insertHash(uint64_t hash); // false if it was already there
+    std::string    segmentPath(uint32_t segment) const;
+};
+
+#endif // CORPUS_STORE_HPP
@@ -0,0 +1,112 @@
+#ifndef COVERAGE_HPP
+#define COVERAGE_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+
+#include "ConfigurationManager.hpp"
+#include "CorpusStore.hpp"
+#include "SeedScheduler.hpp"
+
+// Must match CEZ_COV_MAP_SIZE in tests/coverage/cez_cov_rt.c
+#define COVERAGE_MAP_SIZE  (1 << 16)
+#define MAX_CORPUS_ENTRIES 4096
+#define MAX_CORPUS_INPUT   65536
+
+/**
+ * Inputs that reached new coverage in one target, shared by every thread
+ * forwarding to it. Entries are only appended, never evicted. They are kept
+ * in memory (up to MAX_CORPUS_ENTRIES) unless persist() moved them to a
+ * CorpusStore, which has no such limit and outlives the proxy. pick() follows
+ * the corpus' power schedule.
+ */
+class Corpus {
+  public:
+    Corpus();
+    ~Corpus();
+
+    bool   persist(const std::string& dir);
+    void   setSchedule(PowerSchedule schedule);
+    bool   add(const uint8_t* data, size_t size, const SeedInfo& info = SeedInfo());
+    bool   pick(std::vector<uint8_t>& out);
+    size_t size();
+    void   hitPath(uint64_t path) { scheduler_.hitPath(path); }
+
+    CorpusStore* store() { return store_.get(); } // nullptr when in memory
+
+  private:
+    pthread_mutex_t                   mutex_;
+    std::vector<std::vector<uint8_t>> entries_;
+    std::vector<SeedInfo>             infos_; // of entries_
+    std::unique_ptr<CorpusStore>      store_;
+    SeedScheduler                     scheduler_;
+    uint64_t                          rng_ = 0x2545F4914F6CDD1Dull;
+};
+
+/**
+ * Edge map shared with one coverage-instrumented target (see the entity's
+ * `coverage_map`). The target only increments counters; the proxy classifies
+ * them into AFL-style hit-count buckets, compares them with the buckets seen so
+ * far and clears the map for the next message.
+ *
+ * A target handles a message some time after the proxy forwarded it, so the
+ * coverage found in the map when the next message is forwarded is credited to
+ * the previous one.
+ */
+class CoverageMap {
+  public:
+    CoverageMap(const std::string& entity, const std::string& path);
+    ~CoverageMap();
+
+    bool open();
+    void recordSent(const uint8_t* data, size_t size);
+
+    static void recordReply(CoverageMap* map); // the target sent something back; accepts nullptr
+    static void describe(const uint8_t* map, SeedInfo& info); // path and edges of a raw map, nothing else
+
+    Corpus&            corpus() { return corpus_; }
+    const std::string& entity() const { return entity_; }
+
+  private:
+    std::string          entity_;
+    std::string          path_;
+    uint8_t*             map_ = nullptr;
+    std::vector<uint8_t> virgin_;  // bucket bits never seen yet, per edge
+    std::vector<uint8_t> pending_; // last message forwarded to the target
+    pthread_mutex_t      mutex_;
+    Corpus               corpus_;
+    size_t               edges_ = 0;
+
+    // When pending_ was forwarded, and the target's first reply after that (0: none yet)
+    std::atomic<uint64_t> sent_ns_{0};
+    std::atomic<uint64_t> replied_ns_{0};
+
+    bool collectNewCoverage(SeedInfo& info);
+};
+
+/**
+ * All coverage maps of the campaign, keyed by entity name.
+ */
+class CoverageFeedback {
+  public:
+    static CoverageFeedback* getInstance();
+
+    void         addTargets(const std::vector<utils::EntityConfig>& entities, const std::string& corpus_dir = "",
+                            PowerSchedule schedule = SCHEDULE_FAST);
+    CoverageMap* forEntity(const std::string& name);
+
+  private:
+    CoverageFeedback() = default;
+
+    static CoverageFeedback* instance_;
+
+    std::unordered_map<std::string, CoverageMap*> maps_;
+};
+
+#endif // COVERAGE_HPP
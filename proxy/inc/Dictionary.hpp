@@ -0,0 +1,72 @@
+#ifndef DICTIONARY_HPP
+#define DICTIONARY_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+
+#define MAX_DICT_TOKENS    1024
+#define MIN_TOKEN_LENGTH   2
+#define MAX_TOKEN_LENGTH   32
+#define DICT_HASH_SLOTS    2048 // power of two, at least 2 * MAX_DICT_TOKENS
+#define LEARN_SCAN_BYTES   512  // only the head of a message is scanned when learning
+#define LEARN_COUNTERS     4096 // power of two
+#define LEARN_MIN_HITS     4    // a candidate token must be seen this many times
+#define LEARN_WARMUP       64   // messages all learned from, before sampling starts
+#define LEARN_SAMPLE       16   // then one message in this many is learned from
+#define MAGIC_SPAN         8    // leading bytes checked for a constant magic
+#define MAGIC_MIN_MESSAGES 8
+
+/**
+ * Tokens for one connection: configured keywords plus tokens learned from the
+ * traffic that goes through it. Token bytes live back to back in one arena and
+ * are found through an open-addressing hash table of indexes, so contains()
+ * costs one hash and usually one compare.
+ *
+ * learn() looks at the first LEARN_WARMUP forwarded messages, then at one in
+ * LEARN_SAMPLE (it runs on the forwarding path), for:
+ *  - printable runs (keywords, field names, verbs)
+ *  - frequent 4-byte n-grams (binary tags and separators)
+ *  - leading bytes that never change (magic numbers, version bytes)
+ * Candidates are counted in a small table of saturating counters and become
+ * tokens after LEARN_MIN_HITS sightings.
+ */
+class Dictionary {
+  public:
+    Dictionary();
+    Dictionary(const std::vector<std::string>& tokens); // configured tokens, see addEscaped()
+    ~Dictionary();
+
+    bool   add(const uint8_t* token, size_t len);
+    bool   addEscaped(const std::string& token); // accepts \xNN, \n, \r, \t, \\ escapes
+    bool   contains(const uint8_t* token, size_t len);
+    bool   pick(uint32_t random, std::vector<uint8_t>& out);
+    size_t size();
+
+    void learn(const uint8_t* message, size_t len);
+
+  private:
+    pthread_mutex_t       mutex_;
+    std::vector<uint8_t>  arena_;
+    std::vector<uint32_t> offsets_; // token i is arena_[offsets_[i], offsets_[i + 1])
+    int32_t               slots_[DICT_HASH_SLOTS];
+
+    uint8_t counters_[LEARN_COUNTERS];
+    uint8_t magic_[MAGIC_SPAN];
+    uint8_t magic_stable_ = 0; // bit i set while byte i has never changed
+    size_t  magic_len_    = 0;
+    size_t  messages_     = 0;
+
+    std::atomic<uint64_t> seen_{0}; // messages offered to learn(), sampled without the mutex
+
+    static uint32_t hash(const uint8_t* data, size_t len);
+    bool            containsLocked(const uint8_t* token, size_t len, uint32_t h);
+    bool            addLocked(const uint8_t* token, size_t len);
+    void            countCandidate(const uint8_t* token, size_t len);
+    void            learnMagic(const uint8_t* message, size_t len);
+};
+
+#endif // DICTIONARY_HPP
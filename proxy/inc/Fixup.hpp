@@ -0,0 +1,64 @@
+#ifndef FIXUP_HPP
+#define FIXUP_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "Checksum.hpp"
+#include "ConfigurationManager.hpp"
+
+/**
+ * One compiled `fixups` entry. Positions may be negative (from the end of the
+ * message); they are resolved per message.
+ */
+struct Fixup {
+    bool         is_length;
+    ChecksumType checksum; // when !is_length
+    int          offset;
+    uint32_t     width;
+    bool         big_endian;
+    int          from;
+    int          to;
+    bool         to_end; // `to` unset: cover up to the end of the message
+    int          adjust;
+};
+
+/**
+ * Post-mutation stage: recomputes the declared length and checksum fields of
+ * a message right before it is sent, so targets that validate framing do not
+ * drop every mutated message. Lengths go first, then checksums in config
+ * order; a checksum inside its own range is computed with itself zeroed.
+ * Entries that do not fit a (truncated) message are skipped.
+ */
+class FixupStage {
+  public:
+    // Returns nullptr (after printing why) if an entry is invalid
+    static FixupStage* compile(const std::string& entity, const std::vector<utils::FixupConfig>& fixups);
+
+    void apply(uint8_t* data, size_t len) const;
+
+  private:
+    std::vector<Fixup> fixups_; // lengths first
+};
+
+/**
+ * Fix-up stages of the targets, by entity name.
+ */
+class FixupRegistry {
+  public:
+    static FixupRegistry* getInstance();
+
+    void        addTargets(const std::vector<utils::EntityConfig>& entities);
+    FixupStage* forEntity(const std::string& name);
+
+  private:
+    FixupRegistry() = default;
+    static FixupRegistry* instance_;
+
+    std::map<std::string, FixupStage*> stages_;
+};
+
+#endif // FIXUP_HPP
@@ -0,0 +1,84 @@
+#ifndef FLOW_TABLE_HPP
+#define FLOW_TABLE_HPP
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#define FLOW_TABLE_SLOTS     65536 // power of two; flows beyond 3/4 of it are not tracked
+#define FLOW_IDLE_TIMEOUT_MS 60000 // a flow with no traffic in either direction for this long is removed
+#define FLOW_SWEEP_EVERY_MS  1000
+
+class UDPConnection;
+
+/**
+ * One client seen on a proxy port whose entity has no fixed port (`port: -1`).
+ * The proxy forwards the client's messages from a socket of its own, so the
+ * replies that come back on that socket belong to this client only.
+ */
+struct Flow {
+    uint64_t             key;
+    sockaddr_in          peer;       // the client
+    int                  proxy_port;
+    int                  reply_sock; // the proxy port's socket the client sent to; replies leave through it
+    int                  sock;       // bound to an ephemeral port, used towards the other entity
+    UDPConnection*       conn;
+    int                  direction;  // 0: the client is entity A, 1: entity B
+    std::atomic<int64_t> last_seen_ms{0};
+    std::atomic<bool>    unlinked{false}; // set by expire(); its socket no longer gets replies
+};
+
+/**
+ * Flows by (src ip, src port, proxy port). Lookups are lock-free: the table is
+ * a fixed array of atomic pointers probed linearly, so the forwarding path
+ * costs a hash and usually one load. Inserts and expiry take a mutex.
+ *
+ * Expired flows leave tombstones; once those reach a quarter of the table it is
+ * rebuilt into a fresh array and the pointer swapped. Unlinked flows and old
+ * arrays are only freed a full idle timeout later, so a thread that found them
+ * just before still holds valid pointers while it finishes the message.
+ *
+ * A flow found just as it expires must not be used: its socket is already out
+ * of the reply epoll. A user stores `last_seen_ms` and then loads `unlinked`;
+ * expire() stores `unlinked` and then reloads `last_seen_ms`, keeping the flow
+ * if it was used meanwhile. One of the two sees the other, so either the flow
+ * stays or the user sees it unlinked and inserts a new one.
+ */
+class FlowTable {
+  public:
+    FlowTable();
+    ~FlowTable();
+
+    static uint64_t makeKey(const sockaddr_in& src, int proxy_port);
+    static int64_t  now();
+
+    Flow*  find(uint64_t key) const;
+    Flow*  insert(Flow* flow); // returns the flow stored under its key (maybe an older one), nullptr if full
+    void   expire(int64_t now_ms, int64_t idle_ms, std::vector<Flow*>& unlinked);
+    size_t size() const { return count_.load(std::memory_order_relaxed); }
+
+  private:
+    typedef std::atomic<Flow*> Slot;
+
+    template <typename T> struct Retired {
+        T       item;
+        int64_t since_ms;
+    };
+
+    std::atomic<Slot*>         slots_;
+    std::atomic<size_t>        count_{0};
+    size_t                     tombstones_ = 0; // this and the rest are under mutex_
+    pthread_mutex_t            mutex_;
+    std::deque<Retired<Flow*>> retired_flows_;
+    std::deque<Retired<Slot*>> retired_slots_;
+
+    static uint32_t hash(uint64_t key);
+    static Slot*    allocate();
+    static void     place(Slot* slots, Flow* flow);
+    void            rebuildLocked(int64_t now_ms);
+};
+
+#endif // FLOW_TABLE_HPP
@@ -4,35 +4,84 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #define FUZZ_LENGTH_MULTIPLIER 15
 #define MAX_RADAMSA_ARGS       20
 #define MIN_OUTPUT_SIZE        (100 * BATCH)
 #define BATCH                  4096
 #define MAX_BUFFER_SIZE        (10000 * BATCH)
+#define GUIDED_LIVE_ONE_IN     4 // guided mode mutates the live message once in N, a corpus input otherwise
+#define MAX_TOKEN_MUTATIONS    4 // token insertions/replacements applied to one message
 
 enum FuzzStyle { FUZZSTYLE_RANDOMIZATION, FUZZSTYLE_TRUNCATE, FUZZSTYLE_INSERT, FUZZSTYLE_OVERFLOW, FUZZSTYLE_CUSTOM };
 
+// Which of the fuzzing functions fuzz() applies (fuzzer `fuzz_mode` in the config)
+enum FuzzMode {
+    FUZZMODE_POST,
+    FUZZMODE_PRE,
+    FUZZMODE_FULL,
+    FUZZMODE_GUIDED,
+    FUZZMODE_DETERMINISTIC,
+    FUZZMODE_DICTIONARY,
+    FUZZMODE_SCHEMA,
+    FUZZMODE_PASS
+};
+
+// How guided mode picks corpus inputs (fuzzer `power_schedule` in the config, see SeedScheduler)
+enum PowerSchedule { SCHEDULE_UNIFORM, SCHEDULE_EXPLORE, SCHEDULE_FAST, SCHEDULE_COE };
+
+class Corpus;
+class Dictionary;
+class Schema;
+class SessionTracker;
+
+// What fuzz() knows about the message's connection and target; every member may be nullptr
+struct FuzzContext {
+    Corpus*     corpus     = nullptr; // coverage corpus of the target
+    Dictionary* dictionary = nullptr; // tokens of the connection
+    Schema*     schema     = nullptr; // message layout of the target
+
+    SessionTracker* session   = nullptr; // state of the connection's session
+    int             direction = 0;       // 0: entity A (client) -> B (server), 1: back
+};
+
 class FuzzerCore {
   public:
-    FuzzerCore(FuzzStyle style = FUZZSTYLE_RANDOMIZATION);
+    FuzzerCore(FuzzStyle style = FUZZSTYLE_RANDOMIZATION, FuzzMode mode = FUZZMODE_POST);
+
+    static FuzzMode      parseFuzzMode(const std::string& name);
+    static PowerSchedule parsePowerSchedule(const std::string& name);
+
+    uint8_t* fuzz(const uint8_t* input, size_t size, size_t& newSize, const FuzzContext& context = FuzzContext());
 
     uint8_t* preFuzzing(const uint8_t* input, size_t size, size_t& newSize);
     uint8_t* postFuzzing(const uint8_t* input, size_t size, size_t& newSize);
     uint8_t* fullFuzzing(const uint8_t* input, size_t size, size_t& newSize);
-    uint8_t* guidedFuzzing(const uint8_t* input, size_t size, size_t& newSize);
+    uint8_t* guidedFuzzing(const uint8_t* input, size_t size, size_t& newSize,
+                           const FuzzContext& context = FuzzContext());
+    uint8_t* deterministicFuzzing(const uint8_t* input, size_t size, size_t& newSize);
+    uint8_t* dictionaryFuzzing(const uint8_t* input, size_t size, size_t& newSize, Dictionary* dictionary);
+    uint8_t* schemaFuzzing(const uint8_t* input, size_t size, size_t& newSize, const FuzzContext& context);
     uint8_t* pass(const uint8_t* input, size_t size, size_t& newSize);
     uint8_t* normalizeOutputSize(uint8_t* input, size_t input_len, size_t& output_len);
     uint8_t* runRadamsaExpanded(const uint8_t* data, size_t size, size_t& outSize);
 
+    static void     applyDeterministicStage(uint8_t* buffer, size_t size, uint32_t step);
+    static uint32_t deterministicStageCount();
+    static void     applyTokenMutations(std::vector<uint8_t>& buffer, Dictionary& dictionary, uint32_t random);
+
   private:
     FuzzStyle   style;
+    FuzzMode    mode;
     const char* radamsaArgs[MAX_RADAMSA_ARGS];
     int         argCount = 0;
 
     void     configureStyleArgs();
     void     addArg(const char* arg);
     uint8_t* runRadamsa(const uint8_t* data, size_t size, size_t& outSize);
+    uint8_t* runRadamsaRaw(const uint8_t* data, size_t size, size_t& outSize);
 };
 
 #endif // FUZZER_CORE_HPP
@@ -0,0 +1,50 @@
+#ifndef HANG_WATCHDOG_HPP
+#define HANG_WATCHDOG_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <pthread.h>
+
+/**
+ * One peer the proxy is waiting on. Forwarding a message to the peer arms the
+ * slot (if it is not armed already); any message received from the peer
+ * disarms it. Both are a single atomic access on the forwarding path.
+ */
+struct HangSlot {
+    std::atomic<int64_t> armed_since_ms{0};
+    std::string          entity;
+    std::string          description;
+};
+
+/**
+ * Reports a HANG to the launcher server when an armed slot has not been
+ * disarmed within the configured timeout (fuzzer `hang_timeout_ms`).
+ */
+class HangWatchdog {
+  public:
+    static HangWatchdog* getInstance();
+
+    void      start(int timeout_ms);
+    HangSlot* createSlot(const std::string& entity, const std::string& description);
+    void      releaseSlot(HangSlot* slot); // its peer is gone; accepts nullptr
+
+    static void arm(HangSlot* slot);
+    static void disarm(HangSlot* slot);
+
+  private:
+    HangWatchdog();
+
+    static HangWatchdog* instance_;
+
+    int                    timeout_ms_ = 0;
+    pthread_mutex_t        mutex_;
+    std::vector<HangSlot*> slots_;
+
+    static void* loopEntry(void* arg);
+    void         loop();
+    void         report(const HangSlot* slot, int64_t waited_ms);
+};
+
+#endif // HANG_WATCHDOG_HPP
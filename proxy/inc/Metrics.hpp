@@ -0,0 +1,118 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+
+#define HISTOGRAM_SUB_BITS 4  // 16 buckets per power of two: values within 1/16 (6.25%)
+#define HISTOGRAM_MAX_BITS 40 // values up to 2^40 ns (~18 minutes), larger ones land in the last bucket
+#define HISTOGRAM_BUCKETS  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/**
+ * Counter written by one thread only: an increment is a plain load and store,
+ * without a locked instruction. Readers on other threads see a recent value.
+ */
+class LocalCounter {
+  public:
+    void     add(uint64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> value_{0};
+};
+
+/**
+ * HDR-style histogram of nanosecond durations with one writer: log-linear
+ * buckets (HISTOGRAM_SUB_BITS per power of two) so any value is kept within a
+ * fixed relative error, from 1 ns up to 2^HISTOGRAM_MAX_BITS ns.
+ */
+class LatencyHistogram {
+  public:
+    void record(uint64_t ns);
+
+    uint64_t count(size_t bucket) const { return counts_[bucket].get(); }
+    uint64_t total() const { return total_.get(); }
+    uint64_t sumNs() const { return sum_ns_.get(); }
+
+    static size_t   bucketOf(uint64_t ns);
+    static uint64_t upperBound(size_t bucket); // exclusive
+
+  private:
+    LocalCounter counts_[HISTOGRAM_BUCKETS];
+    LocalCounter total_;
+    LocalCounter sum_ns_;
+};
+
+/**
+ * What one forwarding thread did for one direction of one connection. Only
+ * that thread writes it; the endpoint sums all of them when it is read.
+ */
+struct alignas(64) ThreadMetrics {
+    std::string proto;     // udp or tcp
+    std::string link;      // the connection, as in the logs
+    int         direction; // 0: entity A (client) -> B (server), 1: back
+
+    LocalCounter     packets_in;
+    LocalCounter     packets_out;
+    LocalCounter     bytes_in;
+    LocalCounter     bytes_out;
+    LocalCounter     mutations;   // messages passed through the fuzzer
+    LocalCounter     send_errors; // messages not sent
+    LocalCounter     port_misses; // messages for a dynamic-port peer whose port is not known yet
+    LocalCounter     truncated;   // messages larger than the receive buffer
+    LatencyHistogram mutation_ns; // time in the fuzzer, per message
+    LatencyHistogram forward_ns;  // received to sent, per read
+};
+
+/**
+ * Counters and latency histograms of the forwarding threads, served as
+ * Prometheus text on 127.0.0.1:<fuzzer `metrics_port`> and pushed as totals
+ * to the launcher server every `stats_push_ms`.
+ *
+ * The forwarding path only touches its own ThreadMetrics; registering a
+ * thread and reading the endpoint take a mutex that the path never does.
+ */
+class Metrics {
+  public:
+    static Metrics* getInstance();
+    static uint64_t nowNs();
+
+    // A released series with the same labels is handed out again, so short-lived threads do not pile up
+    ThreadMetrics* registerThread(const std::string& proto, const std::string& link, int direction);
+    void           releaseThread(ThreadMetrics* metrics); // its thread is done writing to it
+    void           addGauge(const std::string& name, const std::string& help, std::function<double()> read);
+
+    bool        serve(int port);
+    bool        pushToLauncher(int interval_ms);
+    std::string render();
+    std::string statsMessage(); // STATS proxy <host> <key>=<total> ...
+
+  private:
+    Metrics();
+
+    struct Gauge {
+        std::string             name;
+        std::string             help;
+        std::function<double()> read;
+    };
+
+    static Metrics* instance_;
+
+    pthread_mutex_t             mutex_;
+    std::vector<ThreadMetrics*> threads_;  // never freed: the totals must not go back when a thread ends
+    std::vector<ThreadMetrics*> released_; // in threads_ too, without a writer
+    std::vector<Gauge>          gauges_;
+    int                         listen_fd_        = -1;
+    int                         push_interval_ms_ = 0;
+    long                        started_at_; // ms since the epoch
+
+    static void* serveEntry(void* arg);
+    static void* pushEntry(void* arg);
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,39 @@
+#ifndef MUTATION_KERNELS_HPP
+#define MUTATION_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Deterministic mutation kernels applied to a range of a buffer: the walking
+ * stages of FuzzerCore pass the one to four bytes they change, the
+ * substitutions whole BATCH-sized blocks.
+ *
+ *  - flip:       XOR every 32-bit word with a pattern (bit/byte flips)
+ *  - add8/16/32: wrapping add of a delta to every 8/16/32-bit little-endian lane
+ *  - substitute: replace every byte equal to `from` with `to` (interesting values)
+ *
+ * Each kernel has AVX2, SSE4.2 and scalar versions; the best one supported by
+ * the CPU is picked once at startup. All versions give identical results and
+ * accept any length (the tail is done in scalar code).
+ */
+struct MutationKernels {
+    const char* isa;
+
+    void (*flip)(uint8_t* buf, size_t len, uint32_t pattern);
+    void (*add8)(uint8_t* buf, size_t len, int8_t delta);
+    void (*add16)(uint8_t* buf, size_t len, int16_t delta);
+    void (*add32)(uint8_t* buf, size_t len, int32_t delta);
+    void (*substitute)(uint8_t* buf, size_t len, uint8_t from, uint8_t to);
+
+    // Kernels for the best ISA the CPU supports
+    static const MutationKernels& get();
+
+    // Every version this CPU can run, best first (for benchmarks); returns the count
+    static int available(const MutationKernels** out, int max);
+};
+
+// AFL's interesting 8-bit values, used as substitution targets
+extern const int8_t INTERESTING_8[9];
+
+#endif // MUTATION_KERNELS_HPP
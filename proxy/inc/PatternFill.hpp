@@ -0,0 +1,15 @@
+#ifndef PATTERN_FILL_HPP
+#define PATTERN_FILL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Fills `target` bytes of `dst` with `pattern` repeated (the last copy may be
+ * cut short). The filled region doubles on every step, so a small pattern takes
+ * O(log target) memcpy calls instead of target / pattern_len. An empty pattern
+ * fills with zeros.
+ */
+void patternFill(uint8_t* dst, size_t target, const uint8_t* pattern, size_t pattern_len);
+
+#endif // PATTERN_FILL_HPP
@@ -3,6 +3,13 @@
 #include "ConfigurationManager.hpp"
 #include "UDPHandler.hpp"
 #include "TCPHandler.hpp"
+#include "HangWatchdog.hpp"
+#include "Coverage.hpp"
+#include "Schema.hpp"
+#include "Fixup.hpp"
+#include "Metrics.hpp"
+#include "Capture.hpp"
+#include "Trace.hpp"
 #include <vector>
 
 class ProxyBase {
@@ -0,0 +1,101 @@
+#ifndef SCHEMA_HPP
+#define SCHEMA_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "Checksum.hpp"
+#include "ConfigurationManager.hpp"
+
+#define MAX_SCHEMA_FIELDS        64
+#define MAX_SCHEMA_MUTATIONS     3    // fields mutated in one message
+#define MAX_FIELD_GROWTH         4096 // bytes a variable field may grow by in one mutation
+#define SCHEMA_RAW_LENGTH_ONE_IN 8    // once in N messages a length field is mutated and left as is
+
+class Dictionary;
+
+enum FieldType { FIELD_UINT, FIELD_BYTES };
+
+/**
+ * A schema field compiled from utils::FieldConfig: names resolved to field
+ * indexes and sizes precomputed, so a message is parsed and fixed up with a
+ * single walk over a flat table.
+ */
+struct SchemaField {
+    FieldType    type;
+    bool         big_endian;
+    uint32_t     width;                // bytes, 0 = variable
+    ChecksumType checksum;             // CHECKSUM_NONE unless this is a checksum field
+    bool         is_length      = false;
+    int          cover_first    = -1;  // length/checksum fields: the fields they cover
+    int          cover_last     = -1;
+    int32_t      length_adjust  = 0;
+    uint32_t     fixed_in_cover = 0;   // length fields: bytes of the fixed fields they cover
+    int          length_source  = -1;  // variable fields: the length field that gives their size
+    uint32_t     fixed_after    = 0;   // bytes of the (fixed) fields after this one
+    uint32_t     values_begin   = 0;   // known values, in Schema::values_
+    uint32_t     values_count   = 0;
+};
+
+/**
+ * Layout of the messages an entity receives (its `schema` in the config).
+ *
+ * mutate() parses a message into fields, mutates a few of them by type
+ * (integers: known values, boundaries, small deltas; byte fields: resize,
+ * overwrite, insert tokens) and then recomputes the length and checksum
+ * fields that depend on them, so the message still gets past the target's
+ * framing checks. Messages that do not match the layout are left alone.
+ */
+class Schema {
+  public:
+    // Returns nullptr (after printing why) if the schema is inconsistent
+    static Schema* compile(const std::string& entity, const std::vector<utils::FieldConfig>& fields);
+
+    bool mutate(const uint8_t* input, size_t size, std::vector<uint8_t>& out, uint32_t random,
+                Dictionary* dictionary) const;
+
+    const std::string& entity() const { return entity_; }
+    size_t             fieldCount() const { return fields_.size(); }
+
+  private:
+    struct Span {
+        size_t offset;
+        size_t length;
+    };
+
+    std::string              entity_;
+    std::vector<SchemaField> fields_;
+    std::vector<std::string> names_; // for messages only
+    std::vector<uint64_t>    values_;
+    std::vector<int>         data_fields_; // neither length nor checksum
+    std::vector<int>         length_fields_;
+    std::vector<int>         checksum_fields_; // innermost range first
+
+    bool parse(const uint8_t* input, size_t size, Span* spans, size_t& end) const;
+    void fixup(std::vector<uint8_t>& out, const Span* spans, uint64_t skip) const;
+    void mutateUint(std::vector<uint8_t>& data, const SchemaField& field, uint32_t& random) const;
+    void mutateBytes(std::vector<uint8_t>& data, const SchemaField& field, uint32_t& random,
+                     Dictionary* dictionary) const;
+};
+
+/**
+ * Compiled schemas of the targets, by entity name.
+ */
+class SchemaRegistry {
+  public:
+    static SchemaRegistry* getInstance();
+
+    void    addTargets(const std::vector<utils::EntityConfig>& entities);
+    Schema* forEntity(const std::string& name);
+
+  private:
+    SchemaRegistry() = default;
+    static SchemaRegistry* instance_;
+
+    std::map<std::string, Schema*> schemas_;
+};
+
+#endif // SCHEMA_HPP
@@ -0,0 +1,80 @@
+#ifndef SEED_SCHEDULER_HPP
+#define SEED_SCHEDULER_HPP
+
+#include "CorpusStore.hpp"
+#include "Fuzzer.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#define SCHEDULE_PATH_SLOTS (1 << 18) // path frequency counters; colliding paths share one
+#define SCHEDULE_MAX_FACTOR 32        // AFLFast MAX_FACTOR / POWER_BETA
+#define SCHEDULE_MAX_ENERGY 1600      // AFL HAVOC_MAX_MULT * 100
+#define SCHEDULE_REFRESH    1024      // every energy is recomputed after max(this, seeds) picks
+
+/**
+ * Picks the corpus input guided fuzzing mutates next, with a probability
+ * proportional to its energy (AFLFast power schedules). The energy starts
+ * from AFL's performance score - faster replies, more edges, smaller inputs
+ * and inputs that reached new edges score higher - and is then scaled by
+ * the schedule:
+ *
+ *  - explore: the score alone
+ *  - fast:    2^s(i) / f(i), s(i) being how often the input was picked and
+ *             f(i) how many messages took the same path, so inputs on
+ *             rarely exercised paths get more
+ *  - coe:     2^s(i), or nothing once f(i) is above the mean
+ *
+ * Energies live in a Fenwick tree, so a pick and the update after it are
+ * O(log n). The averages the score depends on, and f(i), drift as traffic
+ * goes on; all energies are recomputed after as many picks as there are
+ * inputs, which keeps the cost per pick constant.
+ *
+ * Not thread-safe, except hitPath(); the corpus serializes the rest.
+ */
+class SeedScheduler {
+  public:
+    SeedScheduler();
+
+    void          setSchedule(PowerSchedule schedule) { schedule_ = schedule; }
+    PowerSchedule schedule() const { return schedule_; }
+
+    void   hitPath(uint64_t path); // once per message the target handled
+    void   add(const SeedInfo& info, size_t size);
+    size_t pick(uint64_t random); // needs size() > 0
+    size_t size() const { return seeds_.size(); }
+
+  private:
+    struct Seed {
+        uint32_t size;
+        uint32_t exec_us;
+        uint32_t slot;   // in path_hits_
+        uint32_t picked; // s(i)
+        uint32_t energy; // current weight in tree_
+        uint16_t edges;
+        uint16_t new_edges;
+    };
+
+    PowerSchedule                            schedule_ = SCHEDULE_FAST;
+    std::vector<Seed>                        seeds_;
+    std::vector<uint64_t>                    tree_; // Fenwick tree of the energies, 1-based
+    uint64_t                                 total_ = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> path_hits_;
+
+    // Recomputed by refresh()
+    double avg_exec_us_  = 0;
+    double avg_edges_    = 0;
+    double avg_size_     = 0;
+    double mean_hits_    = 0;
+    size_t picks_        = 0; // since the last refresh
+    size_t refreshed_at_ = 0; // seeds then
+
+    uint32_t energy(const Seed& seed) const;
+    uint64_t prefix(size_t count) const;
+    void     update(size_t index, uint32_t energy);
+    void     refresh();
+};
+
+#endif // SEED_SCHEDULER_HPP
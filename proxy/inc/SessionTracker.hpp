@@ -0,0 +1,54 @@
+#ifndef SESSION_TRACKER_HPP
+#define SESSION_TRACKER_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "ConfigurationManager.hpp"
+
+#define SESSION_STATE_SLOTS     4096 // power of two; colliding states share a counter
+#define SESSION_MIN_MUTATE_1_IN 16   // even the most common state is mutated once in N messages
+
+// Where the message type of an entity's messages is (its `message_type`); offset < 0 infers it
+struct MessageTypeRule {
+    int offset = -1;
+    int width  = 1;
+};
+
+/**
+ * Session state of one connection, inferred from the messages going through
+ * it. A message's type is the bytes at the sender's `message_type` offset, or
+ * its first byte and length class when none is configured. The state is the
+ * pair (type of the last message in the other direction, type of this
+ * message), i.e. where in the request/response sequence the session is.
+ *
+ * Each state has a hit counter in a fixed table, so observe() is a hash and
+ * two atomic adds. shouldMutate() passes messages of frequently seen states
+ * through unchanged more and more often: the session then gets past them and
+ * mutations land on the rare states deeper in the protocol.
+ */
+class SessionTracker {
+  public:
+    SessionTracker(const std::string& link, MessageTypeRule fromA, MessageTypeRule fromB);
+
+    static MessageTypeRule ruleFor(const std::vector<utils::EntityConfig>& entities, const std::string& name);
+
+    uint32_t observe(int direction, const uint8_t* message, size_t len); // direction 0: A -> B, 1: B -> A
+    bool     shouldMutate(uint32_t state, uint32_t random) const;
+    size_t   states() const { return distinct_.load(std::memory_order_relaxed); }
+
+  private:
+    std::string           link_;
+    MessageTypeRule       rules_[2];
+    std::atomic<uint32_t> last_type_[2];
+    std::atomic<uint32_t> hits_[SESSION_STATE_SLOTS];
+    std::atomic<uint32_t> distinct_{0};
+    std::atomic<uint64_t> total_{0};
+
+    uint32_t messageType(int direction, const uint8_t* message, size_t len) const;
+};
+
+#endif // SESSION_TRACKER_HPP
@@ -1,8 +1,28 @@
 #ifndef TCP_CONNECTION_HPP
 #define TCP_CONNECTION_HPP
 
+#include <atomic>
 #include <string>
 #include <netinet/in.h>
+#include "HangWatchdog.hpp"
+#include "Coverage.hpp"
+#include "Dictionary.hpp"
+#include "Schema.hpp"
+#include "Fixup.hpp"
+#include "SessionTracker.hpp"
+#include "Fuzzer.hpp"
+#include "Metrics.hpp"
+
+/*
+ * Shared by the two forwarding threads of a channel pair: the last one to
+ * stop closes both sockets, frees the pair's session tracker and takes the
+ * pair off the active count.
+ */
+struct TCP_ChannelState {
+    std::atomic<int>  threads{2};
+    std::atomic<int>* active  = nullptr;
+    SessionTracker*   session = nullptr;
+};
 
 class TCP_Connection {
   public:
@@ -15,18 +35,42 @@ class TCP_Connection {
     int         getFD() const;
     std::string getIP() const;
     uint16_t    getPort() const;
+    HangSlot*    getHangSlot() const;
+    CoverageMap* getCoverage() const;
+    Dictionary*  getDictionary() const;
+    Schema*      getSchema() const;
+    FixupStage*  getFixups() const;
+    SessionTracker* getSession() const;
+    ThreadMetrics* getMetrics() const;
 
     void setFD(int fd);
     void setIP(const std::string& ip);
     void setPort(uint16_t port);
-    void startConnectionThread(int forward_fd);
+    void setHangSlot(HangSlot* slot);
+    void setCoverage(CoverageMap* coverage);
+    void setDictionary(Dictionary* dictionary);
+    void setSchema(Schema* schema);
+    void setFixups(FixupStage* fixups);
+    void setSession(SessionTracker* session, int direction);
+    void setFuzzMode(FuzzMode mode);
+    void setMetrics(ThreadMetrics* metrics);
+    void startConnectionThread(const TCP_Connection& forward, TCP_ChannelState* state);
 
     static void* _connection_thread_loop(void* args);
 
   private:
-    int         socket_fd_;
-    std::string ip_;
-    uint16_t    port_;
+    int             socket_fd_;
+    std::string     ip_;
+    uint16_t        port_;
+    HangSlot*       hang_slot_         = nullptr; // waiting for this peer to answer
+    CoverageMap*    coverage_          = nullptr; // set when this peer is coverage-instrumented
+    Schema*         schema_            = nullptr; // layout of the messages this peer receives
+    FixupStage*     fixups_            = nullptr; // applied to what is sent to this peer
+    Dictionary*     dictionary_        = nullptr; // tokens of the redirection, shared by both directions
+    SessionTracker* session_           = nullptr; // shared by the two sides of a channel pair
+    int             session_direction_ = 0;       // what this peer sends: 0 client -> server, 1 back
+    FuzzMode        fuzz_mode_         = FUZZMODE_POST;
+    ThreadMetrics*  metrics_           = nullptr; // what this peer sends, once forwarded
 };
 
 class TCP_ChannelPair {
@@ -39,7 +83,7 @@ class TCP_ChannelPair {
 
     void setClientSide(const TCP_Connection& conn);
     void setServerSide(const TCP_Connection& conn);
-    void startChannelThreads();
+    void startChannelThreads(std::atomic<int>* active);
 
   private:
     TCP_Connection client_side_;
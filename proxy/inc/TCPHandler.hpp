@@ -1,6 +1,7 @@
 #ifndef TCP_HANDLER_HPP
 #define TCP_HANDLER_HPP
 
+#include <atomic>
 #include <vector>
 #include <string>
 #include <pthread.h>
@@ -16,17 +17,20 @@ class TCPHandler {
   public:
     TCPHandler(); // Default
     TCPHandler(const std::vector<utils::EntityConfig>&   tcp_entities,
-               const std::vector<utils::TCPRedirection>& tcp_redirections);
+               const std::vector<utils::TCPRedirection>& tcp_redirections, FuzzMode mode = FUZZMODE_POST);
     ~TCPHandler();
 
     void         addChannelPair(const TCP_ChannelPair& pair);
-    void         printStatus() const;
     static void* _listen_thread(void* args);
 
   private:
+    std::string entityName(const std::string& ip, int port) const;
+
     std::vector<utils::EntityConfig> _entities;
     std::vector<TCP_ChannelPair>     _channelPairs;
     std::vector<int>                 _listenSockets;
+    FuzzMode                         _fuzzMode = FUZZMODE_POST;
+    std::atomic<int>                 _activePairs{0}; // pairs with a forwarding thread still running
 };
 
 #endif // TCP_HANDLER_HPP
@@ -0,0 +1,119 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+/*
+ * Hot-path trace points, compiled in with -DCEZ_TRACE=ON only. Each thread
+ * records complete spans (rdtsc start and end) into its own ring buffer;
+ * SIGUSR2 makes the proxy write all rings as a Chrome/Perfetto JSON trace
+ * to TRACE_DIR. Without CEZ_TRACE the macros expand to nothing.
+ *
+ *   CEZ_TRACE_THREAD("udp recv " + link);  // names the calling thread's track
+ *   { CEZ_TRACE_SCOPE(TRACE_SEND, len); sendto(...); }
+ *   CEZ_TRACE_MARK(t0); len = recv(...); CEZ_TRACE_SPAN(TRACE_RECV, t0, len);
+ */
+
+#include <atomic>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#define TRACE_RING_SIZE 65536 // spans kept per thread, the oldest are overwritten
+#define TRACE_DIR       "/tmp/logs"
+
+enum TraceStage {
+    TRACE_RECV,          // recv/recvmsg, including the wait for a message
+    TRACE_MUTATE,        // FuzzerCore::fuzz, everything below included
+    TRACE_RADAMSA_SPAWN, // pipes and fork of ./radamsa
+    TRACE_PIPE_WRITE,    // input to radamsa
+    TRACE_PIPE_READ,     // radamsa output, until it exits
+    TRACE_NORMALIZE,     // normalizeOutputSize
+    TRACE_COPY,          // assembling the fuzzed message around the original
+    TRACE_FIXUP,         // fix-ups and coverage bookkeeping before send
+    TRACE_SEND,          // send/sendto/sendmsg
+    TRACE_STAGES
+};
+
+struct TraceEvent {
+    uint64_t start;
+    uint64_t end;
+    uint32_t stage;
+    uint32_t bytes;
+};
+
+/*
+ * One thread's spans. Only that thread writes; the dump copies what it finds.
+ * When the thread exits the ring is kept, so a later dump still shows it,
+ * until a new thread takes it over.
+ */
+struct TraceRing {
+    std::string           name;
+    int                   tid;
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> first{0}; // spans before it belong to the ring's previous thread
+    TraceEvent            events[TRACE_RING_SIZE];
+};
+
+class Tracer {
+  public:
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return steadyNs();
+#endif
+    }
+
+    static void record(TraceStage stage, uint64_t start, uint64_t end, size_t bytes)
+    {
+        TraceRing*  ring  = ring_ ? ring_ : attach();
+        uint64_t    slot  = ring->next.load(std::memory_order_relaxed);
+        TraceEvent& event = ring->events[slot % TRACE_RING_SIZE];
+        event.start       = start;
+        event.end         = end;
+        event.stage       = stage;
+        event.bytes       = (uint32_t) bytes;
+        ring->next.store(slot + 1, std::memory_order_release);
+    }
+
+    static void nameThread(const std::string& name);
+    static bool start(); // SIGUSR2 handler and the thread that writes the dumps
+    static bool dump(const std::string& path);
+
+  private:
+    static uint64_t   steadyNs();
+    static TraceRing* attach();
+    static void*      dumpEntry(void* arg);
+
+    static thread_local TraceRing* ring_;
+};
+
+/* Records the span of its enclosing scope. */
+class TraceScope {
+  public:
+    TraceScope(TraceStage stage, size_t bytes = 0) : stage_(stage), bytes_(bytes), start_(Tracer::now()) {}
+    ~TraceScope() { Tracer::record(stage_, start_, Tracer::now(), bytes_); }
+
+  private:
+    TraceStage stage_;
+    size_t     bytes_;
+    uint64_t   start_;
+};
+
+#ifdef CEZ_TRACE
+#define CEZ_TRACE_CONCAT_(a, b)           a##b
+#define CEZ_TRACE_CONCAT(a, b)            CEZ_TRACE_CONCAT_(a, b)
+#define CEZ_TRACE_SCOPE(stage, ...)       TraceScope CEZ_TRACE_CONCAT(trace_scope_, __LINE__)(stage, ##__VA_ARGS__)
+#define CEZ_TRACE_MARK(var)               uint64_t var = Tracer::now()
+#define CEZ_TRACE_SPAN(stage, var, bytes) Tracer::record(stage, var, Tracer::now(), (size_t) (bytes))
+#define CEZ_TRACE_THREAD(name)            Tracer::nameThread(name)
+#define CEZ_TRACE_START()                 Tracer::start()
+#else
+#define CEZ_TRACE_SCOPE(stage, ...)
+#define CEZ_TRACE_MARK(var)
+#define CEZ_TRACE_SPAN(stage, var, bytes)
+#define CEZ_TRACE_THREAD(name)
+#define CEZ_TRACE_START()
+#endif
+
+#endif // TRACE_HPP
@@ -1,10 +1,15 @@
 #ifndef UDP_CONNECTION_HPP
 #define UDP_CONNECTION_HPP
 
+#include <atomic>
 #include <string>
-#include <queue>
-#include <pthread.h>
 #include "ConfigurationManager.hpp" // include struct Connection
+#include "HangWatchdog.hpp"
+#include "Coverage.hpp"
+#include "Dictionary.hpp"
+#include "Schema.hpp"
+#include "Fixup.hpp"
+#include "SessionTracker.hpp"
 
 /**
  * @brief Represents a bidirectional UDP communication channel between two entities.
@@ -16,18 +21,14 @@ class UDPConnection {
                   const std::string& entityB_ip, int entityB_port, int port_entityB_recv, int port_entityB_send)
         : entityA_ip_(entityA_ip), entityA_port_(entityA_port), port_entityA_recv_(port_entityA_recv),
           port_entityA_send_(port_entityA_send), entityB_ip_(entityB_ip), entityB_port_(entityB_port),
-          port_entityB_recv_(port_entityB_recv), port_entityB_send_(port_entityB_send) {
-        pthread_mutex_init(&dynamic_ports_mutex_, nullptr);
-    }
+          port_entityB_recv_(port_entityB_recv), port_entityB_send_(port_entityB_send) {}
 
     // Constructor din struct Connection
     UDPConnection(const utils::Connection& conn)
         : entityA_ip_(conn.entityA_ip), entityA_port_(conn.entityA_port),
           port_entityA_recv_(conn.entityA_proxy_port_recv), port_entityA_send_(conn.entityA_proxy_port_send),
           entityB_ip_(conn.entityB_ip), entityB_port_(conn.entityB_port),
-          port_entityB_recv_(conn.entityB_proxy_port_recv), port_entityB_send_(conn.entityB_proxy_port_send) {
-        pthread_mutex_init(&dynamic_ports_mutex_, nullptr);
-    }
+          port_entityB_recv_(conn.entityB_proxy_port_recv), port_entityB_send_(conn.entityB_proxy_port_send) {}
 
     const std::string& getEntityAIP() const { return entityA_ip_; }
     int                getEntityAPort() const { return entityA_port_; }
@@ -51,23 +52,42 @@ class UDPConnection {
     int  getRecvSockFromEntityB() const { return recv_sock_from_entityB_; }
     void setRecvSockFromEntityB(int sock) { recv_sock_from_entityB_ = sock; }
 
-    void pushDynamicPort(int port) {
-        pthread_mutex_lock(&dynamic_ports_mutex_);
-        dynamic_ports_.push(port);
-        pthread_mutex_unlock(&dynamic_ports_mutex_);
-    }
-
-    bool popDynamicPort(int& port) {
-        pthread_mutex_lock(&dynamic_ports_mutex_);
-        if (dynamic_ports_.empty()) {
-            pthread_mutex_unlock(&dynamic_ports_mutex_);
-            return false;
-        }
-        port = dynamic_ports_.front();
-        dynamic_ports_.pop();
-        pthread_mutex_unlock(&dynamic_ports_mutex_);
-        return true;
-    }
+    HangSlot* getHangSlotA() const { return hang_slot_A_; }
+    void      setHangSlotA(HangSlot* slot) { hang_slot_A_ = slot; }
+
+    HangSlot* getHangSlotB() const { return hang_slot_B_; }
+    void      setHangSlotB(HangSlot* slot) { hang_slot_B_ = slot; }
+
+    CoverageMap* getCoverageA() const { return coverage_A_; }
+    void         setCoverageA(CoverageMap* coverage) { coverage_A_ = coverage; }
+
+    CoverageMap* getCoverageB() const { return coverage_B_; }
+    void         setCoverageB(CoverageMap* coverage) { coverage_B_ = coverage; }
+
+    Schema* getSchemaA() const { return schema_A_; }
+    void    setSchemaA(Schema* schema) { schema_A_ = schema; }
+
+    Schema* getSchemaB() const { return schema_B_; }
+    void    setSchemaB(Schema* schema) { schema_B_ = schema; }
+
+    FixupStage* getFixupsA() const { return fixups_A_; }
+    void        setFixupsA(FixupStage* fixups) { fixups_A_ = fixups; }
+
+    FixupStage* getFixupsB() const { return fixups_B_; }
+    void        setFixupsB(FixupStage* fixups) { fixups_B_ = fixups; }
+
+    SessionTracker* getSession() const { return session_; }
+    void            setSession(SessionTracker* session) { session_ = session; }
+
+    Dictionary* getDictionary() const { return dictionary_; }
+    void        setDictionary(Dictionary* dictionary) { dictionary_ = dictionary; }
+
+    // Port an entity with `port: -1` last sent from, for messages to it that are not replies to a flow
+    int  getLastPortA() const { return last_port_A_.load(std::memory_order_relaxed); }
+    void setLastPortA(int port) { last_port_A_.store(port, std::memory_order_relaxed); }
+
+    int  getLastPortB() const { return last_port_B_.load(std::memory_order_relaxed); }
+    void setLastPortB(int port) { last_port_B_.store(port, std::memory_order_relaxed); }
 
   private:
     std::string entityA_ip_;
@@ -85,8 +105,23 @@ class UDPConnection {
     int recv_sock_from_entityA_ = -1;
     int recv_sock_from_entityB_ = -1;
 
-    std::queue<int> dynamic_ports_;
-    pthread_mutex_t dynamic_ports_mutex_;
+    HangSlot* hang_slot_A_ = nullptr; // waiting for entity A to answer
+    HangSlot* hang_slot_B_ = nullptr; // waiting for entity B to answer
+
+    CoverageMap* coverage_A_ = nullptr; // set when entity A is coverage-instrumented
+    CoverageMap* coverage_B_ = nullptr;
+
+    Schema* schema_A_ = nullptr; // layout of the messages sent to entity A
+    Schema* schema_B_ = nullptr;
+
+    FixupStage* fixups_A_ = nullptr; // applied to what is sent to entity A
+    FixupStage* fixups_B_ = nullptr;
+
+    Dictionary*     dictionary_ = nullptr; // tokens of this connection, both directions
+    SessionTracker* session_    = nullptr;
+
+    std::atomic<int> last_port_A_{-1};
+    std::atomic<int> last_port_B_{-1};
 };
 
 #endif // UDP_CONNECTION_HPP
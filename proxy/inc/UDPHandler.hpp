@@ -1,6 +1,7 @@
 #ifndef UDP_HANDLER_HPP
 #define UDP_HANDLER_HPP
 
+#include <atomic>
 #include <vector>
 #include <unordered_map>
 #include <string>
@@ -9,14 +10,37 @@
 
 #include "UDPConnection.hpp"
 #include "ConfigurationManager.hpp"
+#include "FlowTable.hpp"
 #include "Fuzzer.hpp"
+#include "Metrics.hpp"
+#include "UDPOffload.hpp"
 
 #define MAX_UDP_PAYLOAD_SIZE 65500
 
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+/**
+ * One of the `udp_workers` shards. Every recv port has one SO_REUSEPORT socket
+ * per worker and the kernel steers a client to the same socket every time (by
+ * a hash of its address), so all of a flow's messages go through one worker,
+ * in order, and the worker's flow table is the only one that knows the flow.
+ */
+struct UDPWorker {
+    int        id;
+    FuzzerCore fuzzer;
+    FlowTable  flows;           // clients of entities with `port: -1`
+    int        flow_epoll = -1; // flow sockets, for their replies
+
+    UDPWorker(int id, FuzzMode mode) : id(id), fuzzer(FUZZSTYLE_RANDOMIZATION, mode) {}
+};
+
 class UDPHandler {
   public:
     static UDPHandler* getInstance();
-    UDPHandler(const std::vector<utils::EntityConfig>& entities, char* ip);
+    UDPHandler(const std::vector<utils::EntityConfig>& entities, char* ip, FuzzMode mode = FUZZMODE_POST,
+               int workers = 1, bool offload = false, int max_datagram = UDP_MAX_DATAGRAM, bool transparent = true);
 
     void buildFromConnections(std::vector<utils::Connection>& connections);
     void startRecvThreads();
@@ -26,13 +50,18 @@ class UDPHandler {
     const std::vector<int>&                        getRecvSockets() const;
     const std::vector<UDPConnection*>&             getConnections() const;
     const std::unordered_map<int, UDPConnection*>& getSocketToConnectionMap() const;
+    const std::vector<UDPWorker*>&                 getWorkers() const { return workers_; }
 
   private:
     static UDPHandler* instance_;
 
     std::vector<utils::EntityConfig> entities_;
     std::string                      proxyIP_;
-    FuzzerCore                       fuzzer;
+    std::vector<UDPWorker*>          workers_;
+    bool                             offload_;          // UDP_GRO on every socket, trains of datagrams per read
+    bool                             gso_;              // offload_ and the kernel takes UDP_SEGMENT
+    size_t                           recv_buffer_size_; // per forwarding thread, allocated once
+    bool                             transparent_;      // IP_TRANSPARENT on the forwarding sockets
 
     std::vector<int> recv_sockets_;
     std::vector<int> send_sockets_;
@@ -41,12 +70,24 @@ class UDPHandler {
     std::vector<UDPConnection*>             connections_;
     std::unordered_map<int, UDPConnection*> sock_to_connection_;
 
-    int  createAndBindSocket(int port, bool transparent);
+    struct RecvSocket {
+        int            sock;
+        UDPConnection* conn;
+        int            direction; // 0: receives from entity A
+        UDPWorker*     worker;
+    };
+    std::vector<RecvSocket> recv_workers_;
+
+    int         createAndBindSocket(int port, bool transparent, bool reusePort = false);
+    bool        createWorkerSockets(UDPConnection* conn, int direction, int port, std::vector<RecvSocket>& out);
+    Flow*       flowFor(UDPWorker* worker, const RecvSocket& recv, const sockaddr_in& src);
+    std::string entityName(const std::string& ip, int port) const;
     void setupUDPConnection(std::unique_ptr<UDPConnection> conn);
 
     friend void* socketRecvThread(void* arg);
     static void* recvThreadEntry(void* arg);
     static void* sendThreadEntry(void* arg);
+    static void* flowThreadEntry(void* arg);
 };
 
 #endif // UDP_HANDLER_HPP
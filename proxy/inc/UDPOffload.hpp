@@ -0,0 +1,72 @@
+#ifndef UDP_OFFLOAD_HPP
+#define UDP_OFFLOAD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define UDP_MAX_DATAGRAM   65507 // largest UDP payload over IPv4
+#define UDP_TRAIN_BYTES    65507 // the most one GSO send carries
+#define UDP_TRAIN_SEGMENTS 64    // kernel limit of segments per GSO send
+#define UDP_GRO_BYTES      65535 // the most one GRO read returns
+
+/*
+ * Segmentation offload for the fuzzer's `udp_offload` setting. With UDP_GRO
+ * the kernel hands a socket back-to-back datagrams of one sender as a single
+ * buffer (a train) of equal-size segments; with UDP_SEGMENT one sendmsg()
+ * carries a train that the kernel or the NIC splits into datagrams again.
+ */
+bool udpGsoSupported();
+bool udpEnableGro(int sock);
+
+// Returns the bytes received; `segment` is the size of each datagram in them (the last may be shorter).
+// `truncated` is set when the datagram (or train) did not fit in `capacity`.
+ssize_t udpRecvTrain(int sock, uint8_t* buffer, size_t capacity, sockaddr_in& src, size_t& segment, bool& truncated);
+
+/**
+ * Datagrams to one destination, sent straight from the buffers they were
+ * built in (the fuzzer's output) without copying them. With GSO they are
+ * gathered into trains, all of the same size except a shorter last one, and
+ * a datagram that cannot join the train sends the train first. Without GSO
+ * every datagram goes out as soon as it is added.
+ */
+class UDPTrain {
+  public:
+    UDPTrain(int sock, const sockaddr_in& dst, bool gso);
+    ~UDPTrain() { flush(); }
+
+    void    add(uint8_t* datagram, size_t len); // takes a malloc()ed buffer, freed once sent
+    ssize_t flush();                            // bytes sent, -1 if a send failed (reported with perror)
+
+    size_t sentDatagrams() const { return sent_datagrams_; }
+    size_t sentBytes() const { return sent_bytes_; }
+
+  private:
+    int          sock_;
+    sockaddr_in  dst_;
+    bool         gso_;
+    struct iovec iov_[UDP_TRAIN_SEGMENTS];
+    size_t       used_           = 0;
+    size_t       segment_        = 0;
+    size_t       count_          = 0;
+    bool         closed_         = false; // a shorter datagram ended the train
+    size_t       sent_datagrams_ = 0;
+    size_t       sent_bytes_     = 0;
+
+    ssize_t sendEach();
+};
+
+#endif // UDP_OFFLOAD_HPP
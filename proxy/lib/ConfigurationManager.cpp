@@ -4,6 +4,63 @@
 
 namespace utils {
 
+// A single field name or a [first, last] list
+static std::vector<std::string> field_names(const YAML::Node& node)
+{
+    if (node.IsSequence()) {
+        return node.as<std::vector<std::string>>();
+    }
+    return {node.as<std::string>()};
+}
+
+static FieldConfig parse_field(const YAML::Node& node)
+{
+    FieldConfig field;
+    field.name   = node["name"].as<std::string>();
+    field.type   = node["type"].as<std::string>();
+    field.endian = node["endian"] ? node["endian"].as<std::string>() : "big";
+    if (node["length"]) {
+        field.length = node["length"].as<int>();
+    }
+    if (node["values"]) {
+        field.values = node["values"].as<std::vector<uint64_t>>();
+    }
+    if (node["length_of"]) {
+        field.length_of = field_names(node["length_of"]);
+    }
+    if (node["length_adjust"]) {
+        field.length_adjust = node["length_adjust"].as<int>();
+    }
+    if (node["checksum"]) {
+        field.checksum = node["checksum"].as<std::string>();
+    }
+    if (node["checksum_of"]) {
+        field.checksum_of = field_names(node["checksum_of"]);
+    }
+    return field;
+}
+
+static FixupConfig parse_fixup(const YAML::Node& node)
+{
+    FixupConfig fixup;
+    fixup.type   = node["type"].as<std::string>();
+    fixup.offset = node["offset"].as<int>();
+    fixup.endian = node["endian"] ? node["endian"].as<std::string>() : "big";
+    if (node["width"]) {
+        fixup.width = node["width"].as<int>();
+    }
+    if (node["from"]) {
+        fixup.from = node["from"].as<int>();
+    }
+    if (node["to"]) {
+        fixup.to = node["to"].as<int>();
+    }
+    if (node["adjust"]) {
+        fixup.adjust = node["adjust"].as<int>();
+    }
+    return fixup;
+}
+
 ConfigurationManager::ConfigurationManager(const std::string& config_path) : path_(config_path) {}
 
 bool ConfigurationManager::parse()
@@ -45,6 +102,70 @@ bool ConfigurationManager::parse()
                     }
                 }
 
+                if (data["hang_timeout_ms"]) {
+                    entity.hang_timeout_ms = data["hang_timeout_ms"].as<int>();
+                }
+
+                if (data["fuzz_mode"]) {
+                    entity.fuzz_mode = data["fuzz_mode"].as<std::string>();
+                }
+                if (data["udp_workers"]) {
+                    entity.udp_workers = data["udp_workers"].as<int>();
+                }
+                if (data["udp_offload"]) {
+                    entity.udp_offload = data["udp_offload"].as<bool>();
+                }
+                if (data["udp_max_datagram"]) {
+                    entity.udp_max_datagram = data["udp_max_datagram"].as<int>();
+                }
+                if (data["udp_transparent"]) {
+                    entity.udp_transparent = data["udp_transparent"].as<bool>();
+                }
+                if (data["metrics_port"]) {
+                    entity.metrics_port = data["metrics_port"].as<int>();
+                }
+                if (data["stats_push_ms"]) {
+                    entity.stats_push_ms = data["stats_push_ms"].as<int>();
+                }
+                if (data["pcap_dir"]) {
+                    entity.pcap_dir = data["pcap_dir"].as<std::string>();
+                }
+                if (data["pcap_rotate_mb"]) {
+                    entity.pcap_rotate_mb = data["pcap_rotate_mb"].as<int>();
+                }
+                if (data["pcap_rotate_s"]) {
+                    entity.pcap_rotate_s = data["pcap_rotate_s"].as<int>();
+                }
+                if (data["corpus_dir"]) {
+                    entity.corpus_dir = data["corpus_dir"].as<std::string>();
+                }
+                if (data["power_schedule"]) {
+                    entity.power_schedule = data["power_schedule"].as<std::string>();
+                }
+
+                if (data["coverage_map"]) {
+                    entity.coverage_map = data["coverage_map"].as<std::string>();
+                }
+
+                if (data["schema"]) {
+                    for (const auto& fnode : data["schema"]) {
+                        entity.schema.push_back(parse_field(fnode));
+                    }
+                }
+
+                if (data["message_type"]) {
+                    entity.message_type_offset = data["message_type"]["offset"].as<int>();
+                    if (data["message_type"]["width"]) {
+                        entity.message_type_width = data["message_type"]["width"].as<int>();
+                    }
+                }
+
+                if (data["fixups"]) {
+                    for (const auto& fnode : data["fixups"]) {
+                        entity.fixups.push_back(parse_fixup(fnode));
+                    }
+                }
+
                 if (data["destinations"]) {
                     for (const auto& dst : data["destinations"]) {
                         Destination d;
@@ -72,6 +193,9 @@ bool ConfigurationManager::parse()
                         c.entityB_port            = cnode["entityB_port"].as<int>();
                         c.entityB_proxy_port_recv = cnode["entityB_proxy_port_recv"].as<int>();
                         c.entityB_proxy_port_send = cnode["entityB_proxy_port_send"].as<int>();
+                        if (cnode["dictionary"]) {
+                            c.dictionary = cnode["dictionary"].as<std::vector<std::string>>();
+                        }
                         entity.connections.push_back(c);
                     }
                 }
@@ -82,6 +206,9 @@ bool ConfigurationManager::parse()
                         c.server_ip   = cnode["server_ip"].as<std::string>();
                         c.server_port = cnode["server_port"].as<int>();
                         c.proxy_port  = cnode["proxy_port"].as<int>();
+                        if (cnode["dictionary"]) {
+                            c.dictionary = cnode["dictionary"].as<std::vector<std::string>>();
+                        }
                         entity.tcp_redirections.push_back(c);
                     }
                 }
@@ -36,12 +36,40 @@ struct Connection {
     int         entityB_proxy_port_send;
     int         recv_sock_from_entityB = -1;
     int         send_sock_to_entityB   = -1;
+
+    std::vector<std::string> dictionary; // protocol tokens, \xNN escapes allowed
 };
 
 struct TCPRedirection {
     std::string server_ip;
     uint16_t    server_port;
     uint16_t    proxy_port;
+
+    std::vector<std::string> dictionary;
+};
+
+// One field of a message schema (an entity's `schema`, in message order)
+struct FieldConfig {
+    std::string              name;
+    std::string              type;              // uint8, uint16, uint32, uint64, bytes or string
+    std::string              endian;            // big (default) or little
+    int                      length = 0;        // bytes/string: fixed size, 0 = variable
+    std::vector<uint64_t>    values;            // integers: known (enum) values
+    std::vector<std::string> length_of;         // holds the byte length of a field or [first, last] range
+    int                      length_adjust = 0; // added to the computed length
+    std::string              checksum;          // crc32, crc32c, inet, sum8 or xor8
+    std::vector<std::string> checksum_of;       // field or [first, last] range the checksum covers
+};
+
+// A value recomputed in every message forwarded to an entity (its `fixups`); negative positions count from the end
+struct FixupConfig {
+    std::string        type;       // length, crc32, crc32c, inet, sum8 or xor8
+    int                offset = 0; // where the value is written
+    int                width  = 0; // bytes; 0 = 4 for CRCs, 2 for inet and length, 1 for sum8/xor8
+    std::string        endian;     // big (default) or little
+    int                from = 0;   // first covered byte
+    std::optional<int> to;         // end of the covered bytes (exclusive), end of the message if unset
+    int                adjust = 0; // length only: added to the covered size
 };
 
 struct EntityConfig {
@@ -56,6 +84,24 @@ struct EntityConfig {
     std::vector<std::string> args;
 
     // Optional
+    int                         hang_timeout_ms = 0;      // fuzzer only: no reply on a connection within T ms is a HANG
+    std::string                 fuzz_mode;                // fuzzer only: post (default) or another FuzzMode name
+    int                         udp_workers      = 1;     // fuzzer only: sockets/threads per UDP port (0 = one per CPU)
+    bool                        udp_offload      = false; // fuzzer only: UDP_GRO on receive, UDP_SEGMENT (GSO) on send
+    int                         udp_max_datagram = 65507; // fuzzer only: larger UDP datagrams are cut to this size
+    bool                        udp_transparent  = true;  // fuzzer only: false = plain sockets, peers address the proxy
+    int                         metrics_port     = 0;     // fuzzer only: Prometheus endpoint on 127.0.0.1 (0 = off)
+    int                         stats_push_ms    = 5000;  // fuzzer only: totals pushed to the launcher server (0 = off)
+    std::string                 pcap_dir;                 // fuzzer only: pcapng capture of the traffic (empty = off)
+    int                         pcap_rotate_mb   = 100;   // fuzzer only: new capture file after this many MB
+    int                         pcap_rotate_s    = 0;     // fuzzer only: or after this many seconds (0 = size only)
+    std::string                 corpus_dir;               // fuzzer only: coverage corpora kept on disk (empty = memory)
+    std::string                 power_schedule;           // fuzzer only: guided seed choice, fast (default)/explore/coe
+    std::string                 coverage_map;             // edge map file of a coverage-instrumented target
+    std::vector<FieldConfig>    schema;                   // layout of the messages this entity receives
+    std::vector<FixupConfig>    fixups;                   // lengths/checksums recomputed before sending to it
+    int                         message_type_offset = -1; // where this entity's message type is (-1 = infer)
+    int                         message_type_width  = 1;  // 1-4 bytes
     std::vector<Destination>    destinations;
     std::optional<ConnectTo>    connect_to;
     std::vector<Connection>     connections;
@@ -0,0 +1,378 @@
+#include "Capture.hpp"
+#include "Checksum.hpp"
+#include "Metrics.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#define PCAPNG_SHB        0x0A0D0D0A
+#define PCAPNG_IDB        0x00000001
+#define PCAPNG_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_EPB_HEADER 28  // block type and length, interface, timestamp, captured and original length
+#define LINKTYPE_RAW      101 // the packet starts at the IP header
+#define IPV4_HEADER       20
+#define IPV4_MAX_PACKET   65535
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+PacketCapture*              PacketCapture::instance_ = nullptr;
+std::atomic<PacketCapture*> PacketCapture::active_{nullptr};
+
+// pcapng fields are in the writer's byte order, announced by PCAPNG_BYTE_ORDER
+static void put16(uint8_t* at, uint16_t value)
+{
+    memcpy(at, &value, sizeof(value));
+}
+
+static void put32(uint8_t* at, uint32_t value)
+{
+    memcpy(at, &value, sizeof(value));
+}
+
+static size_t pad4(size_t len)
+{
+    return (len + 3) & ~(size_t) 3;
+}
+
+static void add_option(std::vector<uint8_t>& block, uint16_t code, const void* value, uint16_t len)
+{
+    size_t at = block.size();
+    block.resize(at + 4 + pad4(len));
+    put16(&block[at], code);
+    put16(&block[at + 2], len);
+    if (len > 0) {
+        memcpy(&block[at + 4], value, len);
+    }
+}
+
+// Section header and the two interfaces, at the start of every file
+static std::vector<uint8_t> file_header()
+{
+    std::vector<uint8_t> out(28);
+    int64_t              section_length = -1; // not known in advance
+    put32(&out[0], PCAPNG_SHB);
+    put32(&out[4], 28);
+    put32(&out[8], PCAPNG_BYTE_ORDER);
+    put16(&out[12], 1);
+    put16(&out[14], 0);
+    memcpy(&out[16], &section_length, sizeof(section_length));
+    put32(&out[24], 28);
+
+    const char* names[] = {"original", "mutated"}; // CAPTURE_ORIGINAL, CAPTURE_MUTATED
+    for (const char* name : names) {
+        std::vector<uint8_t> block(16);
+        uint8_t              resolution = 9; // timestamps in ns
+        put16(&block[8], LINKTYPE_RAW);
+        add_option(block, 2, name, (uint16_t) strlen(name)); // if_name
+        add_option(block, 9, &resolution, 1);                // if_tsresol
+        add_option(block, 0, nullptr, 0);                    // opt_endofopt
+        block.resize(block.size() + 4);
+        put32(&block[0], PCAPNG_IDB);
+        put32(&block[4], (uint32_t) block.size());
+        put32(&block[block.size() - 4], (uint32_t) block.size());
+        out.insert(out.end(), block.begin(), block.end());
+    }
+    return out;
+}
+
+PacketCapture::PacketCapture()
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake_, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+PacketCapture* PacketCapture::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new PacketCapture();
+    }
+    return instance_;
+}
+
+CaptureLink PacketCapture::link(uint8_t proto, const sockaddr_in& src, const sockaddr_in& dst)
+{
+    CaptureLink link{};
+    link.proto    = proto;
+    link.src_ip   = src.sin_addr.s_addr;
+    link.dst_ip   = dst.sin_addr.s_addr;
+    link.src_port = ntohs(src.sin_port);
+    link.dst_port = ntohs(dst.sin_port);
+    return link;
+}
+
+CaptureLink PacketCapture::link(uint8_t proto, const std::string& src_ip, uint16_t src_port, const std::string& dst_ip,
+                                uint16_t dst_port)
+{
+    sockaddr_in src{};
+    sockaddr_in dst{};
+    inet_pton(AF_INET, src_ip.c_str(), &src.sin_addr);
+    inet_pton(AF_INET, dst_ip.c_str(), &dst.sin_addr);
+    src.sin_port = htons(src_port);
+    dst.sin_port = htons(dst_port);
+    return link(proto, src, dst);
+}
+
+bool PacketCapture::start(const std::string& dir, int rotate_mb, int rotate_s)
+{
+    dir_          = dir;
+    rotate_bytes_ = (size_t) std::max(rotate_mb, 1) << 20;
+    rotate_s_     = rotate_s;
+
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        perror("[ERROR] [Capture] mkdir");
+        return false;
+    }
+    if (!openFile(0)) {
+        return false;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, writerEntry, this) != 0) {
+        perror("[ERROR] [Capture] pthread_create");
+        closeFile();
+        return false;
+    }
+    pthread_detach(tid);
+
+    Metrics::getInstance()->addGauge("cez_capture_dropped_packets",
+                                     "Packets the pcapng capture left out: its writer fell behind or could not write.",
+                                     [this] { return (double) dropped_.load(std::memory_order_relaxed); });
+    active_.store(this, std::memory_order_release);
+    std::cout << "[INFO] [Capture] pcapng capture in " << dir << ", new file every " << std::max(rotate_mb, 1) << " MB"
+              << (rotate_s > 0 ? " or " + std::to_string(rotate_s) + " s" : "") << std::endl;
+    return true;
+}
+
+/*
+ * Encodes one packet as an Enhanced Packet Block. The headers are built
+ * before taking the lock, which then only covers the copy. UDP and TCP
+ * checksums are left 0: summing every payload again cost more than the rest
+ * of the capture, and Wireshark does not check them by default (for UDP over
+ * IPv4, 0 means "no checksum").
+ */
+void PacketCapture::record(int interface, CaptureLink& link, const uint8_t* payload, size_t len)
+{
+    size_t transport_len = link.proto == IPPROTO_TCP ? 20 : 8;
+    size_t headers_len   = IPV4_HEADER + transport_len;
+    size_t captured      = std::min(len, (size_t) IPV4_MAX_PACKET - headers_len);
+    size_t packet_len    = headers_len + captured;
+    size_t block_len     = PCAPNG_EPB_HEADER + pad4(packet_len) + 4;
+
+    uint8_t  headers[IPV4_HEADER + 20] = {0};
+    uint8_t* ip                        = headers;
+    uint8_t* transport                 = headers + IPV4_HEADER;
+
+    ip[0] = 0x45; // IPv4, no options
+    storeUint(ip + 2, 2, true, packet_len);
+    storeUint(ip + 6, 2, true, 0x4000); // don't fragment
+    ip[8] = 64;
+    ip[9] = link.proto;
+    memcpy(ip + 12, &link.src_ip, 4);
+    memcpy(ip + 16, &link.dst_ip, 4);
+    storeUint(ip + 10, 2, true, inetChecksum(ip, IPV4_HEADER));
+
+    storeUint(transport, 2, true, link.src_port);
+    storeUint(transport + 2, 2, true, link.dst_port);
+    if (link.proto == IPPROTO_TCP) {
+        storeUint(transport + 4, 4, true, link.seq[interface]);
+        transport[12] = 5 << 4; // header length, in words
+        transport[13] = 0x08;   // PSH
+        storeUint(transport + 14, 2, true, 65535);
+        link.seq[interface] += (uint32_t) len;
+    } else {
+        storeUint(transport + 4, 2, true, transport_len + captured);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t ns = (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+
+    pthread_mutex_lock(&mutex_);
+    size_t at = pending_.size();
+    if (at + block_len > CAPTURE_MAX_PENDING) {
+        pthread_mutex_unlock(&mutex_);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    pending_.resize(at + block_len);
+    uint8_t* block = &pending_[at];
+    put32(block, PCAPNG_EPB);
+    put32(block + 4, (uint32_t) block_len);
+    put32(block + 8, (uint32_t) interface);
+    put32(block + 12, (uint32_t) (ns >> 32));
+    put32(block + 16, (uint32_t) ns);
+    put32(block + 20, (uint32_t) packet_len);
+    put32(block + 24, (uint32_t) (headers_len + len));
+    memcpy(block + PCAPNG_EPB_HEADER, headers, headers_len);
+    memcpy(block + PCAPNG_EPB_HEADER + headers_len, payload, captured);
+    put32(block + block_len - 4, (uint32_t) block_len);
+    bool wake = at < CAPTURE_BATCH_BYTES && at + block_len >= CAPTURE_BATCH_BYTES;
+    pthread_mutex_unlock(&mutex_);
+
+    if (wake) {
+        pthread_cond_signal(&wake_);
+    }
+}
+
+/*
+ * A new file mapped for `rotate_bytes_` (more if its first block needs it) and
+ * grown with ftruncate() before each copy, so it never ends in unwritten bytes.
+ * A file that cannot be set up is removed and keeps its number for the retry.
+ */
+bool PacketCapture::openFile(size_t min_size)
+{
+    std::string path = dir_ + "/proxy_" + std::to_string(getpid()) + "_" + std::to_string(file_seq_) + ".pcapng";
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        perror("[ERROR] [Capture] open");
+        return false;
+    }
+    std::vector<uint8_t> header = file_header();
+    map_size_                   = std::max(rotate_bytes_, header.size() + min_size);
+    void* map                   = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+        perror("[ERROR] [Capture] mmap");
+        closeFile();
+        unlink(path.c_str());
+        return false;
+    }
+    map_       = (uint8_t*) map;
+    used_      = 0;
+    opened_at_ = time(nullptr);
+    if (!append(header.data(), header.size())) {
+        closeFile();
+        unlink(path.c_str());
+        return false;
+    }
+    header_size_ = used_;
+    file_seq_++;
+    std::cout << "[INFO] [Capture] Writing " << path << std::endl;
+    return true;
+}
+
+void PacketCapture::closeFile()
+{
+    if (map_) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool PacketCapture::append(const uint8_t* blocks, size_t len)
+{
+    if (ftruncate(fd_, (off_t) (used_ + len)) < 0) {
+        perror("[ERROR] [Capture] ftruncate");
+        return false;
+    }
+    // Fault the new pages in with one call instead of one fault each (EINVAL before Linux 5.14). It also
+    // fails, instead of the copy raising SIGBUS, when the file system has no room left for them.
+    size_t page = used_ & ~(size_t) (sysconf(_SC_PAGESIZE) - 1);
+    if (madvise(map_ + page, used_ + len - page, MADV_POPULATE_WRITE) < 0 && errno != EINVAL) {
+        perror("[ERROR] [Capture] madvise");
+        if (ftruncate(fd_, (off_t) used_) < 0) {
+            perror("[ERROR] [Capture] ftruncate");
+        }
+        return false;
+    }
+    memcpy(map_ + used_, blocks, len);
+    used_ += len;
+    return true;
+}
+
+// Packets (one block each) of a batch from `offset` on
+static size_t count_blocks(const std::vector<uint8_t>& batch, size_t offset)
+{
+    size_t count = 0;
+    while (offset < batch.size()) {
+        uint32_t block;
+        memcpy(&block, &batch[offset + 4], sizeof(block));
+        offset += block;
+        ++count;
+    }
+    return count;
+}
+
+// Copies whole blocks, as many at once as fit in the current file
+void PacketCapture::writeBatch(const std::vector<uint8_t>& batch)
+{
+    if (fd_ >= 0 && rotate_s_ > 0 && used_ > header_size_ && time(nullptr) - opened_at_ >= rotate_s_) {
+        closeFile();
+    }
+
+    size_t offset = 0;
+    while (offset < batch.size()) {
+        uint32_t first;
+        memcpy(&first, &batch[offset + 4], sizeof(first));
+        if (fd_ >= 0 && used_ + first > map_size_) {
+            closeFile();
+        }
+        if (fd_ < 0 && time(nullptr) >= retry_at_ && !openFile(first)) {
+            retry_at_ = time(nullptr) + CAPTURE_RETRY_S;
+            std::cerr << "[WARN] [Capture] Dropping packets for " << CAPTURE_RETRY_S << " s before the next file"
+                      << std::endl;
+        }
+        if (fd_ < 0) {
+            dropped_.fetch_add(count_blocks(batch, offset), std::memory_order_relaxed);
+            return;
+        }
+
+        size_t end = offset;
+        while (end < batch.size()) {
+            uint32_t block;
+            memcpy(&block, &batch[end + 4], sizeof(block));
+            if (used_ + (end - offset) + block > map_size_) {
+                break;
+            }
+            end += block;
+        }
+        if (!append(&batch[offset], end - offset)) {
+            closeFile();
+            dropped_.fetch_add(count_blocks(batch, offset), std::memory_order_relaxed);
+            return;
+        }
+        offset = end;
+    }
+}
+
+void* PacketCapture::writerEntry(void* arg)
+{
+    PacketCapture*       capture = static_cast<PacketCapture*>(arg);
+    std::vector<uint8_t> batch; // swapped with pending_, so both keep their capacity
+
+    while (true) {
+        batch.clear();
+        pthread_mutex_lock(&capture->mutex_);
+        if (capture->pending_.size() < CAPTURE_BATCH_BYTES) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += CAPTURE_BATCH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&capture->wake_, &capture->mutex_, &deadline);
+        }
+        capture->pending_.swap(batch);
+        pthread_mutex_unlock(&capture->mutex_);
+
+        if (!batch.empty()) {
+            capture->writeBatch(batch);
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,245 @@
+#include "Checksum.hpp"
+#include <cstring>
+#include <immintrin.h>
+
+/*
+ * Reflected CRC tables, built once at startup. entry[k][b] is the CRC of byte
+ * b followed by k zero bytes, for slicing-by-8.
+ */
+struct CrcTable {
+    uint32_t entry[8][256];
+    CrcTable(uint32_t polynomial)
+    {
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            uint32_t crc = byte;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+            }
+            entry[0][byte] = crc;
+        }
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            for (int k = 1; k < 8; ++k) {
+                entry[k][byte] = (entry[k - 1][byte] >> 8) ^ entry[0][entry[k - 1][byte] & 0xFF];
+            }
+        }
+    }
+};
+
+static const CrcTable crc32_table(0xEDB88320);
+static const CrcTable crc32c_table(0x82F63B78);
+
+static uint32_t crc_reflected(const CrcTable& table, const uint8_t* data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    size_t   i   = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data + i, sizeof(lo));
+        memcpy(&hi, data + i + 4, sizeof(hi));
+        lo ^= crc;
+        crc = table.entry[7][lo & 0xFF] ^ table.entry[6][(lo >> 8) & 0xFF] ^ table.entry[5][(lo >> 16) & 0xFF] ^
+              table.entry[4][lo >> 24] ^ table.entry[3][hi & 0xFF] ^ table.entry[2][(hi >> 8) & 0xFF] ^
+              table.entry[1][(hi >> 16) & 0xFF] ^ table.entry[0][hi >> 24];
+    }
+    for (; i < len; ++i) {
+        crc = (crc >> 8) ^ table.entry[0][(crc ^ data[i]) & 0xFF];
+    }
+    return ~crc;
+}
+
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(const uint8_t* data, size_t len)
+{
+    uint64_t crc = 0xFFFFFFFF;
+    size_t   i   = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+    }
+    uint32_t crc32 = (uint32_t) crc;
+    for (; i < len; ++i) {
+        crc32 = _mm_crc32_u8(crc32, data[i]);
+    }
+    return ~crc32;
+}
+
+/*
+ * Ones' complement sums: the sum of 16-bit words is the same in either byte
+ * order once byte-swapped (RFC 1071), so the vector versions add native
+ * little-endian words and swap the folded result at the end.
+ */
+
+static uint16_t fold_inet(uint64_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t) sum;
+}
+
+// Sum of the big-endian words of data[start, len), an odd last byte padded with zero
+static uint64_t inet_tail(const uint8_t* data, size_t start, size_t len)
+{
+    uint64_t sum = 0;
+    size_t   i   = start;
+    for (; i + 2 <= len; i += 2) {
+        sum += (uint32_t) (data[i] << 8 | data[i + 1]);
+    }
+    if (i < len) {
+        sum += (uint32_t) data[i] << 8;
+    }
+    return sum;
+}
+
+static uint16_t swap16(uint16_t value)
+{
+    return (uint16_t) (value << 8 | value >> 8);
+}
+
+// 32-bit lanes take at most this many 16-bit additions before they are spilled
+#define INET_SPILL_STEPS 32768
+
+static uint16_t inet_sse2(const uint8_t* data, size_t len)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    uint64_t      total = 0;
+    size_t        i     = 0;
+
+    while (i + 16 <= len) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t steps = 0; steps < INET_SPILL_STEPS && i + 16 <= len; ++steps, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+            acc       = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc       = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*) lanes, acc);
+        total += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    uint16_t vector_sum = swap16(fold_inet(total));
+    return (uint16_t) ~fold_inet(vector_sum + inet_tail(data, i, len));
+}
+
+__attribute__((target("avx2"))) static uint16_t inet_avx2(const uint8_t* data, size_t len)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    uint64_t      total = 0;
+    size_t        i     = 0;
+
+    while (i + 32 <= len) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t steps = 0; steps < INET_SPILL_STEPS && i + 32 <= len; ++steps, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+            acc       = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc       = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*) lanes, acc);
+        for (uint32_t lane : lanes) {
+            total += lane;
+        }
+    }
+    uint16_t vector_sum = swap16(fold_inet(total));
+    return (uint16_t) ~fold_inet(vector_sum + inet_tail(data, i, len));
+}
+
+static const struct ChecksumKernels {
+    uint32_t (*crc32c)(const uint8_t* data, size_t len);
+    uint16_t (*inet)(const uint8_t* data, size_t len);
+    ChecksumKernels()
+    {
+        __builtin_cpu_init();
+        crc32c = __builtin_cpu_supports("sse4.2") ? crc32c_sse42 : crc32cScalar;
+        inet   = __builtin_cpu_supports("avx2") ? inet_avx2 : inet_sse2;
+    }
+} kernels;
+
+ChecksumType parseChecksumType(const std::string& name)
+{
+    if (name == "crc32") {
+        return CHECKSUM_CRC32;
+    }
+    if (name == "crc32c") {
+        return CHECKSUM_CRC32C;
+    }
+    if (name == "inet") {
+        return CHECKSUM_INET;
+    }
+    if (name == "sum8") {
+        return CHECKSUM_SUM8;
+    }
+    if (name == "xor8") {
+        return CHECKSUM_XOR8;
+    }
+    return CHECKSUM_NONE;
+}
+
+uint32_t crc32(const uint8_t* data, size_t len)
+{
+    return crc_reflected(crc32_table, data, len);
+}
+
+uint32_t crc32c(const uint8_t* data, size_t len)
+{
+    return kernels.crc32c(data, len);
+}
+
+uint32_t crc32cScalar(const uint8_t* data, size_t len)
+{
+    return crc_reflected(crc32c_table, data, len);
+}
+
+uint16_t inetChecksum(const uint8_t* data, size_t len)
+{
+    return kernels.inet(data, len);
+}
+
+uint16_t inetChecksumScalar(const uint8_t* data, size_t len)
+{
+    return (uint16_t) ~fold_inet(inet_tail(data, 0, len));
+}
+
+uint32_t computeChecksum(ChecksumType type, const uint8_t* data, size_t len)
+{
+    uint8_t acc = 0;
+    switch (type) {
+        case CHECKSUM_CRC32:
+            return crc32(data, len);
+        case CHECKSUM_CRC32C:
+            return crc32c(data, len);
+        case CHECKSUM_INET:
+            return inetChecksum(data, len);
+        case CHECKSUM_SUM8:
+            for (size_t i = 0; i < len; ++i) {
+                acc = (uint8_t) (acc + data[i]);
+            }
+            return acc;
+        case CHECKSUM_XOR8:
+            for (size_t i = 0; i < len; ++i) {
+                acc ^= data[i];
+            }
+            return acc;
+        case CHECKSUM_NONE:
+            break;
+    }
+    return 0;
+}
+
+uint64_t loadUint(const uint8_t* data, uint32_t width, bool big_endian)
+{
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < width; ++i) {
+        uint32_t byte = big_endian ? i : width - 1 - i;
+        value         = value << 8 | data[byte];
+    }
+    return value;
+}
+
+void storeUint(uint8_t* data, uint32_t width, bool big_endian, uint64_t value)
+{
+    for (uint32_t i = 0; i < width; ++i) {
+        uint32_t byte = big_endian ? width - 1 - i : i;
+        data[byte]    = (uint8_t) value;
+        value >>= 8;
+    }
+}
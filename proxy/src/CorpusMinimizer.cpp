@@ -0,0 +1,680 @@
+#include "CorpusMinimizer.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+extern char** environ;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// ========== Popcount kernels ==========
+
+// Edges of `index`/`bits` that are not in `covered`
+typedef uint32_t (*GainKernel)(const uint16_t* index, const uint64_t* bits, size_t count, const uint64_t* covered);
+
+static uint32_t gain_generic(const uint16_t* index, const uint64_t* bits, size_t count, const uint64_t* covered)
+{
+    uint32_t gain = 0;
+    for (size_t i = 0; i < count; ++i) {
+        gain += __builtin_popcountll(bits[i] & ~covered[index[i]]);
+    }
+    return gain;
+}
+
+// Same loop; with the instruction available gcc stops calling into libgcc for every word
+__attribute__((target("popcnt"))) static uint32_t gain_popcnt(const uint16_t* index, const uint64_t* bits,
+                                                             size_t count, const uint64_t* covered)
+{
+    uint32_t gain = 0;
+    for (size_t i = 0; i < count; ++i) {
+        gain += __builtin_popcountll(bits[i] & ~covered[index[i]]);
+    }
+    return gain;
+}
+
+static GainKernel gain_kernel()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt") ? gain_popcnt : gain_generic;
+}
+
+/*
+ * Eight map counters -> eight bits, one per non-zero counter: the high bit of
+ * each byte is set if any of its bits is, then the multiply gathers the high
+ * bits into the top byte (byte b -> bit b).
+ */
+static uint64_t nonzero_bytes(uint64_t counters)
+{
+    uint64_t high = (((counters & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | counters) & 0x8080808080808080ull;
+    return ((high >> 7) * 0x0102040810204080ull) >> 56;
+}
+
+// ========== Target instances ==========
+
+// Whether something listens on `port` in this thread's network namespace (any address, IPv4 or IPv6)
+static bool listening(bool tcp, int port)
+{
+    const char* tables[2][2] = {{"/proc/thread-self/net/udp", "/proc/thread-self/net/udp6"},
+                                {"/proc/thread-self/net/tcp", "/proc/thread-self/net/tcp6"}};
+    char        local_port[8];
+    snprintf(local_port, sizeof(local_port), ":%04X", port);
+
+    for (const char* table : tables[tcp]) {
+        std::ifstream file(table);
+        std::string   line;
+        std::getline(file, line); // header
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string        slot, local, remote, state;
+            fields >> slot >> local >> remote >> state;
+            bool port_matches = local.size() > 5 && local.compare(local.size() - 5, 5, local_port) == 0;
+            if (port_matches && (!tcp || state == "0A")) { // 0A: TCP_LISTEN
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// A new network namespace only has a loopback interface, and it is down
+static bool loopback_up()
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("[ERROR] socket (loopback)");
+        return false;
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, "lo", IFNAMSIZ - 1);
+    bool up = ioctl(fd, SIOCGIFFLAGS, &ifr) == 0;
+    ifr.ifr_flags |= IFF_UP;
+    up = up && ioctl(fd, SIOCSIFFLAGS, &ifr) == 0;
+    if (!up) {
+        perror("[ERROR] ioctl (loopback up)");
+    }
+    close(fd);
+    return up;
+}
+
+// ========== CorpusMinimizer ==========
+
+CorpusMinimizer::CorpusMinimizer(const CminOptions& options) : options_(options) {}
+
+void CorpusMinimizer::usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s --cmin [options] CONFIG [-- TARGET [ARGS...]]\n"
+            "  --entity NAME             target whose corpus is minimized (default: the only one with a coverage_map)\n"
+            "  --out DIR                 where the kept inputs go (default: <corpus_dir>/<entity>.cmin)\n"
+            "  --replace                 then move the corpus to <dir>.orig and the result in its place\n"
+            "  --jobs N                  target instances replaying in parallel (default: one per CPU)\n"
+            "  --timeout-ms MS           longest a single input may take, then the target is hung (default 1000)\n"
+            "  --settle-ms MS            no reply: an input is done once the map is still this long (default 5)\n"
+            "  --startup-timeout-ms MS   longest wait for TARGET to listen (default 5000)\n"
+            "TARGET defaults to the entity's exec_with, binary_path and args; it must be built with CEZ_COVERAGE.\n",
+            argv0);
+}
+
+bool CorpusMinimizer::parseOptions(int argc, char* argv[], CminOptions& options)
+{
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            if (!options.config.empty()) {
+                return false;
+            }
+            options.config = arg;
+            continue;
+        }
+        if (arg == "--replace") {
+            options.replace = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--entity") {
+            options.entity = value;
+        } else if (arg == "--out") {
+            options.out = value;
+        } else if (arg == "--jobs") {
+            options.jobs = atoi(value);
+        } else if (arg == "--timeout-ms") {
+            options.timeout_ms = atoi(value);
+        } else if (arg == "--settle-ms") {
+            options.settle_ms = atoi(value);
+        } else if (arg == "--startup-timeout-ms") {
+            options.startup_timeout_ms = atoi(value);
+        } else {
+            return false;
+        }
+    }
+    for (++i; i < argc; ++i) {
+        options.target.push_back(argv[i]);
+    }
+    return !options.config.empty() && options.timeout_ms > 0 && options.settle_ms > 0;
+}
+
+bool CorpusMinimizer::loadConfig()
+{
+    utils::ConfigurationManager cm(options_.config);
+    if (!cm.parse()) {
+        printf("[ERROR] utils::ConfigurationManager::parse()\n");
+        return false;
+    }
+    utils::EntityConfig fuzzer = cm.getFuzzer();
+    if (fuzzer.corpus_dir.empty()) {
+        fprintf(stderr, "[ERROR] [Cmin] The fuzzer has no corpus_dir; only corpora kept on disk can be minimized\n");
+        return false;
+    }
+
+    int found = 0;
+    for (const auto& entity : cm.getEntities()) {
+        bool wanted = options_.entity.empty() ? !entity.coverage_map.empty() : entity.name == options_.entity;
+        if (wanted && entity.role != "fuzzer") {
+            entity_ = entity;
+            ++found;
+        }
+    }
+    if (found != 1) {
+        fprintf(stderr, "[ERROR] [Cmin] %s\n",
+                options_.entity.empty() ? "Pick the entity with --entity: not exactly one has a coverage_map"
+                                        : ("No entity named " + options_.entity).c_str());
+        return false;
+    }
+    if ((entity_.protocol != "udp" && entity_.protocol != "tcp") || entity_.port <= 0) {
+        fprintf(stderr, "[ERROR] [Cmin] %s does not listen on a UDP or TCP port\n", entity_.name.c_str());
+        return false;
+    }
+
+    in_dir_ = fuzzer.corpus_dir + "/" + entity_.name;
+    if (options_.out.empty()) {
+        options_.out = in_dir_ + ".cmin";
+    }
+    if (options_.target.empty()) {
+        if (entity_.binary_path.empty()) {
+            fprintf(stderr, "[ERROR] [Cmin] %s has no binary_path; give the target after --\n", entity_.name.c_str());
+            return false;
+        }
+        if (!entity_.exec_with.empty()) {
+            options_.target.push_back(entity_.exec_with);
+        }
+        options_.target.push_back(entity_.binary_path);
+        options_.target.insert(options_.target.end(), entity_.args.begin(), entity_.args.end());
+    }
+    return true;
+}
+
+bool CorpusMinimizer::run()
+{
+    if (!loadConfig()) {
+        return false;
+    }
+    struct stat st;
+    if (stat((in_dir_ + "/index.dat").c_str(), &st) != 0) {
+        fprintf(stderr, "[ERROR] [Cmin] No corpus in %s\n", in_dir_.c_str());
+        return false;
+    }
+    in_ = std::make_unique<CorpusStore>(in_dir_);
+    if (!in_->open()) {
+        return false;
+    }
+    if (in_->size() == 0) {
+        fprintf(stderr, "[ERROR] [Cmin] The corpus in %s is empty\n", in_dir_.c_str());
+        return false;
+    }
+    if (stat((options_.out + "/index.dat").c_str(), &st) == 0) {
+        fprintf(stderr, "[ERROR] [Cmin] %s already holds a corpus\n", options_.out.c_str());
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    auto start = std::chrono::steady_clock::now();
+    if (!replayAll()) {
+        return false;
+    }
+    std::vector<size_t> kept = select();
+    if (kept.empty()) {
+        // Nothing to cover with: an uninstrumented target, or a map it does not write to
+        fprintf(stderr, "[ERROR] [Cmin] No input reached any edge; is %s built with CEZ_COVERAGE? %s is untouched\n",
+                options_.target[0].c_str(), in_dir_.c_str());
+        return false;
+    }
+    double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!write(kept)) {
+        return false;
+    }
+
+    uint64_t bytes_in = 0, bytes_out = 0;
+    for (const Cover& cover : covers_) {
+        bytes_in += cover.size;
+    }
+    for (size_t index : kept) {
+        bytes_out += covers_[index].size;
+    }
+    printf("[INFO] [Cmin] Kept %zu of %zu inputs (%.1f of %.1f KB) in %s, %.1f s; %zu crashed, %zu hung the target\n",
+           kept.size(), covers_.size(), bytes_out / 1024.0, bytes_in / 1024.0, options_.out.c_str(), took,
+           crashes_.load(), hangs_.load());
+
+    if (options_.replace) {
+        std::string orig = in_dir_ + ".orig";
+        if (stat(orig.c_str(), &st) == 0) {
+            fprintf(stderr, "[ERROR] [Cmin] %s already exists; the result stays in %s\n", orig.c_str(),
+                    options_.out.c_str());
+            return false;
+        }
+        if (rename(in_dir_.c_str(), orig.c_str()) < 0 || rename(options_.out.c_str(), in_dir_.c_str()) < 0) {
+            perror("[ERROR] rename (corpus)");
+            return false;
+        }
+        printf("[INFO] [Cmin] %s now holds the minimized corpus, the original is in %s\n", in_dir_.c_str(),
+               orig.c_str());
+    }
+    return true;
+}
+
+/*
+ * Whether namespaces can be made is found out on a throwaway thread: unshare()
+ * only moves the calling thread, and this one must stay where it is.
+ */
+bool CorpusMinimizer::replayAll()
+{
+    covers_.resize(in_->size());
+
+    int error = 0;
+    std::thread([this, &error]() {
+        isolated_ = unshare(CLONE_NEWNET) == 0;
+        error     = errno;
+    }).join();
+    long jobs = options_.jobs > 0 ? options_.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (!isolated_ && jobs > 1) {
+        fprintf(stderr, "[WARN] [Cmin] unshare(CLONE_NEWNET): %s; replaying on one instance, on port %d here\n",
+                strerror(error), entity_.port);
+    }
+    jobs = isolated_ ? std::max<long>(1, std::min<long>(jobs, (long) covers_.size())) : 1;
+    printf("[INFO] [Cmin] Replaying %zu inputs of %s on %ld instance(s) of %s\n", covers_.size(),
+           entity_.name.c_str(), jobs, options_.target[0].c_str());
+
+    std::vector<std::thread> workers;
+    for (long id = 0; id < jobs; ++id) {
+        workers.emplace_back(&CorpusMinimizer::work, this, (int) id);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return !failed_;
+}
+
+void CorpusMinimizer::work(int id)
+{
+    if (isolated_ && unshare(CLONE_NEWNET) < 0) {
+        perror("[ERROR] unshare (network namespace)");
+        failed_ = true;
+        return;
+    }
+    if (isolated_ && !loopback_up()) {
+        failed_ = true;
+        return;
+    }
+
+    Instance instance;
+    instance.id       = id;
+    instance.map_path = "/dev/shm/cez_cmin_" + std::to_string(getpid()) + "_" + std::to_string(id) + ".map";
+    int fd            = open(instance.map_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || ftruncate(fd, COVERAGE_MAP_SIZE) < 0) {
+        perror("[ERROR] open (cmin coverage map)");
+        failed_ = true;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    void* map = mmap(nullptr, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("[ERROR] mmap (cmin coverage map)");
+        failed_ = true;
+        unlink(instance.map_path.c_str());
+        return;
+    }
+    instance.map = (uint8_t*) map;
+
+    size_t total = covers_.size();
+    size_t step  = std::max<size_t>(1, total / 10);
+    while (!failed_) {
+        if (instance.pid < 0 && !launch(instance)) {
+            failed_ = true;
+            break;
+        }
+        size_t index = next_++;
+        if (index >= total) {
+            break;
+        }
+        const uint8_t* data;
+        size_t         size;
+        if (!in_->view(index, data, size)) {
+            continue; // left out of the result
+        }
+        if (!replay(instance, data, size, covers_[index])) {
+            stop(instance); // launched again for the next input
+        }
+        size_t done = ++replayed_;
+        if (done % step == 0 || done == total) {
+            printf("[INFO] [Cmin] %zu/%zu inputs replayed\n", done, total);
+        }
+    }
+
+    stop(instance);
+    munmap(instance.map, COVERAGE_MAP_SIZE);
+    unlink(instance.map_path.c_str());
+}
+
+bool CorpusMinimizer::launch(Instance& instance)
+{
+    std::vector<std::string> env;
+    for (char** var = environ; var && *var; ++var) {
+        if (strncmp(*var, "CEZ_COVERAGE_MAP=", strlen("CEZ_COVERAGE_MAP=")) != 0) {
+            env.push_back(*var);
+        }
+    }
+    env.push_back("CEZ_COVERAGE_MAP=" + instance.map_path);
+
+    std::vector<char*> argv, envp;
+    for (const std::string& arg : options_.target) {
+        argv.push_back((char*) arg.c_str());
+    }
+    argv.push_back(nullptr);
+    for (const std::string& var : env) {
+        envp.push_back((char*) var.c_str());
+    }
+    envp.push_back(nullptr);
+
+    // The target's own output is of no use here; SIGPIPE is ignored in this process and must not be in it
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_init(&attr);
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    pid_t pid = -1;
+    int   ret = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), envp.data());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (ret != 0) {
+        fprintf(stderr, "[ERROR] posix_spawnp(%s): %s\n", argv[0], strerror(ret));
+        return false;
+    }
+    instance.pid = pid;
+
+    bool     tcp      = entity_.protocol == "tcp";
+    uint64_t deadline = now_ns() + (uint64_t) options_.startup_timeout_ms * 1000000ull;
+    while (!listening(tcp, entity_.port)) {
+        bool exited = waitpid(pid, nullptr, WNOHANG) == pid;
+        if (exited || now_ns() > deadline) {
+            fprintf(stderr, "[ERROR] [Cmin] %s is not listening on %s port %d\n", argv[0], tcp ? "TCP" : "UDP",
+                    entity_.port);
+            if (exited) {
+                instance.pid = -1; // already reaped
+            }
+            stop(instance);
+            return false;
+        }
+        usleep(10000);
+    }
+    return true;
+}
+
+void CorpusMinimizer::stop(Instance& instance)
+{
+    if (instance.pid > 0) {
+        kill(instance.pid, SIGKILL);
+        waitpid(instance.pid, nullptr, 0);
+        instance.pid = -1;
+    }
+}
+
+/*
+ * Sends one input on a fresh socket and waits for the first reply, the map
+ * to settle, or the timeout. Returns false when the instance crashed or hung
+ * and has to be replaced; the input keeps the coverage it reached anyway.
+ */
+bool CorpusMinimizer::replay(Instance& instance, const uint8_t* data, size_t size, Cover& cover)
+{
+    bool tcp = entity_.protocol == "tcp";
+    memset(instance.map, 0, COVERAGE_MAP_SIZE);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(entity_.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    uint64_t start   = now_ns();
+    bool     replied = false, hung = false;
+    int      sock    = socket(AF_INET, (tcp ? SOCK_STREAM : SOCK_DGRAM) | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("[ERROR] socket (cmin)");
+    } else if (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("[ERROR] connect (cmin)");
+    } else {
+        for (size_t sent = 0; sent < size;) {
+            ssize_t n = send(sock, data + sent, size - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            sent += (size_t) n;
+        }
+
+        const uint64_t* words   = (const uint64_t*) instance.map;
+        uint64_t        last    = 0;
+        uint64_t        changed = start;
+        uint8_t         reply[65536];
+        while (true) {
+            struct pollfd pfd = {sock, POLLIN, 0};
+            if (poll(&pfd, 1, 1) > 0) {
+                ssize_t n = recv(sock, reply, sizeof(reply), MSG_DONTWAIT);
+                replied   = n > 0;
+                if (n >= 0 || errno == ECONNREFUSED || errno == ECONNRESET) {
+                    break; // a reply, the peer closed, or it is gone
+                }
+            }
+
+            uint64_t hash = 0, any = 0;
+            for (size_t w = 0; w < CMIN_WORDS * 8; ++w) {
+                hash = (hash ^ words[w]) * 0x100000001B3ull;
+                any |= words[w];
+            }
+            uint64_t now = now_ns();
+            if (hash != last) {
+                last    = hash;
+                changed = now;
+            } else if (any != 0 && now - changed >= (uint64_t) options_.settle_ms * 1000000ull) {
+                break;
+            }
+            if (now - start >= (uint64_t) options_.timeout_ms * 1000000ull) {
+                hung = any != 0;
+                break;
+            }
+        }
+    }
+    if (sock >= 0) {
+        close(sock);
+    }
+
+    if (replied) {
+        cover.info.exec_us = (uint32_t) std::min<uint64_t>((now_ns() - start) / 1000, UINT32_MAX);
+    }
+    CoverageMap::describe(instance.map, cover.info);
+    const uint64_t* words = (const uint64_t*) instance.map;
+    for (size_t w = 0; w < CMIN_WORDS; ++w) {
+        uint64_t bits = 0;
+        for (size_t k = 0; k < 8; ++k) {
+            if (words[w * 8 + k] != 0) {
+                bits |= nonzero_bytes(words[w * 8 + k]) << (k * 8);
+            }
+        }
+        if (bits != 0) {
+            cover.index.push_back((uint16_t) w);
+            cover.bits.push_back(bits);
+        }
+    }
+    cover.size = (uint32_t) size;
+    cover.done = true;
+
+    size_t index = &cover - covers_.data();
+    int    status;
+    if (waitpid(instance.pid, &status, WNOHANG) == instance.pid) {
+        ++crashes_;
+        printf("[WARN] [Cmin] Input %zu: the target %s %d\n", index, WIFSIGNALED(status) ? "died of signal" : "exited",
+               WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+        instance.pid = -1;
+        return false;
+    }
+    if (hung) {
+        ++hangs_;
+        printf("[WARN] [Cmin] Input %zu: the target was still running after %d ms\n", index, options_.timeout_ms);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Greedy set cover, after leaving out all but the smallest of the inputs
+ * with identical coverage.
+ */
+std::vector<size_t> CorpusMinimizer::select()
+{
+    struct Candidate {
+        uint32_t gain;
+        uint32_t size;
+        size_t   index;
+        bool     operator<(const Candidate& other) const // the heap's top is the largest
+        {
+            if (gain != other.gain) {
+                return gain < other.gain;
+            }
+            return size != other.size ? size > other.size : index > other.index;
+        }
+    };
+
+    std::unordered_map<uint64_t, size_t> smallest; // coverage hash -> input
+    for (size_t i = 0; i < covers_.size(); ++i) {
+        const Cover& cover = covers_[i];
+        if (!cover.done || cover.bits.empty()) {
+            continue;
+        }
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (size_t w = 0; w < cover.bits.size(); ++w) {
+            hash = (hash ^ cover.index[w]) * 0x100000001B3ull;
+            hash = (hash ^ cover.bits[w]) * 0x100000001B3ull;
+        }
+        auto it = smallest.find(hash);
+        if (it == smallest.end()) {
+            smallest.emplace(hash, i);
+        } else if (cover.size < covers_[it->second].size) {
+            it->second = i;
+        }
+    }
+
+    GainKernel                     gain = gain_kernel();
+    std::vector<uint64_t>          covered(CMIN_WORDS, 0);
+    std::priority_queue<Candidate> heap;
+    for (const auto& entry : smallest) {
+        const Cover& cover = covers_[entry.second];
+        heap.push({gain(cover.index.data(), cover.bits.data(), cover.bits.size(), covered.data()), cover.size,
+                   entry.second});
+    }
+
+    std::vector<size_t> kept;
+    size_t              edges = 0;
+    while (!heap.empty()) {
+        Candidate top = heap.top();
+        heap.pop();
+        const Cover& cover = covers_[top.index];
+        top.gain           = gain(cover.index.data(), cover.bits.data(), cover.bits.size(), covered.data());
+        if (top.gain == 0) {
+            continue;
+        }
+        if (!heap.empty() && top < heap.top()) {
+            heap.push(top); // another input may add more now
+            continue;
+        }
+        for (size_t w = 0; w < cover.bits.size(); ++w) {
+            covered[cover.index[w]] |= cover.bits[w];
+        }
+        edges += top.gain;
+        kept.push_back(top.index);
+    }
+    printf("[INFO] [Cmin] %zu edges, %zu distinct coverages, covered by %zu inputs\n", edges, smallest.size(),
+           kept.size());
+    return kept;
+}
+
+/*
+ * The kept inputs go in their original order, with what the campaign knew
+ * about them; what it did not know is filled in from the replay.
+ */
+bool CorpusMinimizer::write(const std::vector<size_t>& kept)
+{
+    CorpusStore out(options_.out);
+    if (!out.open()) {
+        return false;
+    }
+
+    std::vector<size_t> order(kept);
+    std::sort(order.begin(), order.end());
+    for (size_t index : order) {
+        const uint8_t* data;
+        size_t         size;
+        CorpusEntry    entry;
+        if (!in_->view(index, data, size) || !in_->entry(index, entry)) {
+            continue;
+        }
+        const SeedInfo& replayed = covers_[index].info;
+        SeedInfo        info     = entry.info;
+        info.path                = info.path ? info.path : replayed.path;
+        info.exec_us             = info.exec_us ? info.exec_us : replayed.exec_us;
+        info.edges               = info.edges ? info.edges : replayed.edges;
+        out.add(data, size, info);
+    }
+    return true;
+}
@@ -0,0 +1,363 @@
+#include "CorpusStore.hpp"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define CORPUS_MAGIC   0x3150524F435A4543ull // "CEZCORP1"
+#define CORPUS_VERSION 2
+
+/*
+ * MurmurHash64A. Inputs are at most 64 KB and only hashed when added, so a
+ * 64-bit hash is collision-free for any realistic corpus.
+ */
+static uint64_t hash_input(const uint8_t* data, size_t size)
+{
+    const uint64_t m = 0xC6A4A7935BD1E995ull;
+    const int      r = 47;
+    uint64_t       h = 0x9E3779B97F4A7C15ull ^ (size * m);
+
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t k;
+        memcpy(&k, data + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    const uint8_t* tail = data + words * 8;
+    switch (size & 7) {
+        case 7: h ^= (uint64_t) tail[6] << 48; [[fallthrough]];
+        case 6: h ^= (uint64_t) tail[5] << 40; [[fallthrough]];
+        case 5: h ^= (uint64_t) tail[4] << 32; [[fallthrough]];
+        case 4: h ^= (uint64_t) tail[3] << 24; [[fallthrough]];
+        case 3: h ^= (uint64_t) tail[2] << 16; [[fallthrough]];
+        case 2: h ^= (uint64_t) tail[1] << 8; [[fallthrough]];
+        case 1:
+            h ^= (uint64_t) tail[0];
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h == 0 ? 1 : h; // 0 marks a free slot in the hash table
+}
+
+// mkdir -p
+static bool make_dirs(const std::string& path)
+{
+    for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) < 0 && errno != EEXIST) {
+            perror(("[ERROR] [Corpus] mkdir " + prefix).c_str());
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+CorpusStore::CorpusStore(const std::string& dir) : dir_(dir)
+{
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_mutex_init(&map_mutex_, nullptr);
+}
+
+CorpusStore::~CorpusStore()
+{
+    for (auto& mapping : segments_) {
+        const uint8_t* base = mapping.load(std::memory_order_relaxed);
+        if (base != nullptr) {
+            munmap((void*) base, CORPUS_SEGMENT_SIZE);
+        }
+    }
+    if (header_ != nullptr) {
+        munmap(header_, CORPUS_INDEX_HEADER + (size_t) CORPUS_MAX_ENTRIES * sizeof(CorpusEntry));
+    }
+    if (segment_fd_ >= 0) {
+        close(segment_fd_);
+    }
+    if (index_fd_ >= 0) {
+        close(index_fd_);
+    }
+    pthread_mutex_destroy(&map_mutex_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+std::string CorpusStore::segmentPath(uint32_t segment) const
+{
+    return dir_ + "/segment_" + std::to_string(segment) + ".dat";
+}
+
+/*
+ * The index is mapped at its largest size once; the file behind it grows as
+ * entries are added, and only entries below `count` are ever touched.
+ */
+bool CorpusStore::open()
+{
+    if (!make_dirs(dir_)) {
+        return false;
+    }
+    std::string path = dir_ + "/index.dat";
+    index_fd_        = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (index_fd_ < 0) {
+        perror("[ERROR] [Corpus] open (index)");
+        return false;
+    }
+
+    flock(index_fd_, LOCK_EX);
+    bool        ok = false;
+    struct stat st;
+    if (fstat(index_fd_, &st) < 0) {
+        perror("[ERROR] [Corpus] fstat (index)");
+    } else if (st.st_size == 0 &&
+               ftruncate(index_fd_, CORPUS_INDEX_HEADER + (off_t) CORPUS_INDEX_GROW * sizeof(CorpusEntry)) < 0) {
+        perror("[ERROR] [Corpus] ftruncate (index)");
+    } else {
+        void* map = mmap(nullptr, CORPUS_INDEX_HEADER + (size_t) CORPUS_MAX_ENTRIES * sizeof(CorpusEntry),
+                         PROT_READ | PROT_WRITE, MAP_SHARED, index_fd_, 0);
+        if (map == MAP_FAILED) {
+            perror("[ERROR] [Corpus] mmap (index)");
+        } else {
+            header_  = (CorpusIndexHeader*) map;
+            entries_ = (CorpusEntry*) ((uint8_t*) map + CORPUS_INDEX_HEADER);
+            ok       = true;
+        }
+    }
+
+    if (ok && st.st_size == 0) {
+        header_->magic      = CORPUS_MAGIC;
+        header_->version    = CORPUS_VERSION;
+        header_->entry_size = sizeof(CorpusEntry);
+        header_->capacity   = CORPUS_INDEX_GROW;
+    } else if (ok) {
+        uint64_t room = ((uint64_t) st.st_size - std::min<uint64_t>(st.st_size, CORPUS_INDEX_HEADER)) /
+                        sizeof(CorpusEntry);
+        if (header_->magic != CORPUS_MAGIC || header_->version != CORPUS_VERSION ||
+            header_->entry_size != sizeof(CorpusEntry) || header_->count > room || header_->capacity > room) {
+            fprintf(stderr, "[ERROR] [Corpus] %s is not a corpus index (or a damaged one)\n", path.c_str());
+            ok = false;
+        }
+    }
+    if (ok) {
+        catchUp();
+    }
+    flock(index_fd_, LOCK_UN);
+
+    if (ok) {
+        std::cout << "[INFO] [Corpus] " << dir_ << ": " << size() << " inputs" << std::endl;
+    }
+    return ok;
+}
+
+/*
+ * Called with mutex_ and the flock held.
+ */
+bool CorpusStore::growIndex()
+{
+    uint64_t capacity = header_->capacity + CORPUS_INDEX_GROW;
+    if (capacity > CORPUS_MAX_ENTRIES) {
+        fprintf(stderr, "[ERROR] [Corpus] %s is full (%u inputs)\n", dir_.c_str(), CORPUS_MAX_ENTRIES);
+        return false;
+    }
+    if (ftruncate(index_fd_, CORPUS_INDEX_HEADER + (off_t) capacity * sizeof(CorpusEntry)) < 0) {
+        perror("[ERROR] [Corpus] ftruncate (index)");
+        return false;
+    }
+    header_->capacity = capacity;
+    return true;
+}
+
+/*
+ * Segment files are created at their full size (sparse), so a reader's mapping
+ * never runs past the end of the file.
+ */
+bool CorpusStore::openSegment(uint32_t segment)
+{
+    if (segment_fd_ >= 0 && segment_id_ == segment) {
+        return true;
+    }
+    if (segment_fd_ >= 0) {
+        close(segment_fd_);
+    }
+    segment_fd_ = ::open(segmentPath(segment).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (segment_fd_ < 0) {
+        perror("[ERROR] [Corpus] open (segment)");
+        return false;
+    }
+    segment_id_ = segment;
+
+    struct stat st;
+    if (fstat(segment_fd_, &st) == 0 && st.st_size < (off_t) CORPUS_SEGMENT_SIZE &&
+        ftruncate(segment_fd_, CORPUS_SEGMENT_SIZE) < 0) {
+        perror("[ERROR] [Corpus] ftruncate (segment)");
+        close(segment_fd_);
+        segment_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+const uint8_t* CorpusStore::segment(uint32_t segment)
+{
+    if (segment >= CORPUS_MAX_SEGMENTS) {
+        return nullptr;
+    }
+    const uint8_t* base = segments_[segment].load(std::memory_order_acquire);
+    if (base != nullptr) {
+        return base;
+    }
+
+    pthread_mutex_lock(&map_mutex_);
+    base = segments_[segment].load(std::memory_order_relaxed);
+    if (base == nullptr) {
+        int fd = ::open(segmentPath(segment).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("[ERROR] [Corpus] open (segment)");
+        } else {
+            void* map = mmap(nullptr, CORPUS_SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (map == MAP_FAILED) {
+                perror("[ERROR] [Corpus] mmap (segment)");
+            } else {
+                base = (const uint8_t*) map;
+                segments_[segment].store(base, std::memory_order_release);
+            }
+        }
+    }
+    pthread_mutex_unlock(&map_mutex_);
+    return base;
+}
+
+/*
+ * Linear probing over a power-of-two table kept at most half full.
+ */
+bool CorpusStore::insertHash(uint64_t hash)
+{
+    if ((hashed_ + 1) * 2 > hashes_.size()) {
+        std::vector<uint64_t> old;
+        old.swap(hashes_);
+        hashes_.assign(std::max<size_t>(old.size() * 2, 1024), 0);
+        for (uint64_t h : old) {
+            for (size_t slot = h & (hashes_.size() - 1); h != 0; slot = (slot + 1) & (hashes_.size() - 1)) {
+                if (hashes_[slot] == 0) {
+                    hashes_[slot] = h;
+                    break;
+                }
+            }
+        }
+    }
+    for (size_t slot = hash & (hashes_.size() - 1);; slot = (slot + 1) & (hashes_.size() - 1)) {
+        if (hashes_[slot] == hash) {
+            return false;
+        }
+        if (hashes_[slot] == 0) {
+            hashes_[slot] = hash;
+            return true;
+        }
+    }
+}
+
+/*
+ * Hashes the entries other processes added since the last look. Called with
+ * the flock held.
+ */
+void CorpusStore::catchUp()
+{
+    size_t count = header_->count;
+    while (hashed_ < count) {
+        insertHash(entries_[hashed_].hash);
+        ++hashed_;
+    }
+}
+
+bool CorpusStore::add(const uint8_t* data, size_t size, const SeedInfo& info)
+{
+    if (size == 0 || size > CORPUS_SEGMENT_SIZE) {
+        return false;
+    }
+    uint64_t hash = hash_input(data, size);
+
+    pthread_mutex_lock(&mutex_);
+    flock(index_fd_, LOCK_EX);
+    catchUp();
+
+    bool     added   = false;
+    uint32_t segment = header_->segment;
+    uint64_t offset  = header_->tail;
+    if (offset + size > CORPUS_SEGMENT_SIZE) {
+        ++segment;
+        offset = 0;
+    }
+
+    size_t count = header_->count;
+    bool   fresh = insertHash(hash);
+    if (!fresh) {
+        // already there
+    } else if (segment >= CORPUS_MAX_SEGMENTS) {
+        fprintf(stderr, "[ERROR] [Corpus] %s is full (%u segments)\n", dir_.c_str(), CORPUS_MAX_SEGMENTS);
+    } else if ((count < header_->capacity || growIndex()) && openSegment(segment)) {
+        if (pwrite(segment_fd_, data, size, (off_t) offset) != (ssize_t) size) {
+            perror("[ERROR] [Corpus] pwrite (segment)");
+        } else {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            entries_[count] = {hash, offset, segment, (uint32_t) size,
+                               (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec, info};
+            header_->segment = segment;
+            header_->tail    = offset + size;
+            __atomic_store_n(&header_->count, count + 1, __ATOMIC_RELEASE);
+            added = true;
+        }
+    }
+    if (added) {
+        ++hashed_;
+    } else if (fresh) {
+        // Not written: forget the hash so a later add can retry (errors only, so rebuilding is fine)
+        hashes_.clear();
+        hashed_ = 0;
+        catchUp();
+    }
+
+    flock(index_fd_, LOCK_UN);
+    pthread_mutex_unlock(&mutex_);
+    return added;
+}
+
+/*
+ * `data` stays valid as long as the store: segments are never unmapped or
+ * rewritten.
+ */
+bool CorpusStore::view(size_t index, const uint8_t*& data, size_t& size)
+{
+    if (index >= this->size()) {
+        return false;
+    }
+    const CorpusEntry& entry = entries_[index];
+    const uint8_t*     base  = segment(entry.segment);
+    if (base == nullptr || entry.offset + entry.size > CORPUS_SEGMENT_SIZE) {
+        return false;
+    }
+    data = base + entry.offset;
+    size = entry.size;
+    return true;
+}
+
+bool CorpusStore::entry(size_t index, CorpusEntry& entry)
+{
+    if (index >= this->size()) {
+        return false;
+    }
+    entry = entries_[index];
+    return true;
+}
@@ -0,0 +1,341 @@
+#include "Coverage.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+CoverageFeedback* CoverageFeedback::instance_ = nullptr;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Hit count -> bucket bit: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+.
+ */
+static uint8_t bucket_of(uint8_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    if (count <= 3) {
+        return (uint8_t) (1 << (count - 1));
+    }
+    if (count <= 7) {
+        return 8;
+    }
+    if (count <= 15) {
+        return 16;
+    }
+    if (count <= 31) {
+        return 32;
+    }
+    return count <= 127 ? 64 : 128;
+}
+
+static const struct BucketTable {
+    uint8_t bucket[256];
+    BucketTable()
+    {
+        for (int count = 0; count < 256; ++count) {
+            bucket[count] = bucket_of((uint8_t) count);
+        }
+    }
+} bucket_table;
+
+// ========== Corpus ==========
+
+Corpus::Corpus()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+Corpus::~Corpus()
+{
+    pthread_mutex_destroy(&mutex_);
+}
+
+/*
+ * Inputs already in `dir` (from an earlier run, or another proxy sharing it)
+ * are part of the corpus from now on. Called at startup, before any
+ * forwarding thread uses the corpus.
+ */
+bool Corpus::persist(const std::string& dir)
+{
+    std::unique_ptr<CorpusStore> store = std::make_unique<CorpusStore>(dir);
+    if (!store->open()) {
+        return false;
+    }
+    pthread_mutex_lock(&mutex_);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        store->add(entries_[i].data(), entries_[i].size(), infos_[i]);
+    }
+    entries_.clear();
+    infos_.clear();
+    store_ = std::move(store);
+    pthread_mutex_unlock(&mutex_);
+    return true;
+}
+
+void Corpus::setSchedule(PowerSchedule schedule)
+{
+    pthread_mutex_lock(&mutex_);
+    scheduler_.setSchedule(schedule);
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool Corpus::add(const uint8_t* data, size_t size, const SeedInfo& info)
+{
+    if (size == 0) {
+        return false;
+    }
+    if (size > MAX_CORPUS_INPUT) {
+        size = MAX_CORPUS_INPUT;
+    }
+    if (store_) {
+        return store_->add(data, size, info);
+    }
+
+    pthread_mutex_lock(&mutex_);
+    bool added = entries_.size() < MAX_CORPUS_ENTRIES;
+    if (added) {
+        entries_.emplace_back(data, data + size);
+        infos_.push_back(info);
+    }
+    pthread_mutex_unlock(&mutex_);
+    return added;
+}
+
+bool Corpus::pick(std::vector<uint8_t>& out)
+{
+    pthread_mutex_lock(&mutex_);
+    size_t count = store_ ? store_->size() : entries_.size();
+    if (count == 0) {
+        pthread_mutex_unlock(&mutex_);
+        return false;
+    }
+    // The scheduler learns about the inputs added since (here or, with a store, by other proxies)
+    while (scheduler_.size() < count) {
+        CorpusEntry entry{};
+        if (!store_) {
+            entry.info = infos_[scheduler_.size()];
+            entry.size = (uint32_t) entries_[scheduler_.size()].size();
+        } else if (!store_->entry(scheduler_.size(), entry)) {
+            break;
+        }
+        scheduler_.add(entry.info, entry.size);
+    }
+    // xorshift64; the scheduler only needs it cheap and roughly uniform
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    size_t index  = scheduler_.pick(rng_);
+    bool   picked = true;
+    if (store_) {
+        const uint8_t* data;
+        size_t         size;
+        picked = store_->view(index, data, size);
+        if (picked) {
+            out.assign(data, data + size);
+        }
+    } else {
+        out = entries_[index];
+    }
+    pthread_mutex_unlock(&mutex_);
+    return picked;
+}
+
+size_t Corpus::size()
+{
+    if (store_) {
+        return store_->size();
+    }
+    pthread_mutex_lock(&mutex_);
+    size_t count = entries_.size();
+    pthread_mutex_unlock(&mutex_);
+    return count;
+}
+
+// ========== CoverageMap ==========
+
+CoverageMap::CoverageMap(const std::string& entity, const std::string& path)
+    : entity_(entity), path_(path), virgin_(COVERAGE_MAP_SIZE, 0xff)
+{
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+CoverageMap::~CoverageMap()
+{
+    if (map_ != nullptr) {
+        munmap(map_, COVERAGE_MAP_SIZE);
+    }
+    pthread_mutex_destroy(&mutex_);
+}
+
+/*
+ * Either side may create the map file first; both size it the same way.
+ */
+bool CoverageMap::open()
+{
+    int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror("[ERROR] open (coverage map)");
+        return false;
+    }
+    if (ftruncate(fd, COVERAGE_MAP_SIZE) < 0) {
+        perror("[ERROR] ftruncate (coverage map)");
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("[ERROR] mmap (coverage map)");
+        return false;
+    }
+
+    map_ = (uint8_t*) map;
+    memset(map_, 0, COVERAGE_MAP_SIZE);
+    std::cout << "[INFO] [Coverage] " << entity_ << " -> " << path_ << std::endl;
+    return true;
+}
+
+/*
+ * Walks the map a word at a time (most of it is zero), records the buckets
+ * that were never seen before and clears what it read. `info` gets the path
+ * the message took: a hash of its buckets, its edges and how many were new.
+ */
+bool CoverageMap::collectNewCoverage(SeedInfo& info)
+{
+    bool         found = false;
+    uint64_t*    words = (uint64_t*) map_;
+    const size_t count = COVERAGE_MAP_SIZE / sizeof(uint64_t);
+
+    for (size_t w = 0; w < count; ++w) {
+        if (words[w] == 0) {
+            continue;
+        }
+        uint8_t* hits = (uint8_t*) &words[w];
+        for (size_t b = 0; b < sizeof(uint64_t); ++b) {
+            size_t  edge   = w * sizeof(uint64_t) + b;
+            uint8_t bucket = bucket_table.bucket[hits[b]];
+            if (bucket == 0) {
+                continue;
+            }
+            info.path = (info.path ^ (edge << 8 | bucket)) * 0x100000001B3ull;
+            info.edges += info.edges < UINT16_MAX;
+            if (bucket & virgin_[edge]) {
+                if (virgin_[edge] == 0xff) {
+                    ++edges_;
+                    ++info.new_edges;
+                }
+                virgin_[edge] &= (uint8_t) ~bucket;
+                found = true;
+            }
+        }
+        // The target may bump a counter between the read and the clear; that hit is simply lost.
+        words[w] = 0;
+    }
+    return found;
+}
+
+// The path hash and edge count collectNewCoverage() would give, for a map that is not a campaign's
+void CoverageMap::describe(const uint8_t* map, SeedInfo& info)
+{
+    for (size_t edge = 0; edge < COVERAGE_MAP_SIZE; ++edge) {
+        uint8_t bucket = bucket_table.bucket[map[edge]];
+        if (bucket != 0) {
+            info.path = (info.path ^ (edge << 8 | bucket)) * 0x100000001B3ull;
+            info.edges += info.edges < UINT16_MAX;
+        }
+    }
+}
+
+void CoverageMap::recordSent(const uint8_t* data, size_t size)
+{
+    if (map_ == nullptr) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    SeedInfo info;
+    bool     found   = collectNewCoverage(info);
+    uint64_t sent    = sent_ns_.load(std::memory_order_relaxed);
+    uint64_t replied = replied_ns_.load(std::memory_order_relaxed);
+    if (replied > sent) {
+        info.exec_us = (uint32_t) std::min<uint64_t>((replied - sent) / 1000, UINT32_MAX);
+    }
+    corpus_.hitPath(info.path);
+    if (found && !pending_.empty() && corpus_.add(pending_.data(), pending_.size(), info)) {
+        std::cout << "[INFO] [Coverage] " << entity_ << ": new coverage (" << edges_ << " edges), corpus size "
+                  << corpus_.size() << std::endl;
+    }
+    pending_.assign(data, data + std::min<size_t>(size, MAX_CORPUS_INPUT));
+    sent_ns_.store(now_ns(), std::memory_order_relaxed);
+    pthread_mutex_unlock(&mutex_);
+}
+
+/*
+ * Called for every message from the target, so it only compares and maybe
+ * stores a timestamp; the first reply after a forwarded message times it.
+ */
+void CoverageMap::recordReply(CoverageMap* map)
+{
+    if (map == nullptr) {
+        return;
+    }
+    uint64_t sent = map->sent_ns_.load(std::memory_order_relaxed);
+    if (sent != 0 && map->replied_ns_.load(std::memory_order_relaxed) < sent) {
+        map->replied_ns_.store(now_ns(), std::memory_order_relaxed);
+    }
+}
+
+// ========== CoverageFeedback ==========
+
+CoverageFeedback* CoverageFeedback::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new CoverageFeedback();
+    }
+    return instance_;
+}
+
+/*
+ * With a `corpus_dir`, each target's corpus is kept in <corpus_dir>/<entity>.
+ */
+void CoverageFeedback::addTargets(const std::vector<utils::EntityConfig>& entities, const std::string& corpus_dir,
+                                  PowerSchedule schedule)
+{
+    for (const auto& entity : entities) {
+        if (entity.coverage_map.empty()) {
+            continue;
+        }
+        CoverageMap* map = new CoverageMap(entity.name, entity.coverage_map);
+        if (!map->open()) {
+            delete map;
+            continue;
+        }
+        map->corpus().setSchedule(schedule);
+        if (!corpus_dir.empty() && !map->corpus().persist(corpus_dir + "/" + entity.name)) {
+            std::cerr << "[WARN] [Coverage] " << entity.name << ": corpus kept in memory only" << std::endl;
+        }
+        maps_[entity.name] = map;
+    }
+}
+
+/*
+ * Returns nullptr for targets without a coverage map.
+ */
+CoverageMap* CoverageFeedback::forEntity(const std::string& name)
+{
+    auto it = maps_.find(name);
+    return it == maps_.end() ? nullptr : it->second;
+}
@@ -0,0 +1,236 @@
+#include "Dictionary.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+Dictionary::Dictionary()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+    memset(slots_, -1, sizeof(slots_));
+    memset(counters_, 0, sizeof(counters_));
+    offsets_.push_back(0);
+}
+
+Dictionary::Dictionary(const std::vector<std::string>& tokens) : Dictionary()
+{
+    for (const auto& token : tokens) {
+        if (!addEscaped(token)) {
+            std::cerr << "[WARN] [Dictionary] Skipping token \"" << token << "\" (duplicate or not "
+                      << MIN_TOKEN_LENGTH << "-" << MAX_TOKEN_LENGTH << " bytes)" << std::endl;
+        }
+    }
+}
+
+Dictionary::~Dictionary()
+{
+    pthread_mutex_destroy(&mutex_);
+}
+
+static bool is_text(uint8_t c)
+{
+    return isprint(c) || c == '\r' || c == '\n' || c == '\t';
+}
+
+// FNV-1a
+uint32_t Dictionary::hash(const uint8_t* data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+bool Dictionary::containsLocked(const uint8_t* token, size_t len, uint32_t h)
+{
+    for (uint32_t probe = 0; probe < DICT_HASH_SLOTS; ++probe) {
+        int32_t index = slots_[(h + probe) & (DICT_HASH_SLOTS - 1)];
+        if (index < 0) {
+            return false;
+        }
+        size_t begin = offsets_[index];
+        if (offsets_[index + 1] - begin == len && memcmp(&arena_[begin], token, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Dictionary::addLocked(const uint8_t* token, size_t len)
+{
+    if (len < MIN_TOKEN_LENGTH || len > MAX_TOKEN_LENGTH || offsets_.size() > MAX_DICT_TOKENS) {
+        return false;
+    }
+
+    uint32_t h = hash(token, len);
+    if (containsLocked(token, len, h)) {
+        return false;
+    }
+
+    uint32_t slot = h & (DICT_HASH_SLOTS - 1);
+    while (slots_[slot] >= 0) {
+        slot = (slot + 1) & (DICT_HASH_SLOTS - 1);
+    }
+    slots_[slot] = (int32_t) offsets_.size() - 1;
+    arena_.insert(arena_.end(), token, token + len);
+    offsets_.push_back((uint32_t) arena_.size());
+    return true;
+}
+
+bool Dictionary::add(const uint8_t* token, size_t len)
+{
+    pthread_mutex_lock(&mutex_);
+    bool added = addLocked(token, len);
+    pthread_mutex_unlock(&mutex_);
+    return added;
+}
+
+bool Dictionary::addEscaped(const std::string& token)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < token.size(); ++i) {
+        if (token[i] != '\\' || i + 1 == token.size()) {
+            bytes.push_back((uint8_t) token[i]);
+            continue;
+        }
+        char escape = token[++i];
+        if (escape == 'x' && i + 2 < token.size() && isxdigit((unsigned char) token[i + 1]) &&
+            isxdigit((unsigned char) token[i + 2])) {
+            bytes.push_back((uint8_t) strtoul(token.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else if (escape == 'n') {
+            bytes.push_back('\n');
+        } else if (escape == 'r') {
+            bytes.push_back('\r');
+        } else if (escape == 't') {
+            bytes.push_back('\t');
+        } else {
+            bytes.push_back((uint8_t) escape);
+        }
+    }
+    return add(bytes.data(), bytes.size());
+}
+
+bool Dictionary::contains(const uint8_t* token, size_t len)
+{
+    pthread_mutex_lock(&mutex_);
+    bool found = containsLocked(token, len, hash(token, len));
+    pthread_mutex_unlock(&mutex_);
+    return found;
+}
+
+bool Dictionary::pick(uint32_t random, std::vector<uint8_t>& out)
+{
+    pthread_mutex_lock(&mutex_);
+    size_t count = offsets_.size() - 1;
+    if (count == 0) {
+        pthread_mutex_unlock(&mutex_);
+        return false;
+    }
+    size_t index = random % count;
+    out.assign(arena_.begin() + offsets_[index], arena_.begin() + offsets_[index + 1]);
+    pthread_mutex_unlock(&mutex_);
+    return true;
+}
+
+size_t Dictionary::size()
+{
+    pthread_mutex_lock(&mutex_);
+    size_t count = offsets_.size() - 1;
+    pthread_mutex_unlock(&mutex_);
+    return count;
+}
+
+/*
+ * Counters are shared by all candidates; a collision only makes a token
+ * appear a bit earlier. A counter stops at LEARN_MIN_HITS.
+ */
+void Dictionary::countCandidate(const uint8_t* token, size_t len)
+{
+    uint8_t& counter = counters_[hash(token, len) & (LEARN_COUNTERS - 1)];
+    if (counter == LEARN_MIN_HITS) {
+        return;
+    }
+    if (++counter == LEARN_MIN_HITS && addLocked(token, len)) {
+        std::cout << "[DEBUG] [Dictionary] Learned token of " << len << " bytes" << std::endl;
+    }
+}
+
+void Dictionary::learnMagic(const uint8_t* message, size_t len)
+{
+    size_t span = len < MAGIC_SPAN ? len : MAGIC_SPAN;
+
+    if (messages_ == 0) {
+        memcpy(magic_, message, span);
+        magic_len_    = span;
+        magic_stable_ = (uint8_t) ((1u << span) - 1);
+    } else {
+        magic_len_ = span < magic_len_ ? span : magic_len_;
+        for (size_t i = 0; i < MAGIC_SPAN; ++i) {
+            if (i >= magic_len_ || message[i] != magic_[i]) {
+                magic_stable_ &= (uint8_t) ~(1u << i);
+            }
+        }
+    }
+
+    if (++messages_ != MAGIC_MIN_MESSAGES) {
+        return;
+    }
+    // The leading run of bytes that stayed the same across the first messages
+    size_t run = 0;
+    while (run < magic_len_ && (magic_stable_ & (1u << run))) {
+        ++run;
+    }
+    if (addLocked(magic_, run)) {
+        std::cout << "[DEBUG] [Dictionary] Learned " << run << "-byte magic" << std::endl;
+    }
+}
+
+void Dictionary::learn(const uint8_t* message, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    uint64_t seen = seen_.fetch_add(1, std::memory_order_relaxed);
+    if (seen >= LEARN_WARMUP && seen % LEARN_SAMPLE != 0) {
+        return;
+    }
+    size_t scan = len < LEARN_SCAN_BYTES ? len : LEARN_SCAN_BYTES;
+
+    pthread_mutex_lock(&mutex_);
+    if (offsets_.size() > MAX_DICT_TOKENS) {
+        pthread_mutex_unlock(&mutex_);
+        return;
+    }
+
+    if (messages_ < MAGIC_MIN_MESSAGES) {
+        learnMagic(message, len);
+    }
+
+    size_t run_start = 0;
+    for (size_t i = 0; i <= scan; ++i) {
+        bool printable = i < scan && isgraph(message[i]);
+        if (printable) {
+            continue;
+        }
+        size_t run = i - run_start;
+        if (run >= 3 && run <= MAX_TOKEN_LENGTH) {
+            countCandidate(message + run_start, run);
+        }
+        run_start = i + 1;
+    }
+
+    // Binary n-grams: skip plain text (the runs cover it) and runs of one byte value (padding)
+    for (size_t i = 0; i + 4 <= scan; ++i) {
+        const uint8_t* gram = message + i;
+        if (is_text(gram[0]) && is_text(gram[1]) && is_text(gram[2]) && is_text(gram[3])) {
+            continue;
+        }
+        if (gram[0] == gram[1] && gram[1] == gram[2] && gram[2] == gram[3]) {
+            continue;
+        }
+        countCandidate(gram, 4);
+    }
+    pthread_mutex_unlock(&mutex_);
+}
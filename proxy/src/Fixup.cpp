@@ -0,0 +1,121 @@
+#include "Fixup.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+FixupRegistry* FixupRegistry::instance_ = nullptr;
+
+static uint32_t default_width(ChecksumType checksum)
+{
+    switch (checksum) {
+        case CHECKSUM_CRC32:
+        case CHECKSUM_CRC32C:
+            return 4;
+        case CHECKSUM_SUM8:
+        case CHECKSUM_XOR8:
+            return 1;
+        case CHECKSUM_INET:
+        case CHECKSUM_NONE:
+            break;
+    }
+    return 2;
+}
+
+// Negative positions count from the end; false if outside [0, len]
+static bool resolve(int position, size_t len, size_t& out)
+{
+    int64_t resolved = position < 0 ? (int64_t) len + position : position;
+    if (resolved < 0 || (uint64_t) resolved > len) {
+        return false;
+    }
+    out = (size_t) resolved;
+    return true;
+}
+
+FixupStage* FixupStage::compile(const std::string& entity, const std::vector<utils::FixupConfig>& fixups)
+{
+    FixupStage* stage = new FixupStage();
+
+    for (const auto& config : fixups) {
+        Fixup fixup;
+        fixup.is_length  = config.type == "length";
+        fixup.checksum   = fixup.is_length ? CHECKSUM_NONE : parseChecksumType(config.type);
+        fixup.offset     = config.offset;
+        fixup.width      = config.width > 0 ? (uint32_t) config.width : default_width(fixup.checksum);
+        fixup.big_endian = config.endian != "little";
+        fixup.from       = config.from;
+        fixup.to         = config.to.value_or(0);
+        fixup.to_end     = !config.to.has_value();
+        fixup.adjust     = config.adjust;
+
+        if (!fixup.is_length && fixup.checksum == CHECKSUM_NONE) {
+            std::cerr << "[ERROR] [Fixup] " << entity << ": unknown fixup type \"" << config.type << "\"" << std::endl;
+            delete stage;
+            return nullptr;
+        }
+        if (fixup.width > 8) {
+            std::cerr << "[ERROR] [Fixup] " << entity << ": " << config.type << " width must be 1-8 bytes" << std::endl;
+            delete stage;
+            return nullptr;
+        }
+        stage->fixups_.push_back(fixup);
+    }
+
+    std::stable_partition(stage->fixups_.begin(), stage->fixups_.end(),
+                          [](const Fixup& fixup) { return fixup.is_length; });
+    std::cout << "[INFO] [Fixup] " << entity << ": " << stage->fixups_.size() << " fix-ups" << std::endl;
+    return stage;
+}
+
+void FixupStage::apply(uint8_t* data, size_t len) const
+{
+    for (const Fixup& fixup : fixups_) {
+        size_t offset, from, to = len;
+        if (!resolve(fixup.offset, len, offset) || offset + fixup.width > len || !resolve(fixup.from, len, from) ||
+            (!fixup.to_end && !resolve(fixup.to, len, to)) || from > to) {
+            continue;
+        }
+
+        if (fixup.is_length) {
+            storeUint(data + offset, fixup.width, fixup.big_endian, (uint64_t) (to - from) + fixup.adjust);
+            continue;
+        }
+        if (offset < to && offset + fixup.width > from) {
+            memset(data + offset, 0, fixup.width);
+        }
+        uint32_t checksum = computeChecksum(fixup.checksum, data + from, to - from);
+        storeUint(data + offset, fixup.width, fixup.big_endian, checksum);
+    }
+}
+
+// ========== FixupRegistry ==========
+
+FixupRegistry* FixupRegistry::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new FixupRegistry();
+    }
+    return instance_;
+}
+
+void FixupRegistry::addTargets(const std::vector<utils::EntityConfig>& entities)
+{
+    for (const auto& entity : entities) {
+        if (entity.fixups.empty()) {
+            continue;
+        }
+        FixupStage* stage = FixupStage::compile(entity.name, entity.fixups);
+        if (stage != nullptr) {
+            stages_[entity.name] = stage;
+        }
+    }
+}
+
+/*
+ * Returns nullptr for targets without fix-ups.
+ */
+FixupStage* FixupRegistry::forEntity(const std::string& name)
+{
+    auto it = stages_.find(name);
+    return it == stages_.end() ? nullptr : it->second;
+}
@@ -0,0 +1,179 @@
+#include "FlowTable.hpp"
+#include <unistd.h>
+#include <time.h>
+
+static Flow        TOMBSTONE_FLOW;
+static Flow* const TOMBSTONE = &TOMBSTONE_FLOW;
+
+FlowTable::FlowTable()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+    slots_.store(allocate(), std::memory_order_relaxed);
+}
+
+FlowTable::~FlowTable()
+{
+    Slot* slots = slots_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FLOW_TABLE_SLOTS; ++i) {
+        Flow* flow = slots[i].load(std::memory_order_relaxed);
+        if (flow != nullptr && flow != TOMBSTONE) {
+            close(flow->sock);
+            delete flow;
+        }
+    }
+    delete[] slots;
+    for (const auto& retired : retired_flows_) {
+        close(retired.item->sock);
+        delete retired.item;
+    }
+    for (const auto& retired : retired_slots_) {
+        delete[] retired.item;
+    }
+    pthread_mutex_destroy(&mutex_);
+}
+
+uint64_t FlowTable::makeKey(const sockaddr_in& src, int proxy_port)
+{
+    return ((uint64_t) src.sin_addr.s_addr << 32) | ((uint64_t) src.sin_port << 16) | (uint16_t) proxy_port;
+}
+
+int64_t FlowTable::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Finalizer of MurmurHash3's 64-bit variant
+uint32_t FlowTable::hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+FlowTable::Slot* FlowTable::allocate()
+{
+    Slot* slots = new Slot[FLOW_TABLE_SLOTS];
+    for (size_t i = 0; i < FLOW_TABLE_SLOTS; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+    return slots;
+}
+
+Flow* FlowTable::find(uint64_t key) const
+{
+    Slot*    slots = slots_.load(std::memory_order_acquire);
+    uint32_t index = hash(key);
+    for (uint32_t probe = 0; probe < FLOW_TABLE_SLOTS; ++probe, ++index) {
+        Flow* flow = slots[index & (FLOW_TABLE_SLOTS - 1)].load(std::memory_order_acquire);
+        if (flow == nullptr) {
+            return nullptr;
+        }
+        if (flow != TOMBSTONE && flow->key == key) {
+            return flow;
+        }
+    }
+    return nullptr;
+}
+
+// Into a table that holds no flow with the same key
+void FlowTable::place(Slot* slots, Flow* flow)
+{
+    uint32_t index = hash(flow->key);
+    while (true) {
+        Slot& slot    = slots[index++ & (FLOW_TABLE_SLOTS - 1)];
+        Flow* current = slot.load(std::memory_order_relaxed);
+        if (current == nullptr || current == TOMBSTONE) {
+            slot.store(flow, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+Flow* FlowTable::insert(Flow* flow)
+{
+    pthread_mutex_lock(&mutex_);
+    Flow* existing = find(flow->key);
+    if (existing != nullptr) {
+        pthread_mutex_unlock(&mutex_);
+        return existing;
+    }
+    if (count_.load(std::memory_order_relaxed) >= FLOW_TABLE_SLOTS / 4 * 3) {
+        pthread_mutex_unlock(&mutex_);
+        return nullptr;
+    }
+    // Reusing a tombstone is fine: readers skip it either way
+    Slot*    slots = slots_.load(std::memory_order_relaxed);
+    uint32_t index = hash(flow->key);
+    while (true) {
+        Slot& slot    = slots[index++ & (FLOW_TABLE_SLOTS - 1)];
+        Flow* current = slot.load(std::memory_order_relaxed);
+        if (current == nullptr || current == TOMBSTONE) {
+            tombstones_ -= current == TOMBSTONE;
+            slot.store(flow, std::memory_order_release);
+            break;
+        }
+    }
+    count_.fetch_add(1, std::memory_order_relaxed);
+    pthread_mutex_unlock(&mutex_);
+    return flow;
+}
+
+void FlowTable::expire(int64_t now_ms, int64_t idle_ms, std::vector<Flow*>& unlinked)
+{
+    pthread_mutex_lock(&mutex_);
+    Slot* slots = slots_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FLOW_TABLE_SLOTS; ++i) {
+        Flow* flow = slots[i].load(std::memory_order_relaxed);
+        if (flow == nullptr || flow == TOMBSTONE) {
+            continue;
+        }
+        if (now_ms - flow->last_seen_ms.load(std::memory_order_relaxed) < idle_ms) {
+            continue;
+        }
+        flow->unlinked.store(true);
+        if (now_ms - flow->last_seen_ms.load() < idle_ms) {
+            flow->unlinked.store(false); // found and used since the check above
+            continue;
+        }
+        slots[i].store(TOMBSTONE, std::memory_order_release);
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        ++tombstones_;
+        retired_flows_.push_back({flow, now_ms});
+        unlinked.push_back(flow);
+    }
+    if (tombstones_ >= FLOW_TABLE_SLOTS / 4) {
+        rebuildLocked(now_ms);
+    }
+
+    // Nothing can still be using what was unlinked a whole idle timeout ago
+    while (!retired_flows_.empty() && now_ms - retired_flows_.front().since_ms >= idle_ms) {
+        close(retired_flows_.front().item->sock);
+        delete retired_flows_.front().item;
+        retired_flows_.pop_front();
+    }
+    while (!retired_slots_.empty() && now_ms - retired_slots_.front().since_ms >= idle_ms) {
+        delete[] retired_slots_.front().item;
+        retired_slots_.pop_front();
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void FlowTable::rebuildLocked(int64_t now_ms)
+{
+    Slot* old_slots = slots_.load(std::memory_order_relaxed);
+    Slot* new_slots = allocate();
+    for (size_t i = 0; i < FLOW_TABLE_SLOTS; ++i) {
+        Flow* flow = old_slots[i].load(std::memory_order_relaxed);
+        if (flow != nullptr && flow != TOMBSTONE) {
+            place(new_slots, flow);
+        }
+    }
+    slots_.store(new_slots, std::memory_order_release);
+    retired_slots_.push_back({old_slots, now_ms});
+    tombstones_ = 0;
+}
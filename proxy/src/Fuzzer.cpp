@@ -1,11 +1,20 @@
 // FuzzerCore.cpp
 #include "Fuzzer.hpp"
+#include "Coverage.hpp"
+#include "Dictionary.hpp"
+#include "Schema.hpp"
+#include "SessionTracker.hpp"
+#include "MutationKernels.hpp"
+#include "PatternFill.hpp"
+#include "Trace.hpp"
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <algorithm>
+#include <vector>
 
 /**
  * FuzzerCore implementation ensures that every fuzzed output buffer
@@ -16,10 +25,23 @@
  *  - postFuzzing: apply fuzz, then return [original message][fuzz]
  *  - preFuzzing: apply fuzz, then return [fuzz][original message]
  *  - fullFuzzing: apply fuzz twice, then return [fuzz1][original message][fuzz2]
+ *  - guidedFuzzing: mutate an input from the target's coverage corpus (no padding)
+ *  - deterministicFuzzing: apply the next deterministic stage in-process (no padding)
+ *  - dictionaryFuzzing: insert/replace protocol tokens of the connection (no padding)
+ *  - schemaFuzzing: mutate the fields of the target's message schema, then fix up lengths/checksums
  *  - pass: return the original message exactly (no padding/truncation)
  */
 
-FuzzerCore::FuzzerCore(FuzzStyle style) : style(style)
+// xorshift32 step of a per-thread state
+static uint32_t next_random(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+FuzzerCore::FuzzerCore(FuzzStyle style, FuzzMode mode) : style(style), mode(mode)
 {
     for (int i = 0; i < MAX_RADAMSA_ARGS; ++i) {
         radamsaArgs[i] = nullptr;
@@ -27,6 +49,95 @@ FuzzerCore::FuzzerCore(FuzzStyle style) : style(style)
     configureStyleArgs();
 }
 
+FuzzMode FuzzerCore::parseFuzzMode(const std::string& name)
+{
+    if (name == "pre") {
+        return FUZZMODE_PRE;
+    }
+    if (name == "full") {
+        return FUZZMODE_FULL;
+    }
+    if (name == "guided") {
+        return FUZZMODE_GUIDED;
+    }
+    if (name == "deterministic") {
+        return FUZZMODE_DETERMINISTIC;
+    }
+    if (name == "dictionary") {
+        return FUZZMODE_DICTIONARY;
+    }
+    if (name == "schema") {
+        return FUZZMODE_SCHEMA;
+    }
+    if (name == "pass") {
+        return FUZZMODE_PASS;
+    }
+    if (!name.empty() && name != "post") {
+        fprintf(stderr, "[WARN] Unknown fuzz_mode \"%s\", using post\n", name.c_str());
+    }
+    return FUZZMODE_POST;
+}
+
+PowerSchedule FuzzerCore::parsePowerSchedule(const std::string& name)
+{
+    if (name == "uniform") {
+        return SCHEDULE_UNIFORM;
+    }
+    if (name == "explore") {
+        return SCHEDULE_EXPLORE;
+    }
+    if (name == "coe") {
+        return SCHEDULE_COE;
+    }
+    if (!name.empty() && name != "fast") {
+        fprintf(stderr, "[WARN] Unknown power_schedule \"%s\", using fast\n", name.c_str());
+    }
+    return SCHEDULE_FAST;
+}
+
+/**
+ * fuzz:
+ *   - Applies the fuzzing function selected by the configured mode.
+ *   - `context.corpus` is only used by guided mode.
+ *   - `context.dictionary` learns from the (unmutated) messages, sampled, in every mode.
+ *   - `context.session` sees every message too; messages in states the
+ *     session reaches often are passed through unchanged more often.
+ */
+uint8_t* FuzzerCore::fuzz(const uint8_t* input, size_t size, size_t& newSize, const FuzzContext& context)
+{
+    static thread_local uint32_t rng = 0x1B873593;
+
+    if (context.dictionary) {
+        context.dictionary->learn(input, size);
+    }
+    if (context.session) {
+        uint32_t state = context.session->observe(context.direction, input, size);
+        if (!context.session->shouldMutate(state, next_random(rng))) {
+            return pass(input, size, newSize);
+        }
+    }
+
+    switch (mode) {
+        case FUZZMODE_PRE:
+            return preFuzzing(input, size, newSize);
+        case FUZZMODE_FULL:
+            return fullFuzzing(input, size, newSize);
+        case FUZZMODE_GUIDED:
+            return guidedFuzzing(input, size, newSize, context);
+        case FUZZMODE_DETERMINISTIC:
+            return deterministicFuzzing(input, size, newSize);
+        case FUZZMODE_DICTIONARY:
+            return dictionaryFuzzing(input, size, newSize, context.dictionary);
+        case FUZZMODE_SCHEMA:
+            return schemaFuzzing(input, size, newSize, context);
+        case FUZZMODE_PASS:
+            return pass(input, size, newSize);
+        case FUZZMODE_POST:
+            break;
+    }
+    return postFuzzing(input, size, newSize);
+}
+
 void FuzzerCore::addArg(const char* arg)
 {
     if (argCount < MAX_RADAMSA_ARGS - 1) {
@@ -73,15 +184,15 @@ void FuzzerCore::configureStyleArgs()
 }
 
 /**
- * runRadamsa:
+ * runRadamsaRaw:
  *   - Forks a child process to exec "./radamsa" with configured arguments.
  *   - Writes `data` to child's stdin.
- *   - Reads up to MAX_BUFFER_SIZE bytes from child's stdout into a temporary buffer.
- *   - Normalizes that buffer to lie between MIN_OUTPUT_SIZE and MAX_BUFFER_SIZE.
+ *   - Reads up to MAX_BUFFER_SIZE bytes from child's stdout.
  *   - Returns a malloc'ed buffer of length outSize, or nullptr on failure.
  */
-uint8_t* FuzzerCore::runRadamsa(const uint8_t* data, size_t size, size_t& outSize)
+uint8_t* FuzzerCore::runRadamsaRaw(const uint8_t* data, size_t size, size_t& outSize)
 {
+    CEZ_TRACE_MARK(spawn_start);
     int in_pipe[2], out_pipe[2];
     if (pipe(in_pipe) < 0 || pipe(out_pipe) < 0) {
         perror("pipe failed");
@@ -108,10 +219,14 @@ uint8_t* FuzzerCore::runRadamsa(const uint8_t* data, size_t size, size_t& outSiz
     }
 
     // Parent: close unused ends, write input, read output
+    CEZ_TRACE_SPAN(TRACE_RADAMSA_SPAWN, spawn_start, 0);
     close(in_pipe[0]);
     close(out_pipe[1]);
-    write(in_pipe[1], data, size);
-    close(in_pipe[1]);
+    {
+        CEZ_TRACE_SCOPE(TRACE_PIPE_WRITE, size);
+        write(in_pipe[1], data, size);
+        close(in_pipe[1]);
+    }
 
     uint8_t* tempBuf = (uint8_t*) malloc(MAX_BUFFER_SIZE);
     if (!tempBuf) {
@@ -122,9 +237,11 @@ uint8_t* FuzzerCore::runRadamsa(const uint8_t* data, size_t size, size_t& outSiz
         return nullptr;
     }
 
+    CEZ_TRACE_MARK(read_start);
     ssize_t readBytes = read(out_pipe[0], tempBuf, MAX_BUFFER_SIZE);
     close(out_pipe[0]);
     waitpid(pid, nullptr, 0);
+    CEZ_TRACE_SPAN(TRACE_PIPE_READ, read_start, readBytes > 0 ? readBytes : 0);
 
     if (readBytes <= 0) {
         // No data or error reading
@@ -133,9 +250,28 @@ uint8_t* FuzzerCore::runRadamsa(const uint8_t* data, size_t size, size_t& outSiz
         return nullptr;
     }
 
+    outSize = (size_t) readBytes;
+    return tempBuf;
+}
+
+/**
+ * runRadamsa:
+ *   - Runs radamsa once (runRadamsaRaw).
+ *   - Normalizes the output to lie between MIN_OUTPUT_SIZE and MAX_BUFFER_SIZE.
+ *   - Returns a malloc'ed buffer of length outSize, or nullptr on failure.
+ */
+uint8_t* FuzzerCore::runRadamsa(const uint8_t* data, size_t size, size_t& outSize)
+{
+    size_t   rawLen  = 0;
+    uint8_t* tempBuf = runRadamsaRaw(data, size, rawLen);
+    if (!tempBuf) {
+        outSize = 0;
+        return nullptr;
+    }
+
     // Normalize length into [MIN_OUTPUT_SIZE, MAX_BUFFER_SIZE]
     size_t   normalizedLen = 0;
-    uint8_t* finalBuf      = normalizeOutputSize(tempBuf, (size_t) readBytes, normalizedLen);
+    uint8_t* finalBuf      = normalizeOutputSize(tempBuf, rawLen, normalizedLen);
     free(tempBuf);
 
     outSize = normalizedLen;
@@ -169,12 +305,7 @@ uint8_t* FuzzerCore::runRadamsaExpanded(const uint8_t* data, size_t size, size_t
             outSize = 0;
             return nullptr;
         }
-        size_t copied = 0;
-        while (copied < target) {
-            size_t toCopy = std::min(size, target - copied);
-            memcpy(result + copied, data, toCopy);
-            copied += toCopy;
-        }
+        patternFill(result, target, data, size);
         outSize = target;
         return result;
     }
@@ -209,10 +340,9 @@ uint8_t* FuzzerCore::runRadamsaExpanded(const uint8_t* data, size_t size, size_t
     free(firstFuzz);
 
     // Fill the remainder with repeats of input
-    while (copied < target) {
-        size_t toCopy = std::min(size, target - copied);
-        memcpy(expanded + copied, data, toCopy);
-        copied += toCopy;
+    if (copied < target) {
+        patternFill(expanded + copied, target - copied, data, size);
+        copied = target;
     }
 
     outSize = copied;
@@ -229,6 +359,7 @@ uint8_t* FuzzerCore::runRadamsaExpanded(const uint8_t* data, size_t size, size_t
  */
 uint8_t* FuzzerCore::normalizeOutputSize(uint8_t* input, size_t input_len, size_t& output_len)
 {
+    CEZ_TRACE_SCOPE(TRACE_NORMALIZE, input_len);
     if (input_len >= MIN_OUTPUT_SIZE && input_len <= MAX_BUFFER_SIZE) {
         // Already in range: return a copy
         output_len    = input_len;
@@ -254,13 +385,8 @@ uint8_t* FuzzerCore::normalizeOutputSize(uint8_t* input, size_t input_len, size_
             output_len = 0;
             return nullptr;
         }
-        size_t copied = 0;
-        while (copied < target) {
-            size_t toCopy = std::min(input_len, target - copied);
-            memcpy(expanded + copied, input, toCopy);
-            copied += toCopy;
-        }
-        output_len = copied;
+        patternFill(expanded, target, input, input_len);
+        output_len = target;
         return expanded;
     }
 
@@ -304,6 +430,7 @@ uint8_t* FuzzerCore::postFuzzing(const uint8_t* input, size_t size, size_t& newS
     }
 
     // Concatenate [original][fuzz]
+    CEZ_TRACE_MARK(copy_start);
     size_t   combinedLen = size + fuzzSize;
     uint8_t* combined    = (uint8_t*) malloc(combinedLen);
     if (!combined) {
@@ -314,6 +441,7 @@ uint8_t* FuzzerCore::postFuzzing(const uint8_t* input, size_t size, size_t& newS
     }
     memcpy(combined, input, size);
     memcpy(combined + size, fuzzed, fuzzSize);
+    CEZ_TRACE_SPAN(TRACE_COPY, copy_start, combinedLen);
     free(fuzzed);
 
     // Normalize the combined buffer into [MIN_OUTPUT_SIZE, MAX_BUFFER_SIZE]
@@ -352,6 +480,7 @@ uint8_t* FuzzerCore::preFuzzing(const uint8_t* input, size_t size, size_t& newSi
     }
 
     // Concatenate [fuzz][original]
+    CEZ_TRACE_MARK(copy_start);
     size_t   combinedLen = fuzzSize + size;
     uint8_t* combined    = (uint8_t*) malloc(combinedLen);
     if (!combined) {
@@ -362,6 +491,7 @@ uint8_t* FuzzerCore::preFuzzing(const uint8_t* input, size_t size, size_t& newSi
     }
     memcpy(combined, fuzzed, fuzzSize);
     memcpy(combined + fuzzSize, input, size);
+    CEZ_TRACE_SPAN(TRACE_COPY, copy_start, combinedLen);
     free(fuzzed);
 
     // Normalize the combined buffer into [MIN_OUTPUT_SIZE, MAX_BUFFER_SIZE]
@@ -412,6 +542,7 @@ uint8_t* FuzzerCore::fullFuzzing(const uint8_t* input, size_t size, size_t& newS
     }
 
     // Concatenate [fuzz1][original][fuzz2]
+    CEZ_TRACE_MARK(copy_start);
     size_t   combinedLen = fuzz1Size + size + fuzz2Size;
     uint8_t* combined    = (uint8_t*) malloc(combinedLen);
     if (!combined) {
@@ -433,6 +564,7 @@ uint8_t* FuzzerCore::fullFuzzing(const uint8_t* input, size_t size, size_t& newS
     if (fuzz2Size > 0) {
         memcpy(combined + offset, fuzz2, fuzz2Size);
     }
+    CEZ_TRACE_SPAN(TRACE_COPY, copy_start, combinedLen);
     if (fuzz1)
         free(fuzz1);
     if (fuzz2)
@@ -449,34 +581,232 @@ uint8_t* FuzzerCore::fullFuzzing(const uint8_t* input, size_t size, size_t& newS
 
 /**
  * guidedFuzzing:
- *   - Not modified: returns a copy of input, padded with zeros if size < MIN_OUTPUT_SIZE
- *     or truncated if size > MAX_BUFFER_SIZE.
+ *   - Picks the seed: usually an input that found new coverage in the target
+ *     (from `corpus`, by its power schedule), sometimes the live message so
+ *     the corpus keeps growing with the protocol's current state.
+ *   - Mutates the seed once and returns the result as is (no padding), so a
+ *     mutation stays close to what reached new code: by the target's schema
+ *     or with the connection's tokens when those exist, with radamsa otherwise.
+ *   - Falls back to a copy of the seed if radamsa fails.
  */
-uint8_t* FuzzerCore::guidedFuzzing(const uint8_t* input, size_t size, size_t& newSize)
+uint8_t* FuzzerCore::guidedFuzzing(const uint8_t* input, size_t size, size_t& newSize, const FuzzContext& context)
 {
-    size_t target = size;
-    if (target < MIN_OUTPUT_SIZE) {
-        target = MIN_OUTPUT_SIZE;
-    } else if (target > MAX_BUFFER_SIZE) {
-        target = MAX_BUFFER_SIZE;
+    // One FuzzerCore may be shared by several forwarding threads
+    static thread_local uint32_t rng = 0x9E3779B9;
+    std::vector<uint8_t>         seed;
+
+    next_random(rng);
+    bool useLive = context.corpus == nullptr || rng % GUIDED_LIVE_ONE_IN == 0 || !context.corpus->pick(seed);
+    if (useLive) {
+        seed.assign(input, input + size);
     }
-    uint8_t* buffer = (uint8_t*) malloc(target);
-    if (!buffer) {
-        perror("malloc failed");
-        newSize = 0;
-        return nullptr;
+
+    std::vector<uint8_t> mutatedSeed;
+    uint32_t             mutator = (rng >> 8) % 3;
+    if (mutator == 0 && context.schema &&
+        context.schema->mutate(seed.data(), seed.size(), mutatedSeed, rng, context.dictionary)) {
+        return pass(mutatedSeed.data(), mutatedSeed.size(), newSize);
     }
-    // Copy input
-    size_t toCopy = std::min(size, target);
-    memcpy(buffer, input, toCopy);
-    // If padded, fill rest with zeros
-    if (toCopy < target) {
-        memset(buffer + toCopy, 0, target - toCopy);
+    if (mutator <= 1 && context.dictionary && context.dictionary->size() > 0) {
+        applyTokenMutations(seed, *context.dictionary, rng);
+        return pass(seed.data(), seed.size(), newSize);
+    }
+
+    uint8_t* mutated = runRadamsaRaw(seed.data(), seed.size(), newSize);
+    if (mutated) {
+        return mutated;
+    }
+    return pass(seed.data(), seed.size(), newSize);
+}
+
+/*
+ * Deterministic stages, in order: walking bit flips (one bit of one byte),
+ * walking 1/2/4-byte flips, +/- ARITH_MAX on the 8/16/32-bit lane at one
+ * position, then every common byte of the message replaced by every
+ * interesting value.
+ */
+#define ARITH_MAX          35
+#define STAGES_BITFLIP     8
+#define STAGES_BYTEFLIP    3
+#define STAGES_ARITH       (2 * ARITH_MAX)
+#define STAGES_WALKING     (STAGES_BITFLIP + STAGES_BYTEFLIP + 3 * STAGES_ARITH)
+#define STAGES_INTERESTING (sizeof(SUBSTITUTED_BYTES) * sizeof(INTERESTING_8))
+
+static const uint8_t SUBSTITUTED_BYTES[] = {0x00, 0xff, ' ', '\n', '0', '1'};
+
+uint32_t FuzzerCore::deterministicStageCount()
+{
+    return STAGES_WALKING + STAGES_INTERESTING;
+}
+
+/**
+ * applyDeterministicStage:
+ *   - Applies deterministic step `step` to `buffer` in place, using the SIMD
+ *     kernels the CPU supports.
+ *   - Like AFL, a walking stage visits every position of the message, one
+ *     per step, before the next stage starts; each step changes one location.
+ *     The substitutions are whole-message transforms, one step each, done on
+ *     BATCH-sized blocks.
+ *   - `step` wraps around the steps of a message of `size` bytes.
+ */
+void FuzzerCore::applyDeterministicStage(uint8_t* buffer, size_t size, uint32_t step)
+{
+    if (size == 0) {
+        return;
+    }
+    const MutationKernels& kernels = MutationKernels::get();
+
+    uint64_t walking = (uint64_t) STAGES_WALKING * size;
+    uint64_t at      = step % (walking + STAGES_INTERESTING);
+    if (at >= walking) {
+        uint32_t s = (uint32_t) (at - walking);
+        for (size_t offset = 0; offset < size; offset += BATCH) {
+            kernels.substitute(buffer + offset, std::min((size_t) BATCH, size - offset),
+                               SUBSTITUTED_BYTES[s / sizeof(INTERESTING_8)],
+                               (uint8_t) INTERESTING_8[s % sizeof(INTERESTING_8)]);
+        }
+        return;
+    }
+
+    uint32_t s    = (uint32_t) (at / size);
+    size_t   pos  = at % size;
+    uint8_t* base = buffer + pos;
+    size_t   left = size - pos; // the kernels leave lanes that do not fit untouched
+
+    if (s < STAGES_BITFLIP) {
+        kernels.flip(base, 1, 1u << s);
+        return;
+    }
+    s -= STAGES_BITFLIP;
+    if (s < STAGES_BYTEFLIP) {
+        kernels.flip(base, std::min<size_t>(left, 1u << s), 0xffffffffu);
+        return;
+    }
+    s -= STAGES_BYTEFLIP;
+
+    // deltas +1, -1, +2, -2, ... +ARITH_MAX, -ARITH_MAX
+    int delta = (int) (s % STAGES_ARITH) / 2 + 1;
+    if (s % 2) {
+        delta = -delta;
+    }
+    if (s < STAGES_ARITH) {
+        kernels.add8(base, 1, (int8_t) delta);
+    } else if (s < 2 * STAGES_ARITH) {
+        kernels.add16(base, std::min<size_t>(left, 2), (int16_t) delta);
+    } else {
+        kernels.add32(base, std::min<size_t>(left, 4), delta);
+    }
+}
+
+/**
+ * deterministicFuzzing:
+ *   - Returns a copy of the input with the next deterministic step applied.
+ *   - Each forwarding thread walks the steps on its own.
+ */
+uint8_t* FuzzerCore::deterministicFuzzing(const uint8_t* input, size_t size, size_t& newSize)
+{
+    static thread_local uint32_t step = 0;
+
+    uint8_t* buffer = pass(input, size, newSize);
+    if (buffer) {
+        applyDeterministicStage(buffer, newSize, step++);
     }
-    newSize = target;
     return buffer;
 }
 
+/*
+ * Length of the run of printable bytes around `pos` (its start goes in `begin`);
+ * that is what a textual token looks like inside a message.
+ */
+static size_t printable_run(const std::vector<uint8_t>& buffer, size_t pos, size_t& begin)
+{
+    begin = pos;
+    while (begin > 0 && isgraph(buffer[begin - 1])) {
+        --begin;
+    }
+    size_t end = pos;
+    while (end < buffer.size() && isgraph(buffer[end])) {
+        ++end;
+    }
+    return end - begin;
+}
+
+/**
+ * applyTokenMutations:
+ *   - Applies 1..MAX_TOKEN_MUTATIONS token mutations to `buffer` in place:
+ *       - insert a token at a random position
+ *       - replace the token under a random position with another one, if the
+ *         printable run there is a known token
+ *       - otherwise overwrite the bytes at that position with a token
+ *   - `random` seeds the choices; the output never exceeds MAX_BUFFER_SIZE.
+ */
+void FuzzerCore::applyTokenMutations(std::vector<uint8_t>& buffer, Dictionary& dictionary, uint32_t random)
+{
+    std::vector<uint8_t> token;
+    uint32_t             rounds = random % MAX_TOKEN_MUTATIONS + 1;
+
+    for (uint32_t i = 0; i < rounds; ++i) {
+        next_random(random);
+        if (!dictionary.pick(random >> 1, token) || buffer.size() + token.size() > MAX_BUFFER_SIZE) {
+            return;
+        }
+
+        size_t pos = buffer.empty() ? 0 : (random >> 8) % (buffer.size() + 1);
+        if (random & 1 || pos == buffer.size()) {
+            buffer.insert(buffer.begin() + pos, token.begin(), token.end());
+            continue;
+        }
+
+        size_t begin = 0;
+        size_t run   = printable_run(buffer, pos, begin);
+        if (run > 0 && dictionary.contains(buffer.data() + begin, run)) {
+            buffer.erase(buffer.begin() + begin, buffer.begin() + begin + run);
+            buffer.insert(buffer.begin() + begin, token.begin(), token.end());
+            continue;
+        }
+        size_t len = std::min(token.size(), buffer.size() - pos);
+        memcpy(buffer.data() + pos, token.data(), len);
+    }
+}
+
+/**
+ * dictionaryFuzzing:
+ *   - Returns a copy of the input with token mutations applied (no padding).
+ *   - Passes the message through while the connection has no tokens yet.
+ */
+uint8_t* FuzzerCore::dictionaryFuzzing(const uint8_t* input, size_t size, size_t& newSize, Dictionary* dictionary)
+{
+    static thread_local uint32_t rng = 0x2545F491;
+
+    if (!dictionary || dictionary->size() == 0) {
+        return pass(input, size, newSize);
+    }
+
+    next_random(rng);
+    std::vector<uint8_t> buffer(input, input + size);
+    applyTokenMutations(buffer, *dictionary, rng);
+    return pass(buffer.data(), buffer.size(), newSize);
+}
+
+/**
+ * schemaFuzzing:
+ *   - Mutates the fields of the target's schema and fixes up the length and
+ *     checksum fields that depend on them (no padding).
+ *   - Falls back to token mutations, then to a copy, for targets without a
+ *     schema or messages that do not match it.
+ */
+uint8_t* FuzzerCore::schemaFuzzing(const uint8_t* input, size_t size, size_t& newSize, const FuzzContext& context)
+{
+    static thread_local uint32_t rng = 0x6C8E9CF5;
+    std::vector<uint8_t>         mutated;
+
+    next_random(rng);
+    if (context.schema && context.schema->mutate(input, size, mutated, rng, context.dictionary)) {
+        return pass(mutated.data(), mutated.size(), newSize);
+    }
+    return dictionaryFuzzing(input, size, newSize, context.dictionary);
+}
+
 /**
  * pass:
  *   - Returns an exact copy of the original input (no padding or truncation).
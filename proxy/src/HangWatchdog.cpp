@@ -0,0 +1,164 @@
+#include "HangWatchdog.hpp"
+#include "utils/Messages.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+HangWatchdog* HangWatchdog::instance_ = nullptr;
+
+static int64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+HangWatchdog::HangWatchdog()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+HangWatchdog* HangWatchdog::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new HangWatchdog();
+    }
+    return instance_;
+}
+
+void HangWatchdog::start(int timeout_ms)
+{
+    timeout_ms_ = timeout_ms;
+    if (timeout_ms_ <= 0) {
+        return;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, &HangWatchdog::loopEntry, this) != 0) {
+        perror("[ERROR] pthread_create (hang watchdog)");
+        timeout_ms_ = 0;
+        return;
+    }
+    pthread_detach(tid);
+    std::cout << "[INFO] Hang watchdog started (timeout " << timeout_ms_ << " ms)" << std::endl;
+}
+
+/*
+ * Returns nullptr when the watchdog is disabled; arm()/disarm() accept it.
+ */
+HangSlot* HangWatchdog::createSlot(const std::string& entity, const std::string& description)
+{
+    if (timeout_ms_ <= 0) {
+        return nullptr;
+    }
+
+    HangSlot* slot    = new HangSlot();
+    slot->entity      = entity;
+    slot->description = description;
+
+    pthread_mutex_lock(&mutex_);
+    slots_.push_back(slot);
+    pthread_mutex_unlock(&mutex_);
+    return slot;
+}
+
+/*
+ * TCP creates slots per connection; they are freed when the connection ends
+ * so the list the watchdog walks does not grow with every reconnect.
+ */
+void HangWatchdog::releaseSlot(HangSlot* slot)
+{
+    if (slot == nullptr) {
+        return;
+    }
+    pthread_mutex_lock(&mutex_);
+    auto it = std::find(slots_.begin(), slots_.end(), slot);
+    if (it != slots_.end()) {
+        *it = slots_.back();
+        slots_.pop_back();
+    }
+    pthread_mutex_unlock(&mutex_);
+    delete slot;
+}
+
+void HangWatchdog::arm(HangSlot* slot)
+{
+    if (slot == nullptr || slot->armed_since_ms.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    int64_t expected = 0;
+    slot->armed_since_ms.compare_exchange_strong(expected, monotonic_ms(), std::memory_order_relaxed);
+}
+
+void HangWatchdog::disarm(HangSlot* slot)
+{
+    if (slot == nullptr || slot->armed_since_ms.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    slot->armed_since_ms.store(0, std::memory_order_relaxed);
+}
+
+void* HangWatchdog::loopEntry(void* arg)
+{
+    static_cast<HangWatchdog*>(arg)->loop();
+    return nullptr;
+}
+
+void HangWatchdog::loop()
+{
+    // Check four times per timeout so a hang is reported at most 25% late.
+    useconds_t tick = (useconds_t) timeout_ms_ * 1000 / 4;
+
+    while (true) {
+        usleep(tick);
+        int64_t now = monotonic_ms();
+
+        pthread_mutex_lock(&mutex_);
+        for (HangSlot* slot : slots_) {
+            int64_t since = slot->armed_since_ms.load(std::memory_order_relaxed);
+            if (since == 0 || now - since < timeout_ms_) {
+                continue;
+            }
+            // Disarm first so one hang is reported once, not on every tick.
+            if (slot->armed_since_ms.compare_exchange_strong(since, 0, std::memory_order_relaxed)) {
+                report(slot, now - since);
+            }
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+/*
+ * Sends "CRASH <entity> HANG no reply for <ms> ms (<description>)" to the
+ * launcher server running next to the proxy, which restarts the campaign.
+ */
+void HangWatchdog::report(const HangSlot* slot, int64_t waited_ms)
+{
+    char message[512];
+    int  len = snprintf(message, sizeof(message), "CRASH %s HANG no reply for %lld ms (%s)", slot->entity.c_str(),
+                        (long long) waited_ms, slot->description.c_str());
+
+    std::cerr << "[WARN] [HangWatchdog] " << message << std::endl;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("[ERROR] socket (hang report)");
+        return;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(NOTIFY_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (sendto(sock, message, std::min<size_t>(len, sizeof(message) - 1), 0, (sockaddr*) &addr, sizeof(addr)) < 0) {
+        perror("[ERROR] sendto (hang report)");
+    }
+    close(sock);
+}
@@ -0,0 +1,360 @@
+#include "Metrics.hpp"
+#include "utils/Messages.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+
+Metrics* Metrics::instance_ = nullptr;
+
+// Upper bounds of the exported histogram buckets, in seconds
+static const double EXPORTED_BOUNDS[] = {1e-6, 2e-6, 5e-6, 1e-5, 2e-5, 5e-5, 1e-4, 2e-4, 5e-4, 1e-3, 2e-3,
+                                         5e-3, 1e-2, 2e-2, 5e-2, 0.1,  0.2,  0.5,  1,    2,    5,    10};
+
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns >> HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    if (ns < (1u << HISTOGRAM_SUB_BITS)) {
+        return (size_t) ns;
+    }
+    int shift = 63 - __builtin_clzll(ns) - HISTOGRAM_SUB_BITS;
+    return ((size_t) (shift + 1) << HISTOGRAM_SUB_BITS) + ((ns >> shift) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::upperBound(size_t bucket)
+{
+    if (bucket < (1u << HISTOGRAM_SUB_BITS)) {
+        return bucket + 1;
+    }
+    int      shift = (int) (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub   = bucket & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    return ((1ull << HISTOGRAM_SUB_BITS) + sub + 1) << shift;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    counts_[bucketOf(ns)].add(1);
+    total_.add(1);
+    sum_ns_.add(ns);
+}
+
+Metrics::Metrics()
+{
+    pthread_mutex_init(&mutex_, nullptr);
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    started_at_ = (long) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+Metrics* Metrics::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new Metrics();
+    }
+    return instance_;
+}
+
+uint64_t Metrics::nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+ThreadMetrics* Metrics::registerThread(const std::string& proto, const std::string& link, int direction)
+{
+    pthread_mutex_lock(&mutex_);
+    for (size_t i = 0; i < released_.size(); ++i) {
+        ThreadMetrics* metrics = released_[i];
+        if (metrics->proto == proto && metrics->link == link && metrics->direction == direction) {
+            released_[i] = released_.back();
+            released_.pop_back();
+            pthread_mutex_unlock(&mutex_);
+            return metrics;
+        }
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    ThreadMetrics* metrics = new ThreadMetrics();
+    metrics->proto         = proto;
+    metrics->link          = link;
+    metrics->direction     = direction;
+
+    pthread_mutex_lock(&mutex_);
+    threads_.push_back(metrics);
+    pthread_mutex_unlock(&mutex_);
+    return metrics;
+}
+
+void Metrics::releaseThread(ThreadMetrics* metrics)
+{
+    pthread_mutex_lock(&mutex_);
+    released_.push_back(metrics);
+    pthread_mutex_unlock(&mutex_);
+}
+
+void Metrics::addGauge(const std::string& name, const std::string& help, std::function<double()> read)
+{
+    pthread_mutex_lock(&mutex_);
+    gauges_.push_back({name, help, read});
+    pthread_mutex_unlock(&mutex_);
+}
+
+namespace {
+
+// The threads of one direction of one connection, summed
+struct Series {
+    uint64_t packets_in = 0, packets_out = 0, bytes_in = 0, bytes_out = 0;
+    uint64_t mutations = 0, send_errors = 0, port_misses = 0, truncated = 0;
+    uint64_t mutation_buckets[HISTOGRAM_BUCKETS] = {0}, mutation_count = 0, mutation_sum_ns = 0;
+    uint64_t forward_buckets[HISTOGRAM_BUCKETS]  = {0}, forward_count = 0, forward_sum_ns = 0;
+};
+
+void merge(uint64_t* buckets, uint64_t& count, uint64_t& sum_ns, const LatencyHistogram& histogram)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        buckets[i] += histogram.count(i);
+    }
+    count += histogram.total();
+    sum_ns += histogram.sumNs();
+}
+
+void header(std::string& out, const char* name, const char* type, const char* help)
+{
+    out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+void sample(std::string& out, const std::string& name, const std::string& labels, double value)
+{
+    char number[64];
+    snprintf(number, sizeof(number), "%.17g", value);
+    out += name + "{" + labels + "} " + number + "\n";
+}
+
+// A bucket counts in `le` if all of its values are below the bound, so a bound inside a bucket undercounts a little
+void histogram(std::string& out, const std::string& name, const std::string& labels, const uint64_t* buckets,
+               uint64_t count, uint64_t sum_ns)
+{
+    size_t   bucket     = 0;
+    uint64_t cumulative = 0;
+    for (double bound : EXPORTED_BOUNDS) {
+        uint64_t bound_ns = (uint64_t) (bound * 1e9 + 0.5);
+        while (bucket < HISTOGRAM_BUCKETS && LatencyHistogram::upperBound(bucket) <= bound_ns + 1) {
+            cumulative += buckets[bucket++];
+        }
+        char le[32];
+        snprintf(le, sizeof(le), "%g", bound);
+        sample(out, name + "_bucket", labels + ",le=\"" + le + "\"", (double) cumulative);
+    }
+    sample(out, name + "_bucket", labels + ",le=\"+Inf\"", (double) count);
+    sample(out, name + "_sum", labels, (double) sum_ns / 1e9);
+    sample(out, name + "_count", labels, (double) count);
+}
+
+} // namespace
+
+std::string Metrics::render()
+{
+    std::map<std::string, Series> series;
+    std::vector<Gauge>            gauges;
+
+    pthread_mutex_lock(&mutex_);
+    for (const ThreadMetrics* t : threads_) {
+        std::string labels = "proto=\"" + t->proto + "\",link=\"" + t->link + "\",direction=\"" +
+                             (t->direction == 0 ? "client_to_server" : "server_to_client") + "\"";
+        Series&     s      = series[labels];
+        s.packets_in += t->packets_in.get();
+        s.packets_out += t->packets_out.get();
+        s.bytes_in += t->bytes_in.get();
+        s.bytes_out += t->bytes_out.get();
+        s.mutations += t->mutations.get();
+        s.send_errors += t->send_errors.get();
+        s.port_misses += t->port_misses.get();
+        s.truncated += t->truncated.get();
+        merge(s.mutation_buckets, s.mutation_count, s.mutation_sum_ns, t->mutation_ns);
+        merge(s.forward_buckets, s.forward_count, s.forward_sum_ns, t->forward_ns);
+    }
+    gauges = gauges_;
+    pthread_mutex_unlock(&mutex_);
+
+    struct CounterColumn {
+        const char* name;
+        const char* help;
+        uint64_t Series::*value;
+    };
+    static const CounterColumn counters[] = {
+        {"cez_packets_in_total", "Messages received from the sending peer.", &Series::packets_in},
+        {"cez_packets_out_total", "Messages sent to the receiving peer.", &Series::packets_out},
+        {"cez_bytes_in_total", "Bytes received from the sending peer.", &Series::bytes_in},
+        {"cez_bytes_out_total", "Bytes sent to the receiving peer (after fuzzing).", &Series::bytes_out},
+        {"cez_mutations_total", "Messages passed through the fuzzer.", &Series::mutations},
+        {"cez_send_errors_total", "Messages that could not be sent.", &Series::send_errors},
+        {"cez_dynamic_port_misses_total", "Messages for a dynamic-port peer whose port was not known yet.",
+         &Series::port_misses},
+        {"cez_truncated_total", "Messages larger than the receive buffer.", &Series::truncated},
+    };
+
+    std::string out;
+    for (const CounterColumn& column : counters) {
+        header(out, column.name, "counter", column.help);
+        for (const auto& [labels, s] : series) {
+            sample(out, column.name, labels, (double) (s.*column.value));
+        }
+    }
+    header(out, "cez_mutation_duration_seconds", "histogram", "Time in the fuzzer per message.");
+    for (const auto& [labels, s] : series) {
+        histogram(out, "cez_mutation_duration_seconds", labels, s.mutation_buckets, s.mutation_count,
+                  s.mutation_sum_ns);
+    }
+    header(out, "cez_forward_duration_seconds", "histogram", "Time from receiving a message to sending it on.");
+    for (const auto& [labels, s] : series) {
+        histogram(out, "cez_forward_duration_seconds", labels, s.forward_buckets, s.forward_count, s.forward_sum_ns);
+    }
+    for (const Gauge& gauge : gauges) {
+        header(out, gauge.name.c_str(), "gauge", gauge.help.c_str());
+        char number[64];
+        snprintf(number, sizeof(number), "%.17g", gauge.read());
+        out += gauge.name + " " + number + "\n";
+    }
+    return out;
+}
+
+bool Metrics::serve(int port)
+{
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        perror("[ERROR] [Metrics] socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd_, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(listen_fd_, 8) < 0) {
+        perror("[ERROR] [Metrics] bind/listen");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, serveEntry, this) != 0) {
+        perror("[ERROR] [Metrics] pthread_create");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    pthread_detach(tid);
+    std::cout << "[INFO] [Metrics] Serving http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+}
+
+// One request per connection; whatever the path, the answer is the metrics
+void* Metrics::serveEntry(void* arg)
+{
+    Metrics* metrics = static_cast<Metrics*>(arg);
+    while (true) {
+        int fd = accept(metrics->listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            perror("[ERROR] [Metrics] accept");
+            sleep(1);
+            continue;
+        }
+        struct timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[4096];
+        if (recv(fd, request, sizeof(request), 0) > 0) {
+            std::string body     = metrics->render();
+            std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                   std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            for (size_t sent = 0; sent < response.size();) {
+                ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    break;
+                }
+                sent += (size_t) n;
+            }
+        }
+        close(fd);
+    }
+    return nullptr;
+}
+
+/*
+ * Totals over all threads, in the launcher's STATS format. `started` tells the
+ * server when these counters began, so it can carry them over a proxy restart.
+ */
+std::string Metrics::statsMessage()
+{
+    uint64_t packets_in = 0, packets_out = 0, bytes_in = 0, bytes_out = 0, mutations = 0, send_errors = 0;
+
+    pthread_mutex_lock(&mutex_);
+    for (const ThreadMetrics* t : threads_) {
+        packets_in += t->packets_in.get();
+        packets_out += t->packets_out.get();
+        bytes_in += t->bytes_in.get();
+        bytes_out += t->bytes_out.get();
+        mutations += t->mutations.get();
+        send_errors += t->send_errors.get();
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    char host[64] = "proxy";
+    gethostname(host, sizeof(host) - 1);
+
+    char message[512];
+    snprintf(message, sizeof(message),
+             "STATS proxy %s started=%ld packets_in=%llu packets_out=%llu bytes_in=%llu bytes_out=%llu "
+             "mutations=%llu send_errors=%llu",
+             host, started_at_, (unsigned long long) packets_in, (unsigned long long) packets_out,
+             (unsigned long long) bytes_in, (unsigned long long) bytes_out, (unsigned long long) mutations,
+             (unsigned long long) send_errors);
+    return message;
+}
+
+bool Metrics::pushToLauncher(int interval_ms)
+{
+    push_interval_ms_ = interval_ms;
+
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, pushEntry, this) != 0) {
+        perror("[ERROR] [Metrics] pthread_create (stats push)");
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+// Same datagram channel as the hang reports; nobody listening is not an error
+void* Metrics::pushEntry(void* arg)
+{
+    Metrics* metrics = static_cast<Metrics*>(arg);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("[ERROR] [Metrics] socket (stats push)");
+        return nullptr;
+    }
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(NOTIFY_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    while (true) {
+        usleep((useconds_t) metrics->push_interval_ms_ * 1000);
+        std::string message = metrics->statsMessage();
+        sendto(sock, message.data(), message.size(), 0, (sockaddr*) &addr, sizeof(addr));
+    }
+    return nullptr;
+}
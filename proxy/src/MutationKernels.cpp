@@ -0,0 +1,238 @@
+#include "MutationKernels.hpp"
+#include <cstring>
+#include <immintrin.h>
+
+const int8_t INTERESTING_8[9] = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+
+/*
+ * Scalar versions. They also finish the tail the vector versions leave over,
+ * so `start` is always a multiple of 4 and word/lane boundaries stay aligned
+ * to the start of the block.
+ */
+
+static void flip_tail(uint8_t* buf, size_t start, size_t len, uint32_t pattern)
+{
+    uint8_t bytes[4];
+    memcpy(bytes, &pattern, sizeof(bytes));
+    for (size_t i = start; i < len; ++i) {
+        buf[i] ^= bytes[i & 3];
+    }
+}
+
+static void add8_tail(uint8_t* buf, size_t start, size_t len, int8_t delta)
+{
+    for (size_t i = start; i < len; ++i) {
+        buf[i] = (uint8_t) (buf[i] + delta);
+    }
+}
+
+// A trailing partial lane is left untouched.
+static void add16_tail(uint8_t* buf, size_t start, size_t len, int16_t delta)
+{
+    for (size_t i = start; i + 2 <= len; i += 2) {
+        uint16_t lane;
+        memcpy(&lane, buf + i, sizeof(lane));
+        lane = (uint16_t) (lane + delta);
+        memcpy(buf + i, &lane, sizeof(lane));
+    }
+}
+
+static void add32_tail(uint8_t* buf, size_t start, size_t len, int32_t delta)
+{
+    for (size_t i = start; i + 4 <= len; i += 4) {
+        uint32_t lane;
+        memcpy(&lane, buf + i, sizeof(lane));
+        lane = lane + (uint32_t) delta;
+        memcpy(buf + i, &lane, sizeof(lane));
+    }
+}
+
+static void substitute_tail(uint8_t* buf, size_t start, size_t len, uint8_t from, uint8_t to)
+{
+    for (size_t i = start; i < len; ++i) {
+        if (buf[i] == from) {
+            buf[i] = to;
+        }
+    }
+}
+
+static void flip_scalar(uint8_t* buf, size_t len, uint32_t pattern)
+{
+    flip_tail(buf, 0, len, pattern);
+}
+
+static void add8_scalar(uint8_t* buf, size_t len, int8_t delta)
+{
+    add8_tail(buf, 0, len, delta);
+}
+
+static void add16_scalar(uint8_t* buf, size_t len, int16_t delta)
+{
+    add16_tail(buf, 0, len, delta);
+}
+
+static void add32_scalar(uint8_t* buf, size_t len, int32_t delta)
+{
+    add32_tail(buf, 0, len, delta);
+}
+
+static void substitute_scalar(uint8_t* buf, size_t len, uint8_t from, uint8_t to)
+{
+    substitute_tail(buf, 0, len, from, to);
+}
+
+/*
+ * SSE4.2 versions (16 bytes per step)
+ */
+
+__attribute__((target("sse4.2"))) static void flip_sse42(uint8_t* buf, size_t len, uint32_t pattern)
+{
+    const __m128i mask = _mm_set1_epi32((int) pattern);
+    size_t        i    = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        _mm_storeu_si128((__m128i*) (buf + i), _mm_xor_si128(v, mask));
+    }
+    flip_tail(buf, i, len, pattern);
+}
+
+__attribute__((target("sse4.2"))) static void add8_sse42(uint8_t* buf, size_t len, int8_t delta)
+{
+    const __m128i d = _mm_set1_epi8(delta);
+    size_t        i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        _mm_storeu_si128((__m128i*) (buf + i), _mm_add_epi8(v, d));
+    }
+    add8_tail(buf, i, len, delta);
+}
+
+__attribute__((target("sse4.2"))) static void add16_sse42(uint8_t* buf, size_t len, int16_t delta)
+{
+    const __m128i d = _mm_set1_epi16(delta);
+    size_t        i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        _mm_storeu_si128((__m128i*) (buf + i), _mm_add_epi16(v, d));
+    }
+    add16_tail(buf, i, len, delta);
+}
+
+__attribute__((target("sse4.2"))) static void add32_sse42(uint8_t* buf, size_t len, int32_t delta)
+{
+    const __m128i d = _mm_set1_epi32(delta);
+    size_t        i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        _mm_storeu_si128((__m128i*) (buf + i), _mm_add_epi32(v, d));
+    }
+    add32_tail(buf, i, len, delta);
+}
+
+__attribute__((target("sse4.2"))) static void substitute_sse42(uint8_t* buf, size_t len, uint8_t from, uint8_t to)
+{
+    const __m128i f = _mm_set1_epi8((char) from);
+    const __m128i t = _mm_set1_epi8((char) to);
+    size_t        i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (buf + i));
+        _mm_storeu_si128((__m128i*) (buf + i), _mm_blendv_epi8(v, t, _mm_cmpeq_epi8(v, f)));
+    }
+    substitute_tail(buf, i, len, from, to);
+}
+
+/*
+ * AVX2 versions (32 bytes per step)
+ */
+
+__attribute__((target("avx2"))) static void flip_avx2(uint8_t* buf, size_t len, uint32_t pattern)
+{
+    const __m256i mask = _mm256_set1_epi32((int) pattern);
+    size_t        i    = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+        _mm256_storeu_si256((__m256i*) (buf + i), _mm256_xor_si256(v, mask));
+    }
+    flip_tail(buf, i, len, pattern);
+}
+
+__attribute__((target("avx2"))) static void add8_avx2(uint8_t* buf, size_t len, int8_t delta)
+{
+    const __m256i d = _mm256_set1_epi8(delta);
+    size_t        i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+        _mm256_storeu_si256((__m256i*) (buf + i), _mm256_add_epi8(v, d));
+    }
+    add8_tail(buf, i, len, delta);
+}
+
+__attribute__((target("avx2"))) static void add16_avx2(uint8_t* buf, size_t len, int16_t delta)
+{
+    const __m256i d = _mm256_set1_epi16(delta);
+    size_t        i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+        _mm256_storeu_si256((__m256i*) (buf + i), _mm256_add_epi16(v, d));
+    }
+    add16_tail(buf, i, len, delta);
+}
+
+__attribute__((target("avx2"))) static void add32_avx2(uint8_t* buf, size_t len, int32_t delta)
+{
+    const __m256i d = _mm256_set1_epi32(delta);
+    size_t        i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+        _mm256_storeu_si256((__m256i*) (buf + i), _mm256_add_epi32(v, d));
+    }
+    add32_tail(buf, i, len, delta);
+}
+
+__attribute__((target("avx2"))) static void substitute_avx2(uint8_t* buf, size_t len, uint8_t from, uint8_t to)
+{
+    const __m256i f = _mm256_set1_epi8((char) from);
+    const __m256i t = _mm256_set1_epi8((char) to);
+    size_t        i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (buf + i));
+        _mm256_storeu_si256((__m256i*) (buf + i), _mm256_blendv_epi8(v, t, _mm256_cmpeq_epi8(v, f)));
+    }
+    substitute_tail(buf, i, len, from, to);
+}
+
+static const MutationKernels AVX2_KERNELS = {
+    "avx2", flip_avx2, add8_avx2, add16_avx2, add32_avx2, substitute_avx2,
+};
+static const MutationKernels SSE42_KERNELS = {
+    "sse4.2", flip_sse42, add8_sse42, add16_sse42, add32_sse42, substitute_sse42,
+};
+static const MutationKernels SCALAR_KERNELS = {
+    "scalar", flip_scalar, add8_scalar, add16_scalar, add32_scalar, substitute_scalar,
+};
+
+int MutationKernels::available(const MutationKernels** out, int max)
+{
+    int count = 0;
+    __builtin_cpu_init();
+    if (count < max && __builtin_cpu_supports("avx2")) {
+        out[count++] = &AVX2_KERNELS;
+    }
+    if (count < max && __builtin_cpu_supports("sse4.2")) {
+        out[count++] = &SSE42_KERNELS;
+    }
+    if (count < max) {
+        out[count++] = &SCALAR_KERNELS;
+    }
+    return count;
+}
+
+const MutationKernels& MutationKernels::get()
+{
+    static const MutationKernels* best = [] {
+        const MutationKernels* kernels[1];
+        available(kernels, 1);
+        return kernels[0];
+    }();
+    return *best;
+}
@@ -0,0 +1,24 @@
+#include "PatternFill.hpp"
+#include <cstring>
+#include <algorithm>
+
+void patternFill(uint8_t* dst, size_t target, const uint8_t* pattern, size_t pattern_len)
+{
+    if (target == 0) {
+        return;
+    }
+    if (pattern_len == 0) {
+        memset(dst, 0, target);
+        return;
+    }
+
+    size_t filled = std::min(pattern_len, target);
+    memcpy(dst, pattern, filled);
+
+    // dst[0, filled) is a whole number of patterns, so copying it after itself keeps the repetition
+    while (filled < target) {
+        size_t chunk = std::min(filled, target - filled);
+        memcpy(dst + filled, dst, chunk);
+        filled += chunk;
+    }
+}
@@ -30,14 +30,34 @@ ProxyBase::ProxyBase(const char* path)
     // Folosim direct fuzzer-ul din config
     utils::EntityConfig fuzzer  = cm.getFuzzer();
     char*               proxyIP = strdup(fuzzer.ip.c_str());
+
+    CEZ_TRACE_START();
+    HangWatchdog::getInstance()->start(fuzzer.hang_timeout_ms);
+    CoverageFeedback::getInstance()->addTargets(entities, fuzzer.corpus_dir,
+                                                FuzzerCore::parsePowerSchedule(fuzzer.power_schedule));
+    SchemaRegistry::getInstance()->addTargets(entities);
+    FixupRegistry::getInstance()->addTargets(entities);
+    FuzzMode fuzzMode = FuzzerCore::parseFuzzMode(fuzzer.fuzz_mode);
+    if (fuzzer.metrics_port > 0) {
+        Metrics::getInstance()->serve(fuzzer.metrics_port);
+    }
+    if (fuzzer.stats_push_ms > 0) {
+        Metrics::getInstance()->pushToLauncher(fuzzer.stats_push_ms);
+    }
+    if (!fuzzer.pcap_dir.empty()) {
+        PacketCapture::getInstance()->start(fuzzer.pcap_dir, fuzzer.pcap_rotate_mb, fuzzer.pcap_rotate_s);
+    }
+
     if (udp_entities.size() > 0) {
-        udp_handler_ = std::make_unique<UDPHandler>(udp_entities, proxyIP);
+        udp_handler_ =
+            std::make_unique<UDPHandler>(udp_entities, proxyIP, fuzzMode, fuzzer.udp_workers, fuzzer.udp_offload,
+                                         fuzzer.udp_max_datagram, fuzzer.udp_transparent);
         udp_handler_->buildFromConnections(fuzzer.connections);
         udp_handler_->startRecvThreads();
         udp_handler_->startSendThreads();
     }
 
     if (tcp_entities.size() > 0) {
-        tcp_handler_ = std::make_unique<TCPHandler>(tcp_entities, fuzzer.tcp_redirections);
+        tcp_handler_ = std::make_unique<TCPHandler>(tcp_entities, fuzzer.tcp_redirections, fuzzMode);
     }
 }
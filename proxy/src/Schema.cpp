@@ -0,0 +1,429 @@
+#include "Schema.hpp"
+#include "Dictionary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+SchemaRegistry* SchemaRegistry::instance_ = nullptr;
+
+static uint32_t next_random(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static uint32_t uint_width(const std::string& type)
+{
+    if (type == "uint8") {
+        return 1;
+    }
+    if (type == "uint16") {
+        return 2;
+    }
+    if (type == "uint32") {
+        return 4;
+    }
+    return type == "uint64" ? 8 : 0;
+}
+
+// ========== Compilation ==========
+
+/*
+ * Resolves a field or [first, last] range to indexes; false if a name is unknown.
+ */
+static bool resolve_range(const std::vector<std::string>& names, const std::vector<std::string>& range, int& first,
+                          int& last)
+{
+    if (range.empty() || range.size() > 2) {
+        return false;
+    }
+    auto index = [&](const std::string& name) {
+        auto it = std::find(names.begin(), names.end(), name);
+        return it == names.end() ? -1 : (int) (it - names.begin());
+    };
+    first = index(range.front());
+    last  = index(range.back());
+    return first >= 0 && last >= first;
+}
+
+Schema* Schema::compile(const std::string& entity, const std::vector<utils::FieldConfig>& fields)
+{
+    if (fields.empty() || fields.size() > MAX_SCHEMA_FIELDS) {
+        std::cerr << "[ERROR] [Schema] " << entity << ": a schema needs 1-" << MAX_SCHEMA_FIELDS << " fields"
+                  << std::endl;
+        return nullptr;
+    }
+
+    Schema* schema  = new Schema();
+    schema->entity_ = entity;
+    for (const auto& config : fields) {
+        schema->names_.push_back(config.name);
+    }
+
+    auto fail = [&](const std::string& field, const std::string& reason) {
+        std::cerr << "[ERROR] [Schema] " << entity << "." << field << ": " << reason << std::endl;
+        delete schema;
+        return nullptr;
+    };
+
+    // Types and sizes
+    for (const auto& config : fields) {
+        SchemaField field;
+        field.big_endian = config.endian != "little";
+        field.checksum   = CHECKSUM_NONE;
+        field.width      = uint_width(config.type);
+        if (field.width > 0) {
+            field.type = FIELD_UINT;
+        } else if (config.type == "bytes" || config.type == "string") {
+            field.type  = FIELD_BYTES;
+            field.width = (uint32_t) std::max(config.length, 0);
+        } else {
+            return fail(config.name, "unknown type \"" + config.type + "\"");
+        }
+        field.values_begin = (uint32_t) schema->values_.size();
+        field.values_count = (uint32_t) config.values.size();
+        schema->values_.insert(schema->values_.end(), config.values.begin(), config.values.end());
+        schema->fields_.push_back(field);
+    }
+
+    // Length and checksum dependencies
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const utils::FieldConfig& config = fields[i];
+        SchemaField&              field  = schema->fields_[i];
+        bool                      depends = !config.length_of.empty() || !config.checksum.empty();
+
+        if (depends && field.type != FIELD_UINT) {
+            return fail(config.name, "length and checksum fields must be integers");
+        }
+        if (!config.length_of.empty() && !config.checksum.empty()) {
+            return fail(config.name, "a field is either a length or a checksum");
+        }
+
+        if (!config.length_of.empty()) {
+            if (!resolve_range(schema->names_, config.length_of, field.cover_first, field.cover_last)) {
+                return fail(config.name, "length_of must name a field or a [first, last] range");
+            }
+            field.is_length     = true;
+            field.length_adjust = config.length_adjust;
+            int variable        = -1;
+            for (int c = field.cover_first; c <= field.cover_last; ++c) {
+                if (schema->fields_[c].width > 0) {
+                    field.fixed_in_cover += schema->fields_[c].width;
+                } else if (variable >= 0) {
+                    return fail(config.name, "covers more than one variable-size field");
+                } else {
+                    variable = c;
+                }
+            }
+            if (variable >= 0) {
+                if (variable < (int) i) {
+                    return fail(config.name, "must come before the variable-size field it sizes");
+                }
+                if (schema->fields_[variable].length_source >= 0) {
+                    return fail(schema->names_[variable], "sized by more than one length field");
+                }
+                schema->fields_[variable].length_source = (int) i;
+            }
+            schema->length_fields_.push_back((int) i);
+        }
+
+        if (!config.checksum.empty()) {
+            field.checksum = parseChecksumType(config.checksum);
+            if (field.checksum == CHECKSUM_NONE) {
+                return fail(config.name, "unknown checksum \"" + config.checksum + "\"");
+            }
+            std::vector<std::string> whole = {schema->names_.front(), schema->names_.back()};
+            if (!resolve_range(schema->names_, config.checksum_of.empty() ? whole : config.checksum_of,
+                               field.cover_first, field.cover_last)) {
+                return fail(config.name, "checksum_of must name a field or a [first, last] range");
+            }
+            schema->checksum_fields_.push_back((int) i);
+        }
+
+        if (!field.is_length && field.checksum == CHECKSUM_NONE) {
+            schema->data_fields_.push_back((int) i);
+        }
+    }
+
+    // A variable field without a length field takes what the fixed fields after it leave
+    uint32_t fixed_after = 0;
+    bool     variable    = false;
+    for (int i = (int) fields.size() - 1; i >= 0; --i) {
+        SchemaField& field = schema->fields_[i];
+        field.fixed_after  = fixed_after;
+        if (field.width == 0 && field.length_source < 0) {
+            if (variable) {
+                return fail(fields[i].name, "only the last unsized variable field can take the rest of the message");
+            }
+            variable = true;
+        } else if (field.width == 0) {
+            variable = true; // sized by its length field; fields before it must not take the rest either
+        }
+        fixed_after += field.width;
+    }
+
+    // Inner checksums first, so an outer one covers their final value
+    std::stable_sort(schema->checksum_fields_.begin(), schema->checksum_fields_.end(), [&](int a, int b) {
+        return schema->fields_[a].cover_last - schema->fields_[a].cover_first <
+               schema->fields_[b].cover_last - schema->fields_[b].cover_first;
+    });
+
+    std::cout << "[INFO] [Schema] " << entity << ": " << fields.size() << " fields, "
+              << schema->length_fields_.size() << " length and " << schema->checksum_fields_.size()
+              << " checksum dependencies" << std::endl;
+    return schema;
+}
+
+// ========== Messages ==========
+
+/*
+ * Splits a message into field spans; `end` is where the last field ends (any
+ * trailing bytes are kept as they are). False if the message does not match.
+ */
+bool Schema::parse(const uint8_t* input, size_t size, Span* spans, size_t& end) const
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        const SchemaField& field  = fields_[i];
+        size_t             length = field.width;
+
+        if (offset + field.fixed_after > size) {
+            return false;
+        }
+        if (field.width == 0 && field.length_source >= 0) {
+            const SchemaField& source = fields_[field.length_source];
+            int64_t            value =
+                (int64_t) loadUint(input + spans[field.length_source].offset, source.width, source.big_endian);
+            value -= source.length_adjust + source.fixed_in_cover;
+            if (value < 0 || (uint64_t) value > size - offset - field.fixed_after) {
+                return false;
+            }
+            length = (size_t) value;
+        } else if (field.width == 0) {
+            length = size - offset - field.fixed_after;
+        }
+
+        if (offset + length > size) {
+            return false;
+        }
+        spans[i] = {offset, length};
+        offset += length;
+    }
+    end = offset;
+    return true;
+}
+
+/*
+ * Recomputes the length fields, then the checksums; fields whose bit is set in
+ * `skip` were mutated on purpose and keep their value.
+ */
+void Schema::fixup(std::vector<uint8_t>& out, const Span* spans, uint64_t skip) const
+{
+    for (int index : length_fields_) {
+        const SchemaField& field = fields_[index];
+        if (skip & (1ull << index)) {
+            continue;
+        }
+        uint64_t length = 0;
+        for (int c = field.cover_first; c <= field.cover_last; ++c) {
+            length += spans[c].length;
+        }
+        storeUint(out.data() + spans[index].offset, field.width, field.big_endian, length + field.length_adjust);
+    }
+
+    for (int index : checksum_fields_) {
+        const SchemaField& field = fields_[index];
+        if (skip & (1ull << index)) {
+            continue;
+        }
+        // A checksum inside its own range is computed with itself zeroed (as in IP headers)
+        uint8_t* slot  = out.data() + spans[index].offset;
+        size_t   begin = spans[field.cover_first].offset;
+        size_t   end   = spans[field.cover_last].offset + spans[field.cover_last].length;
+        memset(slot, 0, field.width);
+        uint32_t checksum = computeChecksum(field.checksum, out.data() + begin, end - begin);
+        storeUint(slot, field.width, field.big_endian, checksum);
+    }
+}
+
+void Schema::mutateUint(std::vector<uint8_t>& data, const SchemaField& field, uint32_t& random) const
+{
+    uint64_t max   = field.width == 8 ? ~0ull : (1ull << (8 * field.width)) - 1;
+    uint64_t value = loadUint(data.data(), field.width, field.big_endian);
+    uint32_t r     = next_random(random);
+
+    switch (r % 5) {
+        case 0:
+            if (field.values_count > 0) {
+                value = values_[field.values_begin + (r >> 8) % field.values_count];
+                break;
+            }
+            // fall through
+        case 1: {
+            const uint64_t boundaries[] = {0, 1, max, max - 1, max >> 1, (max >> 1) + 1};
+            value                       = boundaries[(r >> 8) % 6];
+            break;
+        }
+        case 2: {
+            uint64_t delta = (r >> 8) % 35 + 1;
+            value          = (r >> 16) & 1 ? value + delta : value - delta;
+            break;
+        }
+        case 3:
+            value ^= 1ull << ((r >> 8) % (8 * field.width));
+            break;
+        default:
+            value = ((uint64_t) next_random(random) << 32) | next_random(random);
+            break;
+    }
+    storeUint(data.data(), field.width, field.big_endian, value & max);
+}
+
+/*
+ * Fixed-size fields are only overwritten; variable ones may also grow
+ * (long runs for overflows), shrink (down to empty) or get a token inserted.
+ */
+void Schema::mutateBytes(std::vector<uint8_t>& data, const SchemaField& field, uint32_t& random,
+                         Dictionary* dictionary) const
+{
+    static const uint8_t fill_bytes[] = {'A', 0x00, 0xff, '%', '\n', '9'};
+    std::vector<uint8_t> token;
+    bool                 variable = field.width == 0;
+    uint32_t             r        = next_random(random);
+    uint8_t              fill     = fill_bytes[(r >> 8) % sizeof(fill_bytes)];
+    size_t               pos      = data.empty() ? 0 : next_random(random) % data.size();
+
+    switch (r % 6) {
+        case 0:
+            if (dictionary && dictionary->pick(next_random(random), token)) {
+                if (variable) {
+                    data.insert(data.begin() + pos, token.begin(), token.end());
+                } else {
+                    memcpy(data.data() + pos, token.data(), std::min(token.size(), data.size() - pos));
+                }
+                break;
+            }
+            // fall through
+        case 1:
+            for (size_t i = pos; i < data.size() && i < pos + 8; ++i) {
+                data[i] = (uint8_t) next_random(random);
+            }
+            break;
+        case 2:
+            if (variable) {
+                data.insert(data.end(), next_random(random) % MAX_FIELD_GROWTH + 1, fill);
+            } else {
+                memset(data.data(), fill, data.size());
+            }
+            break;
+        case 3:
+            if (variable) {
+                data.resize(data.empty() ? 0 : next_random(random) % data.size());
+            } else {
+                memset(data.data(), 0, data.size());
+            }
+            break;
+        case 4:
+            if (variable && data.size() <= MAX_FIELD_GROWTH) {
+                data.insert(data.end(), data.begin(), data.end());
+                break;
+            }
+            // fall through
+        default:
+            if (!data.empty()) {
+                data[pos] ^= (uint8_t) (1u << (r >> 16) % 8);
+            }
+            break;
+    }
+}
+
+/**
+ * mutate:
+ *   - Parses `input` (false if it does not match the schema).
+ *   - Mutates 1..MAX_SCHEMA_MUTATIONS data fields; once in
+ *     SCHEMA_RAW_LENGTH_ONE_IN picks a length field instead and leaves its
+ *     mutated value in place.
+ *   - Rebuilds the message into `out` and fixes up lengths and checksums.
+ */
+bool Schema::mutate(const uint8_t* input, size_t size, std::vector<uint8_t>& out, uint32_t random,
+                    Dictionary* dictionary) const
+{
+    Span   spans[MAX_SCHEMA_FIELDS];
+    Span   mutated[MAX_SCHEMA_FIELDS];
+    size_t end = 0;
+    if (!parse(input, size, spans, end) || (data_fields_.empty() && length_fields_.empty())) {
+        return false;
+    }
+
+    uint64_t targets = 0;
+    uint64_t skip    = 0;
+    uint32_t rounds  = next_random(random) % MAX_SCHEMA_MUTATIONS + 1;
+    for (uint32_t i = 0; i < rounds; ++i) {
+        uint32_t r = next_random(random);
+        if (data_fields_.empty() || (!length_fields_.empty() && r % SCHEMA_RAW_LENGTH_ONE_IN == 0)) {
+            int index = length_fields_[(r >> 8) % length_fields_.size()];
+            targets |= 1ull << index;
+            skip |= 1ull << index;
+        } else {
+            targets |= 1ull << data_fields_[(r >> 8) % data_fields_.size()];
+        }
+    }
+
+    std::vector<uint8_t> field;
+    out.clear();
+    out.reserve(size + MAX_FIELD_GROWTH);
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        const uint8_t* src = input + spans[i].offset;
+        if (targets & (1ull << i)) {
+            field.assign(src, src + spans[i].length);
+            if (fields_[i].type == FIELD_UINT) {
+                mutateUint(field, fields_[i], random);
+            } else {
+                mutateBytes(field, fields_[i], random, dictionary);
+            }
+            mutated[i] = {out.size(), field.size()};
+            out.insert(out.end(), field.begin(), field.end());
+        } else {
+            mutated[i] = {out.size(), spans[i].length};
+            out.insert(out.end(), src, src + spans[i].length);
+        }
+    }
+    out.insert(out.end(), input + end, input + size);
+
+    fixup(out, mutated, skip);
+    return true;
+}
+
+// ========== SchemaRegistry ==========
+
+SchemaRegistry* SchemaRegistry::getInstance()
+{
+    if (instance_ == nullptr) {
+        instance_ = new SchemaRegistry();
+    }
+    return instance_;
+}
+
+void SchemaRegistry::addTargets(const std::vector<utils::EntityConfig>& entities)
+{
+    for (const auto& entity : entities) {
+        if (entity.schema.empty()) {
+            continue;
+        }
+        Schema* schema = Schema::compile(entity.name, entity.schema);
+        if (schema != nullptr) {
+            schemas_[entity.name] = schema;
+        }
+    }
+}
+
+/*
+ * Returns nullptr for targets without a schema.
+ */
+Schema* SchemaRegistry::forEntity(const std::string& name)
+{
+    auto it = schemas_.find(name);
+    return it == schemas_.end() ? nullptr : it->second;
+}
@@ -0,0 +1,188 @@
+#include "SeedScheduler.hpp"
+#include <algorithm>
+
+SeedScheduler::SeedScheduler() : tree_(1, 0), path_hits_(new std::atomic<uint32_t>[SCHEDULE_PATH_SLOTS])
+{
+    for (size_t i = 0; i < SCHEDULE_PATH_SLOTS; ++i) {
+        path_hits_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void SeedScheduler::hitPath(uint64_t path)
+{
+    if (path != 0) {
+        path_hits_[path % SCHEDULE_PATH_SLOTS].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/*
+ * AFL's calculate_score() without the handicap and depth bonuses (the proxy
+ * has no queue cycles), then the schedule's factor.
+ */
+uint32_t SeedScheduler::energy(const Seed& seed) const
+{
+    if (schedule_ == SCHEDULE_UNIFORM) {
+        return 1;
+    }
+
+    double score = 100;
+    if (seed.exec_us > 0 && avg_exec_us_ > 0) {
+        double exec = seed.exec_us;
+        if (exec * 0.1 > avg_exec_us_) {
+            score = 10;
+        } else if (exec * 0.25 > avg_exec_us_) {
+            score = 25;
+        } else if (exec * 0.5 > avg_exec_us_) {
+            score = 50;
+        } else if (exec * 0.75 > avg_exec_us_) {
+            score = 75;
+        } else if (exec * 4 < avg_exec_us_) {
+            score = 300;
+        } else if (exec * 3 < avg_exec_us_) {
+            score = 200;
+        } else if (exec * 2 < avg_exec_us_) {
+            score = 150;
+        }
+    }
+    if (avg_edges_ > 0) {
+        double edges = seed.edges;
+        if (edges * 0.3 > avg_edges_) {
+            score *= 3;
+        } else if (edges * 0.5 > avg_edges_) {
+            score *= 2;
+        } else if (edges * 0.75 > avg_edges_) {
+            score *= 1.5;
+        } else if (edges * 3 < avg_edges_) {
+            score *= 0.25;
+        } else if (edges * 2 < avg_edges_) {
+            score *= 0.5;
+        } else if (edges * 1.5 < avg_edges_) {
+            score *= 0.75;
+        }
+    }
+    if (seed.size * 2 < avg_size_) {
+        score *= 1.5;
+    } else if (seed.size > avg_size_ * 2) {
+        score *= 0.75;
+    }
+    if (seed.new_edges > 0) {
+        score *= 2;
+    }
+
+    double hits   = std::max<uint32_t>(path_hits_[seed.slot].load(std::memory_order_relaxed), 1);
+    double growth = seed.picked < 16 ? (double) (1u << seed.picked) : SCHEDULE_MAX_FACTOR;
+    double factor = 1;
+    if (schedule_ == SCHEDULE_FAST) {
+        factor = std::min(growth / hits, (double) SCHEDULE_MAX_FACTOR);
+    } else if (schedule_ == SCHEDULE_COE) {
+        factor = hits > mean_hits_ ? 0 : std::min(growth, (double) SCHEDULE_MAX_FACTOR);
+    }
+    score = std::min(score * factor, (double) SCHEDULE_MAX_ENERGY);
+
+    // coe leaves the inputs of frequent paths out on purpose; the others never starve one completely
+    if (schedule_ == SCHEDULE_COE) {
+        return (uint32_t) score;
+    }
+    return std::max<uint32_t>((uint32_t) score, 1);
+}
+
+// Sum of the first `count` energies
+uint64_t SeedScheduler::prefix(size_t count) const
+{
+    uint64_t sum = 0;
+    for (; count > 0; count &= count - 1) {
+        sum += tree_[count];
+    }
+    return sum;
+}
+
+void SeedScheduler::update(size_t index, uint32_t energy)
+{
+    int64_t delta        = (int64_t) energy - (int64_t) seeds_[index].energy;
+    seeds_[index].energy = energy;
+    total_ += delta;
+    for (size_t i = index + 1; i < tree_.size(); i += i & (~i + 1)) {
+        tree_[i] += delta;
+    }
+}
+
+/*
+ * Appending to a Fenwick tree: the new node covers its own energy and the
+ * nodes its lowest set bit spans below it.
+ */
+void SeedScheduler::add(const SeedInfo& info, size_t size)
+{
+    Seed seed = {(uint32_t) size, info.exec_us, (uint32_t) (info.path % SCHEDULE_PATH_SLOTS), 0, 0, info.edges,
+                 info.new_edges};
+    seed.energy = energy(seed);
+    seeds_.push_back(seed);
+
+    size_t node = seeds_.size();
+    size_t low  = node & (~node + 1);
+    tree_.push_back(seed.energy + prefix(node - 1) - prefix(node - low));
+    total_ += seed.energy;
+}
+
+void SeedScheduler::refresh()
+{
+    double exec_sum = 0, edges_sum = 0, size_sum = 0, hits_sum = 0;
+    size_t timed    = 0;
+    for (const Seed& seed : seeds_) {
+        exec_sum += seed.exec_us;
+        timed += seed.exec_us > 0;
+        edges_sum += seed.edges;
+        size_sum += seed.size;
+        hits_sum += path_hits_[seed.slot].load(std::memory_order_relaxed);
+    }
+    double count = (double) seeds_.size();
+    avg_exec_us_ = timed ? exec_sum / timed : 0;
+    avg_edges_   = edges_sum / count;
+    avg_size_    = size_sum / count;
+    mean_hits_   = hits_sum / count;
+
+    // Rebuilt bottom-up in O(n)
+    total_ = 0;
+    for (size_t i = 0; i < seeds_.size(); ++i) {
+        seeds_[i].energy = energy(seeds_[i]);
+        tree_[i + 1]     = seeds_[i].energy;
+        total_ += seeds_[i].energy;
+    }
+    for (size_t node = 1; node < tree_.size(); ++node) {
+        size_t parent = node + (node & (~node + 1));
+        if (parent < tree_.size()) {
+            tree_[parent] += tree_[node];
+        }
+    }
+    picks_        = 0;
+    refreshed_at_ = seeds_.size();
+}
+
+size_t SeedScheduler::pick(uint64_t random)
+{
+    if (picks_ >= std::max<size_t>(SCHEDULE_REFRESH, seeds_.size()) || seeds_.size() >= refreshed_at_ * 2) {
+        refresh();
+    }
+    ++picks_;
+    if (total_ == 0) {
+        return random % seeds_.size(); // coe with every path above the mean
+    }
+
+    // Descends the tree to the first seed whose energies so far exceed `target`
+    uint64_t target = random % total_;
+    size_t   node   = 0;
+    size_t   step   = 1;
+    while (step * 2 < tree_.size()) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (node + step < tree_.size() && tree_[node + step] <= target) {
+            node += step;
+            target -= tree_[node];
+        }
+    }
+
+    Seed& seed = seeds_[node];
+    ++seed.picked;
+    update(node, energy(seed));
+    return node;
+}
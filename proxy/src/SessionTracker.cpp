@@ -0,0 +1,89 @@
+#include "SessionTracker.hpp"
+#include <algorithm>
+#include <iostream>
+
+SessionTracker::SessionTracker(const std::string& link, MessageTypeRule fromA, MessageTypeRule fromB) : link_(link)
+{
+    rules_[0] = fromA;
+    rules_[1] = fromB;
+    last_type_[0].store(0);
+    last_type_[1].store(0);
+    for (auto& hits : hits_) {
+        hits.store(0, std::memory_order_relaxed);
+    }
+}
+
+MessageTypeRule SessionTracker::ruleFor(const std::vector<utils::EntityConfig>& entities, const std::string& name)
+{
+    MessageTypeRule rule;
+    for (const auto& entity : entities) {
+        if (entity.name == name && entity.message_type_offset >= 0) {
+            rule.offset = entity.message_type_offset;
+            rule.width  = entity.message_type_width > 0 ? std::min(entity.message_type_width, 4) : 1;
+        }
+    }
+    return rule;
+}
+
+/*
+ * Types are never 0, so 0 can mean "no message yet" in last_type_.
+ */
+uint32_t SessionTracker::messageType(int direction, const uint8_t* message, size_t len) const
+{
+    const MessageTypeRule& rule = rules_[direction];
+    uint32_t               type = 0;
+
+    if (rule.offset < 0) {
+        // First byte and length class (0, 1, 2-3, 4-7, ...)
+        uint32_t length_class = len == 0 ? 0 : 64 - __builtin_clzll(len);
+        type                  = (len > 0 ? message[0] : 0) << 8 | length_class;
+    } else if ((size_t) rule.offset + rule.width <= len) {
+        for (int i = 0; i < rule.width; ++i) {
+            type = type << 8 | message[rule.offset + i];
+        }
+    } else {
+        type = 0xFFFFFFFF; // too short to carry a type
+    }
+    return type * 2 + 1;
+}
+
+uint32_t SessionTracker::observe(int direction, const uint8_t* message, size_t len)
+{
+    uint32_t type     = messageType(direction, message, len);
+    uint32_t previous = last_type_[1 - direction].load(std::memory_order_relaxed);
+    last_type_[direction].store(type, std::memory_order_relaxed);
+
+    // Mix (direction, previous, type) into a slot index
+    uint64_t key   = ((uint64_t) previous << 32 | type) ^ ((uint64_t) direction << 63);
+    key            = (key ^ (key >> 31)) * 0x9E3779B97F4A7C15ull;
+    uint32_t state = (uint32_t) (key >> 40) & (SESSION_STATE_SLOTS - 1);
+
+    total_.fetch_add(1, std::memory_order_relaxed);
+    if (hits_[state].fetch_add(1, std::memory_order_relaxed) == 0) {
+        size_t count = distinct_.fetch_add(1, std::memory_order_relaxed) + 1;
+        std::cout << "[DEBUG] [Session] " << link_ << ": new state " << state << " (" << count << " states)"
+                  << std::endl;
+    }
+    return state;
+}
+
+/*
+ * States seen at most as often as the average state are always mutated;
+ * more common ones with probability average / hits, but at least
+ * 1 / SESSION_MIN_MUTATE_1_IN.
+ */
+bool SessionTracker::shouldMutate(uint32_t state, uint32_t random) const
+{
+    uint64_t hits     = hits_[state & (SESSION_STATE_SLOTS - 1)].load(std::memory_order_relaxed);
+    uint64_t distinct = distinct_.load(std::memory_order_relaxed);
+    if (hits == 0 || distinct == 0) {
+        return true;
+    }
+
+    uint64_t average = total_.load(std::memory_order_relaxed) / distinct;
+    if (hits <= average) {
+        return true;
+    }
+    uint64_t budget = std::max(average, hits / SESSION_MIN_MUTATE_1_IN);
+    return random % hits < budget;
+}
@@ -1,9 +1,12 @@
 #include "TCPConnection.hpp"
 #include <arpa/inet.h>
+#include <sys/socket.h>
 #include <cstring>
 #include <unistd.h>
 #include <iostream>
 #include "Fuzzer.hpp"
+#include "Capture.hpp"
+#include "Trace.hpp"
 
 // ========== TCP_Connection ==========
 
@@ -30,6 +33,16 @@ uint16_t TCP_Connection::getPort() const
     return port_;
 }
 
+HangSlot* TCP_Connection::getHangSlot() const
+{
+    return hang_slot_;
+}
+
+CoverageMap* TCP_Connection::getCoverage() const
+{
+    return coverage_;
+}
+
 void TCP_Connection::setFD(int fd)
 {
     socket_fd_ = fd;
@@ -45,57 +58,236 @@ void TCP_Connection::setPort(uint16_t port)
     port_ = port;
 }
 
-void TCP_Connection::startConnectionThread(int forward_fd)
+void TCP_Connection::setHangSlot(HangSlot* slot)
+{
+    hang_slot_ = slot;
+}
+
+void TCP_Connection::setCoverage(CoverageMap* coverage)
+{
+    coverage_ = coverage;
+}
+
+Dictionary* TCP_Connection::getDictionary() const
+{
+    return dictionary_;
+}
+
+void TCP_Connection::setDictionary(Dictionary* dictionary)
+{
+    dictionary_ = dictionary;
+}
+
+Schema* TCP_Connection::getSchema() const
+{
+    return schema_;
+}
+
+void TCP_Connection::setSchema(Schema* schema)
+{
+    schema_ = schema;
+}
+
+FixupStage* TCP_Connection::getFixups() const
+{
+    return fixups_;
+}
+
+void TCP_Connection::setFixups(FixupStage* fixups)
+{
+    fixups_ = fixups;
+}
+
+SessionTracker* TCP_Connection::getSession() const
+{
+    return session_;
+}
+
+void TCP_Connection::setSession(SessionTracker* session, int direction)
+{
+    session_           = session;
+    session_direction_ = direction;
+}
+
+void TCP_Connection::setFuzzMode(FuzzMode mode)
+{
+    fuzz_mode_ = mode;
+}
+
+ThreadMetrics* TCP_Connection::getMetrics() const
+{
+    return metrics_;
+}
+
+void TCP_Connection::setMetrics(ThreadMetrics* metrics)
+{
+    metrics_ = metrics;
+}
+
+/*
+ * Starts the thread forwarding what this peer sends to `forward`.
+ */
+void TCP_Connection::startConnectionThread(const TCP_Connection& forward, TCP_ChannelState* state)
 {
     int       ret = 0;
     pthread_t _thread;
     struct _targ {
-        int recvfd;
-        int sendfd;
+        int               recvfd;
+        int               sendfd;
+        HangSlot*         recvslot;
+        HangSlot*         sendslot;
+        CoverageMap*      recvcoverage;
+        CoverageMap*      sendcoverage;
+        Schema*           sendschema;
+        FixupStage*       sendfixups;
+        Dictionary*       dictionary;
+        SessionTracker*   session;
+        int               direction;
+        FuzzMode          mode;
+        ThreadMetrics*    metrics;
+        TCP_ChannelState* state;
+        CaptureLink       capture;
     }* _thread_arg;
-    _thread_arg         = (struct _targ*) malloc(sizeof(*_thread_arg));
-    _thread_arg->recvfd = this->getFD();
-    _thread_arg->sendfd = forward_fd;
+    _thread_arg               = (struct _targ*) malloc(sizeof(*_thread_arg));
+    _thread_arg->recvfd       = this->getFD();
+    _thread_arg->sendfd       = forward.getFD();
+    _thread_arg->recvslot     = hang_slot_;
+    _thread_arg->sendslot     = forward.getHangSlot();
+    _thread_arg->recvcoverage = coverage_;
+    _thread_arg->sendcoverage = forward.getCoverage();
+    _thread_arg->sendschema   = forward.getSchema();
+    _thread_arg->sendfixups   = forward.getFixups();
+    _thread_arg->dictionary   = dictionary_;
+    _thread_arg->session      = session_;
+    _thread_arg->direction    = session_direction_;
+    _thread_arg->mode         = fuzz_mode_;
+    _thread_arg->metrics      = metrics_;
+    _thread_arg->state        = state;
+    _thread_arg->capture      = PacketCapture::link(IPPROTO_TCP, ip_, port_, forward.getIP(), forward.getPort());
 
     ret = pthread_create(&_thread, NULL, TCP_Connection::_connection_thread_loop, _thread_arg);
     if (ret < 0) {
         std::cerr << "[TCP_Connection] Couldn't start thread TCPConnection\n";
         free(_thread_arg);
         exit(-1);
-    }
+    }    pthread_detach(_thread);
 }
 
-// Placeholder for future threaded handling of connection
+// Forwards until the peer closes its side, which is then passed on to the other peer
 void* TCP_Connection::_connection_thread_loop(void* args)
 {
-    FuzzerCore _fuzzer(FUZZSTYLE_RANDOMIZATION);
     struct _targ {
-        int recvfd;
-        int sendfd;
-    }*      _thread_arg = (struct _targ*) args;
-    int     recv_fd     = _thread_arg->recvfd;
-    int     send_fd     = _thread_arg->sendfd;
-    ssize_t ret         = 0;
+        int               recvfd;
+        int               sendfd;
+        HangSlot*         recvslot;
+        HangSlot*         sendslot;
+        CoverageMap*      recvcoverage;
+        CoverageMap*      sendcoverage;
+        Schema*           sendschema;
+        FixupStage*       sendfixups;
+        Dictionary*       dictionary;
+        SessionTracker*   session;
+        int               direction;
+        FuzzMode          mode;
+        ThreadMetrics*    metrics;
+        TCP_ChannelState* state;
+        CaptureLink       capture;
+    }*                _thread_arg = (struct _targ*) args;
+    int               recv_fd     = _thread_arg->recvfd;
+    int               send_fd     = _thread_arg->sendfd;
+    HangSlot*         recv_slot   = _thread_arg->recvslot;
+    HangSlot*         send_slot   = _thread_arg->sendslot;
+    CoverageMap*      replies     = _thread_arg->recvcoverage; // of the peer this thread reads from
+    CoverageMap*      coverage    = _thread_arg->sendcoverage;
+    FixupStage*       fixups      = _thread_arg->sendfixups;
+    ThreadMetrics*    metrics     = _thread_arg->metrics;
+    TCP_ChannelState* state       = _thread_arg->state;
+    CaptureLink       link        = _thread_arg->capture; // this direction, for the whole connection
+    PacketCapture*    capture     = PacketCapture::active();
+    FuzzerCore        _fuzzer(FUZZSTYLE_RANDOMIZATION, _thread_arg->mode);
+    FuzzContext       context;
+    ssize_t           ret = 0;
+
+    context.corpus     = coverage ? &coverage->corpus() : nullptr;
+    context.schema     = _thread_arg->sendschema;
+    context.dictionary = _thread_arg->dictionary;
+    context.session    = _thread_arg->session;
+    context.direction  = _thread_arg->direction;
     free(_thread_arg);
 
+    CEZ_TRACE_THREAD("tcp " + metrics->link + (context.direction == 0 ? " client->server" : " server->client"));
     char buffer[65536];
     while (true) {
         memset(buffer, 0, sizeof(buffer));
-        ret = recv(recv_fd, buffer, sizeof(buffer), 0);
+        CEZ_TRACE_MARK(recv_start);
+        ret = recv(recv_fd, buffer, sizeof(buffer) - 1, 0); // keep a NUL for the log line below
+        CEZ_TRACE_SPAN(TRACE_RECV, recv_start, ret > 0 ? ret : 0);
         std::cout << "[TCPConenction] Received " << buffer << "\n";
         if (ret < 0) {
             std::cerr << "[ERROR] Error at receving message on socket " << recv_fd << "\n";
             exit(-1);
         }
-        size_t   fuzzedSize = 0;
+        if (ret == 0) {
+            std::cout << "[TCPConnection] Peer on socket " << recv_fd << " closed its side\n";
+            shutdown(send_fd, SHUT_WR);
+            break;
+        }
+        HangWatchdog::disarm(recv_slot);
+        CoverageMap::recordReply(replies);
+        uint64_t received_ns = Metrics::nowNs();
+        metrics->packets_in.add(1);
+        metrics->bytes_in.add((uint64_t) ret);
+        if (capture) {
+            capture->record(CAPTURE_ORIGINAL, link, reinterpret_cast<const uint8_t*>(buffer), (size_t) ret);
+        }
+
+        size_t fuzzedSize = 0;
+        CEZ_TRACE_MARK(mutate_start);
         uint8_t* fuzzedBuff =
-            _fuzzer.postFuzzing(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(ret), fuzzedSize);
+            _fuzzer.fuzz(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(ret), fuzzedSize, context);
+        CEZ_TRACE_SPAN(TRACE_MUTATE, mutate_start, fuzzedSize);
+        metrics->mutations.add(1);
+        metrics->mutation_ns.record(Metrics::nowNs() - received_ns);
+
+        if (fixups && fuzzedBuff) {
+            CEZ_TRACE_SCOPE(TRACE_FIXUP, fuzzedSize);
+            fixups->apply(fuzzedBuff, fuzzedSize);
+        }
+        if (capture && fuzzedBuff) {
+            capture->record(CAPTURE_MUTATED, link, fuzzedBuff, fuzzedSize);
+        }
 
         std::cout << "[TCPConnection] Forwarding ..." << "\n";
-        ret = send(send_fd, fuzzedBuff, fuzzedSize, 0);
+        CEZ_TRACE_MARK(send_start);
+        ret = send(send_fd, fuzzedBuff, fuzzedSize, MSG_NOSIGNAL);
+        CEZ_TRACE_SPAN(TRACE_SEND, send_start, fuzzedSize);
+        if (ret < 0) {
+            metrics->send_errors.add(1);
+        } else {
+            metrics->packets_out.add(1);
+            metrics->bytes_out.add((uint64_t) ret);
+        }
+        metrics->forward_ns.record(Metrics::nowNs() - received_ns);
+        HangWatchdog::arm(send_slot);
+        if (coverage && ret > 0) {
+            coverage->recordSent(fuzzedBuff, (size_t) ret);
+        }
         free(fuzzedBuff);
     }
 
+    Metrics::getInstance()->releaseThread(metrics);
+    if (state->threads.fetch_sub(1) == 1) {
+        // The other thread is gone too: the pair's slots are the two this one holds
+        HangWatchdog::getInstance()->releaseSlot(recv_slot);
+        HangWatchdog::getInstance()->releaseSlot(send_slot);
+        close(recv_fd);
+        close(send_fd);
+        if (state->active) {
+            state->active->fetch_sub(1);
+        }
+        delete state->session;
+        delete state;
+    }
     return nullptr;
 }
 
@@ -128,8 +320,14 @@ void TCP_ChannelPair::setServerSide(const TCP_Connection& conn)
     server_side_ = conn;
 }
 
-void TCP_ChannelPair::startChannelThreads()
+void TCP_ChannelPair::startChannelThreads(std::atomic<int>* active)
 {
-    this->client_side_.startConnectionThread(this->server_side_.getFD());
-    this->server_side_.startConnectionThread(this->client_side_.getFD());
+    TCP_ChannelState* state = new TCP_ChannelState();
+    state->active           = active;
+    state->session          = this->client_side_.getSession();
+    if (active) {
+        active->fetch_add(1);
+    }
+    this->client_side_.startConnectionThread(this->server_side_, state);
+    this->server_side_.startConnectionThread(this->client_side_, state);
 }
\ No newline at end of file
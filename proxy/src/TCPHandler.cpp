@@ -9,14 +9,17 @@ struct ListenThreadArgs {
     int         proxy_port;
     int         listen_fd;
     TCPHandler* handler;
+    Dictionary* dictionary;
 };
 
 TCPHandler::TCPHandler() {}
 
 TCPHandler::TCPHandler(const std::vector<utils::EntityConfig>&   tcp_entities,
-                       const std::vector<utils::TCPRedirection>& tcp_redirections)
-    : _entities(tcp_entities)
+                       const std::vector<utils::TCPRedirection>& tcp_redirections, FuzzMode mode)
+    : _entities(tcp_entities), _fuzzMode(mode)
 {
+    Metrics::getInstance()->addGauge("cez_tcp_active_channel_pairs", "TCP client/server pairs being forwarded.",
+                                     [this] { return (double) _activePairs.load(std::memory_order_relaxed); });
 
     for (const auto& redir : tcp_redirections) {
         int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -49,11 +52,14 @@ TCPHandler::TCPHandler(const std::vector<utils::EntityConfig>&   tcp_entities,
         std::cout << "[TCPHandler] Listening on 0.0.0.0:" << redir.proxy_port << "\n";
 
         // Launch accept thread
-        auto*     args = new ListenThreadArgs{redir.server_port, redir.server_ip, redir.proxy_port, listen_fd, this};
+        Dictionary* dictionary = new Dictionary(redir.dictionary);
+        auto*       args =
+            new ListenThreadArgs{redir.server_port, redir.server_ip, redir.proxy_port, listen_fd, this, dictionary};
         pthread_t tid;
         if (pthread_create(&tid, nullptr, _listen_thread, args) != 0) {
             std::cerr << "[TCPHandler] Failed to start thread for port " << redir.proxy_port << "\n";
             close(listen_fd);
+            delete dictionary;
             delete args;
         } else {
             pthread_detach(tid);
@@ -69,9 +75,14 @@ void TCPHandler::addChannelPair(const TCP_ChannelPair& pair)
     std::cout << "[TCPHandler] Added channel pair.\n";
 }
 
-void TCPHandler::printStatus() const
+std::string TCPHandler::entityName(const std::string& ip, int port) const
 {
-    std::cout << "[TCPHandler] Total active pairs: " << _channelPairs.size() << "\n";
+    for (const auto& entity : _entities) {
+        if (entity.ip == ip && (port == -1 || entity.port == -1 || entity.port == port)) {
+            return entity.name;
+        }
+    }
+    return ip + ":" + std::to_string(port);
 }
 
 void* TCPHandler::_listen_thread(void* args)
@@ -117,10 +128,38 @@ void* TCPHandler::_listen_thread(void* args)
         }
         std::cout << "[TCPHandler] Socket connected to server " << data->ip << ":" << data->port << "\n";
         TCP_Connection  _to_server_connection(_to_server_fd, data->ip, data->port);
+        std::string link = std::string(client_ip) + ":" + std::to_string(client_port) + " <-> " + data->ip + ":" +
+                           std::to_string(data->port);
+        std::string     client_name = data->handler->entityName(client_ip, -1);
+        std::string     server_name = data->handler->entityName(data->ip, data->port);
+        _form_clinet_connection.setHangSlot(HangWatchdog::getInstance()->createSlot(client_name, "tcp " + link));
+        _to_server_connection.setHangSlot(HangWatchdog::getInstance()->createSlot(server_name, "tcp " + link));
+        _form_clinet_connection.setCoverage(CoverageFeedback::getInstance()->forEntity(client_name));
+        _to_server_connection.setCoverage(CoverageFeedback::getInstance()->forEntity(server_name));
+        _form_clinet_connection.setSchema(SchemaRegistry::getInstance()->forEntity(client_name));
+        _to_server_connection.setSchema(SchemaRegistry::getInstance()->forEntity(server_name));
+        _form_clinet_connection.setFixups(FixupRegistry::getInstance()->forEntity(client_name));
+        _to_server_connection.setFixups(FixupRegistry::getInstance()->forEntity(server_name));
+        _form_clinet_connection.setFuzzMode(data->handler->_fuzzMode);
+        _to_server_connection.setFuzzMode(data->handler->_fuzzMode);
+        _form_clinet_connection.setDictionary(data->dictionary);
+        _to_server_connection.setDictionary(data->dictionary);
+
+        // Labelled without the client port, so reconnecting clients keep adding to the same series
+        std::string metrics_link = std::string(client_ip) + " <-> " + data->ip + ":" + std::to_string(data->port);
+        _form_clinet_connection.setMetrics(Metrics::getInstance()->registerThread("tcp", metrics_link, 0));
+        _to_server_connection.setMetrics(Metrics::getInstance()->registerThread("tcp", metrics_link, 1));
+
+        SessionTracker* session =
+            new SessionTracker("tcp " + link, SessionTracker::ruleFor(data->handler->_entities, client_name),
+                               SessionTracker::ruleFor(data->handler->_entities, server_name));
+        _form_clinet_connection.setSession(session, 0);
+        _to_server_connection.setSession(session, 1);
+
         TCP_ChannelPair _pair;
         _pair.setClientSide(_form_clinet_connection);
         _pair.setServerSide(_to_server_connection);
-        _pair.startChannelThreads();
+        _pair.startChannelThreads(&data->handler->_activePairs);
         data->handler->addChannelPair(_pair);
         std::cout << "[TCPHandler] Channel initialised\n";
     }
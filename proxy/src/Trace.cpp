@@ -0,0 +1,219 @@
+#include "Trace.hpp"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+
+thread_local TraceRing* Tracer::ring_ = nullptr;
+
+static const char* STAGE_NAMES[TRACE_STAGES] = {"recv", "mutate", "radamsa_spawn", "pipe_write", "pipe_read",
+                                                "normalize", "copy", "fixup", "send"};
+
+static pthread_mutex_t         rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<TraceRing*> rings;      // every ring made, in use or not
+static std::vector<TraceRing*> free_rings; // of threads that exited, reused by the next ones
+static int                     dump_pipe[2] = {-1, -1};
+
+// Both clocks at start(), to convert ticks to time at dump
+static uint64_t start_ticks = 0;
+static uint64_t start_ns    = 0;
+
+static std::string json_string(const std::string& value)
+{
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += ((unsigned char) c < 0x20) ? ' ' : c;
+    }
+    return out + "\"";
+}
+
+uint64_t Tracer::steadyNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Hands the thread's ring back when the thread exits (TCP starts threads per connection)
+struct RingRelease {
+    TraceRing* ring = nullptr;
+    ~RingRelease()
+    {
+        pthread_mutex_lock(&rings_mutex);
+        free_rings.push_back(ring);
+        pthread_mutex_unlock(&rings_mutex);
+    }
+};
+
+TraceRing* Tracer::attach()
+{
+    TraceRing* ring = nullptr;
+    int        tid  = (int) syscall(SYS_gettid);
+
+    pthread_mutex_lock(&rings_mutex);
+    if (!free_rings.empty()) {
+        ring = free_rings.back();
+        free_rings.pop_back();
+    } else {
+        ring = new TraceRing();
+        rings.push_back(ring);
+    }
+    ring->tid  = tid;
+    ring->name = "thread " + std::to_string(tid);
+    ring->first.store(ring->next.load(std::memory_order_relaxed), std::memory_order_release);
+    pthread_mutex_unlock(&rings_mutex);
+
+    static thread_local RingRelease release;
+    release.ring = ring;
+    ring_        = ring;
+    return ring;
+}
+
+void Tracer::nameThread(const std::string& name)
+{
+    TraceRing* ring = ring_ ? ring_ : attach();
+    pthread_mutex_lock(&rings_mutex);
+    ring->name = name;
+    pthread_mutex_unlock(&rings_mutex);
+}
+
+static void on_dump_signal(int)
+{
+    char byte = 1;
+    if (write(dump_pipe[1], &byte, 1) < 0) {
+        // Nothing to do in a signal handler; a dump is already pending
+    }
+}
+
+bool Tracer::start()
+{
+    start_ticks = now();
+    start_ns    = steadyNs();
+
+    if (pipe2(dump_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        perror("[ERROR] [Tracer] pipe2");
+        return false;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_dump_signal;
+    action.sa_flags   = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+
+    pthread_t tid;
+    if (pthread_create(&tid, nullptr, dumpEntry, nullptr) != 0) {
+        perror("[ERROR] [Tracer] pthread_create");
+        return false;
+    }
+    pthread_detach(tid);
+    std::cout << "[INFO] [Tracer] Tracing is on, kill -USR2 " << getpid() << " writes " << TRACE_DIR
+              << "/proxy_trace_<pid>_<n>.json" << std::endl;
+    return true;
+}
+
+void* Tracer::dumpEntry(void*)
+{
+    int sequence = 0;
+    while (true) {
+        char   byte;
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(dump_pipe[0], &fds);
+        if (select(dump_pipe[0] + 1, &fds, nullptr, nullptr, nullptr) <= 0) {
+            continue;
+        }
+        while (read(dump_pipe[0], &byte, 1) > 0) {
+        }
+        std::string path = std::string(TRACE_DIR) + "/proxy_trace_" + std::to_string(getpid()) + "_" +
+                           std::to_string(sequence++) + ".json";
+        if (dump(path)) {
+            std::cout << "[INFO] [Tracer] Trace written to " << path << std::endl;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Chrome trace event format ("X" complete events, microseconds), which
+ * chrome://tracing and ui.perfetto.dev both open. Spans still being written
+ * while the ring is copied are left out.
+ */
+bool Tracer::dump(const std::string& path)
+{
+    // Ticks per ns, measured over the whole run so far
+    uint64_t ticks = now() - start_ticks;
+    uint64_t ns    = steadyNs() - start_ns;
+    double   scale = ticks > 0 && ns > 0 ? (double) ns / (double) ticks : 1.0;
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        perror("[ERROR] [Tracer] fopen");
+        return false;
+    }
+
+    // A ring taken over after this keeps the previous thread's tid for the spans that follow; rare enough
+    pthread_mutex_lock(&rings_mutex);
+    std::vector<TraceRing*>  snapshot = rings;
+    std::vector<std::string> names;
+    std::vector<int>         tids;
+    std::vector<uint64_t>    firsts;
+    for (TraceRing* ring : snapshot) {
+        names.push_back(ring->name);
+        tids.push_back(ring->tid);
+        firsts.push_back(ring->first.load(std::memory_order_acquire));
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    int         pid       = (int) getpid();
+    const char* separator = "\n";
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    std::vector<TraceEvent> events;
+    for (size_t r = 0; r < snapshot.size(); ++r) {
+        TraceRing* ring = snapshot[r];
+        fprintf(file,
+                "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": %s}}",
+                separator, pid, tids[r], json_string(names[r]).c_str());
+        separator = ",\n";
+
+        uint64_t end   = ring->next.load(std::memory_order_acquire);
+        uint64_t begin = std::max(end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0, firsts[r]);
+        events.clear();
+        for (uint64_t i = begin; i < end; ++i) {
+            events.push_back(ring->events[i % TRACE_RING_SIZE]);
+        }
+        // Slots the thread went on to overwrite (or is writing) while they were copied
+        uint64_t written = ring->next.load(std::memory_order_acquire);
+        size_t   skip    = 0;
+        if (written >= begin + TRACE_RING_SIZE) {
+            skip = std::min<size_t>(written - begin - TRACE_RING_SIZE + 1, events.size());
+        }
+
+        for (size_t i = skip; i < events.size(); ++i) {
+            const TraceEvent& event = events[i];
+            if (event.stage >= TRACE_STAGES || event.end < event.start || event.start < start_ticks) {
+                continue;
+            }
+            double ts  = (double) (event.start - start_ticks) * scale / 1000.0;
+            double dur = (double) (event.end - event.start) * scale / 1000.0;
+            fprintf(file,
+                    ",\n{\"ph\": \"X\", \"cat\": \"proxy\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, "
+                    "\"dur\": %.3f, \"args\": {\"bytes\": %u}}",
+                    STAGE_NAMES[event.stage], pid, tids[r], ts, dur, event.bytes);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
@@ -1,21 +1,66 @@
 #include "UDPHandler.hpp"
 #include "UDPConnection.hpp"
+#include "UDPOffload.hpp"
+#include "Capture.hpp"
+#include "Trace.hpp"
 
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <linux/netfilter_ipv4.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 
 UDPHandler* UDPHandler::instance_ = nullptr;
 
-UDPHandler::UDPHandler(const std::vector<utils::EntityConfig>& entities, char* ip)
-    : entities_(entities), proxyIP_(ip), fuzzer(FUZZSTYLE_RANDOMIZATION)
+UDPHandler::UDPHandler(const std::vector<utils::EntityConfig>& entities, char* ip, FuzzMode mode, int workers,
+                       bool offload, int max_datagram, bool transparent)
+    : entities_(entities), proxyIP_(ip), offload_(offload), gso_(offload && udpGsoSupported()),
+      transparent_(transparent)
 {
+    // A GRO read can return a train of datagrams bigger than any single one
+    recv_buffer_size_ = std::min(std::max(max_datagram, 1), UDP_MAX_DATAGRAM);
+    if (offload_) {
+        recv_buffer_size_ = std::max(recv_buffer_size_, (size_t) UDP_GRO_BYTES);
+    }
     instance_ = this;
-    std::cout << "[DEBUG] UDPHandler initialized with proxy IP: " << proxyIP_ << std::endl;
+    if (workers <= 0) {
+        workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (workers <= 0) {
+        workers = 1;
+    }
+    for (int i = 0; i < workers; ++i) {
+        UDPWorker* worker  = new UDPWorker(i, mode);
+        worker->flow_epoll = epoll_create1(0);
+        if (worker->flow_epoll < 0) {
+            perror("[ERROR] epoll_create1");
+        }
+        workers_.push_back(worker);
+    }
+    Metrics::getInstance()->addGauge("cez_udp_flows", "Clients of dynamic-port entities with a flow of their own.",
+                                     [this] {
+                                         size_t flows = 0;
+                                         for (UDPWorker* worker : workers_) {
+                                             flows += worker->flows.size();
+                                         }
+                                         return (double) flows;
+                                     });
+    std::cout << "[DEBUG] UDPHandler initialized with proxy IP: " << proxyIP_ << " and " << workers << " worker(s)"
+              << std::endl;
+    if (!transparent_) {
+        std::cout << "[INFO] UDP plain forwarding: no IP_TRANSPARENT, peers send to the proxy ports themselves"
+                  << std::endl;
+    }
+    if (offload_) {
+        std::cout << "[INFO] UDP offload: GRO on receive, GSO " << (gso_ ? "on" : "not supported, sending one by one")
+                  << std::endl;
+    }
 }
 
 UDPHandler* UDPHandler::getInstance()
@@ -23,8 +68,10 @@ UDPHandler* UDPHandler::getInstance()
     return instance_;
 }
 
-int UDPHandler::createAndBindSocket(int port, bool useTransparent)
+int UDPHandler::createAndBindSocket(int port, bool useTransparent, bool reusePort)
 {
+    // Plain forwarding binds the proxy's own address only, which needs no privileges
+    useTransparent = useTransparent && transparent_;
     std::cout << "[DEBUG] Creating UDP socket on port " << port << " with "
               << (useTransparent ? "IP_TRANSPARENT" : "IP_RECVORIGDSTADDR") << std::endl;
 
@@ -41,6 +88,14 @@ int UDPHandler::createAndBindSocket(int port, bool useTransparent)
         close(sock);
         return -1;
     }
+    if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+        perror("[ERROR] setsockopt(SO_REUSEPORT)");
+        close(sock);
+        return -1;
+    }
+    if (offload_ && !udpEnableGro(sock)) {
+        perror("[WARN] setsockopt(UDP_GRO), receiving one datagram at a time");
+    }
 
     sockaddr_in addr{};
     addr.sin_family      = AF_INET;
@@ -57,6 +112,125 @@ int UDPHandler::createAndBindSocket(int port, bool useTransparent)
     return sock;
 }
 
+static std::string link_name(const UDPConnection* conn)
+{
+    return conn->getEntityAIP() + ":" + std::to_string(conn->getEntityAPort()) + " <-> " + conn->getEntityBIP() + ":" +
+           std::to_string(conn->getEntityBPort());
+}
+
+std::string UDPHandler::entityName(const std::string& ip, int port) const
+{
+    for (const auto& entity : entities_) {
+        if (entity.ip == ip && (port == -1 || entity.port == -1 || entity.port == port)) {
+            return entity.name;
+        }
+    }
+    return ip + ":" + std::to_string(port);
+}
+
+/*
+ * Steers a datagram to socket (hash of its source address and port) % workers
+ * of the port's SO_REUSEPORT group, so a client always lands on one worker.
+ * The packet data starts at the UDP payload; the headers are read relative to
+ * the network header (source port assuming no IP options).
+ */
+static bool attach_steering(int sock, int workers)
+{
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t) (SKF_NET_OFF + 12)}, // A = source address
+        {BPF_MISC | BPF_TAX, 0, 0, 0},                                  // X = A
+        {BPF_LD | BPF_H | BPF_ABS, 0, 0, (uint32_t) (SKF_NET_OFF + 20)}, // A = source port
+        {BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0},
+        {BPF_ALU | BPF_MUL | BPF_K, 0, 0, 0x9e3779b1},
+        {BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t) workers},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog program = {(unsigned short) (sizeof(code) / sizeof(code[0])), code};
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+}
+
+/*
+ * One recv socket per worker on `port`, appended to `out`. With more than one
+ * worker they form a SO_REUSEPORT group.
+ */
+bool UDPHandler::createWorkerSockets(UDPConnection* conn, int direction, int port, std::vector<RecvSocket>& out)
+{
+    int    workers = (int) workers_.size();
+    size_t first   = out.size();
+
+    for (int i = 0; i < workers; ++i) {
+        int sock = createAndBindSocket(port, false, workers > 1);
+        if (sock < 0) {
+            return false;
+        }
+        out.push_back({sock, conn, direction, workers_[i]});
+    }
+    if (workers > 1 && !attach_steering(out[first].sock, workers)) {
+        perror("[WARN] setsockopt(SO_ATTACH_REUSEPORT_CBPF), steering by the kernel's flow hash");
+    }
+    return true;
+}
+
+/*
+ * The flow of a client of an entity with `port: -1`, created on its first
+ * message: the client gets a socket of its own towards the other entity, so
+ * the replies on that socket go back to it and not to another client.
+ * Returns nullptr if the flow cannot be created; the shared socket is used then.
+ */
+Flow* UDPHandler::flowFor(UDPWorker* worker, const RecvSocket& recv, const sockaddr_in& src)
+{
+    UDPConnection* conn       = recv.conn;
+    int            proxy_port = recv.direction == 0 ? conn->getEntityARecvPort() : conn->getEntityBRecvPort();
+    uint64_t       key        = FlowTable::makeKey(src, proxy_port);
+    Flow*          flow       = worker->flows.find(key);
+    if (flow) {
+        flow->last_seen_ms.store(FlowTable::now());
+        if (!flow->unlinked.load()) {
+            return flow;
+        }
+        // Expired since find(): its socket no longer gets replies, so a new flow takes its place
+    }
+
+    int sock = createAndBindSocket(0, true);
+    if (sock < 0) {
+        return nullptr;
+    }
+    flow             = new Flow();
+    flow->key        = key;
+    flow->peer       = src;
+    flow->proxy_port = proxy_port;
+    flow->reply_sock = recv.sock;
+    flow->sock       = sock;
+    flow->conn       = conn;
+    flow->direction  = recv.direction;
+    flow->last_seen_ms.store(FlowTable::now(), std::memory_order_relaxed);
+
+    Flow* stored = worker->flows.insert(flow);
+    if (stored != flow) {
+        close(sock);
+        delete flow;
+        if (stored == nullptr) {
+            std::cerr << "[WARN] [Flow] Flow table of worker " << worker->id << " full (" << worker->flows.size()
+                      << " flows), using the shared socket" << std::endl;
+        }
+        return stored;
+    }
+
+    struct epoll_event event{};
+    event.events   = EPOLLIN;
+    event.data.ptr = flow;
+    if (epoll_ctl(worker->flow_epoll, EPOLL_CTL_ADD, sock, &event) < 0) {
+        perror("[ERROR] [Flow] epoll_ctl");
+    }
+
+    char ip[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &src.sin_addr, ip, sizeof(ip));
+    std::cout << "[DEBUG] [Flow] New flow " << ip << ":" << ntohs(src.sin_port) << " on port " << proxy_port
+              << " (worker " << worker->id << ", " << worker->flows.size() << " flows)" << std::endl;
+    return flow;
+}
+
 void UDPHandler::buildFromConnections(std::vector<utils::Connection>& conns)
 {
     std::cout << "[DEBUG] Starting to build connections..." << std::endl;
@@ -64,22 +238,42 @@ void UDPHandler::buildFromConnections(std::vector<utils::Connection>& conns)
     for (const auto& conn_struct : conns) {
         std::unique_ptr<UDPConnection> conn = std::make_unique<UDPConnection>(conn_struct);
 
-        int recvA = createAndBindSocket(conn->getEntityARecvPort(), false);
-        int sendB = createAndBindSocket(conn->getEntityBSendPort(), true);
-        int recvB = createAndBindSocket(conn->getEntityBRecvPort(), false);
-        int sendA = createAndBindSocket(conn->getEntityASendPort(), true);
-
-        if (recvA >= 0 && sendB >= 0 && recvB >= 0 && sendA >= 0) {
-            conn->setRecvSockFromEntityA(recvA);
+        std::vector<RecvSocket> recv;
+        bool recvOk = createWorkerSockets(conn.get(), 0, conn->getEntityARecvPort(), recv) &&
+                      createWorkerSockets(conn.get(), 1, conn->getEntityBRecvPort(), recv);
+        int  sendB  = createAndBindSocket(conn->getEntityBSendPort(), true);
+        int  sendA  = createAndBindSocket(conn->getEntityASendPort(), true);
+
+        if (recvOk && sendB >= 0 && sendA >= 0) {
+            // The first socket of each side is also the one the send threads forward through
+            for (const auto& socket : recv) {
+                if (socket.direction == 0 && conn->getRecvSockFromEntityA() < 0) {
+                    conn->setRecvSockFromEntityA(socket.sock);
+                } else if (socket.direction == 1 && conn->getRecvSockFromEntityB() < 0) {
+                    conn->setRecvSockFromEntityB(socket.sock);
+                }
+                sock_to_connection_[socket.sock] = conn.get();
+                recv_sockets_.push_back(socket.sock);
+                recv_workers_.push_back(socket);
+            }
             conn->setSendSockToEntityB(sendB);
-            conn->setRecvSockFromEntityB(recvB);
             conn->setSendSockToEntityA(sendA);
 
-            sock_to_connection_[recvA] = conn.get();
-            sock_to_connection_[recvB] = conn.get();
-
-            recv_sockets_.push_back(recvA);
-            recv_sockets_.push_back(recvB);
+            std::string   link     = link_name(conn.get());
+            std::string   nameA    = entityName(conn->getEntityAIP(), conn->getEntityAPort());
+            std::string   nameB    = entityName(conn->getEntityBIP(), conn->getEntityBPort());
+            HangWatchdog* watchdog = HangWatchdog::getInstance();
+            conn->setHangSlotA(watchdog->createSlot(nameA, "udp " + link));
+            conn->setHangSlotB(watchdog->createSlot(nameB, "udp " + link));
+            conn->setCoverageA(CoverageFeedback::getInstance()->forEntity(nameA));
+            conn->setCoverageB(CoverageFeedback::getInstance()->forEntity(nameB));
+            conn->setSchemaA(SchemaRegistry::getInstance()->forEntity(nameA));
+            conn->setSchemaB(SchemaRegistry::getInstance()->forEntity(nameB));
+            conn->setFixupsA(FixupRegistry::getInstance()->forEntity(nameA));
+            conn->setFixupsB(FixupRegistry::getInstance()->forEntity(nameB));
+            conn->setDictionary(new Dictionary(conn_struct.dictionary));
+            conn->setSession(new SessionTracker("udp " + link, SessionTracker::ruleFor(entities_, nameA),
+                                                SessionTracker::ruleFor(entities_, nameB)));
 
             sock_to_connection_[sendA] = conn.get();
             sock_to_connection_[sendB] = conn.get();
@@ -95,25 +289,72 @@ void UDPHandler::buildFromConnections(std::vector<utils::Connection>& conns)
     }
 }
 
-void UDPHandler::startRecvThreads()
+/*
+ * Fuzzes each datagram of a received train (one datagram without GRO) and
+ * queues the results on `train`, which sends them from the fuzzer's buffers.
+ * With a capture running, both versions of each datagram go to it on `link`.
+ * Returns the number of datagrams.
+ */
+static size_t fuzz_train(FuzzerCore& fuzzer, const FuzzContext& context, FixupStage* fixups, CoverageMap* coverage,
+                         const uint8_t* data, size_t len, size_t segment, UDPTrain& train, ThreadMetrics* metrics,
+                         CaptureLink& link)
 {
-    std::cout << "[DEBUG] Launching receiver threads for each recv socket..." << std::endl;
+    PacketCapture* capture   = PacketCapture::active();
+    size_t         datagrams = 0;
+    for (size_t offset = 0; offset < len; offset += segment, ++datagrams) {
+        size_t size = std::min(segment, len - offset);
+        if (capture) {
+            capture->record(CAPTURE_ORIGINAL, link, data + offset, size);
+        }
 
-    for (int sock : recv_sockets_) {
-        if (sock_to_connection_.count(sock) == 0) {
-            std::cerr << "[ERROR] No mapping found for socket FD " << sock << std::endl;
-            continue;
+        size_t   fuzzedSize = 0;
+        uint64_t start_ns   = Metrics::nowNs();
+        CEZ_TRACE_MARK(mutate_start);
+        uint8_t* fuzzedBuf = fuzzer.fuzz(data + offset, size, fuzzedSize, context);
+        CEZ_TRACE_SPAN(TRACE_MUTATE, mutate_start, fuzzedSize);
+        metrics->mutation_ns.record(Metrics::nowNs() - start_ns);
+        metrics->mutations.add(1);
+
+        fuzzedSize = std::min(fuzzedSize, (size_t) MAX_UDP_PAYLOAD_SIZE - 1);
+        {
+            CEZ_TRACE_SCOPE(TRACE_FIXUP, fuzzedSize);
+            if (fixups) {
+                fixups->apply(fuzzedBuf, fuzzedSize);
+            }
+            if (coverage) {
+                coverage->recordSent(fuzzedBuf, fuzzedSize);
+            }
         }
+        if (capture) {
+            capture->record(CAPTURE_MUTATED, link, fuzzedBuf, fuzzedSize);
+        }
+        train.add(fuzzedBuf, fuzzedSize);
+    }
+    return datagrams;
+}
 
-        UDPConnection* conn = sock_to_connection_[sock];
-        pthread_t      tid;
+// After train.flush(): what went out, and what did not
+static void count_sent(ThreadMetrics* metrics, const UDPTrain& train, size_t datagrams, uint64_t received_ns)
+{
+    metrics->packets_out.add(train.sentDatagrams());
+    metrics->bytes_out.add(train.sentBytes());
+    metrics->send_errors.add(datagrams - train.sentDatagrams());
+    metrics->forward_ns.record(Metrics::nowNs() - received_ns);
+}
+
+void UDPHandler::startRecvThreads()
+{
+    std::cout << "[DEBUG] Launching receiver threads for each recv socket..." << std::endl;
 
-        if (pthread_create(&tid, nullptr, &UDPHandler::recvThreadEntry,
-                           new std::pair<int, UDPConnection*>(sock, conn)) != 0) {
+    for (const auto& recv : recv_workers_) {
+        pthread_t tid;
+
+        if (pthread_create(&tid, nullptr, &UDPHandler::recvThreadEntry, new RecvSocket(recv)) != 0) {
             perror("[ERROR] pthread_create failed");
         } else {
             pthread_detach(tid);
-            std::cout << "[DEBUG] Thread launched for socket FD: " << sock << std::endl;
+            std::cout << "[DEBUG] Thread launched for socket FD: " << recv.sock << " (worker " << recv.worker->id
+                      << ")" << std::endl;
         }
     }
 
@@ -122,87 +363,121 @@ void UDPHandler::startRecvThreads()
 
 void* UDPHandler::recvThreadEntry(void* arg)
 {
-    auto [recv_sock, conn] = *static_cast<std::pair<int, UDPConnection*>*>(arg);
-    delete static_cast<std::pair<int, UDPConnection*>*>(arg);
+    RecvSocket recv = *static_cast<RecvSocket*>(arg);
+    delete static_cast<RecvSocket*>(arg);
 
     // 1) Începem prin a prelua referința la fuzzer
-    UDPHandler* handler = UDPHandler::getInstance();
-    FuzzerCore& fuzzer  = handler->fuzzer;
-
-    char               buffer[4096] = {0};
-    struct sockaddr_in src_addr{};
-    socklen_t          addrlen = sizeof(src_addr);
+    UDPHandler*    handler   = UDPHandler::getInstance();
+    int            recv_sock = recv.sock;
+    UDPConnection* conn      = recv.conn;
+    UDPWorker*     worker    = recv.worker;
+    FuzzerCore&    fuzzer    = worker->fuzzer;
+    ThreadMetrics* metrics   = Metrics::getInstance()->registerThread("udp", link_name(conn), recv.direction);
+    CEZ_TRACE_THREAD("udp recv " + link_name(conn) + (recv.direction == 0 ? " A->B" : " B->A"));
+
+    std::vector<uint8_t> buffer(handler->recv_buffer_size_);
+    struct sockaddr_in   src_addr{};
+    size_t               segment   = 0;
+    bool                 truncated = false;
 
     std::cout << "[TYPE] [RECV THREAD] Listening on FD " << recv_sock << std::endl;
 
     while (true) {
-        ssize_t len = recvfrom(recv_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&src_addr), &addrlen);
+        ssize_t len = udpRecvTrain(recv_sock, buffer.data(), buffer.size(), src_addr, segment, truncated);
         if (len <= 0) {
             perror("[TYPE] [RECV THREAD] recvfrom failed");
             break;
         }
+        uint64_t received_ns = Metrics::nowNs();
 
         char src_ip[INET_ADDRSTRLEN] = {0};
         inet_ntop(AF_INET, &src_addr.sin_addr, src_ip, sizeof(src_ip));
         int src_port = ntohs(src_addr.sin_port);
 
-        printf("[TYPE] [RECV THREAD] Received %zd bytes on socket %d from %s:%u\n", len, recv_sock, src_ip, src_port);
+        size_t datagrams = (len + segment - 1) / segment;
+        printf("[TYPE] [RECV THREAD] Received %zd bytes (%zu datagrams) on socket %d from %s:%u\n", len, datagrams,
+               recv_sock, src_ip, src_port);
+        metrics->packets_in.add(datagrams);
+        metrics->bytes_in.add(len);
+        if (truncated) {
+            std::cerr << "[WARN] [RECV THREAD] Datagram cut to " << len << " bytes, raise udp_max_datagram"
+                      << std::endl;
+            metrics->truncated.add(1);
+        }
 
-        std::string target_ip;
-        int         target_port = -1;
-        int         send_sock   = -1;
+        std::string  target_ip;
+        int          target_port = -1;
+        int          send_sock   = -1;
+        CoverageMap* coverage    = nullptr;
+        Schema*      schema      = nullptr;
+        FixupStage*  fixups      = nullptr;
+        int          direction   = 0;
 
-        if (recv_sock == conn->getRecvSockFromEntityA()) {
-            send_sock   = conn->getSendSockToEntityB();
+        if (recv.direction == 0) {
             target_ip   = conn->getEntityBIP();
-            target_port = conn->getEntityBPort();
-            if (target_port == -1) {
-                conn->popDynamicPort(target_port);
-            }
+            target_port = conn->getEntityBPort() == -1 ? conn->getLastPortB() : conn->getEntityBPort();
+            send_sock   = conn->getSendSockToEntityB();
             if (conn->getEntityAPort() == -1) {
-                conn->pushDynamicPort(src_port);
-                std::cout << "[TYPE] [RECV THREAD] Stored dynamic port from A: " << src_port << std::endl;
+                conn->setLastPortA(src_port);
+                Flow* flow = handler->flowFor(worker, recv, src_addr);
+                if (flow) {
+                    send_sock = flow->sock;
+                }
             }
-        } else if (recv_sock == conn->getRecvSockFromEntityB()) {
-            send_sock   = conn->getSendSockToEntityA();
+            HangWatchdog::disarm(conn->getHangSlotA());
+            CoverageMap::recordReply(conn->getCoverageA());
+            coverage = conn->getCoverageB();
+            schema   = conn->getSchemaB();
+            fixups   = conn->getFixupsB();
+        } else {
+            direction   = 1;
             target_ip   = conn->getEntityAIP();
-            target_port = conn->getEntityAPort();
-            if (target_port == -1) {
-                conn->popDynamicPort(target_port);
-            }
+            target_port = conn->getEntityAPort() == -1 ? conn->getLastPortA() : conn->getEntityAPort();
+            send_sock   = conn->getSendSockToEntityA();
             if (conn->getEntityBPort() == -1) {
-                conn->pushDynamicPort(src_port);
-                std::cout << "[TYPE] [RECV THREAD] Stored dynamic port from B: " << src_port << std::endl;
+                conn->setLastPortB(src_port);
+                Flow* flow = handler->flowFor(worker, recv, src_addr);
+                if (flow) {
+                    send_sock = flow->sock;
+                }
             }
-        } else {
-            std::cerr << "[TYPE] [RECV THREAD] recv_sock not recognized in connection." << std::endl;
+            HangWatchdog::disarm(conn->getHangSlotB());
+            CoverageMap::recordReply(conn->getCoverageB());
+            coverage = conn->getCoverageA();
+            schema   = conn->getSchemaA();
+            fixups   = conn->getFixupsA();
+        }
+
+        if (target_port == -1) {
+            std::cerr << "[WARN] [RECV THREAD] No port known yet for " << target_ip << ", dropping message"
+                      << std::endl;
+            metrics->port_misses.add(datagrams);
             continue;
         }
+        HangWatchdog::arm(direction == 0 ? conn->getHangSlotB() : conn->getHangSlotA());
 
         std::cout << "[TYPE] [RECV THREAD] Forwarding " << len << " bytes from " << src_ip << ":" << src_port << " to "
                   << target_ip << ":" << target_port << std::endl;
 
-        size_t   fuzzedSize = 0;
-        uint8_t* fuzzedBuf =
-            fuzzer.postFuzzing(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(len), fuzzedSize);
+        FuzzContext context;
+        context.corpus     = coverage ? &coverage->corpus() : nullptr;
+        context.dictionary = conn->getDictionary();
+        context.schema     = schema;
+        context.session    = conn->getSession();
+        context.direction  = direction;
 
         struct sockaddr_in dst_addr{};
         dst_addr.sin_family = AF_INET;
         dst_addr.sin_port   = htons(target_port);
         inet_pton(AF_INET, target_ip.c_str(), &dst_addr.sin_addr);
 
-        uint8_t _UDPPayload[MAX_UDP_PAYLOAD_SIZE] = {0};
-        size_t  _UDPPayloadSize = fuzzedSize > (MAX_UDP_PAYLOAD_SIZE - 1) ? (MAX_UDP_PAYLOAD_SIZE - 1) : fuzzedSize;
-        memcpy(_UDPPayload, fuzzedBuf, _UDPPayloadSize);
-        ssize_t sent = sendto(send_sock, _UDPPayload, _UDPPayloadSize, 0, reinterpret_cast<sockaddr*>(&dst_addr),
-                              sizeof(dst_addr));
-        if (sent < 0) {
-            perror("[TYPE] [RECV THREAD] sendto failed");
-        } else {
-            std::cout << "[TYPE] [RECV THREAD] Sent " << sent << " bytes (fuzzed) to " << target_ip << ":"
-                      << target_port << std::endl;
-        }
-        free(fuzzedBuf);
+        UDPTrain    train(send_sock, dst_addr, handler->gso_);
+        CaptureLink link = PacketCapture::link(IPPROTO_UDP, src_addr, dst_addr);
+        fuzz_train(fuzzer, context, fixups, coverage, buffer.data(), len, segment, train, metrics, link);
+        train.flush();
+        std::cout << "[TYPE] [RECV THREAD] Sent " << train.sentBytes() << " bytes (fuzzed) to " << target_ip << ":"
+                  << target_port << std::endl;
+        count_sent(metrics, train, datagrams, received_ns);
         // ==============================================
     }
 
@@ -217,24 +492,31 @@ void* UDPHandler::sendThreadEntry(void* arg)
     auto [send_sock, conn, isFromA] = *static_cast<std::tuple<int, UDPConnection*, bool>*>(arg);
     delete static_cast<std::tuple<int, UDPConnection*, bool>*>(arg);
 
-    // 1) Retrieve the fuzzer instance from the singleton
-    UDPHandler* handler = UDPHandler::getInstance();
-    FuzzerCore& fuzzer  = handler->fuzzer;
+    // 1) Retrieve the fuzzer of the first worker from the singleton
+    UDPHandler*    handler = UDPHandler::getInstance();
+    FuzzerCore&    fuzzer  = handler->workers_[0]->fuzzer;
+    ThreadMetrics* metrics = Metrics::getInstance()->registerThread("udp", link_name(conn), isFromA ? 0 : 1);
+    CEZ_TRACE_THREAD("udp send " + link_name(conn) + (isFromA ? " A->B" : " B->A"));
 
-    char               buffer[4096] = {0};
-    struct sockaddr_in src_addr{};
-    socklen_t          addrlen = sizeof(src_addr);
+    std::vector<uint8_t> buffer(handler->recv_buffer_size_);
+    struct sockaddr_in   src_addr{};
+    size_t               segment   = 0;
+    bool                 truncated = false;
 
     std::cout << "[SEND-THREAD] Listening on FD " << send_sock << (isFromA ? " (from A side)" : " (from B side)")
               << std::endl;
 
     while (true) {
         // Receive data transparently on send_sock
-        ssize_t len = recvfrom(send_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&src_addr), &addrlen);
+        ssize_t len = udpRecvTrain(send_sock, buffer.data(), buffer.size(), src_addr, segment, truncated);
         if (len <= 0) {
             perror("[SEND-THREAD] recvfrom failed");
             break;
         }
+        uint64_t received_ns = Metrics::nowNs();
+        size_t   datagrams   = (len + segment - 1) / segment;
+        metrics->packets_in.add(datagrams);
+        metrics->bytes_in.add(len);
 
         // Extract source IP and port
         char src_ip[INET_ADDRSTRLEN] = {0};
@@ -242,77 +524,80 @@ void* UDPHandler::sendThreadEntry(void* arg)
         int src_port = ntohs(src_addr.sin_port);
 
         printf("[SEND-INFO] Received %zd bytes on send-sock FD %d from %s:%u\n", len, send_sock, src_ip, src_port);
+        if (truncated) {
+            std::cerr << "[SEND-WARN] Datagram cut to " << len << " bytes, raise udp_max_datagram" << std::endl;
+            metrics->truncated.add(1);
+        }
 
-        int         forward_sock = -1;
-        std::string dst_ip;
-        int         dst_port = -1;
+        int          forward_sock = -1;
+        std::string  dst_ip;
+        int          dst_port = -1;
+        CoverageMap* coverage = nullptr;
+        Schema*      schema   = nullptr;
+        FixupStage*  fixups   = nullptr;
 
         if (isFromA) {
             // Direction A -> B
+            HangWatchdog::disarm(conn->getHangSlotA());
+            CoverageMap::recordReply(conn->getCoverageA());
+            HangWatchdog::arm(conn->getHangSlotB());
+            coverage     = conn->getCoverageB();
+            schema       = conn->getSchemaB();
+            fixups       = conn->getFixupsB();
             forward_sock = conn->getRecvSockFromEntityB();
             dst_ip       = conn->getEntityBIP();
 
-            if (conn->getEntityBPort() == -1) {
-                // Use a dynamic port for B from the list
-                if (!conn->popDynamicPort(dst_port)) {
-                    // If no more ports in the list, fall back to the source port
-                    dst_port = src_port;
-                    std::cout << "[SEND-WARN] (A->B) Dynamic port list empty, using source port: " << src_port
-                              << std::endl;
-                } else {
-                    std::cout << "[SEND-INFO] (A->B) Popped dynamic port for B: " << dst_port << std::endl;
-                }
-            } else {
-                // B has a static port
-                dst_port = conn->getEntityBPort();
+            // Replies of clients with their own flow come back on the flow socket; this is the shared one
+            dst_port = conn->getEntityBPort() == -1 ? conn->getLastPortB() : conn->getEntityBPort();
+            if (dst_port == -1) {
+                dst_port = src_port;
+                metrics->port_misses.add(datagrams);
+                std::cout << "[SEND-WARN] (A->B) No port known for B yet, using source port: " << src_port
+                          << std::endl;
             }
         } else {
             // Direction B -> A
+            HangWatchdog::disarm(conn->getHangSlotB());
+            CoverageMap::recordReply(conn->getCoverageB());
+            HangWatchdog::arm(conn->getHangSlotA());
+            coverage     = conn->getCoverageA();
+            schema       = conn->getSchemaA();
+            fixups       = conn->getFixupsA();
             forward_sock = conn->getRecvSockFromEntityA();
             dst_ip       = conn->getEntityAIP();
 
-            if (conn->getEntityAPort() == -1) {
-                // Use a dynamic port for A from the list
-                if (!conn->popDynamicPort(dst_port)) {
-                    dst_port = src_port;
-                    std::cout << "[SEND-WARN] (B->A) Dynamic port list empty, using source port: " << src_port
-                              << std::endl;
-                } else {
-                    std::cout << "[SEND-INFO] (B->A) Popped dynamic port for A: " << dst_port << std::endl;
-                }
-            } else {
-                // A has a static port
-                dst_port = conn->getEntityAPort();
+            dst_port = conn->getEntityAPort() == -1 ? conn->getLastPortA() : conn->getEntityAPort();
+            if (dst_port == -1) {
+                dst_port = src_port;
+                metrics->port_misses.add(datagrams);
+                std::cout << "[SEND-WARN] (B->A) No port known for A yet, using source port: " << src_port
+                          << std::endl;
             }
         }
 
-        // === Insert fuzzer call (postFuzzing) here ===
-        // Copy received data into a buffer and apply post-fuzzing
-        size_t   fuzzedSize = 0;
-        uint8_t* fuzzedBuf =
-            fuzzer.postFuzzing(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(len), fuzzedSize);
-        // =============================================
+        // === Insert fuzzer call here ===
+        // Copy received data into a buffer and apply the configured fuzzing mode
+        FuzzContext context;
+        context.corpus     = coverage ? &coverage->corpus() : nullptr;
+        context.dictionary = conn->getDictionary();
+        context.schema     = schema;
+        context.session    = conn->getSession();
+        context.direction  = isFromA ? 0 : 1;
 
         struct sockaddr_in dst_addr{};
         dst_addr.sin_family = AF_INET;
         dst_addr.sin_port   = htons(dst_port);
         inet_pton(AF_INET, dst_ip.c_str(), &dst_addr.sin_addr);
 
-        uint8_t _UDPPayload[MAX_UDP_PAYLOAD_SIZE] = {0};
-        size_t  _UDPPayloadSize = fuzzedSize > (MAX_UDP_PAYLOAD_SIZE - 1) ? (MAX_UDP_PAYLOAD_SIZE - 1) : fuzzedSize;
-        memcpy(_UDPPayload, fuzzedBuf, _UDPPayloadSize);
-        // Send the fuzzed data onward
-        ssize_t sent = sendto(forward_sock, _UDPPayload, _UDPPayloadSize, 0, reinterpret_cast<sockaddr*>(&dst_addr),
-                              sizeof(dst_addr));
-        if (sent < 0) {
-            perror("[SEND-THREAD] sendto failed");
-        } else {
-            std::cout << "[SEND-DEBUG] Forwarded " << sent << " bytes (fuzzed) to " << dst_ip << ":" << dst_port
-                      << " via FD " << forward_sock << std::endl;
-        }
-
-        // Free the fuzzed buffer
-        free(fuzzedBuf);
+        // Fuzz, then send the fuzzed data onward
+        UDPTrain    train(forward_sock, dst_addr, handler->gso_);
+        CaptureLink link = PacketCapture::link(IPPROTO_UDP, src_addr, dst_addr);
+        fuzz_train(fuzzer, context, fixups, coverage, buffer.data(), len, segment, train, metrics, link);
+        train.flush();
+        count_sent(metrics, train, datagrams, received_ns);
+        // =============================================
+        std::cout << "[SEND-DEBUG] Forwarded " << train.sentBytes() << " bytes (fuzzed) to " << dst_ip << ":"
+                  << dst_port << " via FD " << forward_sock << std::endl;
     }
 
     std::cout << "[SEND-INFO] Closing send-sock FD: " << send_sock << std::endl;
@@ -320,6 +605,113 @@ void* UDPHandler::sendThreadEntry(void* arg)
     return nullptr;
 }
 
+/*
+ * Replies on the flow sockets: each goes back to the client of its flow, from
+ * the proxy port the client sent to. Also expires idle flows.
+ */
+void* UDPHandler::flowThreadEntry(void* arg)
+{
+    UDPWorker*  worker  = static_cast<UDPWorker*>(arg);
+    FuzzerCore& fuzzer  = worker->fuzzer;
+    UDPHandler* handler = UDPHandler::getInstance();
+
+    std::vector<uint8_t> buffer(handler->recv_buffer_size_);
+    struct epoll_event   events[64];
+    std::vector<Flow*>   expired;
+    int64_t              last_sweep_ms = FlowTable::now();
+
+    // Replies of every connection with flows come through this thread; one series per connection and direction
+    std::unordered_map<const UDPConnection*, ThreadMetrics*> metrics_of[2];
+
+    std::cout << "[DEBUG] [Flow] Reply thread of worker " << worker->id << " started" << std::endl;
+    CEZ_TRACE_THREAD("udp flows, worker " + std::to_string(worker->id));
+
+    while (true) {
+        int ready = epoll_wait(worker->flow_epoll, events, 64, FLOW_SWEEP_EVERY_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("[ERROR] [Flow] epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            Flow*       flow = static_cast<Flow*>(events[i].data.ptr);
+            sockaddr_in src_addr{};
+            size_t      segment   = 0;
+            bool        truncated = false;
+            ssize_t     len = udpRecvTrain(flow->sock, buffer.data(), buffer.size(), src_addr, segment, truncated);
+            if (len <= 0) {
+                continue;
+            }
+            uint64_t        received_ns = Metrics::nowNs();
+            UDPConnection*  conn        = flow->conn;
+            ThreadMetrics*& metrics     = metrics_of[1 - flow->direction][conn];
+            if (metrics == nullptr) {
+                metrics = Metrics::getInstance()->registerThread("udp", link_name(conn), 1 - flow->direction);
+            }
+            size_t datagrams = (len + segment - 1) / segment;
+            flow->last_seen_ms.store(FlowTable::now(), std::memory_order_relaxed);
+            metrics->packets_in.add(datagrams);
+            metrics->bytes_in.add(len);
+            if (truncated) {
+                std::cerr << "[WARN] [Flow] Datagram cut to " << len << " bytes, raise udp_max_datagram" << std::endl;
+                metrics->truncated.add(1);
+            }
+
+            CoverageMap* coverage;
+            Schema*      schema;
+            FixupStage*  fixups;
+
+            if (flow->direction == 0) {
+                // Entity B answering a client of A
+                HangWatchdog::disarm(conn->getHangSlotB());
+                CoverageMap::recordReply(conn->getCoverageB());
+                HangWatchdog::arm(conn->getHangSlotA());
+                coverage = conn->getCoverageA();
+                schema   = conn->getSchemaA();
+                fixups   = conn->getFixupsA();
+            } else {
+                HangWatchdog::disarm(conn->getHangSlotA());
+                CoverageMap::recordReply(conn->getCoverageA());
+                HangWatchdog::arm(conn->getHangSlotB());
+                coverage = conn->getCoverageB();
+                schema   = conn->getSchemaB();
+                fixups   = conn->getFixupsB();
+            }
+
+            FuzzContext context;
+            context.corpus     = coverage ? &coverage->corpus() : nullptr;
+            context.dictionary = conn->getDictionary();
+            context.schema     = schema;
+            context.session    = conn->getSession();
+            context.direction  = 1 - flow->direction;
+
+            UDPTrain    train(flow->reply_sock, flow->peer, handler->gso_);
+            CaptureLink link = PacketCapture::link(IPPROTO_UDP, src_addr, flow->peer);
+            fuzz_train(fuzzer, context, fixups, coverage, buffer.data(), len, segment, train, metrics, link);
+            train.flush();
+            std::cout << "[DEBUG] [Flow] Forwarded " << train.sentBytes() << " bytes (fuzzed) to client port "
+                      << ntohs(flow->peer.sin_port) << " via FD " << flow->reply_sock << std::endl;
+            count_sent(metrics, train, datagrams, received_ns);
+        }
+
+        int64_t now_ms = FlowTable::now();
+        if (now_ms - last_sweep_ms < FLOW_SWEEP_EVERY_MS) {
+            continue;
+        }
+        last_sweep_ms = now_ms;
+        expired.clear();
+        worker->flows.expire(now_ms, FLOW_IDLE_TIMEOUT_MS, expired);
+        for (Flow* flow : expired) {
+            epoll_ctl(worker->flow_epoll, EPOLL_CTL_DEL, flow->sock, nullptr);
+        }
+        if (!expired.empty()) {
+            std::cout << "[DEBUG] [Flow] Worker " << worker->id << " expired " << expired.size() << " idle flows ("
+                      << worker->flows.size() << " left)" << std::endl;
+        }
+    }
+    return nullptr;
+}
+
 void UDPHandler::startSendThreads()
 {
     std::cout << "[DEBUG] Launching sender threads for each send socket..." << std::endl;
@@ -363,5 +755,21 @@ void UDPHandler::startSendThreads()
         }
     }
 
+    bool dynamic = false;
+    for (UDPConnection* conn : connections_) {
+        dynamic = dynamic || conn->getEntityAPort() == -1 || conn->getEntityBPort() == -1;
+    }
+    for (UDPWorker* worker : workers_) {
+        pthread_t tid;
+        if (!dynamic || worker->flow_epoll < 0) {
+            continue;
+        }
+        if (pthread_create(&tid, nullptr, &UDPHandler::flowThreadEntry, worker) != 0) {
+            perror("[ERROR] pthread_create (flowThreadEntry) failed");
+        } else {
+            pthread_detach(tid);
+        }
+    }
+
     std::cout << "[INFO] All UDP send threads launched." << std::endl;
 }
@@ -0,0 +1,154 @@
+#include "UDPOffload.hpp"
+#include "Trace.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool udpGsoSupported()
+{
+    static const bool supported = [] {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0) {
+            return false;
+        }
+        int  segment = 0;
+        bool ok      = setsockopt(sock, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0;
+        close(sock);
+        return ok;
+    }();
+    return supported;
+}
+
+bool udpEnableGro(int sock)
+{
+    int on = 1;
+    return setsockopt(sock, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+}
+
+ssize_t udpRecvTrain(int sock, uint8_t* buffer, size_t capacity, sockaddr_in& src, size_t& segment, bool& truncated)
+{
+    char          control[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(sockaddr_in))];
+    struct iovec  iov = {buffer, capacity};
+    struct msghdr msg{};
+    msg.msg_name       = &src;
+    msg.msg_namelen    = sizeof(src);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    CEZ_TRACE_MARK(recv_start);
+    ssize_t len = recvmsg(sock, &msg, 0);
+    CEZ_TRACE_SPAN(TRACE_RECV, recv_start, len > 0 ? len : 0);
+    if (len <= 0) {
+        return len;
+    }
+    segment   = (size_t) len;
+    truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            if (gso_size > 0) {
+                segment = (size_t) gso_size;
+            }
+        }
+    }
+    return len;
+}
+
+UDPTrain::UDPTrain(int sock, const sockaddr_in& dst, bool gso) : sock_(sock), dst_(dst), gso_(gso) {}
+
+void UDPTrain::add(uint8_t* datagram, size_t len)
+{
+    bool joins = count_ > 0 && !closed_ && count_ < UDP_TRAIN_SEGMENTS && len <= segment_ &&
+                 used_ + len <= UDP_TRAIN_BYTES;
+    if (count_ > 0 && !joins) {
+        flush();
+    }
+
+    if (count_ == 0) {
+        segment_ = len;
+    } else if (len < segment_) {
+        closed_ = true;
+    }
+    iov_[count_].iov_base = datagram;
+    iov_[count_].iov_len  = len;
+    used_ += len;
+    ++count_;
+    if (!gso_) {
+        flush();
+    }
+}
+
+ssize_t UDPTrain::sendEach()
+{
+    ssize_t total = 0;
+    for (size_t i = 0; i < count_; ++i) {
+        CEZ_TRACE_SCOPE(TRACE_SEND, iov_[i].iov_len);
+        ssize_t sent = sendto(sock_, iov_[i].iov_base, iov_[i].iov_len, 0, (const sockaddr*) &dst_, sizeof(dst_));
+        if (sent < 0) {
+            perror("[ERROR] [UDPTrain] sendto");
+            total = -1;
+            continue;
+        }
+        ++sent_datagrams_;
+        sent_bytes_ += (size_t) sent;
+        if (total >= 0) {
+            total += sent;
+        }
+    }
+    return total;
+}
+
+ssize_t UDPTrain::flush()
+{
+    if (count_ == 0) {
+        return 0;
+    }
+
+    ssize_t sent;
+    if (count_ == 1) {
+        sent = sendEach();
+    } else {
+        char          control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+        struct msghdr msg{};
+        msg.msg_name       = &dst_;
+        msg.msg_namelen    = sizeof(dst_);
+        msg.msg_iov        = iov_;
+        msg.msg_iovlen     = count_;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level     = SOL_UDP;
+        cmsg->cmsg_type      = UDP_SEGMENT;
+        cmsg->cmsg_len       = CMSG_LEN(sizeof(uint16_t));
+        uint16_t gso_size    = (uint16_t) segment_;
+        memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+        CEZ_TRACE_MARK(send_start);
+        sent = sendmsg(sock_, &msg, 0);
+        CEZ_TRACE_SPAN(TRACE_SEND, send_start, used_);
+        if (sent >= 0) {
+            sent_datagrams_ += count_;
+            sent_bytes_ += (size_t) sent;
+        } else if (errno == EINVAL || errno == EIO || errno == EMSGSIZE) {
+            // Segments larger than the path MTU, or no GSO on this route: one by one then
+            sent = sendEach();
+        } else {
+            perror("[ERROR] [UDPTrain] sendmsg(UDP_SEGMENT)");
+        }
+    }
+
+    for (size_t i = 0; i < count_; ++i) {
+        free(iov_[i].iov_base);
+    }
+    used_   = 0;
+    count_  = 0;
+    closed_ = false;
+    return sent;
+}
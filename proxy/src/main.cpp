@@ -1,4 +1,7 @@
 #include <iostream>
+#include <memory>
+#include <cstring>
+#include "CorpusMinimizer.hpp"
 #include "ProxyBase.hpp"
 #include <pthread.h>
 #include <unistd.h>
@@ -18,13 +21,26 @@ int main(int argc, char* argv[])
 {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <config.yaml path>" << std::endl;
+        std::cerr << "       " << argv[0] << " --cmin [options] <config.yaml path> [-- TARGET [ARGS...]]" << std::endl;
         return 1;
     }
 
+    // Corpus minimization runs instead of the proxy
+    if (strcmp(argv[1], "--cmin") == 0) {
+        CminOptions options;
+        if (!CorpusMinimizer::parseOptions(argc - 1, argv + 1, options)) {
+            CorpusMinimizer::usage(argv[0]);
+            return 1;
+        }
+        return CorpusMinimizer(options).run() ? 0 : 1;
+    }
+
     const char* config_path = argv[1];
 
+    // Lives as long as the process: the handlers' threads keep using it
+    std::unique_ptr<ProxyBase> proxy;
     try {
-        ProxyBase proxy(config_path);
+        proxy = std::make_unique<ProxyBase>(config_path);
     } catch (const std::exception& ex) {
         std::cerr << "Eroare la inițializarea ProxyBase: " << ex.what() << std::endl;
         return 1;
@@ -38,8 +54,10 @@ int main(int argc, char* argv[])
         pthread_detach(flush_thread);
     }
 
-    while (1)
-        ; // FOR THE MOMENT [TODO]
+    // The handlers' threads do the work; spinning here would take a CPU from them
+    while (1) {
+        pause();
+    }
 
     return 0;
 }
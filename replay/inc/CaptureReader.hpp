@@ -0,0 +1,33 @@
+#ifndef CAPTURE_READER_HPP
+#define CAPTURE_READER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* One UDP datagram or TCP segment with data, as it was captured. */
+struct CapturedMessage {
+    uint64_t             ts_ns;
+    int                  interface; // pcapng interface, 0 in a classic pcap
+    uint8_t              proto;     // IPPROTO_UDP or IPPROTO_TCP
+    uint32_t             src_ip;    // network order
+    uint32_t             dst_ip;    // network order
+    uint16_t             src_port;  // host order
+    uint16_t             dst_port;  // host order
+    std::vector<uint8_t> payload;
+};
+
+struct Capture {
+    std::vector<std::string>     interfaces; // names of the pcapng interfaces ("" when unnamed)
+    std::vector<CapturedMessage> messages;   // in file order
+};
+
+/*
+ * Reads a classic pcap or a pcapng file, such as the proxy's own `pcap_dir`
+ * captures. Only IPv4 UDP and TCP is kept, over raw IP, Ethernet, Linux
+ * cooked (v1/v2) or BSD loopback links; fragments, empty TCP segments and
+ * TCP retransmissions are left out.
+ */
+bool readCapture(const std::string& path, Capture& capture);
+
+#endif // CAPTURE_READER_HPP
@@ -0,0 +1,76 @@
+#ifndef REPLAYER_HPP
+#define REPLAYER_HPP
+
+#include "CaptureReader.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+enum ReplayTiming {
+    REPLAY_LOCKSTEP, // each message once the target sent the replies it sent in the capture (or a timeout)
+    REPLAY_ORIGINAL, // with the captured gaps between messages
+    REPLAY_FAST,     // back to back
+};
+
+struct ReplayOptions {
+    ReplayTiming timing           = REPLAY_LOCKSTEP;
+    std::string  target_ip        = "127.0.0.1";
+    int          target_port      = -1;   // -1: the captured server port
+    int          server_port      = -1;   // captured server port, -1: where the first message went
+    int          interface        = -1;   // pcapng interface to replay, -1: all
+    int          reply_timeout_ms = 1000; // lockstep: the longest wait for the replies to a message
+};
+
+/**
+ * Sends the client side of a capture to a target on this host: every message
+ * that went to the captured server, the server's replies being left out.
+ * Each captured client (protocol, address and port) gets a socket of its
+ * own, so the target sees as many clients as there were, in the same order.
+ */
+class Replayer {
+  public:
+    Replayer(const Capture& capture, const ReplayOptions& options);
+    ~Replayer();
+
+    bool   prepare(); // finds the server and the messages to send; false if there are none
+    size_t run(const std::function<bool()>& target_alive); // returns the messages sent
+
+    uint8_t proto() const { return proto_; }
+    int     targetPort() const { return target_port_; }
+    size_t  messages() const { return steps_.size(); }
+
+  private:
+    struct Flow {
+        uint32_t ip;   // of the captured client
+        uint16_t port; // of the captured client
+        int      sock     = -1;
+        bool     closed   = false; // by the target: the flow is over
+        size_t   received = 0;     // replies so far: datagrams for UDP, bytes for TCP
+    };
+
+    struct Step {
+        const CapturedMessage* message;
+        size_t                 flow;
+        size_t                 replies; // flow's `received` the capture had before the client spoke again
+    };
+
+    const Capture&    capture_;
+    ReplayOptions     options_;
+    uint8_t           proto_       = 0;
+    uint32_t          server_ip_   = 0;
+    uint16_t          server_port_ = 0;
+    int               target_port_ = -1;
+    std::vector<Flow> flows_;
+    std::vector<Step> steps_;
+    bool              target_gone_ = false; // a send or receive was refused
+
+    bool   selected(const CapturedMessage& message) const;
+    bool   connectFlow(Flow& flow);
+    void   drain(uint64_t timeout_ns);
+    void   awaitReplies(const Step& step);
+    size_t receive(Flow& flow);
+};
+
+#endif // REPLAYER_HPP
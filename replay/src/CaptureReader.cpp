@@ -0,0 +1,293 @@
+#include "CaptureReader.hpp"
+#include <netinet/in.h>
+#include <string.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <tuple>
+
+#define PCAP_MAGIC_US     0xA1B2C3D4 // microsecond timestamps
+#define PCAP_MAGIC_NS     0xA1B23C4D // nanosecond timestamps
+#define PCAPNG_SHB        0x0A0D0D0A
+#define PCAPNG_IDB        0x00000001
+#define PCAPNG_SPB        0x00000003
+#define PCAPNG_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+
+#define LINKTYPE_NULL       0
+#define LINKTYPE_ETHERNET   1
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LOOP       108
+#define LINKTYPE_LINUX_SLL  113
+#define LINKTYPE_IPV4       228
+#define LINKTYPE_LINUX_SLL2 276
+
+// Next sequence number of each TCP direction, by interface and endpoints
+using TcpStreams = std::map<std::tuple<int, uint32_t, uint16_t, uint32_t, uint16_t>, uint32_t>;
+
+// File fields, in the byte order of the file
+static uint16_t get16(const uint8_t* at, bool swap)
+{
+    uint16_t value;
+    memcpy(&value, at, sizeof(value));
+    return swap ? __builtin_bswap16(value) : value;
+}
+
+static uint32_t get32(const uint8_t* at, bool swap)
+{
+    uint32_t value;
+    memcpy(&value, at, sizeof(value));
+    return swap ? __builtin_bswap32(value) : value;
+}
+
+// Packet fields, in network order
+static uint16_t be16(const uint8_t* at)
+{
+    return (uint16_t) (at[0] << 8 | at[1]);
+}
+
+static uint32_t be32(const uint8_t* at)
+{
+    return (uint32_t) at[0] << 24 | (uint32_t) at[1] << 16 | (uint32_t) at[2] << 8 | at[3];
+}
+
+// Where the IPv4 header starts in a frame of `linktype`, or -1
+static long ipv4_offset(int linktype, const uint8_t* frame, size_t len)
+{
+    size_t   offset = 0;
+    uint32_t family = 0;
+    uint16_t type   = 0;
+
+    switch (linktype) {
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+            return 0;
+        case LINKTYPE_ETHERNET:
+            if (len < 14) {
+                return -1;
+            }
+            type   = be16(frame + 12);
+            offset = 14;
+            while ((type == 0x8100 || type == 0x88A8) && len >= offset + 4) { // VLAN tags
+                type = be16(frame + offset + 2);
+                offset += 4;
+            }
+            return type == 0x0800 ? (long) offset : -1;
+        case LINKTYPE_LINUX_SLL:
+            return len >= 16 && be16(frame + 14) == 0x0800 ? 16 : -1;
+        case LINKTYPE_LINUX_SLL2:
+            return len >= 20 && be16(frame) == 0x0800 ? 20 : -1;
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            if (len < 4) {
+                return -1;
+            }
+            memcpy(&family, frame, sizeof(family)); // AF_INET, in the byte order of the capturing host
+            return family == 2 || family == 0x02000000 ? 4 : -1;
+        default:
+            return -1;
+    }
+}
+
+// Appends the UDP datagram or TCP data in a captured frame, if it has any
+static void decode_frame(Capture& capture, TcpStreams& streams, int interface, int linktype, uint64_t ts_ns,
+                         const uint8_t* frame, size_t len)
+{
+    long offset = ipv4_offset(linktype, frame, len);
+    if (offset < 0 || len - offset < 20) {
+        return;
+    }
+    const uint8_t* ip = frame + offset;
+    if ((ip[0] >> 4) != 4) {
+        return;
+    }
+    size_t header = (size_t) (ip[0] & 0x0F) * 4;
+    size_t total  = std::min((size_t) be16(ip + 2), len - offset);
+    if (header < 20 || total < header || (be16(ip + 6) & 0x3FFF) != 0) { // too short, or a fragment
+        return;
+    }
+    const uint8_t* transport     = ip + header;
+    size_t         transport_len = total - header;
+
+    CapturedMessage message;
+    message.ts_ns     = ts_ns;
+    message.interface = interface;
+    message.proto     = ip[9];
+    memcpy(&message.src_ip, ip + 12, 4);
+    memcpy(&message.dst_ip, ip + 16, 4);
+
+    const uint8_t* data = nullptr;
+    size_t         size = 0;
+    if (message.proto == IPPROTO_UDP) {
+        if (transport_len < 8 || be16(transport + 4) < 8) {
+            return;
+        }
+        data = transport + 8;
+        size = std::min((size_t) be16(transport + 4), transport_len) - 8;
+    } else if (message.proto == IPPROTO_TCP) {
+        size_t data_offset = (size_t) (transport[12] >> 4) * 4;
+        if (transport_len < 20 || data_offset < 20 || data_offset > transport_len) {
+            return;
+        }
+        data = transport + data_offset;
+        size = transport_len - data_offset;
+    } else {
+        return;
+    }
+    message.src_port = be16(transport);
+    message.dst_port = be16(transport + 2);
+
+    if (message.proto == IPPROTO_TCP && size > 0) {
+        // Drop what was already seen: retransmissions, and the overlap of a repacketized segment
+        auto     key  = std::make_tuple(interface, message.src_ip, message.src_port, message.dst_ip, message.dst_port);
+        uint32_t seq  = be32(transport + 4);
+        auto     next = streams.find(key);
+        if (next != streams.end()) {
+            int32_t seen = (int32_t) (next->second - seq);
+            if (seen >= (int32_t) size) {
+                return;
+            }
+            if (seen > 0) {
+                data += seen;
+                size -= seen;
+                seq += seen;
+            }
+        }
+        streams[key] = seq + (uint32_t) size;
+    }
+    if (size == 0) {
+        return;
+    }
+    message.payload.assign(data, data + size);
+    capture.messages.push_back(std::move(message));
+}
+
+static bool read_pcap(const std::vector<uint8_t>& file, Capture& capture)
+{
+    if (file.size() < 24) {
+        fprintf(stderr, "[ERROR] [Replay] pcap header cut short\n");
+        return false;
+    }
+    uint32_t   magic    = get32(&file[0], false);
+    bool       swap     = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    bool       nanos    = get32(&file[0], swap) == PCAP_MAGIC_NS;
+    int        linktype = (int) (get32(&file[20], swap) & 0x0FFFFFFF); // the upper bits describe the FCS
+    TcpStreams streams;
+
+    capture.interfaces.push_back("");
+    size_t at = 24;
+    while (at + 16 <= file.size()) {
+        uint64_t seconds  = get32(&file[at], swap);
+        uint64_t fraction = get32(&file[at + 4], swap);
+        uint32_t captured = get32(&file[at + 8], swap);
+        if (at + 16 + captured > file.size()) {
+            fprintf(stderr, "[WARN] [Replay] Last packet cut short, ignored\n");
+            break;
+        }
+        uint64_t ts_ns = seconds * 1000000000ull + (nanos ? fraction : fraction * 1000);
+        decode_frame(capture, streams, 0, linktype, ts_ns, &file[at + 16], captured);
+        at += 16 + captured;
+    }
+    return true;
+}
+
+static bool read_pcapng(const std::vector<uint8_t>& file, Capture& capture)
+{
+    struct Interface {
+        int      linktype;
+        uint64_t units; // timestamp units per second
+    };
+    std::vector<Interface> interfaces; // of the current section
+    TcpStreams             streams;
+    bool                   swap    = false;
+    size_t                 base    = 0; // capture.interfaces index of the section's interface 0
+    uint64_t               last_ts = 0;
+
+    size_t at = 0;
+    while (at + 12 <= file.size()) {
+        uint32_t type = get32(&file[at], swap); // the section header type reads the same in both orders
+        if (type == PCAPNG_SHB) {
+            swap = get32(&file[at + 8], false) != PCAPNG_BYTE_ORDER;
+            base = capture.interfaces.size();
+            interfaces.clear();
+        }
+        uint32_t len = get32(&file[at + 4], swap);
+        if (len < 12 || len % 4 != 0 || at + len > file.size()) {
+            fprintf(stderr, "[WARN] [Replay] Block at offset %zu cut short, ignoring the rest\n", at);
+            break;
+        }
+        const uint8_t* body     = &file[at + 8];
+        size_t         body_len = len - 12;
+
+        if (type == PCAPNG_IDB && body_len >= 8) {
+            Interface   interface = {get16(body, swap), 1000000};
+            std::string name;
+            for (size_t option = 8; option + 4 <= body_len;) {
+                uint16_t       code  = get16(body + option, swap);
+                uint16_t       size  = get16(body + option + 2, swap);
+                const uint8_t* value = body + option + 4;
+                if (code == 0 || option + 4 + size > body_len) {
+                    break;
+                }
+                if (code == 2) { // if_name
+                    name.assign((const char*) value, strnlen((const char*) value, size));
+                } else if (code == 9 && size >= 1) { // if_tsresol: 10^-n, or 2^-n with the top bit set
+                    uint8_t exponent = value[0] & 0x7F;
+                    if (value[0] & 0x80) {
+                        interface.units = exponent < 64 ? 1ull << exponent : interface.units;
+                    } else if (exponent <= 19) {
+                        interface.units = 1;
+                        while (exponent-- > 0) {
+                            interface.units *= 10;
+                        }
+                    }
+                }
+                option += 4 + ((size + 3) & ~3);
+            }
+            interfaces.push_back(interface);
+            capture.interfaces.push_back(name);
+        } else if (type == PCAPNG_EPB && body_len >= 20) {
+            uint32_t id       = get32(body, swap);
+            uint64_t ticks    = (uint64_t) get32(body + 4, swap) << 32 | get32(body + 8, swap);
+            uint32_t captured = get32(body + 12, swap);
+            if (id < interfaces.size() && 20 + (size_t) captured <= body_len) {
+                last_ts = (uint64_t) ((unsigned __int128) ticks * 1000000000u / interfaces[id].units);
+                decode_frame(capture, streams, (int) (base + id), interfaces[id].linktype, last_ts, body + 20,
+                             captured);
+            }
+        } else if (type == PCAPNG_SPB && body_len >= 4 && !interfaces.empty()) {
+            // No timestamp: it is taken to follow the previous packet
+            size_t captured = std::min((size_t) get32(body, swap), body_len - 4);
+            decode_frame(capture, streams, (int) base, interfaces[0].linktype, last_ts, body + 4, captured);
+        }
+        at += len;
+    }
+    return true;
+}
+
+bool readCapture(const std::string& path, Capture& capture)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        perror(("[ERROR] [Replay] " + path).c_str());
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t              chunk[65536];
+    size_t               len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + len);
+    }
+    fclose(file);
+
+    uint32_t magic = data.size() >= 4 ? get32(&data[0], false) : 0;
+    if (magic == PCAPNG_SHB) {
+        return read_pcapng(data, capture);
+    }
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS || magic == __builtin_bswap32(PCAP_MAGIC_US) ||
+        magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+        return read_pcap(data, capture);
+    }
+    fprintf(stderr, "[ERROR] [Replay] %s is neither pcap nor pcapng\n", path.c_str());
+    return false;
+}
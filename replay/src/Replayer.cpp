@@ -0,0 +1,225 @@
+#include "Replayer.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <cstdio>
+#include <map>
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static std::string address(uint32_t ip, int port)
+{
+    char text[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &ip, text, sizeof(text));
+    return std::string(text) + ":" + std::to_string(port);
+}
+
+Replayer::Replayer(const Capture& capture, const ReplayOptions& options) : capture_(capture), options_(options) {}
+
+Replayer::~Replayer()
+{
+    for (const Flow& flow : flows_) {
+        if (flow.sock >= 0) {
+            close(flow.sock);
+        }
+    }
+}
+
+bool Replayer::selected(const CapturedMessage& message) const
+{
+    return options_.interface < 0 || message.interface == options_.interface;
+}
+
+/*
+ * The server is where the first message (to `server_port`, if set) went. Each
+ * message to it is a step; the replies that came back to its client before
+ * that client's next message are what lockstep timing waits for.
+ */
+bool Replayer::prepare()
+{
+    for (const auto& message : capture_.messages) {
+        if (selected(message) && (options_.server_port < 0 || message.dst_port == options_.server_port)) {
+            proto_       = message.proto;
+            server_ip_   = message.dst_ip;
+            server_port_ = message.dst_port;
+            break;
+        }
+    }
+    if (proto_ == 0) {
+        fprintf(stderr, "[ERROR] [Replay] No message to replay in the capture\n");
+        return false;
+    }
+    target_port_ = options_.target_port > 0 ? options_.target_port : server_port_;
+
+    std::map<std::pair<uint32_t, uint16_t>, size_t> flow_of;   // client -> index in flows_
+    std::vector<size_t>                             last_step; // per flow
+    std::vector<size_t>                             replies;   // per flow, so far
+
+    for (const auto& message : capture_.messages) {
+        if (!selected(message) || message.proto != proto_) {
+            continue;
+        }
+        if (message.dst_ip == server_ip_ && message.dst_port == server_port_) {
+            auto   client = std::make_pair(message.src_ip, message.src_port);
+            auto   it     = flow_of.find(client);
+            size_t flow   = it != flow_of.end() ? it->second : flows_.size();
+            if (it == flow_of.end()) {
+                flow_of[client] = flow;
+                flows_.push_back({message.src_ip, message.src_port});
+                last_step.push_back(0);
+                replies.push_back(0);
+            }
+            last_step[flow] = steps_.size();
+            steps_.push_back({&message, flow, replies[flow]});
+        } else if (message.src_ip == server_ip_ && message.src_port == server_port_) {
+            auto it = flow_of.find(std::make_pair(message.dst_ip, message.dst_port));
+            if (it == flow_of.end()) {
+                continue; // to a client that has not sent anything yet
+            }
+            replies[it->second] += proto_ == IPPROTO_UDP ? 1 : message.payload.size();
+            steps_[last_step[it->second]].replies = replies[it->second];
+        }
+    }
+
+    printf("[INFO] [Replay] %zu %s messages from %zu clients of %s, sent to %s:%d\n", steps_.size(),
+           proto_ == IPPROTO_UDP ? "UDP" : "TCP", flows_.size(), address(server_ip_, server_port_).c_str(),
+           options_.target_ip.c_str(), target_port_);
+    return true;
+}
+
+bool Replayer::connectFlow(Flow& flow)
+{
+    flow.sock = socket(AF_INET, proto_ == IPPROTO_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (flow.sock < 0) {
+        perror("[ERROR] [Replay] socket");
+        return false;
+    }
+    if (proto_ == IPPROTO_TCP) {
+        int one = 1;
+        setsockopt(flow.sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // one segment per captured message
+    }
+
+    sockaddr_in target{};
+    target.sin_family = AF_INET;
+    target.sin_port   = htons(target_port_);
+    if (inet_pton(AF_INET, options_.target_ip.c_str(), &target.sin_addr) != 1) {
+        fprintf(stderr, "[ERROR] [Replay] Bad target address %s\n", options_.target_ip.c_str());
+        return false;
+    }
+    if (connect(flow.sock, (sockaddr*) &target, sizeof(target)) < 0) {
+        perror("[ERROR] [Replay] connect");
+        return false;
+    }
+    return true;
+}
+
+// Reads everything waiting on the flow's socket
+size_t Replayer::receive(Flow& flow)
+{
+    uint8_t buffer[65536];
+    size_t  received = 0;
+    while (true) {
+        ssize_t len = recv(flow.sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (len > 0) {
+            received += proto_ == IPPROTO_UDP ? 1 : (size_t) len;
+            continue;
+        }
+        if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            // The target closed the connection, or (UDP) nothing listens on its port anymore
+            target_gone_ = len < 0 && errno == ECONNREFUSED;
+            if (len < 0 && !target_gone_) {
+                perror("[WARN] [Replay] recv");
+            }
+            close(flow.sock);
+            flow.sock   = -1;
+            flow.closed = true;
+        }
+        break;
+    }
+    flow.received += received;
+    return received;
+}
+
+// Reads the replies on all flows, waiting up to `timeout_ns` for the first
+void Replayer::drain(uint64_t timeout_ns)
+{
+    std::vector<struct pollfd> fds;
+    std::vector<Flow*>         owners;
+    for (Flow& flow : flows_) {
+        if (flow.sock >= 0) {
+            fds.push_back({flow.sock, POLLIN, 0});
+            owners.push_back(&flow);
+        }
+    }
+    struct timespec timeout = {(time_t) (timeout_ns / 1000000000ull), (long) (timeout_ns % 1000000000ull)};
+    if (ppoll(fds.data(), fds.size(), &timeout, nullptr) <= 0) {
+        return;
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].revents) {
+            receive(*owners[i]);
+        }
+    }
+}
+
+void Replayer::awaitReplies(const Step& step)
+{
+    const Flow& flow     = flows_[step.flow];
+    uint64_t    deadline = now_ns() + (uint64_t) options_.reply_timeout_ms * 1000000ull;
+    while (flow.received < step.replies && flow.sock >= 0 && !target_gone_) {
+        uint64_t now = now_ns();
+        if (now >= deadline) {
+            break;
+        }
+        drain(deadline - now);
+    }
+}
+
+size_t Replayer::run(const std::function<bool()>& target_alive)
+{
+    uint64_t first_ts = steps_.front().message->ts_ns;
+    uint64_t start_ns = now_ns();
+    size_t   sent     = 0;
+
+    for (const Step& step : steps_) {
+        if (target_gone_ || !target_alive()) {
+            break;
+        }
+        if (options_.timing == REPLAY_ORIGINAL) {
+            uint64_t due = start_ns + (step.message->ts_ns > first_ts ? step.message->ts_ns - first_ts : 0);
+            for (uint64_t now = now_ns(); now < due; now = now_ns()) {
+                drain(due - now);
+            }
+        }
+
+        Flow& flow = flows_[step.flow];
+        if (flow.sock < 0 && (flow.closed || !connectFlow(flow))) {
+            fprintf(stderr, "[WARN] [Replay] Client %s has no connection to the target anymore\n",
+                    address(flow.ip, flow.port).c_str());
+            break;
+        }
+        const std::vector<uint8_t>& payload = step.message->payload;
+        if (send(flow.sock, payload.data(), payload.size(), MSG_NOSIGNAL) < 0) {
+            perror("[WARN] [Replay] send");
+            break;
+        }
+        ++sent;
+
+        if (options_.timing == REPLAY_LOCKSTEP) {
+            awaitReplies(step);
+        } else {
+            drain(0);
+        }
+    }
+    return sent;
+}
@@ -0,0 +1,294 @@
+// cez_replay: sends the client side of a pcap/pcapng capture straight to a target it launches on loopback,
+// without the proxy, and reports how the target ended (CrashAnalyzer) - a crash reproducer for CI.
+// Usage: cez_replay [options] CAPTURE -- TARGET [ARGS...]
+#include "CaptureReader.hpp"
+#include "CrashAnalyzer.hpp"
+#include "ProcessSupervisor.hpp"
+#include "Replayer.hpp"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG_DIR "/tmp/logs"
+
+extern char** environ;
+
+struct Options {
+    ReplayOptions            replay;
+    std::string              interface;
+    std::string              capture;
+    std::string              log;
+    std::vector<std::string> target; // program and arguments
+    int                      startup_timeout_ms = 5000;
+    int                      linger_ms          = 1000; // after the last message, for a late crash
+    int                      hang_timeout_ms    = 0;
+};
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] CAPTURE -- TARGET [ARGS...]\n"
+            "  --mode lockstep|original|fast  wait for the captured replies (default), keep the captured gaps,\n"
+            "                                 or send back to back\n"
+            "  --target-ip IP                 where TARGET listens (default 127.0.0.1)\n"
+            "  --target-port PORT             where TARGET listens (default: the captured server port)\n"
+            "  --server-port PORT             captured server port (default: where the first message went)\n"
+            "  --interface NAME|all           pcapng interface (default: \"mutated\" if there is one, else all)\n"
+            "  --reply-timeout-ms MS          lockstep: longest wait for the replies to a message (default 1000)\n"
+            "  --startup-timeout-ms MS        longest wait for TARGET to listen (default 5000)\n"
+            "  --linger-ms MS                 wait after the last message for a late crash (default 1000)\n"
+            "  --hang-timeout-ms MS           report TARGET as hung after spinning this long (default off)\n"
+            "  --log FILE                     TARGET's stdout and stderr (default " LOG_DIR "/replay_TARGET.log)\n"
+            "Exit status: 0 target survived, 1 target crashed, 2 replay error\n",
+            argv0);
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    int i = 1;
+    for (; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+        std::string arg   = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg.rfind("--", 0) != 0) {
+            if (!options.capture.empty()) {
+                return false;
+            }
+            options.capture = arg;
+            continue;
+        }
+        if (value == nullptr) {
+            return false;
+        }
+        ++i;
+        if (arg == "--mode") {
+            if (strcmp(value, "lockstep") == 0) {
+                options.replay.timing = REPLAY_LOCKSTEP;
+            } else if (strcmp(value, "original") == 0) {
+                options.replay.timing = REPLAY_ORIGINAL;
+            } else if (strcmp(value, "fast") == 0) {
+                options.replay.timing = REPLAY_FAST;
+            } else {
+                return false;
+            }
+        } else if (arg == "--target-ip") {
+            options.replay.target_ip = value;
+        } else if (arg == "--target-port") {
+            options.replay.target_port = atoi(value);
+        } else if (arg == "--server-port") {
+            options.replay.server_port = atoi(value);
+        } else if (arg == "--interface") {
+            options.interface = value;
+        } else if (arg == "--reply-timeout-ms") {
+            options.replay.reply_timeout_ms = atoi(value);
+        } else if (arg == "--startup-timeout-ms") {
+            options.startup_timeout_ms = atoi(value);
+        } else if (arg == "--linger-ms") {
+            options.linger_ms = atoi(value);
+        } else if (arg == "--hang-timeout-ms") {
+            options.hang_timeout_ms = atoi(value);
+        } else if (arg == "--log") {
+            options.log = value;
+        } else {
+            return false;
+        }
+    }
+    for (++i; i < argc; ++i) {
+        options.target.push_back(argv[i]);
+    }
+    return !options.capture.empty() && !options.target.empty();
+}
+
+// -1 when `name` is not an interface of the capture; "all" selects every interface
+static bool selectInterface(const Capture& capture, const std::string& name, int& interface)
+{
+    interface = -1;
+    if (name == "all") {
+        return true;
+    }
+    for (size_t i = 0; i < capture.interfaces.size(); ++i) {
+        if (capture.interfaces[i] == (name.empty() ? "mutated" : name)) {
+            interface = (int) i;
+            return true;
+        }
+    }
+    if (name.empty()) {
+        return true; // not a proxy capture: everything in it
+    }
+    fprintf(stderr, "[ERROR] [Replay] The capture has no interface named %s\n", name.c_str());
+    return false;
+}
+
+// Whether something listens on the local `port`, from /proc/net (any address, IPv4 or IPv6)
+static bool listening(uint8_t proto, int port)
+{
+    const char* tables[2][2] = {{"/proc/net/udp", "/proc/net/udp6"}, {"/proc/net/tcp", "/proc/net/tcp6"}};
+    char        local_port[8];
+    snprintf(local_port, sizeof(local_port), ":%04X", port);
+
+    for (const char* table : tables[proto == IPPROTO_TCP]) {
+        std::ifstream file(table);
+        std::string   line;
+        std::getline(file, line); // header
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string        slot, local, remote, state;
+            fields >> slot >> local >> remote >> state;
+            bool port_matches = local.size() > 5 && local.compare(local.size() - 5, 5, local_port) == 0;
+            if (port_matches && (proto == IPPROTO_UDP || state == "0A")) { // 0A: TCP_LISTEN
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static pid_t launchTarget(const Options& options, utils::ChildOutput& output)
+{
+    output.log_fd = open(options.log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output.log_fd < 0) {
+        perror("[ERROR] open(log file)");
+        return -1;
+    }
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+        perror("[ERROR] pipe2(stderr)");
+        close(output.log_fd);
+        output.log_fd = -1;
+        return -1;
+    }
+    fcntl(err_pipe[0], F_SETFL, fcntl(err_pipe[0], F_GETFL) | O_NONBLOCK);
+    output.stderr_fd = err_pipe[0];
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_adddup2(&actions, output.log_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+
+    // SIGPIPE is ignored here; the target must start clean.
+    sigset_t mask, defaults;
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    std::vector<char*> argv;
+    for (const std::string& arg : options.target) {
+        argv.push_back((char*) arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    int   ret = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(err_pipe[1]);
+
+    if (ret != 0) {
+        fprintf(stderr, "[ERROR] posix_spawnp(%s): %s\n", argv[0], strerror(ret));
+        close(output.stderr_fd);
+        close(output.log_fd);
+        output.stderr_fd = -1;
+        output.log_fd    = -1;
+        return -1;
+    }
+    printf("[INFO] [Replay] Launched %s (PID %d), output in %s\n", argv[0], pid, options.log.c_str());
+    return pid;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Capture capture;
+    if (!readCapture(options.capture, capture) ||
+        !selectInterface(capture, options.interface, options.replay.interface)) {
+        return 2;
+    }
+    Replayer replayer(capture, options.replay);
+    if (!replayer.prepare()) {
+        return 2;
+    }
+
+    if (options.log.empty()) {
+        std::string target = options.target[0];
+        mkdir(LOG_DIR, 0755);
+        options.log = LOG_DIR "/replay_" + target.substr(target.find_last_of('/') + 1) + ".log";
+    }
+
+    std::mutex               report_mutex;
+    utils::CrashReport       report;
+    std::atomic<bool>        exited{false};
+    utils::ProcessSupervisor supervisor;
+
+    bool started = supervisor.start([&](pid_t, const std::string&, const utils::CrashReport& crash) {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report = crash;
+        exited = true;
+    });
+    if (!started) {
+        printf("[ERROR] utils::ProcessSupervisor::start()\n");
+        return 2;
+    }
+
+    utils::ChildOutput output;
+    pid_t              pid = launchTarget(options, output);
+    // A target watch() fails on is killed and reaped there, so no stray instance holds the port
+    if (pid < 0 || !supervisor.watch(pid, options.target[0], &output, options.hang_timeout_ms)) {
+        return 2;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.startup_timeout_ms);
+    while (!listening(replayer.proto(), replayer.targetPort())) {
+        if (exited || std::chrono::steady_clock::now() > deadline) {
+            fprintf(stderr, "[ERROR] [Replay] %s is not listening on %s port %d\n", options.target[0].c_str(),
+                    replayer.proto() == IPPROTO_UDP ? "UDP" : "TCP", replayer.targetPort());
+            supervisor.stop(pid);
+            return 2;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    auto   start = std::chrono::steady_clock::now();
+    size_t sent  = replayer.run([&]() { return !exited; });
+    double took  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("[INFO] [Replay] Sent %zu/%zu messages in %.3f s\n", sent, replayer.messages(), took);
+
+    // A crash on the last message may take a moment to show up
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.linger_ms);
+    while (!exited && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (!exited) {
+        supervisor.stop(pid);
+        printf("[RESULT] OK\n");
+        return sent > 0 ? 0 : 2;
+    }
+    std::lock_guard<std::mutex> lock(report_mutex);
+    printf("[RESULT] %s, %zu/%zu messages sent\n", report.format().c_str(), sent, replayer.messages());
+    return report.crash_class == utils::CRASH_CLASS_EXIT ? 0 : 1;
+}
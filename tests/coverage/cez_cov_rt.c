@@ -0,0 +1,55 @@
+/*
+ * Edge coverage runtime for targets built with -DCEZ_COVERAGE=ON.
+ *
+ * The compiler calls __sanitizer_cov_trace_pc() at the start of every basic
+ * block (-fsanitize-coverage=trace-pc, supported by both gcc and clang). Each
+ * call bumps one byte of a 64KB edge map indexed by (previous block, current
+ * block), the same scheme AFL uses. The map is a file mapped MAP_SHARED at the
+ * path given in CEZ_COVERAGE_MAP, which the launcher sets from the entity's
+ * `coverage_map` and the proxy maps from the same config entry.
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Must match COVERAGE_MAP_SIZE in proxy/inc/Coverage.hpp */
+#define CEZ_COV_MAP_SIZE (1 << 16)
+
+/* Linker-provided start of the executable; PCs are made relative to it so
+ * that edge IDs do not change between runs of a PIE target. */
+extern char __executable_start;
+
+static uint8_t           cez_cov_dummy[CEZ_COV_MAP_SIZE];
+static uint8_t*          cez_cov_map = cez_cov_dummy;
+static __thread uint32_t cez_cov_prev;
+
+__attribute__((constructor)) static void cez_cov_init(void)
+{
+    const char* path = getenv("CEZ_COVERAGE_MAP");
+    if (path == NULL || *path == '\0') {
+        return;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return;
+    }
+    if (ftruncate(fd, CEZ_COV_MAP_SIZE) == 0) {
+        void* map = mmap(NULL, CEZ_COV_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            cez_cov_map = (uint8_t*) map;
+        }
+    }
+    close(fd);
+}
+
+void __sanitizer_cov_trace_pc(void)
+{
+    uintptr_t pc  = (uintptr_t) __builtin_return_address(0) - (uintptr_t) &__executable_start;
+    uint32_t  cur = (uint32_t) ((pc ^ (pc >> 15)) * 0x9E3779B1u) >> 16;
+
+    cez_cov_map[(cur ^ cez_cov_prev) & (CEZ_COV_MAP_SIZE - 1)]++;
+    cez_cov_prev = cur >> 1;
+}